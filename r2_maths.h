@@ -22,6 +22,25 @@
 
     You can then include without the define to just use the types
 
+SIMD
+    The hot paths have SSE and AVX/FMA versions that are picked at compile
+    time from the target flags (see SIMD_FLAGS in the Makefile):
+
+        -msse3              SSE kernels (the default on x86_64)
+        -mavx2 -mfma        AVX + FMA kernels
+
+    Define R2_NO_SIMD before including to force the plain C versions.
+
+    The vecn_* and mat_mul kernels are also built for AVX2 and AVX-512F (with
+    gcc / clang on x86) whatever the flags, and the best one the CPU has is
+    picked at run time on first use. Set R2_SIMD=scalar|sse|avx2|avx512 in
+    the environment, or call r2_simd_set, to force a lower level (e.g. for
+    benchmarking). Under HAVE_BLAS the functions backed by BLAS stay on BLAS.
+
+    The AVX2 level also needs F16C, which it uses for the f16 conversions
+    (vecn_to_f16 and friends). f16 / bf16 data is only storage: every
+    kernel widens it to float and accumulates in float.
+
 LICENSE
     See end of file for license information.
 
@@ -30,6 +49,28 @@ LICENSE
 #ifndef R2_MATHS_H
 #define R2_MATHS_H
 
+#if !defined(R2_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+  #define R2_SSE
+  #if defined(__AVX__)
+    #define R2_AVX
+  #endif
+  #if defined(__FMA__)
+    #define R2_FMA
+  #endif
+  #include <immintrin.h>
+  #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // kernels for newer CPUs are compiled with target attributes and picked
+    // at run time, see r2_simd_set
+    #define R2_DISPATCH
+    #define R2_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+    #define R2_TARGET_AVX512 __attribute__((target("avx512f")))
+  #endif
+#endif
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -37,17 +78,26 @@ extern "C"
 
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef HAVE_BLAS
   #ifdef __APPLE__
     #include <Accelerate/Accelerate.h>
   #else
     #include <cblas.h>
+  // LAPACK's LU (OpenBLAS exports it too), it has no C header of its own
+  void sgetrf_(const int *m, const int *n, float *a, const int *lda, int *ipiv, int *info);
   #endif
 #endif
 
+#if !defined(R2_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+  // r2_tensor_open maps files, without this it reads them into memory
+  #define R2_MMAP
+#endif
+
 #ifndef EPSILON
 #define EPSILON 0.000000954
 #endif
@@ -56,6 +106,233 @@ extern "C"
 #define M_PI 3.141592653589
 #endif
 
+/*
+ * R2_ALIGN(n) aligns a variable or member to n bytes. Define
+ * R2_ALIGNED_TYPES before including to give vec4 (and vec3, quat, color)
+ * 16 byte alignment and mat4 64 byte alignment, so arrays of them never
+ * split a cache line and the batch kernels always get aligned data. It
+ * changes the layout of anything that embeds them, so use it for the
+ * whole program or not at all.
+ */
+#if defined(__cplusplus)
+  #define R2_ALIGN(n) alignas(n)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+  #define R2_ALIGN(n) _Alignas(n)
+#elif defined(_MSC_VER)
+  #define R2_ALIGN(n) __declspec(align(n))
+#else
+  #define R2_ALIGN(n) __attribute__((aligned(n)))
+#endif
+#ifdef R2_ALIGNED_TYPES
+  #define R2__ALIGN_VEC4 R2_ALIGN(16)
+  #define R2__ALIGN_MAT4 R2_ALIGN(64)
+#else
+  #define R2__ALIGN_VEC4
+  #define R2__ALIGN_MAT4
+#endif
+
+#ifndef R2_SIMD_MIN_N
+  // Shorter vecn_* calls (vec2/3/4 and friends) skip dispatch and stay scalar
+  #define R2_SIMD_MIN_N 16
+#endif
+
+/*
+ * Blocking for the packed mat_mul (see r2__gemm). A kc x nr panel of m2
+ * should sit in L1, an mc x kc block of m1 in L2 and a kc x nc block of m2
+ * in L3. mc and nc are rounded down to the micro-kernel tile.
+ */
+#ifndef R2_GEMM_KC
+  #define R2_GEMM_KC 256
+#endif
+#ifndef R2_GEMM_MC
+  #define R2_GEMM_MC 128
+#endif
+#ifndef R2_GEMM_NC
+  #define R2_GEMM_NC 2048
+#endif
+#ifndef R2_GEMM_MIN_FLOPS
+  // r1 * c1 * c2 below this is not worth packing for
+  #define R2_GEMM_MIN_FLOPS (64 * 64 * 64)
+#endif
+
+#ifndef R2_LU_BLOCK
+  // mat_lu factors panels of this many columns and hands the rest of the
+  // work (the trailing update) to mat_mul
+  #define R2_LU_BLOCK 64
+#endif
+
+#ifndef R2_I8_BLOCK
+  // mat_mul_i8 walks m2 in blocks of about this many bytes (aim for L2)
+  #define R2_I8_BLOCK (128 * 1024)
+#endif
+
+#ifndef R2_TRANSPOSE_TILE
+  // mat_transpose works through tiles of this many rows and columns so
+  // both the reads and the strided writes stay in cache (keep it a multiple of 8)
+  #define R2_TRANSPOSE_TILE 64
+#endif
+
+#ifndef R2_OMP_MIN_FLOPS
+  // mat_mul only starts OpenMP threads when r1 * c1 * c2 is at least this,
+  // so 3x3 and 4x4 (and other small) products stay serial. Threads are only
+  // used by the packed GEMM, products under R2_GEMM_MIN_FLOPS are always serial
+  #define R2_OMP_MIN_FLOPS (128 * 128 * 128)
+#endif
+
+#ifndef R2_OMP_MIN_BATCH
+  // Batched kernels only split work across OpenMP threads from this many items
+  #define R2_OMP_MIN_BATCH 16384
+#endif
+
+#ifndef R2_STREAM_MIN
+  // Batched kernels write aligned outputs of at least this many bytes with
+  // non-temporal stores, so a result bigger than the cache does not push
+  // the input out of it
+  #define R2_STREAM_MIN (8 * 1024 * 1024)
+#endif
+
+#ifndef R2_KNN_BLOCK
+  // vecn_knn_batch scores this many data rows per mat_mul, and
+  #define R2_KNN_BLOCK 1024
+#endif
+#ifndef R2_KNN_QUERY_BLOCK
+  // this many queries, so the score block stays in L2
+  #define R2_KNN_QUERY_BLOCK 128
+#endif
+#ifndef R2_KNN_GEMM_MIN
+  // fewer queries than this are scored one at a time instead of with mat_mul
+  #define R2_KNN_GEMM_MIN 4
+#endif
+
+// Payloads in tensor files start on multiples of this many bytes (part of the format)
+#define R2_TENSOR_ALIGN 64
+#define R2_TENSOR_MAX_DIMS 4
+#define R2_TENSOR_NAME_MAX 64
+
+#ifndef R2_BVH_BINS
+  // bvh_build buckets primitive centroids into this many bins per axis
+  #define R2_BVH_BINS 16
+#endif
+#ifndef R2_BVH_LEAF_MAX
+  // bvh leaves hold at most this many primitives (unless they all share a centroid)
+  #define R2_BVH_LEAF_MAX 4
+#endif
+#ifndef R2_BVH_TASK_MIN
+  // bvh_build hands subtrees of at least this many primitives to OpenMP tasks
+  #define R2_BVH_TASK_MIN 4096
+#endif
+
+#ifdef R2_SSE
+  // a * b + c, fused when the target has FMA
+  #ifdef R2_FMA
+    #define R2_MADD_PS(a, b, c) _mm_fmadd_ps((a), (b), (c))
+  #else
+    #define R2_MADD_PS(a, b, c) _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+  #endif
+#endif
+
+/*
+ * r2_vf is the widest float register the target has, so stream kernels can
+ * be written once: R2_VF_N lanes per op (8 with AVX, 4 with SSE). Left
+ * undefined without SIMD, in which case only the scalar loops are built.
+ */
+#if defined(R2_AVX)
+  typedef __m256 r2_vf;
+  #define R2_VF_N 8
+  #define R2_VF_LOAD(p) _mm256_loadu_ps(p)
+  #define R2_VF_STORE(p, a) _mm256_storeu_ps((p), (a))
+  // p aligned to sizeof(r2_vf); STREAM is a non-temporal store (follow with _mm_sfence)
+  #define R2_VF_LOADA(p) _mm256_load_ps(p)
+  #define R2_VF_STOREA(p, a) _mm256_store_ps((p), (a))
+  #define R2_VF_STREAM(p, a) _mm256_stream_ps((p), (a))
+  #define R2_VF_SET1(f) _mm256_set1_ps(f)
+  #define R2_VF_ADD(a, b) _mm256_add_ps((a), (b))
+  #define R2_VF_SUB(a, b) _mm256_sub_ps((a), (b))
+  #define R2_VF_MUL(a, b) _mm256_mul_ps((a), (b))
+  #define R2_VF_DIV(a, b) _mm256_div_ps((a), (b))
+  #define R2_VF_MIN(a, b) _mm256_min_ps((a), (b))
+  #define R2_VF_MAX(a, b) _mm256_max_ps((a), (b))
+  #define R2_VF_SQRT(a) _mm256_sqrt_ps(a)
+  #define R2_VF_AND(a, b) _mm256_and_ps((a), (b))
+  #define R2_VF_XOR(a, b) _mm256_xor_ps((a), (b))
+  #define R2_VF_GE(a, b) _mm256_cmp_ps((a), (b), _CMP_GE_OQ)
+  #define R2_VF_SELECT(m, a, b) _mm256_blendv_ps((b), (a), (m))
+  #define R2_VF_MOVEMASK(a) _mm256_movemask_ps(a)
+  #define R2_VF_OR(a, b) _mm256_or_ps((a), (b))
+  #define R2_VF_LT(a, b) _mm256_cmp_ps((a), (b), _CMP_LT_OQ)
+  #define R2_VF_EQ(a, b) _mm256_cmp_ps((a), (b), _CMP_EQ_OQ)
+  #ifdef __AVX2__
+    // matching 32 bit integer lanes, for bit tricks on floats (AVX2 only)
+    typedef __m256i r2_vi;
+    #define R2_VI_SET1(i) _mm256_set1_epi32(i)
+    #define R2_VI_ADD(a, b) _mm256_add_epi32((a), (b))
+    #define R2_VI_SUB(a, b) _mm256_sub_epi32((a), (b))
+    #define R2_VI_AND(a, b) _mm256_and_si256((a), (b))
+    #define R2_VI_EQ(a, b) _mm256_cmpeq_epi32((a), (b))
+    #define R2_VI_SLLI(a, n) _mm256_slli_epi32((a), (n))
+    #define R2_VI_SRLI(a, n) _mm256_srli_epi32((a), (n))
+    #define R2_VI_SRAI(a, n) _mm256_srai_epi32((a), (n))
+    #define R2_VF_TO_VI(a) _mm256_cvtps_epi32(a)
+    #define R2_VF_TRUNC_VI(a) _mm256_cvttps_epi32(a)
+    #define R2_VI_TO_VF(a) _mm256_cvtepi32_ps(a)
+    #define R2_VF_AS_VI(a) _mm256_castps_si256(a)
+    #define R2_VI_AS_VF(a) _mm256_castsi256_ps(a)
+  #endif
+  #ifdef R2_FMA
+    #define R2_VF_MADD(a, b, c) _mm256_fmadd_ps((a), (b), (c))
+  #else
+    #define R2_VF_MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps((a), (b)), (c))
+  #endif
+#elif defined(R2_SSE)
+  typedef __m128 r2_vf;
+  #define R2_VF_N 4
+  #define R2_VF_LOAD(p) _mm_loadu_ps(p)
+  #define R2_VF_STORE(p, a) _mm_storeu_ps((p), (a))
+  #define R2_VF_LOADA(p) _mm_load_ps(p)
+  #define R2_VF_STOREA(p, a) _mm_store_ps((p), (a))
+  #define R2_VF_STREAM(p, a) _mm_stream_ps((p), (a))
+  #define R2_VF_SET1(f) _mm_set1_ps(f)
+  #define R2_VF_ADD(a, b) _mm_add_ps((a), (b))
+  #define R2_VF_SUB(a, b) _mm_sub_ps((a), (b))
+  #define R2_VF_MUL(a, b) _mm_mul_ps((a), (b))
+  #define R2_VF_DIV(a, b) _mm_div_ps((a), (b))
+  #define R2_VF_MIN(a, b) _mm_min_ps((a), (b))
+  #define R2_VF_MAX(a, b) _mm_max_ps((a), (b))
+  #define R2_VF_SQRT(a) _mm_sqrt_ps(a)
+  #define R2_VF_AND(a, b) _mm_and_ps((a), (b))
+  #define R2_VF_XOR(a, b) _mm_xor_ps((a), (b))
+  #define R2_VF_GE(a, b) _mm_cmpge_ps((a), (b))
+  #define R2_VF_SELECT(m, a, b) _mm_or_ps(_mm_and_ps((m), (a)), _mm_andnot_ps((m), (b)))
+  #define R2_VF_MOVEMASK(a) _mm_movemask_ps(a)
+  #define R2_VF_OR(a, b) _mm_or_ps((a), (b))
+  #define R2_VF_LT(a, b) _mm_cmplt_ps((a), (b))
+  #define R2_VF_EQ(a, b) _mm_cmpeq_ps((a), (b))
+  #define R2_VF_MADD(a, b, c) R2_MADD_PS((a), (b), (c))
+  typedef __m128i r2_vi;
+  #define R2_VI_SET1(i) _mm_set1_epi32(i)
+  #define R2_VI_ADD(a, b) _mm_add_epi32((a), (b))
+  #define R2_VI_SUB(a, b) _mm_sub_epi32((a), (b))
+  #define R2_VI_AND(a, b) _mm_and_si128((a), (b))
+  #define R2_VI_EQ(a, b) _mm_cmpeq_epi32((a), (b))
+  #define R2_VI_SLLI(a, n) _mm_slli_epi32((a), (n))
+  #define R2_VI_SRLI(a, n) _mm_srli_epi32((a), (n))
+  #define R2_VI_SRAI(a, n) _mm_srai_epi32((a), (n))
+  #define R2_VF_TO_VI(a) _mm_cvtps_epi32(a)
+  #define R2_VF_TRUNC_VI(a) _mm_cvttps_epi32(a)
+  #define R2_VI_TO_VF(a) _mm_cvtepi32_ps(a)
+  #define R2_VF_AS_VI(a) _mm_castps_si128(a)
+  #define R2_VI_AS_VF(a) _mm_castsi128_ps(a)
+#endif
+
+    /**
+     * IEEE 754 half precision (f16) and bfloat16 (bf16) values, kept as
+     * their raw bits. Use them to store big tables at half the size and
+     * convert with vecn_to_f16 / vecn_from_f16 (and the bf16 versions)
+     * or read them directly with vecn_dot_f16, mat_mul_f16 and friends.
+     */
+    typedef uint16_t f16;
+    typedef uint16_t bf16;
+
     /**
      * A 2d vector backed by an array. This type
      * is only used by vec2. You can
@@ -78,7 +355,7 @@ extern "C"
      * the struct values ->x ->y ->z ->w
      */
     typedef union u_vec4 {
-        float a_vec[4];
+        R2__ALIGN_VEC4 float a_vec[4];
         struct
         {
             float x; // 4
@@ -119,7 +396,7 @@ extern "C"
      * m4->a_mat4 for the array with values in order
      */
     typedef union u_mat4 {
-        float a_mat4[16];
+        R2__ALIGN_MAT4 float a_mat4[16];
         struct
         {
             // clang-format off
@@ -130,6 +407,247 @@ extern "C"
             // clang-format on
         };
     } mat4;
+#undef R2__ALIGN_VEC4
+#undef R2__ALIGN_MAT4
+
+    /**
+     * A vec4 held by value, in an SSE register when there is one, for
+     * chains of vector maths that should stay out of memory. Convert with
+     * r2v4_load / r2v4_store or r2v4_from_vec4 / r2v4_to_vec4, which are a
+     * single unaligned load or store (or nothing at all once inlined).
+     * Without SSE it is just a vec4.
+     */
+#ifdef R2_SSE
+    typedef __m128 r2v4;
+#else
+    typedef vec4 r2v4;
+#endif
+
+    /**
+     * A mat4 by value, as its four columns: c[j] holds a_mat4[4j .. 4j + 3],
+     * so it loads straight from (and stores straight to) a mat4.
+     */
+    typedef struct s_r2m4
+    {
+        r2v4 c[4];
+    } r2m4;
+
+    /**
+     * A stream of 4d points stored as a structure of arrays: x[i], y[i],
+     * z[i] and w[i] make up point i. The arrays are owned by the caller.
+     */
+    typedef struct s_vec4_soa
+    {
+        float *x;
+        float *y;
+        float *z;
+        float *w;
+        size_t n;
+    } vec4_soa;
+
+    /**
+     * A stream of 3d points / directions stored as a structure of arrays.
+     * Unlike an array of vec3 there is no padding lane, and the SoA kernels
+     * below work on R2_VF_N elements per instruction.
+     */
+    typedef struct s_vec3_soa
+    {
+        float *x;
+        float *y;
+        float *z;
+        size_t n;
+    } vec3_soa;
+
+    /**
+     * The six planes of a view frustum: left, right, bottom, top, near, far.
+     * Each is (x, y, z) = unit normal pointing into the frustum and w = d,
+     * so a point p is inside a plane when dot(n, p) + d >= 0.
+     */
+    typedef struct s_frustum
+    {
+        vec4 planes[6];
+    } frustum;
+
+    /**
+     * A node of a flattened bvh, 32 bytes so two share a cache line. Leaves
+     * have count > 0 and own indices[first .. first + count), inner nodes
+     * have count == 0 and their children at first and first + 1. first is
+     * always even for an inner node, so siblings share one line.
+     */
+    typedef struct s_bvh_node
+    {
+        float min[3];
+        uint32_t first;
+        float max[3];
+        uint32_t count;
+    } bvh_node;
+
+    /**
+     * Bounding volume hierarchy over boxes or triangles, node 0 is the root
+     * and node 1 is padding (nodes is 64-byte aligned and children start at
+     * 2, so each sibling pair fills one cache line).
+     * A triangle bvh keeps pointers to the caller's verts and tris, which
+     * have to outlive it. Release with bvh_free.
+     */
+    typedef struct s_bvh
+    {
+        bvh_node *nodes;
+        size_t node_count;
+        uint32_t *indices; // primitive ids in leaf order
+        vec3 *prim_min;    // bounds of each primitive
+        vec3 *prim_max;
+        size_t count; // number of primitives
+        const vec3 *verts;
+        const uint32_t *tris;
+    } bvh;
+
+    /** A bvh query result: primitive id, ray t (or distance) and the point */
+    typedef struct s_bvh_hit
+    {
+        uint32_t prim;
+        float t;
+        vec3 point;
+    } bvh_hit;
+
+    /**
+     * Uniform grid spatial hash. Points are quantized to cells of cell_size
+     * and each cell hashed into one of table_size buckets. After a build,
+     * bucket b holds indices[start[b] .. start[b + 1]), so every bucket is
+     * a contiguous span rather than a linked list.
+     */
+    typedef struct s_spatial_hash
+    {
+        float cell_size;
+        uint32_t table_size; // a power of two
+        uint32_t *start;     // table_size + 1 offsets into indices
+        uint32_t *indices;   // point ids, grouped by bucket
+        uint32_t *keys;      // bucket of each point, scratch for the build
+        size_t count;
+        size_t capacity;
+    } spatial_hash;
+
+    /** A run of candidate ids: indices[first .. first + count) of a spatial_hash */
+    typedef struct s_spatial_hash_span
+    {
+        uint32_t first;
+        uint32_t count;
+    } spatial_hash_span;
+
+    /** Element types of a tensor file payload */
+    typedef enum e_r2_dtype
+    {
+        R2_DTYPE_F32 = 0,
+        R2_DTYPE_F16,
+        R2_DTYPE_BF16,
+        R2_DTYPE_I8 // symmetric, with one float scale per row (see mat_quantize_i8)
+    } r2_dtype;
+
+    /**
+     * The start of a tensor file. Files are written in the host's byte
+     * order, endian tells them apart and only matching files open.
+     */
+    typedef struct s_r2_tensor_header
+    {
+        char magic[8];    // "R2TENSOR"
+        uint32_t endian;  // 0x01020304
+        uint32_t version; // 1
+        uint32_t count;   // number of tensors
+        uint32_t reserved0;
+        uint64_t table; // file offset of count r2_tensor_entry
+        uint8_t reserved[32];
+    } r2_tensor_header;
+
+    /** One tensor in the table at the end of a tensor file */
+    typedef struct s_r2_tensor_entry
+    {
+        char name[R2_TENSOR_NAME_MAX]; // nul terminated
+        uint32_t dtype;                // r2_dtype
+        uint32_t ndim;                 // 1 .. R2_TENSOR_MAX_DIMS
+        uint64_t shape[R2_TENSOR_MAX_DIMS];
+        uint64_t offset; // payload (dense, row-major), a multiple of R2_TENSOR_ALIGN
+        uint64_t bytes;  // payload size
+        uint64_t scales; // I8: file offset of one float per row, otherwise 0
+    } r2_tensor_entry;
+
+    /**
+     * A view of one tensor of an open r2_tensor_file. data points into the
+     * file, aligned to R2_TENSOR_ALIGN, and is valid until r2_tensor_close.
+     * stride[i] is the step in elements along dimension i; rows are the
+     * last dimension, so a 2d tensor is a rows x shape[1] matrix ready for
+     * mat_mul (or mat_mul_f16 / mat_mul_i8 and friends).
+     */
+    typedef struct s_r2_tensor
+    {
+        const char *name;
+        r2_dtype dtype;
+        int ndim;
+        size_t shape[R2_TENSOR_MAX_DIMS];
+        size_t stride[R2_TENSOR_MAX_DIMS];
+        size_t count; // elements
+        size_t rows;  // count / shape[ndim - 1]
+        const void *data;
+        const float *scales; // I8 only, one per row
+    } r2_tensor;
+
+    /** An open tensor file, see r2_tensor_open */
+    typedef struct s_r2_tensor_file
+    {
+        r2_tensor *tensors;
+        uint32_t count;
+        void *base; // the mapping, or the copy of the file without mmap
+        size_t size;
+        bool mapped;
+    } r2_tensor_file;
+
+    /** A tensor file being written, see r2_tensor_write_begin */
+    typedef struct s_r2_tensor_writer
+    {
+        FILE *fp;
+        r2_tensor_entry *entries;
+        uint32_t count;
+        uint32_t capacity;
+        uint64_t offset; // file size so far
+        bool failed;
+    } r2_tensor_writer;
+
+    /** Instruction set levels for the runtime dispatched kernels */
+    typedef enum e_r2_simd_level
+    {
+        R2_SIMD_SCALAR = 0,
+        R2_SIMD_SSE,
+        R2_SIMD_AVX2,
+        R2_SIMD_AVX512
+    } r2_simd_level;
+
+    /**
+     * Accuracy of the vecn_exp / log / pow / sin / cos / tanh kernels.
+     * PRECISE is within a few ULP of the C library (pow within 1 ULP),
+     * FAST is about 1e-4 relative and skips some polynomial terms.
+     */
+    typedef enum e_r2_accuracy
+    {
+        R2_ACCURACY_PRECISE = 0,
+        R2_ACCURACY_FAST
+    } r2_accuracy;
+
+    /** How vecn_knn ranks rows: smallest squared distance or largest dot product */
+    typedef enum e_knn_metric
+    {
+        KNN_L2 = 0,
+        KNN_DOT
+    } knn_metric;
+
+    /** The level the vecn_* / mat_mul kernels are running at */
+    static r2_simd_level r2_simd_get(void);
+    /**
+     * Use the kernels for level, clamped to what the CPU (and the build)
+     * supports. Returns the level actually in use. Not thread safe, call it
+     * before starting any threads that use the library.
+     */
+    static r2_simd_level r2_simd_set(r2_simd_level level);
+    /** Pick the accuracy tier of the transcendental vecn_* kernels (PRECISE by default). Not thread safe either. */
+    static void r2_accuracy_set(r2_accuracy accuracy);
+    static r2_accuracy r2_accuracy_get(void);
 
     /**
      * Returns true if a and b are within EPSILON
@@ -137,6 +655,17 @@ extern "C"
      */
     static bool r2_equals(float a, float b);
     static float deg_to_rad(float d);
+    /**
+     * Allocate size bytes aligned to alignment (a power of two, e.g. 32 for
+     * AVX or 64 for a cache line). Returns NULL if out of memory or the
+     * alignment is not a power of two. Free with r2_aligned_free only.
+     *
+     * An array of vec4 or mat4 from here lets mat4_transform_batch and
+     * friends use aligned loads and stores.
+     */
+    static void *r2_aligned_alloc(size_t alignment, size_t size);
+    /** Free memory from r2_aligned_alloc, NULL is ignored */
+    static void r2_aligned_free(void *p);
     /**
      * Generic Matrix Multiply
      * Raw multiply of any-size matrix against any-size (as long as the rows of the
@@ -151,19 +680,101 @@ extern "C"
      */
     static void mat_mul(const float *m1, const float *m2, unsigned int r1, unsigned int c1, unsigned int r2,
                         unsigned int c2, float *out);
+    /**
+     * mat_mul for f16 / bf16 matrices, out is float. The inputs are widened
+     * to float as they are packed into the GEMM blocks, so only the packed
+     * blocks ever exist as floats. BLAS has no half precision sgemm, so
+     * this uses the packed GEMM even under HAVE_BLAS.
+     */
+    static void mat_mul_f16(const f16 *m1, const f16 *m2, unsigned int r1, unsigned int c1, unsigned int r2,
+                            unsigned int c2, float *out);
+    static void mat_mul_bf16(const bf16 *m1, const bf16 *m2, unsigned int r1, unsigned int c1, unsigned int r2,
+                             unsigned int c2, float *out);
+    /**
+     * Quantize each row of an r x c matrix on its own (see vecn_quantize_i8
+     * and vecn_quantize_u8). scales (and zeros) get one entry per row.
+     */
+    static void mat_quantize_i8(const float *m, unsigned int r, unsigned int c, int8_t *out, float *scales);
+    static void mat_quantize_u8(const float *m, unsigned int r, unsigned int c, uint8_t *out, float *scales,
+                                uint8_t *zeros);
+    /**
+     * int8 matrix multiply with int32 accumulation: out = m1 x m2, with
+     * m1 (r1 x c1) and m2 quantized per row by mat_quantize_i8. m2 is
+     * passed transposed, c2 x c1, so each row of it (one output column)
+     * has its own scale; weight matrices are usually stored this way.
+     * Each int32 dot product is scaled back to float by s1[i] * s2t[j].
+     */
+    static void mat_mul_i8(const int8_t *m1, const float *s1, const int8_t *m2t, const float *s2t, unsigned int r1,
+                           unsigned int c1, unsigned int c2, float *out);
 
     /**
      * Transpose a matrix of arbitrary size. m is row-major with r rows
      * and c columns. out must be a caller-allocated buffer of r*c floats
      * and will be written as a c×r row-major matrix.
      *
+     * Square matrices can be transposed in place by passing m as out
+     * (only square ones, out must not overlap m otherwise).
+     *
      * r,c = rows and columns of m
      */
     static void mat_transpose(const float *m, unsigned int r, unsigned int c, float *out);
 
-    /** Multiply two 4x4 matrices, result into out */
+    /**
+     * LU factorization with partial pivoting of the n×n row-major matrix m,
+     * in place: P m = L U, with U on and above the diagonal and the unit
+     * lower triangle of L below it. piv (n ints) gets the row swaps in the
+     * LAPACK order, but 0-based: row i was swapped with row piv[i], for i
+     * from 0 up. Panels of R2_LU_BLOCK columns are factored at a time and
+     * the rest of the matrix is updated with mat_mul. Under HAVE_BLAS this
+     * is LAPACK's sgetrf.
+     *
+     * Returns false if m is singular (a pivot was exactly zero); the
+     * factorization is still completed.
+     */
+    static bool mat_lu(float *m, unsigned int n, int *piv);
+    /**
+     * Solve A x = b using the factors from mat_lu. b is n×nrhs row-major
+     * (one right hand side per column) and is overwritten by x.
+     */
+    static void mat_lu_solve(const float *lu, const int *piv, unsigned int n, float *b, unsigned int nrhs);
+    /**
+     * Solve a x = b for x, a is n×n and b, x are n×nrhs, all row-major.
+     * a is left untouched and x may be b. Returns false and leaves x
+     * untouched if a is singular (or there was no memory for the factors).
+     */
+    static bool mat_solve(const float *a, const float *b, unsigned int n, unsigned int nrhs, float *x);
+    /**
+     * Inverse of the n×n matrix m into out, which may be m. Returns false
+     * and leaves out untouched if m is singular. Prefer mat_solve when the
+     * inverse is only going to be multiplied by something.
+     */
+    static bool mat_inverse(const float *m, unsigned int n, float *out);
+    /**
+     * Determinant of the n×n matrix m, through its LU factors (0 when m is
+     * singular). The product is kept in double so it does not overflow as
+     * early as n grows. There is no separate error: if there is no memory
+     * for the factors it prints to stderr and returns 0 as well.
+     */
+    static float mat_det(const float *m, unsigned int n);
+
+    /**
+     * Multiply two 4x4 matrices, result into out. This does not go through
+     * mat_mul (or BLAS), the whole of m2 is kept in registers and each row of
+     * the result is 4 broadcasts and multiply-adds. out may alias m1 or m2.
+     */
     static void mat4_mul(const mat4 *m1, const mat4 *m2, mat4 *out);
     static void mat4_transform(const vec4 *p, const mat4 *mat, vec4 *out);
+    /**
+     * mat4_transform over n contiguous points. The matrix columns stay in
+     * registers while the points are streamed through. in and out may be
+     * the same array. Large batches are split across OpenMP threads.
+     */
+    static void mat4_transform_batch(const mat4 *mat, const vec4 *in, vec4 *out, size_t n);
+    /**
+     * As mat4_transform_batch, for points stored as a vec4_soa. Transforms
+     * in->n points; out must have room for as many (and may be in).
+     */
+    static void mat4_transform_soa(const mat4 *mat, const vec4_soa *in, vec4_soa *out);
     /**
      * Fills an mat4 with an array. It expects an array of values
      * that are given in sets of 4s one *row* at a time.
@@ -178,6 +789,33 @@ extern "C"
      */
     static void mat4_lookat(const vec4 *pos, const vec4 *target, const vec4 *up, mat4 *out);
     static void mat4_transpose(const mat4 *m1, mat4 *m2);
+    /**
+     * General 4x4 inverse. Returns false and leaves out untouched if m is
+     * singular (determinant of zero). out may alias m.
+     */
+    static bool mat4_inverse(const mat4 *m, mat4 *out);
+    /**
+     * Inverse of an affine matrix (any rotation, scale and shear plus a
+     * translation): m30 = m31 = m32 = 0, m33 = 1 with the translation in
+     * m03, m13, m23. Only the 3x3 part is inverted, which is much cheaper
+     * than mat4_inverse. Returns false if the 3x3 part is singular.
+     */
+    static bool mat4_inverse_affine(const mat4 *m, mat4 *out);
+    /**
+     * mat4_inverse over n matrices (a bone palette, say). in and out may be
+     * the same array. Returns how many were singular; those are copied to out unchanged.
+     */
+    static size_t mat4_inverse_batch(const mat4 *in, mat4 *out, size_t n);
+    /**
+     * Linear blend skinning of n vertices with 4 influences each. Vertex i
+     * uses palette[bones[i*4 + k]] with weight weights[i*4 + k] for k 0..3
+     * (weights should sum to 1, unused slots weight 0 with any valid bone).
+     * pos is transformed as a point by the blended matrix, nrm as a
+     * direction (w = 0) and renormalized. nrm / out_nrm may be NULL to skip
+     * normals, and out_pos / out_nrm may be pos / nrm.
+     */
+    static void mat4_skin(const mat4 *palette, const uint16_t *bones, const float *weights, const vec4 *pos,
+                          const vec4 *nrm, vec4 *out_pos, vec4 *out_nrm, size_t n);
     static char *mat4_tos(const mat4 *m);
 
     /** Multiply two 3x3 matrices, result into out */
@@ -185,8 +823,120 @@ extern "C"
     static void mat3_identity(mat3 *m);
     static char *mat3_tos(const mat3 *m);
 
+    /**
+     * The value API. Everything takes and returns r2v4 / r2m4, so the
+     * compiler can keep a whole expression in registers. Each function
+     * gives the same result as the vec4 / mat4 function of the same name,
+     * up to rounding where FMA fuses a multiply and add that the vec4 / mat4
+     * function rounds separately (r2v4_lerp, r2m4_transform, r2m4_mul).
+     */
+    static r2v4 r2v4_set(float x, float y, float z, float w);
+    static r2v4 r2v4_splat(float f);
+    static r2v4 r2v4_zero(void);
+    static r2v4 r2v4_load(const vec4 *v);
+    static void r2v4_store(r2v4 v, vec4 *out);
+    static r2v4 r2v4_from_vec4(vec4 v);
+    static vec4 r2v4_to_vec4(r2v4 v);
+    static float r2v4_x(r2v4 v);
+    static float r2v4_y(r2v4 v);
+    static float r2v4_z(r2v4 v);
+    static float r2v4_w(r2v4 v);
+    static bool r2v4_equals(r2v4 v1, r2v4 v2);
+    static r2v4 r2v4_add(r2v4 v1, r2v4 v2);
+    static r2v4 r2v4_sub(r2v4 v1, r2v4 v2);
+    static r2v4 r2v4_mul(r2v4 v, float fac);
+    static r2v4 r2v4_div(r2v4 v, float fac);
+    static r2v4 r2v4_mul_vec(r2v4 v1, r2v4 v2);
+    static r2v4 r2v4_div_vec(r2v4 v1, r2v4 v2);
+    /** v1 * v2 + v3 per element, fused when the target has FMA */
+    static r2v4 r2v4_madd(r2v4 v1, r2v4 v2, r2v4 v3);
+    static r2v4 r2v4_neg(r2v4 v);
+    static r2v4 r2v4_abs(r2v4 v);
+    static r2v4 r2v4_sqrt(r2v4 v);
+    /** As minps / maxps, v2 where either is NaN (and for -0 against 0) */
+    static r2v4 r2v4_min(r2v4 v1, r2v4 v2);
+    static r2v4 r2v4_max(r2v4 v1, r2v4 v2);
+    /** v1 + (v2 - v1) * t */
+    static r2v4 r2v4_lerp(r2v4 v1, r2v4 v2, float t);
+    static float r2v4_dot(r2v4 v1, r2v4 v2);
+    /** Dot product of x, y and z, w is ignored */
+    static float r2v4_dot3(r2v4 v1, r2v4 v2);
+    /** Cross product of x, y and z (as vec3_cross), w of the result is 0 */
+    static r2v4 r2v4_cross3(r2v4 v1, r2v4 v2);
+    static float r2v4_length(r2v4 v);
+    /** As vec4_normalize, a vector shorter than EPSILON gives zero */
+    static r2v4 r2v4_normalize(r2v4 v);
+
+    static r2m4 r2m4_load(const mat4 *m);
+    static void r2m4_store(r2m4 m, mat4 *out);
+    /**
+     * As r2m4_load. It takes a pointer because a 64 byte aligned mat4
+     * (R2_ALIGNED_TYPES) passed by value changes ABI between compilers.
+     */
+    static r2m4 r2m4_from_mat4(const mat4 *m);
+    static mat4 r2m4_to_mat4(r2m4 m);
+    static r2m4 r2m4_identity(void);
+    static r2m4 r2m4_transpose(r2m4 m);
+    /** As mat4_transform(&p, &m, out) */
+    static r2v4 r2m4_transform(r2m4 m, r2v4 p);
+    /** As mat4_mul(&m1, &m2, out) */
+    static r2m4 r2m4_mul(r2m4 m1, r2m4 m2);
+
+    /**
+     * Extract the frustum planes of proj * view, as made by mat4_perspective
+     * and mat4_lookat (OpenGL clip space, -w <= x, y, z <= w). Pass NULL
+     * for view to use proj on its own (a combined view projection, say).
+     */
+    static void frustum_from_mat4(const mat4 *proj, const mat4 *view, frustum *out);
+    /**
+     * Cull centers->n bounding spheres against f. Writes the index of each
+     * sphere that is at least partly inside into visible (room for
+     * centers->n) in order and returns how many there are.
+     */
+    static size_t frustum_cull_spheres(const frustum *f, const vec3_soa *centers, const float *radii,
+                                       uint32_t *visible);
+    /**
+     * As frustum_cull_spheres, but sets bit i % 32 of mask[i / 32] for each
+     * visible sphere i (and clears the rest). mask needs (n + 31) / 32 words.
+     */
+    static void frustum_cull_spheres_mask(const frustum *f, const vec3_soa *centers, const float *radii,
+                                          uint32_t *mask);
+    /** As frustum_cull_spheres for axis aligned boxes given as center and half extents */
+    static size_t frustum_cull_aabbs(const frustum *f, const vec3_soa *centers, const vec3_soa *extents,
+                                     uint32_t *visible);
+    static void frustum_cull_aabbs_mask(const frustum *f, const vec3_soa *centers, const vec3_soa *extents,
+                                        uint32_t *mask);
+
     static void quat_mat4(const quat *q, mat4 *out);
+    /**
+     * Rotate v by the unit quaternion q (q v q*). Uses
+     * v + 2w(q x v) + q x 2(q x v), which is two cross products rather
+     * than two quat_mul_quat calls. v->w is carried through; out may be v.
+     */
     static void quat_mul_vec3(const quat *q, const vec3 *v, vec3 *out);
+    /**
+     * quat_mul_vec3 with the one q over n contiguous vectors. in and out may
+     * be the same array. Large batches are split across OpenMP threads.
+     */
+    static void quat_rotate_batch(const quat *q, const vec3 *in, vec3 *out, size_t n);
+    /** As quat_rotate_batch with a quaternion per vector: out[i] = q[i] in[i] q[i]* */
+    static void quat_rotate_each(const quat *q, const vec3 *in, vec3 *out, size_t n);
+    /**
+     * Interpolate unit quaternions, t in [0, 1]. Both take the shortest path
+     * (q2 is flipped when q1 . q2 < 0) and return a unit quaternion.
+     * quat_slerp has constant angular velocity and falls back to nlerp when
+     * the two are nearly parallel; quat_nlerp is a normalized lerp.
+     */
+    static void quat_slerp(const quat *q1, const quat *q2, float t, quat *out);
+    static void quat_nlerp(const quat *q1, const quat *q2, float t, quat *out);
+    /**
+     * quat_slerp / quat_nlerp over a->n pairs of quaternions stored as
+     * vec4_soa, all blended by the same t (one animation layer over a
+     * skeleton, say). Runs R2_VF_N pairs at once with no branches and
+     * polynomial acos/sin. out may be a or b.
+     */
+    static void quat_slerp_soa(const vec4_soa *a, const vec4_soa *b, float t, vec4_soa *out);
+    static void quat_nlerp_soa(const vec4_soa *a, const vec4_soa *b, float t, vec4_soa *out);
     static void quat_normalize(const quat *q, quat *out);
     /** Conjugate a quaternion (make negative) */
     static void quat_conj(const quat *q, quat *out);
@@ -244,6 +994,26 @@ extern "C"
     static float vec3_dist(const vec3 *v1, const vec3 *v2);
     static void vec3_normalize(const vec3 *v, vec3 *out);
 
+    /**
+     * Structure-of-arrays stream functions. They work on the first a->n
+     * elements, out streams must have room for as many. Outputs may be the
+     * same stream as an input.
+     */
+    static void vec3_soa_add(const vec3_soa *a, const vec3_soa *b, vec3_soa *out);
+    static void vec3_soa_sub(const vec3_soa *a, const vec3_soa *b, vec3_soa *out);
+    static void vec3_soa_mul(const vec3_soa *a, float fac, vec3_soa *out);
+    static void vec3_soa_cross(const vec3_soa *a, const vec3_soa *b, vec3_soa *out);
+    static void vec3_soa_normalize(const vec3_soa *a, vec3_soa *out);
+    /** Per element dot product, out is an array of a->n floats */
+    static void vec3_soa_dot(const vec3_soa *a, const vec3_soa *b, float *out);
+    /** Per element length, out is an array of a->n floats */
+    static void vec3_soa_length(const vec3_soa *a, float *out);
+    /** Array of structures <-> structure of arrays (n is taken from / set on the soa) */
+    static void vec3_to_soa(const vec3 *in, size_t n, vec3_soa *out);
+    static void vec3_from_soa(const vec3_soa *in, vec3 *out);
+    static void vec4_to_soa(const vec4 *in, size_t n, vec4_soa *out);
+    static void vec4_from_soa(const vec4_soa *in, vec4 *out);
+
     static void vec2_zero(vec2 *out);
     static bool vec2_equals(const vec2 *v1, const vec2 *v2);
     static void vec2_set(float x, float y, vec2 *v);
@@ -272,18 +1042,200 @@ extern "C"
     static void vecn_mul_vec(const float *v1, const float *v2, int n, float *out);
     static void vecn_div(const float *v, float fac, int n, float *out);
     static void vecn_div_vec(const float *v1, const float *v2, int n, float *out);
+    /**
+     * out = v^exp, as exp(exp * log|v|) in SIMD. The PRECISE tier keeps the
+     * log and the product in double-float, so it stays within 1 ULP for any
+     * exp; it needs FMA, so it calls powf unless the build or the AVX2
+     * dispatch level has it. Under FAST the error grows with |exp * log v|
+     * (about 1e-4 relative). Special values follow C's pow: negative v give
+     * NaN unless exp is a whole number (every float from 2^24 up is even),
+     * and pow(+-1, +-inf) = pow(1, NaN) = 1.
+     */
     static void vecn_pow(const float *v, float exp, int n, float *out);
     static void vecn_abs(const float *v, int n, float *out);
     static void vecn_sqrt(const float *v, int n, float *out);
+    /**
+     * Element wise exp, log, tanh, sin and cos with SIMD polynomials (see
+     * r2_accuracy_set). sin / cos reduce the argument in float, so they
+     * lose accuracy past |v| of about 8192. out may be v.
+     */
+    static void vecn_exp(const float *v, int n, float *out);
+    static void vecn_log(const float *v, int n, float *out);
+    static void vecn_tanh(const float *v, int n, float *out);
+    static void vecn_sin(const float *v, int n, float *out);
+    static void vecn_cos(const float *v, int n, float *out);
+    static void vecn_sincos(const float *v, int n, float *out_sin, float *out_cos);
     static float vecn_dot(const float *v1, const float *v2, int n);
     static float vecn_length_sqrd(const float *v, int n);
     static float vecn_length(const float *v, int n);
     static float vecn_dist_sqrd(const float *v1, const float *v2, int n);
     static float vecn_dist(const float *v1, const float *v2, int n);
     static void vecn_normalize(const float *v, int n, float *out);
+    /**
+     * Reductions. NaNs are skipped by min / max / argmax; for n == 0 (or
+     * all NaN) min is INFINITY, max is -INFINITY and argmax is -1. argmax
+     * returns the first index of the largest value.
+     */
+    static float vecn_sum(const float *v, int n);
+    static float vecn_min(const float *v, int n);
+    static float vecn_max(const float *v, int n);
+    static int vecn_argmax(const float *v, int n);
+    static void vecn_minmax(const float *v, int n, float *min, float *max);
+    /** Fused single-pass kernels. out may alias any input.
+     * axpy: out = a*x + y; axpby: out = a*x + b*y; fma: out = v1*v2 + v3;
+     * lerp: out = v1 + (v2 - v1)*t; scale_add: out = v*fac + add */
+    static void vecn_axpy(float a, const float *x, const float *y, int n, float *out);
+    static void vecn_axpby(float a, const float *x, float b, const float *y, int n, float *out);
+    static void vecn_fma(const float *v1, const float *v2, const float *v3, int n, float *out);
+    static void vecn_lerp(const float *v1, const float *v2, float t, int n, float *out);
+    static void vecn_scale_add(const float *v, float fac, float add, int n, float *out);
+    /**
+     * Half precision storage. Conversions to f16 / bf16 round to nearest
+     * even; values past the f16 range become infinity. The dot and distance
+     * functions read the halves and accumulate in float.
+     */
+    static float f16_to_float(f16 h);
+    static f16 float_to_f16(float f);
+    static float bf16_to_float(bf16 h);
+    static bf16 float_to_bf16(float f);
+    static void vecn_to_f16(const float *v, int n, f16 *out);
+    static void vecn_from_f16(const f16 *v, int n, float *out);
+    static void vecn_to_bf16(const float *v, int n, bf16 *out);
+    static void vecn_from_bf16(const bf16 *v, int n, float *out);
+    static float vecn_dot_f16(const f16 *v1, const f16 *v2, int n);
+    static float vecn_dist_sqrd_f16(const f16 *v1, const f16 *v2, int n);
+    static float vecn_dot_bf16(const bf16 *v1, const bf16 *v2, int n);
+    static float vecn_dist_sqrd_bf16(const bf16 *v1, const bf16 *v2, int n);
+    /**
+     * Symmetric int8 quantization: out[i] = round(v[i] / scale) in
+     * [-127, 127], with scale = max|v| / 127 returned. v ~= out * scale.
+     */
+    static float vecn_quantize_i8(const float *v, int n, int8_t *out);
+    static void vecn_dequantize_i8(const int8_t *v, float scale, int n, float *out);
+    /**
+     * Asymmetric (uint8) quantization over [min(v, 0), max(v, 0)]:
+     * v ~= (out - zero) * scale. Keeps more precision than the symmetric
+     * form for one-sided data such as activations after a ReLU.
+     */
+    static void vecn_quantize_u8(const float *v, int n, uint8_t *out, float *scale, uint8_t *zero);
+    static void vecn_dequantize_u8(const uint8_t *v, float scale, uint8_t zero, int n, float *out);
+    /**
+     * Exact int32 dot product of two int8 vectors. The values must be in
+     * [-127, 127] (as vecn_quantize_i8 makes them); n up to 2^17 cannot
+     * overflow.
+     */
+    static int32_t vecn_dot_i8(const int8_t *v1, const int8_t *v2, int n);
+    /**
+     * Brute force k nearest neighbours of query among the n rows of data
+     * (row-major, n x d). Writes the k best row ids to idx and their
+     * scores to dist, best first: squared distance for KNN_L2, dot product
+     * for KNN_DOT (cosine similarity if the rows are normalized). When
+     * n < k the extra slots get id UINT32_MAX. k <= 0 does nothing.
+     */
+    static void vecn_knn(const float *data, int n, int d, const float *query, int k, knn_metric metric, uint32_t *idx,
+                         float *dist);
+    /**
+     * vecn_knn for q queries (row-major, q x d) at once; idx and dist are
+     * q x k. From R2_KNN_GEMM_MIN queries the scores are computed in blocks
+     * with mat_mul (queries x rows^T), otherwise row by row. Either way the
+     * queries are split across OpenMP threads.
+     */
+    static void vecn_knn_batch(const float *data, int n, int d, const float *queries, int q, int k, knn_metric metric,
+                               uint32_t *idx, float *dist);
+
+    /**
+     * Build a bvh over n boxes (mins[i], maxs[i]) with a binned SAH split.
+     * Big subtrees are built in parallel as OpenMP tasks. Returns false if
+     * memory runs out (out is then empty but safe to bvh_free).
+     */
+    static bool bvh_build(const vec3 *mins, const vec3 *maxs, size_t n, bvh *out);
+    /** As bvh_build over n triangles with corners verts[tris[i*3 + 0..2]] */
+    static bool bvh_build_triangles(const vec3 *verts, const uint32_t *tris, size_t n, bvh *out);
+    static void bvh_free(bvh *b);
+    /**
+     * Nearest hit along origin + t * dir for 0 <= t <= tmax. Triangles are
+     * hit exactly, boxes where the ray enters them. False on a miss.
+     */
+    static bool bvh_raycast(const bvh *b, const vec3 *origin, const vec3 *dir, float tmax, bvh_hit *hit);
+    /**
+     * Ids of the primitives whose bounds overlap the box min / max. Writes
+     * up to max_out of them and returns the total, which can be larger.
+     */
+    static size_t bvh_overlap(const bvh *b, const vec3 *min, const vec3 *max, uint32_t *out, size_t max_out);
+    /** Closest point to p on any primitive, hit->t is the distance. False if the bvh is empty */
+    static bool bvh_nearest(const bvh *b, const vec3 *p, bvh_hit *hit);
+
+    /**
+     * Set up an empty spatial hash. cell_size is usually about the query
+     * radius; table_size is rounded up to a power of two (about the number
+     * of points is a good start). Returns false if out of memory.
+     */
+    static bool spatial_hash_init(spatial_hash *h, float cell_size, size_t table_size);
+    /**
+     * (Re)build over n points with a counting sort: hash, histogram, prefix
+     * sum, scatter. Keeps and grows its buffers between frames, and large
+     * builds run the histogram and scatter across OpenMP threads.
+     */
+    static bool spatial_hash_build(spatial_hash *h, const vec3 *points, size_t n);
+    /**
+     * The spans of every bucket a sphere around p touches, each bucket once.
+     * They are candidates only (cells share buckets), filter them by
+     * distance or use spatial_hash_radius. Writes up to max_spans and
+     * returns the total. A sphere covering more cells than there are
+     * buckets (or huge coordinates, which are clamped) gives every bucket.
+     */
+    static size_t spatial_hash_query(const spatial_hash *h, const vec3 *p, float radius, spatial_hash_span *spans,
+                                     size_t max_spans);
+    /**
+     * Ids of the points (the array given to spatial_hash_build) within
+     * radius of p. Writes up to max_out and returns the total. This does
+     * not fail: without memory for the spans every point is checked.
+     */
+    static size_t spatial_hash_radius(const spatial_hash *h, const vec3 *points, const vec3 *p, float radius,
+                                      uint32_t *out, size_t max_out);
+    static void spatial_hash_free(spatial_hash *h);
+
+    /**
+     * Tensor files: an r2_tensor_header, the payloads (each aligned to
+     * R2_TENSOR_ALIGN) and then a table of r2_tensor_entry.
+     *
+     * Open path and fill out with views of its tensors. The file is mapped
+     * read only and nothing is copied, so opening is quick whatever the
+     * size and only the pages that get used are read (and they can be
+     * dropped again under memory pressure). Returns false, and says why on
+     * stderr, if the file can not be read or is not a valid tensor file.
+     */
+    static bool r2_tensor_open(const char *path, r2_tensor_file *out);
+    static void r2_tensor_close(r2_tensor_file *f);
+    /** The tensor called name, or NULL */
+    static const r2_tensor *r2_tensor_find(const r2_tensor_file *f, const char *name);
+    /** t's data as floats, or NULL if t is not F32 */
+    static const float *r2_tensor_f32(const r2_tensor *t);
+    /** Create (or truncate) path for writing tensors */
+    static bool r2_tensor_write_begin(r2_tensor_writer *w, const char *path);
+    /**
+     * Add a dense row-major tensor of floats, stored as dtype: F16 and
+     * BF16 are converted, I8 is quantized one row (last dimension) at a
+     * time. The name must be shorter than R2_TENSOR_NAME_MAX. Returns false
+     * on bad arguments or a write error.
+     */
+    static bool r2_tensor_write(r2_tensor_writer *w, const char *name, r2_dtype dtype, int ndim, const size_t *shape,
+                                const float *data);
+    /** As r2_tensor_write for data already in dtype. I8 needs scales, one per row. */
+    static bool r2_tensor_write_raw(r2_tensor_writer *w, const char *name, r2_dtype dtype, int ndim,
+                                    const size_t *shape, const void *data, const float *scales);
+    /** Write the table, fill in the header and close the file. Returns false if any write failed. */
+    static bool r2_tensor_write_end(r2_tensor_writer *w);
 
 #ifdef R2_MATHS_IMPLEMENTATION
 
+#ifdef R2_MMAP
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
     ///////////////////////////////////////////////////////////////
     // FNS
 
@@ -298,776 +1250,7035 @@ extern "C"
         return d * __g_pi_deg;
     }
 
+    static void *r2_aligned_alloc(size_t alignment, size_t size)
+    {
+        // over allocate and keep what malloc gave just before the aligned
+        // block, which works the same everywhere (unlike aligned_alloc,
+        // posix_memalign and _aligned_malloc)
+        unsigned char *raw;
+        uintptr_t p;
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+            return NULL;
+        if (alignment < sizeof(void *))
+            alignment = sizeof(void *);
+        if (size > SIZE_MAX - alignment - sizeof(void *))
+            return NULL;
+        raw = (unsigned char *)malloc(size + alignment + sizeof(void *));
+        if (raw == NULL)
+            return NULL;
+        p = ((uintptr_t)raw + sizeof(void *) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        memcpy((void *)(p - sizeof(void *)), &raw, sizeof(raw));
+        return (void *)p;
+    }
+
+    static void r2_aligned_free(void *p)
+    {
+        void *raw;
+        if (p == NULL)
+            return;
+        memcpy(&raw, (unsigned char *)p - sizeof(void *), sizeof(raw));
+        free(raw);
+    }
+
     ///////////////////////////////////////////////////////////////
-    // Vecn — generic float* operations
+    // Half precision
 
-    static void vecn_zero(float *v, int n)
+    static float f16_to_float(f16 h)
     {
-        int i;
-        for (i = 0; i < n; i++)
-            v[i] = 0.f;
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t e = (h >> 10) & 0x1f;
+        uint32_t m = h & 0x3ff;
+        uint32_t bits;
+        float f;
+        if (e == 0)
+        {
+            // zero or subnormal, m * 2^-24
+            f = (float)m * 5.9604645e-8f;
+            memcpy(&bits, &f, sizeof(bits));
+            bits |= sign;
+        }
+        else if (e == 31)
+            bits = sign | 0x7f800000 | (m << 13);
+        else
+            bits = sign | ((e + 112) << 23) | (m << 13);
+        memcpy(&f, &bits, sizeof(f));
+        return f;
     }
 
-    static bool vecn_equals(const float *v1, const float *v2, int n)
+    static f16 float_to_f16(float f)
     {
-        int i;
-        for (i = 0; i < n; i++)
-            if (!r2_equals(v1[i], v2[i]))
-                return false;
-        return true;
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t ax = x & 0x7fffffff;
+        if (ax > 0x7f800000)
+            return (f16)(sign | 0x7e00 | ((ax >> 13) & 0x3ff)); // quiet NaN
+        if (ax >= 0x477ff000)
+            return (f16)(sign | 0x7c00); // 65520 and up round to infinity
+        if (ax < 0x38800000)
+        {
+            // below 2^-14 the result is subnormal, adding 0.5 lines the
+            // f16 mantissa up with the bottom of the float one and lets the
+            // FPU do the rounding
+            float a;
+            memcpy(&a, &ax, sizeof(a));
+            a += 0.5f;
+            memcpy(&ax, &a, sizeof(ax));
+            return (f16)(sign | (ax - 0x3f000000));
+        }
+        // rebias the exponent and round the 13 dropped bits to nearest even
+        ax += 0xc8000fff + ((ax >> 13) & 1);
+        return (f16)(sign | (ax >> 13));
     }
 
-    static void vecn_add(const float *v1, const float *v2, int n, float *out)
+    static float bf16_to_float(bf16 h)
     {
-        int i;
-        for (i = 0; i < n; i++)
-            out[i] = v1[i] + v2[i];
+        uint32_t bits = (uint32_t)h << 16;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
     }
 
-    static void vecn_sub(const float *v1, const float *v2, int n, float *out)
+    static bf16 float_to_bf16(float f)
+    {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        if ((x & 0x7fffffff) > 0x7f800000)
+            return (bf16)((x >> 16) | 0x40); // quiet NaN
+        x += 0x7fff + ((x >> 16) & 1);
+        return (bf16)(x >> 16);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // SIMD transcendentals
+    //
+    // Cephes style: reduce the argument to a small range with exact (or
+    // split constant) steps, run a polynomial, then rebuild the result.
+    // The FAST tier uses shorter polynomials for the same reductions.
+    // The kernels are in the R2__VMATH_PASS section at the end of this
+    // file, included once for the SSE table at the build's r2_vf width and
+    // once more for the AVX2 table. Without integer lanes to build
+    // exponents with (no SIMD, or AVX without AVX2) the SSE table keeps the
+    // C library loops of the scalar one.
+
+    static r2_accuracy __g_accuracy = R2_ACCURACY_PRECISE;
+
+    static void r2_accuracy_set(r2_accuracy accuracy)
+    {
+        __g_accuracy = accuracy;
+    }
+
+    static r2_accuracy r2_accuracy_get(void)
+    {
+        return __g_accuracy;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // SIMD dispatch
+    //
+    // Each level fills a table of kernels. vecn_* and mat_mul go through
+    // the active table, which is picked from cpuid (and R2_SIMD) on first
+    // use. Calls shorter than R2_SIMD_MIN_N use the scalar table directly.
+
+    typedef struct s_r2_kernels
+    {
+        r2_simd_level level;
+        void (*add)(const float *v1, const float *v2, int n, float *out);
+        void (*sub)(const float *v1, const float *v2, int n, float *out);
+        void (*mul_vec)(const float *v1, const float *v2, int n, float *out);
+        void (*mul)(const float *v, float fac, int n, float *out);
+        float (*dot)(const float *v1, const float *v2, int n);
+        float (*dist_sqrd)(const float *v1, const float *v2, int n);
+        float (*sum)(const float *v, int n);
+        void (*minmax)(const float *v, int n, float *min, float *max);
+        void (*axpby)(float a, const float *x, float b, const float *y, int n, float *out);
+        void (*fma)(const float *v1, const float *v2, const float *v3, int n, float *out);
+        void (*scale_add)(const float *v, float fac, float add, int n, float *out);
+        void (*mat_mul)(const float *m1, const float *m2, unsigned int r1, unsigned int c1, unsigned int c2,
+                        float *out);
+        // GEMM micro-kernel, see r2__gemm. Computes an mr x nr tile of c
+        // (row stride ldc) from packed panels a (kc x mr) and b (kc x nr),
+        // adding to what is in c when acc is set
+        int mr;
+        int nr;
+        void (*gemm_tile)(int kc, const float *a, const float *b, float *c, int ldc, int acc);
+        // f16 storage, converted with F16C where the level has it
+        void (*from_f16)(const f16 *v, int n, float *out);
+        void (*to_f16)(const float *v, int n, f16 *out);
+        float (*dot_f16)(const f16 *v1, const f16 *v2, int n);
+        float (*dist_sqrd_f16)(const f16 *v1, const f16 *v2, int n);
+        int32_t (*dot_i8)(const int8_t *v1, const int8_t *v2, int n);
+        // transcendentals, see r2_accuracy_set
+        void (*exp)(const float *v, int n, float *out);
+        void (*log)(const float *v, int n, float *out);
+        void (*tanh)(const float *v, int n, float *out);
+        void (*sin)(const float *v, int n, float *out);
+        void (*cos)(const float *v, int n, float *out);
+        void (*sincos)(const float *v, int n, float *out_sin, float *out_cos);
+        void (*pow)(const float *v, float exp, int n, float *out);
+    } r2_kernels;
+
+    // scalar
+
+    static void r2__add_scalar(const float *v1, const float *v2, int n, float *out)
     {
         int i;
         for (i = 0; i < n; i++)
-            out[i] = v1[i] - v2[i];
+            out[i] = v1[i] + v2[i];
     }
 
-    static void vecn_mul(const float *v, float fac, int n, float *out)
+    static void r2__sub_scalar(const float *v1, const float *v2, int n, float *out)
     {
-#ifdef HAVE_BLAS
-        cblas_scopy(n, v, 1, out, 1);
-        cblas_sscal(n, fac, out, 1);
-#else
         int i;
         for (i = 0; i < n; i++)
-            out[i] = v[i] * fac;
-#endif
+            out[i] = v1[i] - v2[i];
     }
 
-    static void vecn_mul_vec(const float *v1, const float *v2, int n, float *out)
+    static void r2__mul_vec_scalar(const float *v1, const float *v2, int n, float *out)
     {
         int i;
         for (i = 0; i < n; i++)
             out[i] = v1[i] * v2[i];
     }
 
-    static void vecn_div(const float *v, float fac, int n, float *out)
+    static void r2__mul_scalar(const float *v, float fac, int n, float *out)
     {
-        float d = (fac == 0.f) ? 1.f : 1.f / fac;
-#ifdef HAVE_BLAS
-        cblas_scopy(n, v, 1, out, 1);
-        cblas_sscal(n, d, out, 1);
-#else
         int i;
         for (i = 0; i < n; i++)
-            out[i] = v[i] * d;
-#endif
+            out[i] = v[i] * fac;
     }
 
-    static void vecn_div_vec(const float *v1, const float *v2, int n, float *out)
+    // The reductions keep four independent partial sums (so consecutive adds
+    // do not wait on each other) and combine them pairwise at the end, which
+    // also keeps the rounding error down on long vectors. The SIMD levels
+    // do the same with four registers.
+
+    static float r2__dot_scalar(const float *v1, const float *v2, int n)
+    {
+        float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            s0 += v1[i] * v2[i];
+            s1 += v1[i + 1] * v2[i + 1];
+            s2 += v1[i + 2] * v2[i + 2];
+            s3 += v1[i + 3] * v2[i + 3];
+        }
+        for (; i < n; i++)
+            s0 += v1[i] * v2[i];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    static float r2__dist_sqrd_scalar(const float *v1, const float *v2, int n)
+    {
+        float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            float d0 = v1[i] - v2[i], d1 = v1[i + 1] - v2[i + 1];
+            float d2 = v1[i + 2] - v2[i + 2], d3 = v1[i + 3] - v2[i + 3];
+            s0 += d0 * d0;
+            s1 += d1 * d1;
+            s2 += d2 * d2;
+            s3 += d3 * d3;
+        }
+        for (; i < n; i++)
+        {
+            float d = v1[i] - v2[i];
+            s0 += d * d;
+        }
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    static float r2__sum_scalar(const float *v, int n)
+    {
+        float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            s0 += v[i];
+            s1 += v[i + 1];
+            s2 += v[i + 2];
+            s3 += v[i + 3];
+        }
+        for (; i < n; i++)
+            s0 += v[i];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    // fminf / fmaxf skip NaNs, the SIMD versions keep the same rule by
+    // putting the running value second
+    static void r2__minmax_scalar(const float *v, int n, float *min, float *max)
     {
+        float lo = INFINITY, hi = -INFINITY;
         int i;
         for (i = 0; i < n; i++)
-            out[i] = v1[i] / ((v2[i] == 0.f) ? 1.f : v2[i]);
+        {
+            lo = fminf(lo, v[i]);
+            hi = fmaxf(hi, v[i]);
+        }
+        *min = lo;
+        *max = hi;
     }
 
-    static void vecn_pow(const float *v, float exp, int n, float *out)
+    static void r2__axpby_scalar(float a, const float *x, float b, const float *y, int n, float *out)
     {
         int i;
         for (i = 0; i < n; i++)
-            out[i] = powf(v[i], exp);
+            out[i] = a * x[i] + b * y[i];
     }
 
-    static void vecn_abs(const float *v, int n, float *out)
+    static void r2__fma_scalar(const float *v1, const float *v2, const float *v3, int n, float *out)
     {
         int i;
         for (i = 0; i < n; i++)
-            out[i] = fabsf(v[i]);
+            out[i] = v1[i] * v2[i] + v3[i];
     }
 
-    static void vecn_sqrt(const float *v, int n, float *out)
+    static void r2__scale_add_scalar(const float *v, float fac, float add, int n, float *out)
     {
         int i;
         for (i = 0; i < n; i++)
-            out[i] = sqrtf(v[i]);
+            out[i] = v[i] * fac + add;
     }
 
-    static float vecn_dot(const float *v1, const float *v2, int n)
+    static void r2__mat_mul_scalar(const float *m1, const float *m2, unsigned int r1, unsigned int c1,
+                                   unsigned int c2, float *out)
+    {
+        unsigned int i, j, k;
+        for (i = 0; i < r1; i++)
+        {
+            for (j = 0; j < c2; j++)
+            {
+                float sum = 0.f;
+                for (k = 0; k < c1; k++)
+                {
+                    sum += m1[i * c1 + k] * m2[k * c2 + j];
+                }
+                out[i * c2 + j] = sum;
+            }
+        }
+    }
+
+    static void r2__gemm_4x4_scalar(int kc, const float *a, const float *b, float *c, int ldc, int acc)
+    {
+        float t[4][4] = {{0}};
+        int i, j, k;
+        for (k = 0; k < kc; k++, a += 4, b += 4)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                for (j = 0; j < 4; j++)
+                    t[i][j] += a[i] * b[j];
+            }
+        }
+        for (i = 0; i < 4; i++)
+        {
+            for (j = 0; j < 4; j++)
+                c[i * ldc + j] = acc ? c[i * ldc + j] + t[i][j] : t[i][j];
+        }
+    }
+
+    static void r2__from_f16_scalar(const f16 *v, int n, float *out)
     {
-#ifdef HAVE_BLAS
-        return cblas_sdot(n, v1, 1, v2, 1);
-#else
-        float sum = 0.f;
         int i;
         for (i = 0; i < n; i++)
-            sum += v1[i] * v2[i];
-        return sum;
-#endif
+            out[i] = f16_to_float(v[i]);
     }
 
-    static float vecn_length_sqrd(const float *v, int n)
+    static void r2__to_f16_scalar(const float *v, int n, f16 *out)
     {
-        return vecn_dot(v, v, n);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = float_to_f16(v[i]);
     }
 
-    static float vecn_length(const float *v, int n)
+    static float r2__dot_f16_scalar(const f16 *v1, const f16 *v2, int n)
     {
-#ifdef HAVE_BLAS
-        return cblas_snrm2(n, v, 1);
-#else
-        return sqrtf(vecn_length_sqrd(v, n));
-#endif
+        float sum = 0.f;
+        int i;
+        for (i = 0; i < n; i++)
+            sum += f16_to_float(v1[i]) * f16_to_float(v2[i]);
+        return sum;
     }
 
-    static float vecn_dist_sqrd(const float *v1, const float *v2, int n)
+    static float r2__dist_sqrd_f16_scalar(const f16 *v1, const f16 *v2, int n)
     {
         float sum = 0.f;
         int i;
         for (i = 0; i < n; i++)
         {
-            float d = v1[i] - v2[i];
+            float d = f16_to_float(v1[i]) - f16_to_float(v2[i]);
             sum += d * d;
         }
         return sum;
     }
 
-    static float vecn_dist(const float *v1, const float *v2, int n)
+    static int32_t r2__dot_i8_scalar(const int8_t *v1, const int8_t *v2, int n)
     {
-        return sqrtf(vecn_dist_sqrd(v1, v2, n));
+        int32_t sum = 0;
+        int i;
+        for (i = 0; i < n; i++)
+            sum += (int32_t)v1[i] * v2[i];
+        return sum;
     }
 
-    static void vecn_normalize(const float *v, int n, float *out)
+    static void r2__exp_scalar(const float *v, int n, float *out)
     {
-        float len = vecn_length(v, n);
-        if (len < EPSILON)
-            vecn_zero(out, n);
-        else
-            vecn_div(v, len, n, out);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = expf(v[i]);
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Vec2
-
-    static void vec2_zero(vec2 *out)
+    static void r2__log_scalar(const float *v, int n, float *out)
     {
-        vecn_zero(out->a_vec2, 2);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = logf(v[i]);
     }
-    static bool vec2_equals(const vec2 *v1, const vec2 *v2)
+
+    static void r2__tanh_scalar(const float *v, int n, float *out)
     {
-        return vecn_equals(v1->a_vec2, v2->a_vec2, 2);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = tanhf(v[i]);
     }
 
-    static void vec2_set(float x, float y, vec2 *v)
+    static void r2__sin_scalar(const float *v, int n, float *out)
     {
-        v->x = x;
-        v->y = y;
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = sinf(v[i]);
     }
 
-    static void vec2_add(const vec2 *v1, const vec2 *v2, vec2 *out)
+    static void r2__cos_scalar(const float *v, int n, float *out)
     {
-        vecn_add(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = cosf(v[i]);
     }
-    static void vec2_sub(const vec2 *v1, const vec2 *v2, vec2 *out)
+
+    static void r2__sincos_scalar(const float *v, int n, float *out_sin, float *out_cos)
     {
-        vecn_sub(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+        int i;
+        for (i = 0; i < n; i++)
+        {
+            float x = v[i];
+            out_sin[i] = sinf(x);
+            out_cos[i] = cosf(x);
+        }
     }
-    static void vec2_div(const vec2 *v, float fac, vec2 *out)
+
+    static void r2__pow_scalar(const float *v, float exp, int n, float *out)
     {
-        vecn_div(v->a_vec2, fac, 2, out->a_vec2);
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = powf(v[i], exp);
     }
-    static void vec2_div_vec2(const vec2 *v1, const vec2 *v2, vec2 *out)
+
+    static const r2_kernels r2__kernels_scalar = {
+        R2_SIMD_SCALAR,       r2__add_scalar,     r2__sub_scalar,           r2__mul_vec_scalar,
+        r2__mul_scalar,       r2__dot_scalar,     r2__dist_sqrd_scalar,     r2__sum_scalar,
+        r2__minmax_scalar,    r2__axpby_scalar,   r2__fma_scalar,           r2__scale_add_scalar,
+        r2__mat_mul_scalar,   4,                  4,                        r2__gemm_4x4_scalar,
+        r2__from_f16_scalar,  r2__to_f16_scalar,  r2__dot_f16_scalar,       r2__dist_sqrd_f16_scalar,
+        r2__dot_i8_scalar,    r2__exp_scalar,     r2__log_scalar,           r2__tanh_scalar,
+        r2__sin_scalar,       r2__cos_scalar,     r2__sincos_scalar,        r2__pow_scalar,
+    };
+
+#ifdef R2_SSE
+    // sse
+
+    static float r2__hsum_sse(__m128 v)
     {
-        vecn_div_vec(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+        __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+        return _mm_cvtss_f32(s);
     }
-    static void vec2_mul(const vec2 *v, float fac, vec2 *out)
+
+    static float r2__hmin_sse(__m128 v)
     {
-        vecn_mul(v->a_vec2, fac, 2, out->a_vec2);
+        __m128 s = _mm_min_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_min_ss(s, _mm_shuffle_ps(s, s, 0x55)));
     }
-    static void vec2_mul_vec2(const vec2 *v1, const vec2 *v2, vec2 *out)
+
+    static float r2__hmax_sse(__m128 v)
     {
-        vecn_mul_vec(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+        __m128 s = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_max_ss(s, _mm_shuffle_ps(s, s, 0x55)));
     }
-    static void vec2_pow(const vec2 *v, float exp, vec2 *out)
+
+    static void r2__add_sse(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_pow(v->a_vec2, exp, 2, out->a_vec2);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], _mm_add_ps(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] + v2[i];
     }
-    static float vec2_dot(const vec2 *v1, const vec2 *v2)
+
+    static void r2__sub_sse(const float *v1, const float *v2, int n, float *out)
     {
-        return vecn_dot(v1->a_vec2, v2->a_vec2, 2);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], _mm_sub_ps(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] - v2[i];
     }
-    static float vec2_length_sqrd(const vec2 *v)
+
+    static void r2__mul_vec_sse(const float *v1, const float *v2, int n, float *out)
     {
-        return vecn_length_sqrd(v->a_vec2, 2);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] * v2[i];
     }
-    static float vec2_length(const vec2 *v)
+
+    static void r2__mul_sse(const float *v, float fac, int n, float *out)
     {
-        return vecn_length(v->a_vec2, 2);
+        __m128 f = _mm_set1_ps(fac);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&v[i]), f));
+        for (; i < n; i++)
+            out[i] = v[i] * fac;
     }
-    static float vec2_dist_sqrd(const vec2 *v1, const vec2 *v2)
+
+    static float r2__dot_sse(const float *v1, const float *v2, int n)
     {
-        return vecn_dist_sqrd(v1->a_vec2, v2->a_vec2, 2);
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            a0 = R2_MADD_PS(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i]), a0);
+            a1 = R2_MADD_PS(_mm_loadu_ps(&v1[i + 4]), _mm_loadu_ps(&v2[i + 4]), a1);
+            a2 = R2_MADD_PS(_mm_loadu_ps(&v1[i + 8]), _mm_loadu_ps(&v2[i + 8]), a2);
+            a3 = R2_MADD_PS(_mm_loadu_ps(&v1[i + 12]), _mm_loadu_ps(&v2[i + 12]), a3);
+        }
+        for (; i + 4 <= n; i += 4)
+            a0 = R2_MADD_PS(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i]), a0);
+        float sum = r2__hsum_sse(_mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+        for (; i < n; i++)
+            sum += v1[i] * v2[i];
+        return sum;
     }
-    static float vec2_dist(const vec2 *v1, const vec2 *v2)
+
+    static float r2__dist_sqrd_sse(const float *v1, const float *v2, int n)
     {
-        return vecn_dist(v1->a_vec2, v2->a_vec2, 2);
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        __m128 d0, d1, d2, d3;
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            d0 = _mm_sub_ps(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i]));
+            d1 = _mm_sub_ps(_mm_loadu_ps(&v1[i + 4]), _mm_loadu_ps(&v2[i + 4]));
+            d2 = _mm_sub_ps(_mm_loadu_ps(&v1[i + 8]), _mm_loadu_ps(&v2[i + 8]));
+            d3 = _mm_sub_ps(_mm_loadu_ps(&v1[i + 12]), _mm_loadu_ps(&v2[i + 12]));
+            a0 = R2_MADD_PS(d0, d0, a0);
+            a1 = R2_MADD_PS(d1, d1, a1);
+            a2 = R2_MADD_PS(d2, d2, a2);
+            a3 = R2_MADD_PS(d3, d3, a3);
+        }
+        for (; i + 4 <= n; i += 4)
+        {
+            d0 = _mm_sub_ps(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i]));
+            a0 = R2_MADD_PS(d0, d0, a0);
+        }
+        float sum = r2__hsum_sse(_mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+        for (; i < n; i++)
+        {
+            float d = v1[i] - v2[i];
+            sum += d * d;
+        }
+        return sum;
     }
-    static void vec2_normalize(const vec2 *v, vec2 *out)
+
+    static float r2__sum_sse(const float *v, int n)
     {
-        vecn_normalize(v->a_vec2, 2, out->a_vec2);
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            a0 = _mm_add_ps(a0, _mm_loadu_ps(&v[i]));
+            a1 = _mm_add_ps(a1, _mm_loadu_ps(&v[i + 4]));
+            a2 = _mm_add_ps(a2, _mm_loadu_ps(&v[i + 8]));
+            a3 = _mm_add_ps(a3, _mm_loadu_ps(&v[i + 12]));
+        }
+        for (; i + 4 <= n; i += 4)
+            a0 = _mm_add_ps(a0, _mm_loadu_ps(&v[i]));
+        float sum = r2__hsum_sse(_mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+        for (; i < n; i++)
+            sum += v[i];
+        return sum;
     }
 
-    static float vec2_edge_cross(const vec2 *a, const vec2 *b, const vec2 *c)
+    static void r2__minmax_sse(const float *v, int n, float *min, float *max)
     {
-        return (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+        __m128 lo0 = _mm_set1_ps(INFINITY), lo1 = lo0;
+        __m128 hi0 = _mm_set1_ps(-INFINITY), hi1 = hi0;
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128 x0 = _mm_loadu_ps(&v[i]);
+            __m128 x1 = _mm_loadu_ps(&v[i + 4]);
+            lo0 = _mm_min_ps(x0, lo0);
+            lo1 = _mm_min_ps(x1, lo1);
+            hi0 = _mm_max_ps(x0, hi0);
+            hi1 = _mm_max_ps(x1, hi1);
+        }
+        float lo = r2__hmin_sse(_mm_min_ps(lo0, lo1));
+        float hi = r2__hmax_sse(_mm_max_ps(hi0, hi1));
+        for (; i < n; i++)
+        {
+            lo = fminf(lo, v[i]);
+            hi = fmaxf(hi, v[i]);
+        }
+        *min = lo;
+        *max = hi;
     }
 
-    static void vec2_to_array(const vec2 *v, float *out)
+    static void r2__axpby_sse(float a, const float *x, float b, const float *y, int n, float *out)
     {
-        out[0] = v->x;
-        out[1] = v->y;
+        __m128 va = _mm_set1_ps(a);
+        __m128 vb = _mm_set1_ps(b);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], R2_MADD_PS(va, _mm_loadu_ps(&x[i]), _mm_mul_ps(vb, _mm_loadu_ps(&y[i]))));
+        for (; i < n; i++)
+            out[i] = a * x[i] + b * y[i];
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Vec3
-
-    static void vec3_zero(vec3 *out)
+    static void r2__fma_sse(const float *v1, const float *v2, const float *v3, int n, float *out)
     {
-        vecn_zero(out->a_vec, 3);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], R2_MADD_PS(_mm_loadu_ps(&v1[i]), _mm_loadu_ps(&v2[i]), _mm_loadu_ps(&v3[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] * v2[i] + v3[i];
     }
-    static bool vec3_equals(const vec3 *v1, const vec3 *v2)
+
+    static void r2__scale_add_sse(const float *v, float fac, float add, int n, float *out)
     {
-        return vecn_equals(v1->a_vec, v2->a_vec, 3);
+        __m128 f = _mm_set1_ps(fac);
+        __m128 d = _mm_set1_ps(add);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], R2_MADD_PS(_mm_loadu_ps(&v[i]), f, d));
+        for (; i < n; i++)
+            out[i] = v[i] * fac + add;
     }
 
-    static void vec3_set(float x, float y, float z, vec3 *v)
+    // i-k-j order: each row of out is built from rows of m2 scaled by one
+    // element of m1, so m2 is read along rows instead of down columns
+    static void r2__mat_mul_sse(const float *m1, const float *m2, unsigned int r1, unsigned int c1,
+                                unsigned int c2, float *out)
     {
-        v->x = x;
-        v->y = y;
-        v->z = z;
+        unsigned int i, j, k;
+        for (i = 0; i < r1; i++)
+        {
+            const float *a = &m1[i * c1];
+            float *o = &out[i * c2];
+            for (j = 0; j + 16 <= c2; j += 16)
+            {
+                __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+                __m128 s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+                for (k = 0; k < c1; k++)
+                {
+                    __m128 f = _mm_set1_ps(a[k]);
+                    const float *b = &m2[k * c2 + j];
+                    s0 = R2_MADD_PS(f, _mm_loadu_ps(b), s0);
+                    s1 = R2_MADD_PS(f, _mm_loadu_ps(b + 4), s1);
+                    s2 = R2_MADD_PS(f, _mm_loadu_ps(b + 8), s2);
+                    s3 = R2_MADD_PS(f, _mm_loadu_ps(b + 12), s3);
+                }
+                _mm_storeu_ps(o + j, s0);
+                _mm_storeu_ps(o + j + 4, s1);
+                _mm_storeu_ps(o + j + 8, s2);
+                _mm_storeu_ps(o + j + 12, s3);
+            }
+            for (; j + 4 <= c2; j += 4)
+            {
+                __m128 s0 = _mm_setzero_ps();
+                for (k = 0; k < c1; k++)
+                    s0 = R2_MADD_PS(_mm_set1_ps(a[k]), _mm_loadu_ps(&m2[k * c2 + j]), s0);
+                _mm_storeu_ps(o + j, s0);
+            }
+            for (; j < c2; j++)
+            {
+                float sum = 0.f;
+                for (k = 0; k < c1; k++)
+                    sum += a[k] * m2[k * c2 + j];
+                o[j] = sum;
+            }
+        }
     }
 
-    static void vec3_add(const vec3 *v1, const vec3 *v2, vec3 *out)
+    static void r2__gemm_4x8_sse(int kc, const float *a, const float *b, float *c, int ldc, int acc)
     {
-        vecn_add(v1->a_vec, v2->a_vec, 3, out->a_vec);
+        __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+        __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+        __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+        __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+        int k;
+        for (k = 0; k < kc; k++, a += 4, b += 8)
+        {
+            __m128 b0 = _mm_loadu_ps(b);
+            __m128 b1 = _mm_loadu_ps(b + 4);
+            __m128 ai = _mm_set1_ps(a[0]);
+            c00 = R2_MADD_PS(ai, b0, c00);
+            c01 = R2_MADD_PS(ai, b1, c01);
+            ai = _mm_set1_ps(a[1]);
+            c10 = R2_MADD_PS(ai, b0, c10);
+            c11 = R2_MADD_PS(ai, b1, c11);
+            ai = _mm_set1_ps(a[2]);
+            c20 = R2_MADD_PS(ai, b0, c20);
+            c21 = R2_MADD_PS(ai, b1, c21);
+            ai = _mm_set1_ps(a[3]);
+            c30 = R2_MADD_PS(ai, b0, c30);
+            c31 = R2_MADD_PS(ai, b1, c31);
+        }
+        if (acc)
+        {
+            c00 = _mm_add_ps(c00, _mm_loadu_ps(&c[0 * ldc]));
+            c01 = _mm_add_ps(c01, _mm_loadu_ps(&c[0 * ldc + 4]));
+            c10 = _mm_add_ps(c10, _mm_loadu_ps(&c[1 * ldc]));
+            c11 = _mm_add_ps(c11, _mm_loadu_ps(&c[1 * ldc + 4]));
+            c20 = _mm_add_ps(c20, _mm_loadu_ps(&c[2 * ldc]));
+            c21 = _mm_add_ps(c21, _mm_loadu_ps(&c[2 * ldc + 4]));
+            c30 = _mm_add_ps(c30, _mm_loadu_ps(&c[3 * ldc]));
+            c31 = _mm_add_ps(c31, _mm_loadu_ps(&c[3 * ldc + 4]));
+        }
+        _mm_storeu_ps(&c[0 * ldc], c00);
+        _mm_storeu_ps(&c[0 * ldc + 4], c01);
+        _mm_storeu_ps(&c[1 * ldc], c10);
+        _mm_storeu_ps(&c[1 * ldc + 4], c11);
+        _mm_storeu_ps(&c[2 * ldc], c20);
+        _mm_storeu_ps(&c[2 * ldc + 4], c21);
+        _mm_storeu_ps(&c[3 * ldc], c30);
+        _mm_storeu_ps(&c[3 * ldc + 4], c31);
     }
-    static void vec3_sub(const vec3 *v1, const vec3 *v2, vec3 *out)
+
+    // SSE2 has no signed byte multiply, so widen to 16 bits (sign extended
+    // by the arithmetic shift) and multiply-add pairs into 32 bit lanes
+    static int32_t r2__dot_i8_sse(const int8_t *v1, const int8_t *v2, int n)
     {
-        vecn_sub(v1->a_vec, v2->a_vec, 3, out->a_vec);
-    }
-    static void vec3_div(const vec3 *v, float fac, vec3 *out)
-    {
-        vecn_div(v->a_vec, fac, 3, out->a_vec);
+        __m128i acc = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)&v1[i]);
+            __m128i b = _mm_loadu_si128((const __m128i *)&v2[i]);
+            __m128i alo = _mm_srai_epi16(_mm_unpacklo_epi8(a, a), 8);
+            __m128i ahi = _mm_srai_epi16(_mm_unpackhi_epi8(a, a), 8);
+            __m128i blo = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+            __m128i bhi = _mm_srai_epi16(_mm_unpackhi_epi8(b, b), 8);
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(alo, blo), _mm_madd_epi16(ahi, bhi)));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+        int32_t sum = _mm_cvtsi128_si32(acc);
+        for (; i < n; i++)
+            sum += (int32_t)v1[i] * v2[i];
+        return sum;
     }
-    static void vec3_div_vec3(const vec3 *v1, const vec3 *v2, vec3 *out)
+
+  #ifdef R2_VI_AS_VF
+    // the transcendentals at the build's r2_vf width
+    #define R2__VM(name) name##_sse
+    #define R2__VM_TARGET
+    #define R2__VMATH_PASS
+    #include "r2_maths.h"
+    #undef R2__VMATH_PASS
+    #undef R2__VM_TARGET
+    #undef R2__VM
+  #endif
+
+    // SSE has no half conversions, f16 stays on the scalar kernels
+    static const r2_kernels r2__kernels_sse = {
+        R2_SIMD_SSE,          r2__add_sse,        r2__sub_sse,              r2__mul_vec_sse,
+        r2__mul_sse,          r2__dot_sse,        r2__dist_sqrd_sse,        r2__sum_sse,
+        r2__minmax_sse,       r2__axpby_sse,      r2__fma_sse,              r2__scale_add_sse,
+        r2__mat_mul_sse,      4,                  8,                        r2__gemm_4x8_sse,
+        r2__from_f16_scalar,  r2__to_f16_scalar,  r2__dot_f16_scalar,       r2__dist_sqrd_f16_scalar,
+  #ifdef R2_VI_AS_VF
+        r2__dot_i8_sse,       r2__exp_sse,        r2__log_sse,              r2__tanh_sse,
+        r2__sin_sse,          r2__cos_sse,        r2__sincos_sse,           r2__pow_sse,
+  #else
+        r2__dot_i8_sse,       r2__exp_scalar,     r2__log_scalar,           r2__tanh_scalar,
+        r2__sin_scalar,       r2__cos_scalar,     r2__sincos_scalar,        r2__pow_scalar,
+  #endif
+    };
+#endif
+
+#ifdef R2_DISPATCH
+    // avx2 + fma
+
+    R2_TARGET_AVX2 static float r2__hsum_avx(__m256 v)
     {
-        vecn_div_vec(v1->a_vec, v2->a_vec, 3, out->a_vec);
+        return r2__hsum_sse(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
     }
-    static void vec3_mul(const vec3 *v, float fac, vec3 *out)
+
+    R2_TARGET_AVX2 static void r2__add_avx2(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_mul(v->a_vec, fac, 3, out->a_vec);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_add_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] + v2[i];
     }
-    static void vec3_mul_vec3(const vec3 *v1, const vec3 *v2, vec3 *out)
+
+    R2_TARGET_AVX2 static void r2__sub_avx2(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_mul_vec(v1->a_vec, v2->a_vec, 3, out->a_vec);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_sub_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] - v2[i];
     }
-    static void vec3_pow(const vec3 *v, float exp, vec3 *out)
+
+    R2_TARGET_AVX2 static void r2__mul_vec_avx2(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_pow(v->a_vec, exp, 3, out->a_vec);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] * v2[i];
     }
-    static float vec3_dot(const vec3 *v1, const vec3 *v2)
+
+    R2_TARGET_AVX2 static void r2__mul_avx2(const float *v, float fac, int n, float *out)
     {
-        return vecn_dot(v1->a_vec, v2->a_vec, 3);
+        __m256 f = _mm256_set1_ps(fac);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&v[i]), f));
+        for (; i < n; i++)
+            out[i] = v[i] * fac;
     }
-    static float vec3_length_sqrd(const vec3 *v)
+
+    R2_TARGET_AVX2 static float r2__dot_avx2(const float *v1, const float *v2, int n)
     {
-        return vecn_length_sqrd(v->a_vec, 3);
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i]), a0);
+            a1 = _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i + 8]), _mm256_loadu_ps(&v2[i + 8]), a1);
+            a2 = _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i + 16]), _mm256_loadu_ps(&v2[i + 16]), a2);
+            a3 = _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i + 24]), _mm256_loadu_ps(&v2[i + 24]), a3);
+        }
+        for (; i + 8 <= n; i += 8)
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i]), a0);
+        float sum = r2__hsum_avx(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)));
+        for (; i < n; i++)
+            sum += v1[i] * v2[i];
+        return sum;
     }
-    static float vec3_length(const vec3 *v)
+
+    R2_TARGET_AVX2 static float r2__dist_sqrd_avx2(const float *v1, const float *v2, int n)
     {
-        return vecn_length(v->a_vec, 3);
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        __m256 d0, d1, d2, d3;
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            d0 = _mm256_sub_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i]));
+            d1 = _mm256_sub_ps(_mm256_loadu_ps(&v1[i + 8]), _mm256_loadu_ps(&v2[i + 8]));
+            d2 = _mm256_sub_ps(_mm256_loadu_ps(&v1[i + 16]), _mm256_loadu_ps(&v2[i + 16]));
+            d3 = _mm256_sub_ps(_mm256_loadu_ps(&v1[i + 24]), _mm256_loadu_ps(&v2[i + 24]));
+            a0 = _mm256_fmadd_ps(d0, d0, a0);
+            a1 = _mm256_fmadd_ps(d1, d1, a1);
+            a2 = _mm256_fmadd_ps(d2, d2, a2);
+            a3 = _mm256_fmadd_ps(d3, d3, a3);
+        }
+        for (; i + 8 <= n; i += 8)
+        {
+            d0 = _mm256_sub_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i]));
+            a0 = _mm256_fmadd_ps(d0, d0, a0);
+        }
+        float sum = r2__hsum_avx(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)));
+        for (; i < n; i++)
+        {
+            float d = v1[i] - v2[i];
+            sum += d * d;
+        }
+        return sum;
     }
-    static float vec3_dist_sqrd(const vec3 *v1, const vec3 *v2)
+
+    R2_TARGET_AVX2 static float r2__sum_avx2(const float *v, int n)
     {
-        return vecn_dist_sqrd(v1->a_vec, v2->a_vec, 3);
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            a0 = _mm256_add_ps(a0, _mm256_loadu_ps(&v[i]));
+            a1 = _mm256_add_ps(a1, _mm256_loadu_ps(&v[i + 8]));
+            a2 = _mm256_add_ps(a2, _mm256_loadu_ps(&v[i + 16]));
+            a3 = _mm256_add_ps(a3, _mm256_loadu_ps(&v[i + 24]));
+        }
+        for (; i + 8 <= n; i += 8)
+            a0 = _mm256_add_ps(a0, _mm256_loadu_ps(&v[i]));
+        float sum = r2__hsum_avx(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)));
+        for (; i < n; i++)
+            sum += v[i];
+        return sum;
     }
-    static float vec3_dist(const vec3 *v1, const vec3 *v2)
+
+    R2_TARGET_AVX2 static void r2__minmax_avx2(const float *v, int n, float *min, float *max)
     {
-        return vecn_dist(v1->a_vec, v2->a_vec, 3);
+        __m256 lo0 = _mm256_set1_ps(INFINITY), lo1 = lo0;
+        __m256 hi0 = _mm256_set1_ps(-INFINITY), hi1 = hi0;
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256 x0 = _mm256_loadu_ps(&v[i]);
+            __m256 x1 = _mm256_loadu_ps(&v[i + 8]);
+            lo0 = _mm256_min_ps(x0, lo0);
+            lo1 = _mm256_min_ps(x1, lo1);
+            hi0 = _mm256_max_ps(x0, hi0);
+            hi1 = _mm256_max_ps(x1, hi1);
+        }
+        __m256 lo = _mm256_min_ps(lo0, lo1);
+        __m256 hi = _mm256_max_ps(hi0, hi1);
+        float l = r2__hmin_sse(_mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1)));
+        float h = r2__hmax_sse(_mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1)));
+        for (; i < n; i++)
+        {
+            l = fminf(l, v[i]);
+            h = fmaxf(h, v[i]);
+        }
+        *min = l;
+        *max = h;
     }
-    static void vec3_normalize(const vec3 *v, vec3 *out)
+
+    R2_TARGET_AVX2 static void r2__axpby_avx2(float a, const float *x, float b, const float *y, int n, float *out)
     {
-        vecn_normalize(v->a_vec, 3, out->a_vec);
+        __m256 va = _mm256_set1_ps(a);
+        __m256 vb = _mm256_set1_ps(b);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i],
+                             _mm256_fmadd_ps(va, _mm256_loadu_ps(&x[i]), _mm256_mul_ps(vb, _mm256_loadu_ps(&y[i]))));
+        for (; i < n; i++)
+            out[i] = a * x[i] + b * y[i];
     }
 
-    static void vec3_cross(const vec3 *v1, const vec3 *v2, vec3 *out)
+    R2_TARGET_AVX2 static void r2__fma_avx2(const float *v1, const float *v2, const float *v3, int n, float *out)
     {
-        out->x = (v1->y * v2->z) - (v1->z * v2->y);
-        out->y = (v1->z * v2->x) - (v1->x * v2->z);
-        out->z = (v1->x * v2->y) - (v1->y * v2->x);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_fmadd_ps(_mm256_loadu_ps(&v1[i]), _mm256_loadu_ps(&v2[i]),
+                                                      _mm256_loadu_ps(&v3[i])));
+        for (; i < n; i++)
+            out[i] = v1[i] * v2[i] + v3[i];
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Vec4
-
-    static void vec4_zero(vec4 *out)
+    R2_TARGET_AVX2 static void r2__scale_add_avx2(const float *v, float fac, float add, int n, float *out)
     {
-        vecn_zero(out->a_vec, 4);
+        __m256 f = _mm256_set1_ps(fac);
+        __m256 d = _mm256_set1_ps(add);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_fmadd_ps(_mm256_loadu_ps(&v[i]), f, d));
+        for (; i < n; i++)
+            out[i] = v[i] * fac + add;
     }
-    static bool vec4_equals(const vec4 *v1, const vec4 *v2)
+
+    R2_TARGET_AVX2 static void r2__mat_mul_avx2(const float *m1, const float *m2, unsigned int r1, unsigned int c1,
+                                                unsigned int c2, float *out)
     {
-        return vecn_equals(v1->a_vec, v2->a_vec, 4);
+        unsigned int i, j, k;
+        for (i = 0; i < r1; i++)
+        {
+            const float *a = &m1[i * c1];
+            float *o = &out[i * c2];
+            for (j = 0; j + 32 <= c2; j += 32)
+            {
+                __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+                __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+                for (k = 0; k < c1; k++)
+                {
+                    __m256 f = _mm256_set1_ps(a[k]);
+                    const float *b = &m2[k * c2 + j];
+                    s0 = _mm256_fmadd_ps(f, _mm256_loadu_ps(b), s0);
+                    s1 = _mm256_fmadd_ps(f, _mm256_loadu_ps(b + 8), s1);
+                    s2 = _mm256_fmadd_ps(f, _mm256_loadu_ps(b + 16), s2);
+                    s3 = _mm256_fmadd_ps(f, _mm256_loadu_ps(b + 24), s3);
+                }
+                _mm256_storeu_ps(o + j, s0);
+                _mm256_storeu_ps(o + j + 8, s1);
+                _mm256_storeu_ps(o + j + 16, s2);
+                _mm256_storeu_ps(o + j + 24, s3);
+            }
+            for (; j + 8 <= c2; j += 8)
+            {
+                __m256 s0 = _mm256_setzero_ps();
+                for (k = 0; k < c1; k++)
+                    s0 = _mm256_fmadd_ps(_mm256_set1_ps(a[k]), _mm256_loadu_ps(&m2[k * c2 + j]), s0);
+                _mm256_storeu_ps(o + j, s0);
+            }
+            for (; j < c2; j++)
+            {
+                float sum = 0.f;
+                for (k = 0; k < c1; k++)
+                    sum += a[k] * m2[k * c2 + j];
+                o[j] = sum;
+            }
+        }
     }
 
-    static void vec4_set(const float ary[4], vec4 *v)
+    // 6x16: 12 accumulators + 2 b vectors + 1 broadcast of the 16 ymm registers
+    R2_TARGET_AVX2 static void r2__gemm_6x16_avx2(int kc, const float *a, const float *b, float *c, int ldc,
+                                                  int acc)
     {
-        v->x = ary[0];
-        v->y = ary[1];
-        v->z = ary[2];
-        v->w = ary[3];
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+        int k;
+        for (k = 0; k < kc; k++, a += 6, b += 16)
+        {
+            __m256 b0 = _mm256_loadu_ps(b);
+            __m256 b1 = _mm256_loadu_ps(b + 8);
+            __m256 ai = _mm256_broadcast_ss(&a[0]);
+            c00 = _mm256_fmadd_ps(ai, b0, c00);
+            c01 = _mm256_fmadd_ps(ai, b1, c01);
+            ai = _mm256_broadcast_ss(&a[1]);
+            c10 = _mm256_fmadd_ps(ai, b0, c10);
+            c11 = _mm256_fmadd_ps(ai, b1, c11);
+            ai = _mm256_broadcast_ss(&a[2]);
+            c20 = _mm256_fmadd_ps(ai, b0, c20);
+            c21 = _mm256_fmadd_ps(ai, b1, c21);
+            ai = _mm256_broadcast_ss(&a[3]);
+            c30 = _mm256_fmadd_ps(ai, b0, c30);
+            c31 = _mm256_fmadd_ps(ai, b1, c31);
+            ai = _mm256_broadcast_ss(&a[4]);
+            c40 = _mm256_fmadd_ps(ai, b0, c40);
+            c41 = _mm256_fmadd_ps(ai, b1, c41);
+            ai = _mm256_broadcast_ss(&a[5]);
+            c50 = _mm256_fmadd_ps(ai, b0, c50);
+            c51 = _mm256_fmadd_ps(ai, b1, c51);
+        }
+        if (acc)
+        {
+            c00 = _mm256_add_ps(c00, _mm256_loadu_ps(&c[0 * ldc]));
+            c01 = _mm256_add_ps(c01, _mm256_loadu_ps(&c[0 * ldc + 8]));
+            c10 = _mm256_add_ps(c10, _mm256_loadu_ps(&c[1 * ldc]));
+            c11 = _mm256_add_ps(c11, _mm256_loadu_ps(&c[1 * ldc + 8]));
+            c20 = _mm256_add_ps(c20, _mm256_loadu_ps(&c[2 * ldc]));
+            c21 = _mm256_add_ps(c21, _mm256_loadu_ps(&c[2 * ldc + 8]));
+            c30 = _mm256_add_ps(c30, _mm256_loadu_ps(&c[3 * ldc]));
+            c31 = _mm256_add_ps(c31, _mm256_loadu_ps(&c[3 * ldc + 8]));
+            c40 = _mm256_add_ps(c40, _mm256_loadu_ps(&c[4 * ldc]));
+            c41 = _mm256_add_ps(c41, _mm256_loadu_ps(&c[4 * ldc + 8]));
+            c50 = _mm256_add_ps(c50, _mm256_loadu_ps(&c[5 * ldc]));
+            c51 = _mm256_add_ps(c51, _mm256_loadu_ps(&c[5 * ldc + 8]));
+        }
+        _mm256_storeu_ps(&c[0 * ldc], c00);
+        _mm256_storeu_ps(&c[0 * ldc + 8], c01);
+        _mm256_storeu_ps(&c[1 * ldc], c10);
+        _mm256_storeu_ps(&c[1 * ldc + 8], c11);
+        _mm256_storeu_ps(&c[2 * ldc], c20);
+        _mm256_storeu_ps(&c[2 * ldc + 8], c21);
+        _mm256_storeu_ps(&c[3 * ldc], c30);
+        _mm256_storeu_ps(&c[3 * ldc + 8], c31);
+        _mm256_storeu_ps(&c[4 * ldc], c40);
+        _mm256_storeu_ps(&c[4 * ldc + 8], c41);
+        _mm256_storeu_ps(&c[5 * ldc], c50);
+        _mm256_storeu_ps(&c[5 * ldc + 8], c51);
     }
 
-    static void vec4_add(const vec4 *v1, const vec4 *v2, vec4 *out)
+    R2_TARGET_AVX2 static void r2__from_f16_avx2(const f16 *v, int n, float *out)
     {
-        vecn_add(v1->a_vec, v2->a_vec, 4, out->a_vec);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&v[i])));
+        for (; i < n; i++)
+            out[i] = f16_to_float(v[i]);
     }
-    static void vec4_sub(const vec4 *v1, const vec4 *v2, vec4 *out)
+
+    R2_TARGET_AVX2 static void r2__to_f16_avx2(const float *v, int n, f16 *out)
     {
-        vecn_sub(v1->a_vec, v2->a_vec, 4, out->a_vec);
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *)&out[i], _mm256_cvtps_ph(_mm256_loadu_ps(&v[i]), _MM_FROUND_TO_NEAREST_INT));
+        for (; i < n; i++)
+            out[i] = float_to_f16(v[i]);
     }
-    static void vec4_div(const vec4 *v, float fac, vec4 *out)
+
+    R2_TARGET_AVX2 static float r2__dot_f16_avx2(const f16 *v1, const f16 *v2, int n)
     {
-        vecn_div(v->a_vec, fac, 4, out->a_vec);
+        __m256 acc = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 a = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&v1[i]));
+            __m256 b = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&v2[i]));
+            acc = _mm256_fmadd_ps(a, b, acc);
+        }
+        float sum = r2__hsum_avx(acc);
+        for (; i < n; i++)
+            sum += f16_to_float(v1[i]) * f16_to_float(v2[i]);
+        return sum;
     }
-    static void vec4_mul(const vec4 *v, float fac, vec4 *out)
+
+    R2_TARGET_AVX2 static float r2__dist_sqrd_f16_avx2(const f16 *v1, const f16 *v2, int n)
     {
-        vecn_mul(v->a_vec, fac, 4, out->a_vec);
+        __m256 acc = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&v1[i])),
+                                     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&v2[i])));
+            acc = _mm256_fmadd_ps(d, d, acc);
+        }
+        float sum = r2__hsum_avx(acc);
+        for (; i < n; i++)
+        {
+            float d = f16_to_float(v1[i]) - f16_to_float(v2[i]);
+            sum += d * d;
+        }
+        return sum;
     }
-    static void vec4_mul_vec4(const vec4 *v1, const vec4 *v2, vec4 *out)
+
+    // pmaddubsw multiplies unsigned by signed bytes, so move the sign of v1
+    // onto v2 and use |v1|. Pairs of products sum to at most 2 * 127 * 127,
+    // which is why -128 is not allowed (it would saturate the 16 bit sums).
+    R2_TARGET_AVX2 static int32_t r2__dot_i8_avx2(const int8_t *v1, const int8_t *v2, int n)
     {
-        vecn_mul_vec(v1->a_vec, v2->a_vec, 4, out->a_vec);
+        __m256i ones = _mm256_set1_epi16(1);
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)&v1[i]);
+            __m256i b = _mm256_loadu_si256((const __m256i *)&v2[i]);
+            __m256i p = _mm256_maddubs_epi16(_mm256_sign_epi8(a, a), _mm256_sign_epi8(b, a));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, ones));
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+        int32_t sum = _mm_cvtsi128_si32(s);
+        for (; i < n; i++)
+            sum += (int32_t)v1[i] * v2[i];
+        return sum;
     }
-    static void vec4_pow(const vec4 *v, float exp, vec4 *out)
+
+    // The transcendentals again at AVX2 + FMA width, the AVX-512 table
+    // shares them. r2_vf and its macros are swapped out for the pass and
+    // put back after it.
+  #pragma push_macro("R2_FMA")
+  #pragma push_macro("R2_VF_N")
+  #pragma push_macro("R2_VF_LOAD")
+  #pragma push_macro("R2_VF_STORE")
+  #pragma push_macro("R2_VF_SET1")
+  #pragma push_macro("R2_VF_ADD")
+  #pragma push_macro("R2_VF_SUB")
+  #pragma push_macro("R2_VF_MUL")
+  #pragma push_macro("R2_VF_DIV")
+  #pragma push_macro("R2_VF_MIN")
+  #pragma push_macro("R2_VF_MAX")
+  #pragma push_macro("R2_VF_AND")
+  #pragma push_macro("R2_VF_OR")
+  #pragma push_macro("R2_VF_XOR")
+  #pragma push_macro("R2_VF_GE")
+  #pragma push_macro("R2_VF_LT")
+  #pragma push_macro("R2_VF_EQ")
+  #pragma push_macro("R2_VF_SELECT")
+  #pragma push_macro("R2_VF_MADD")
+  #pragma push_macro("R2_VF_TO_VI")
+  #pragma push_macro("R2_VF_TRUNC_VI")
+  #pragma push_macro("R2_VF_AS_VI")
+  #pragma push_macro("R2_VI_SET1")
+  #pragma push_macro("R2_VI_ADD")
+  #pragma push_macro("R2_VI_SUB")
+  #pragma push_macro("R2_VI_AND")
+  #pragma push_macro("R2_VI_EQ")
+  #pragma push_macro("R2_VI_SLLI")
+  #pragma push_macro("R2_VI_SRLI")
+  #pragma push_macro("R2_VI_SRAI")
+  #pragma push_macro("R2_VI_TO_VF")
+  #pragma push_macro("R2_VI_AS_VF")
+  #undef R2_FMA
+  #undef R2_VF_N
+  #undef R2_VF_LOAD
+  #undef R2_VF_STORE
+  #undef R2_VF_SET1
+  #undef R2_VF_ADD
+  #undef R2_VF_SUB
+  #undef R2_VF_MUL
+  #undef R2_VF_DIV
+  #undef R2_VF_MIN
+  #undef R2_VF_MAX
+  #undef R2_VF_AND
+  #undef R2_VF_OR
+  #undef R2_VF_XOR
+  #undef R2_VF_GE
+  #undef R2_VF_LT
+  #undef R2_VF_EQ
+  #undef R2_VF_SELECT
+  #undef R2_VF_MADD
+  #undef R2_VF_TO_VI
+  #undef R2_VF_TRUNC_VI
+  #undef R2_VF_AS_VI
+  #undef R2_VI_SET1
+  #undef R2_VI_ADD
+  #undef R2_VI_SUB
+  #undef R2_VI_AND
+  #undef R2_VI_EQ
+  #undef R2_VI_SLLI
+  #undef R2_VI_SRLI
+  #undef R2_VI_SRAI
+  #undef R2_VI_TO_VF
+  #undef R2_VI_AS_VF
+  #define R2_FMA
+  #define r2_vf __m256
+  #define r2_vi __m256i
+  #define R2_VF_N 8
+  #define R2_VF_LOAD(p) _mm256_loadu_ps(p)
+  #define R2_VF_STORE(p, a) _mm256_storeu_ps((p), (a))
+  #define R2_VF_SET1(f) _mm256_set1_ps(f)
+  #define R2_VF_ADD(a, b) _mm256_add_ps((a), (b))
+  #define R2_VF_SUB(a, b) _mm256_sub_ps((a), (b))
+  #define R2_VF_MUL(a, b) _mm256_mul_ps((a), (b))
+  #define R2_VF_DIV(a, b) _mm256_div_ps((a), (b))
+  #define R2_VF_MIN(a, b) _mm256_min_ps((a), (b))
+  #define R2_VF_MAX(a, b) _mm256_max_ps((a), (b))
+  #define R2_VF_AND(a, b) _mm256_and_ps((a), (b))
+  #define R2_VF_OR(a, b) _mm256_or_ps((a), (b))
+  #define R2_VF_XOR(a, b) _mm256_xor_ps((a), (b))
+  #define R2_VF_GE(a, b) _mm256_cmp_ps((a), (b), _CMP_GE_OQ)
+  #define R2_VF_LT(a, b) _mm256_cmp_ps((a), (b), _CMP_LT_OQ)
+  #define R2_VF_EQ(a, b) _mm256_cmp_ps((a), (b), _CMP_EQ_OQ)
+  #define R2_VF_SELECT(m, a, b) _mm256_blendv_ps((b), (a), (m))
+  #define R2_VF_MADD(a, b, c) _mm256_fmadd_ps((a), (b), (c))
+  #define R2_VF_TO_VI(a) _mm256_cvtps_epi32(a)
+  #define R2_VF_TRUNC_VI(a) _mm256_cvttps_epi32(a)
+  #define R2_VF_AS_VI(a) _mm256_castps_si256(a)
+  #define R2_VI_SET1(i) _mm256_set1_epi32(i)
+  #define R2_VI_ADD(a, b) _mm256_add_epi32((a), (b))
+  #define R2_VI_SUB(a, b) _mm256_sub_epi32((a), (b))
+  #define R2_VI_AND(a, b) _mm256_and_si256((a), (b))
+  #define R2_VI_EQ(a, b) _mm256_cmpeq_epi32((a), (b))
+  #define R2_VI_SLLI(a, n) _mm256_slli_epi32((a), (n))
+  #define R2_VI_SRLI(a, n) _mm256_srli_epi32((a), (n))
+  #define R2_VI_SRAI(a, n) _mm256_srai_epi32((a), (n))
+  #define R2_VI_TO_VF(a) _mm256_cvtepi32_ps(a)
+  #define R2_VI_AS_VF(a) _mm256_castsi256_ps(a)
+  #define R2__VM(name) name##_avx2
+  #define R2__VM_TARGET R2_TARGET_AVX2
+  #define R2__VMATH_PASS
+  #include "r2_maths.h"
+  #undef R2__VMATH_PASS
+  #undef R2__VM_TARGET
+  #undef R2__VM
+  #undef r2_vf
+  #undef r2_vi
+  #undef R2_FMA
+  #undef R2_VF_N
+  #undef R2_VF_LOAD
+  #undef R2_VF_STORE
+  #undef R2_VF_SET1
+  #undef R2_VF_ADD
+  #undef R2_VF_SUB
+  #undef R2_VF_MUL
+  #undef R2_VF_DIV
+  #undef R2_VF_MIN
+  #undef R2_VF_MAX
+  #undef R2_VF_AND
+  #undef R2_VF_OR
+  #undef R2_VF_XOR
+  #undef R2_VF_GE
+  #undef R2_VF_LT
+  #undef R2_VF_EQ
+  #undef R2_VF_SELECT
+  #undef R2_VF_MADD
+  #undef R2_VF_TO_VI
+  #undef R2_VF_TRUNC_VI
+  #undef R2_VF_AS_VI
+  #undef R2_VI_SET1
+  #undef R2_VI_ADD
+  #undef R2_VI_SUB
+  #undef R2_VI_AND
+  #undef R2_VI_EQ
+  #undef R2_VI_SLLI
+  #undef R2_VI_SRLI
+  #undef R2_VI_SRAI
+  #undef R2_VI_TO_VF
+  #undef R2_VI_AS_VF
+  #pragma pop_macro("R2_FMA")
+  #pragma pop_macro("R2_VF_N")
+  #pragma pop_macro("R2_VF_LOAD")
+  #pragma pop_macro("R2_VF_STORE")
+  #pragma pop_macro("R2_VF_SET1")
+  #pragma pop_macro("R2_VF_ADD")
+  #pragma pop_macro("R2_VF_SUB")
+  #pragma pop_macro("R2_VF_MUL")
+  #pragma pop_macro("R2_VF_DIV")
+  #pragma pop_macro("R2_VF_MIN")
+  #pragma pop_macro("R2_VF_MAX")
+  #pragma pop_macro("R2_VF_AND")
+  #pragma pop_macro("R2_VF_OR")
+  #pragma pop_macro("R2_VF_XOR")
+  #pragma pop_macro("R2_VF_GE")
+  #pragma pop_macro("R2_VF_LT")
+  #pragma pop_macro("R2_VF_EQ")
+  #pragma pop_macro("R2_VF_SELECT")
+  #pragma pop_macro("R2_VF_MADD")
+  #pragma pop_macro("R2_VF_TO_VI")
+  #pragma pop_macro("R2_VF_TRUNC_VI")
+  #pragma pop_macro("R2_VF_AS_VI")
+  #pragma pop_macro("R2_VI_SET1")
+  #pragma pop_macro("R2_VI_ADD")
+  #pragma pop_macro("R2_VI_SUB")
+  #pragma pop_macro("R2_VI_AND")
+  #pragma pop_macro("R2_VI_EQ")
+  #pragma pop_macro("R2_VI_SLLI")
+  #pragma pop_macro("R2_VI_SRLI")
+  #pragma pop_macro("R2_VI_SRAI")
+  #pragma pop_macro("R2_VI_TO_VF")
+  #pragma pop_macro("R2_VI_AS_VF")
+
+    static const r2_kernels r2__kernels_avx2 = {
+        R2_SIMD_AVX2,         r2__add_avx2,       r2__sub_avx2,             r2__mul_vec_avx2,
+        r2__mul_avx2,         r2__dot_avx2,       r2__dist_sqrd_avx2,       r2__sum_avx2,
+        r2__minmax_avx2,      r2__axpby_avx2,     r2__fma_avx2,             r2__scale_add_avx2,
+        r2__mat_mul_avx2,     6,                  16,                       r2__gemm_6x16_avx2,
+        r2__from_f16_avx2,    r2__to_f16_avx2,    r2__dot_f16_avx2,         r2__dist_sqrd_f16_avx2,
+        r2__dot_i8_avx2,      r2__exp_avx2,       r2__log_avx2,             r2__tanh_avx2,
+        r2__sin_avx2,         r2__cos_avx2,       r2__sincos_avx2,          r2__pow_avx2,
+    };
+
+    // avx-512f, the tails use masked loads and stores instead of a scalar loop
+
+    R2_TARGET_AVX512 static __mmask16 r2__tail_mask(int n)
     {
-        vecn_pow(v->a_vec, exp, 4, out->a_vec);
+        return (__mmask16)((1u << n) - 1u);
     }
-    static void vec4_abs(const vec4 *v, vec4 *out)
+
+    R2_TARGET_AVX512 static void r2__add_avx512(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_abs(v->a_vec, 4, out->a_vec);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_add_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i])));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 r = _mm512_add_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]));
+            _mm512_mask_storeu_ps(&out[i], m, r);
+        }
     }
-    static void vec4_sqrt(const vec4 *v, vec4 *out)
+
+    R2_TARGET_AVX512 static void r2__sub_avx512(const float *v1, const float *v2, int n, float *out)
     {
-        vecn_sqrt(v->a_vec, 4, out->a_vec);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_sub_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i])));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 r = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]));
+            _mm512_mask_storeu_ps(&out[i], m, r);
+        }
     }
-    static float vec4_dot(const vec4 *v1, const vec4 *v2)
+
+    R2_TARGET_AVX512 static void r2__mul_vec_avx512(const float *v1, const float *v2, int n, float *out)
     {
-        return vecn_dot(v1->a_vec, v2->a_vec, 4);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_mul_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i])));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 r = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]));
+            _mm512_mask_storeu_ps(&out[i], m, r);
+        }
     }
-    static float vec4_length_sqrd(const vec4 *v)
+
+    R2_TARGET_AVX512 static void r2__mul_avx512(const float *v, float fac, int n, float *out)
     {
-        return vecn_length_sqrd(v->a_vec, 4);
+        __m512 f = _mm512_set1_ps(fac);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_mul_ps(_mm512_loadu_ps(&v[i]), f));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            _mm512_mask_storeu_ps(&out[i], m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &v[i]), f));
+        }
     }
-    static float vec4_length(const vec4 *v)
+
+    R2_TARGET_AVX512 static float r2__dot_avx512(const float *v1, const float *v2, int n)
     {
-        return vecn_length(v->a_vec, 4);
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            a0 = _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i]), a0);
+            a1 = _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i + 16]), _mm512_loadu_ps(&v2[i + 16]), a1);
+            a2 = _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i + 32]), _mm512_loadu_ps(&v2[i + 32]), a2);
+            a3 = _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i + 48]), _mm512_loadu_ps(&v2[i + 48]), a3);
+        }
+        for (; i + 16 <= n; i += 16)
+            a0 = _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i]), a0);
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            a1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]), a1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(a0, a1), _mm512_add_ps(a2, a3)));
     }
-    static float vec4_dist_sqrd(const vec4 *v1, const vec4 *v2)
+
+    R2_TARGET_AVX512 static float r2__dist_sqrd_avx512(const float *v1, const float *v2, int n)
     {
-        return vecn_dist_sqrd(v1->a_vec, v2->a_vec, 4);
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        __m512 d0, d1, d2, d3;
+        int i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            d0 = _mm512_sub_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i]));
+            d1 = _mm512_sub_ps(_mm512_loadu_ps(&v1[i + 16]), _mm512_loadu_ps(&v2[i + 16]));
+            d2 = _mm512_sub_ps(_mm512_loadu_ps(&v1[i + 32]), _mm512_loadu_ps(&v2[i + 32]));
+            d3 = _mm512_sub_ps(_mm512_loadu_ps(&v1[i + 48]), _mm512_loadu_ps(&v2[i + 48]));
+            a0 = _mm512_fmadd_ps(d0, d0, a0);
+            a1 = _mm512_fmadd_ps(d1, d1, a1);
+            a2 = _mm512_fmadd_ps(d2, d2, a2);
+            a3 = _mm512_fmadd_ps(d3, d3, a3);
+        }
+        for (; i + 16 <= n; i += 16)
+        {
+            d0 = _mm512_sub_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i]));
+            a0 = _mm512_fmadd_ps(d0, d0, a0);
+        }
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            d1 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]));
+            a1 = _mm512_fmadd_ps(d1, d1, a1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(a0, a1), _mm512_add_ps(a2, a3)));
     }
-    static float vec4_dist(const vec4 *v1, const vec4 *v2)
+
+    R2_TARGET_AVX512 static float r2__sum_avx512(const float *v, int n)
     {
-        return vecn_dist(v1->a_vec, v2->a_vec, 4);
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            a0 = _mm512_add_ps(a0, _mm512_loadu_ps(&v[i]));
+            a1 = _mm512_add_ps(a1, _mm512_loadu_ps(&v[i + 16]));
+            a2 = _mm512_add_ps(a2, _mm512_loadu_ps(&v[i + 32]));
+            a3 = _mm512_add_ps(a3, _mm512_loadu_ps(&v[i + 48]));
+        }
+        for (; i + 16 <= n; i += 16)
+            a0 = _mm512_add_ps(a0, _mm512_loadu_ps(&v[i]));
+        if (i < n)
+            a1 = _mm512_add_ps(a1, _mm512_maskz_loadu_ps(r2__tail_mask(n - i), &v[i]));
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(a0, a1), _mm512_add_ps(a2, a3)));
     }
-    static void vec4_normalize(const vec4 *v, vec4 *out)
+
+    R2_TARGET_AVX512 static void r2__minmax_avx512(const float *v, int n, float *min, float *max)
     {
-        vecn_normalize(v->a_vec, 4, out->a_vec);
+        __m512 lo0 = _mm512_set1_ps(INFINITY), lo1 = lo0;
+        __m512 hi0 = _mm512_set1_ps(-INFINITY), hi1 = hi0;
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m512 x0 = _mm512_loadu_ps(&v[i]);
+            __m512 x1 = _mm512_loadu_ps(&v[i + 16]);
+            lo0 = _mm512_min_ps(x0, lo0);
+            lo1 = _mm512_min_ps(x1, lo1);
+            hi0 = _mm512_max_ps(x0, hi0);
+            hi1 = _mm512_max_ps(x1, hi1);
+        }
+        for (; i + 16 <= n; i += 16)
+        {
+            __m512 x0 = _mm512_loadu_ps(&v[i]);
+            lo0 = _mm512_min_ps(x0, lo0);
+            hi0 = _mm512_max_ps(x0, hi0);
+        }
+        if (i < n)
+        {
+            // only the lanes in the mask are updated
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 x1 = _mm512_maskz_loadu_ps(m, &v[i]);
+            lo1 = _mm512_mask_min_ps(lo1, m, x1, lo1);
+            hi1 = _mm512_mask_max_ps(hi1, m, x1, hi1);
+        }
+        *min = _mm512_reduce_min_ps(_mm512_min_ps(lo0, lo1));
+        *max = _mm512_reduce_max_ps(_mm512_max_ps(hi0, hi1));
     }
 
-    static char *vec4_tos(const quat *q)
+    R2_TARGET_AVX512 static void r2__axpby_avx512(float a, const float *x, float b, const float *y, int n,
+                                                  float *out)
     {
-        char *out = calloc(sizeof(char), 60);
-        snprintf(out, 50, "(%f, %f, %f, %f)\n", q->x, q->y, q->z, q->w);
-        return out;
+        __m512 va = _mm512_set1_ps(a);
+        __m512 vb = _mm512_set1_ps(b);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i],
+                             _mm512_fmadd_ps(va, _mm512_loadu_ps(&x[i]), _mm512_mul_ps(vb, _mm512_loadu_ps(&y[i]))));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 r = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, &x[i]),
+                                       _mm512_mul_ps(vb, _mm512_maskz_loadu_ps(m, &y[i])));
+            _mm512_mask_storeu_ps(&out[i], m, r);
+        }
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Quat
-    // http://www.tobynorris.com/work/prog/csharp/quatview/help/orientations_and_quaternions.htm
-
-    static void quat_zero(quat *q)
+    R2_TARGET_AVX512 static void r2__fma_avx512(const float *v1, const float *v2, const float *v3, int n, float *out)
     {
-        q->x = 0.;
-        q->y = 0.;
-        q->z = 0.;
-        q->w = 0.;
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_fmadd_ps(_mm512_loadu_ps(&v1[i]), _mm512_loadu_ps(&v2[i]),
+                                                      _mm512_loadu_ps(&v3[i])));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            __m512 r = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, &v1[i]), _mm512_maskz_loadu_ps(m, &v2[i]),
+                                       _mm512_maskz_loadu_ps(m, &v3[i]));
+            _mm512_mask_storeu_ps(&out[i], m, r);
+        }
     }
 
-    static void quat_identity(quat *q)
+    R2_TARGET_AVX512 static void r2__scale_add_avx512(const float *v, float fac, float add, int n, float *out)
     {
-        q->x = 0.;
-        q->y = 0.;
-        q->z = 0.;
-        q->w = 1.;
+        __m512 f = _mm512_set1_ps(fac);
+        __m512 d = _mm512_set1_ps(add);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_fmadd_ps(_mm512_loadu_ps(&v[i]), f, d));
+        if (i < n)
+        {
+            __mmask16 m = r2__tail_mask(n - i);
+            _mm512_mask_storeu_ps(&out[i], m, _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, &v[i]), f, d));
+        }
     }
 
-    static void quat_add(const quat *q1, const quat *q2, quat *out)
+    R2_TARGET_AVX512 static void r2__mat_mul_avx512(const float *m1, const float *m2, unsigned int r1,
+                                                    unsigned int c1, unsigned int c2, float *out)
     {
-        vec4_add(q1, q2, out);
+        unsigned int i, j, k;
+        for (i = 0; i < r1; i++)
+        {
+            const float *a = &m1[i * c1];
+            float *o = &out[i * c2];
+            for (j = 0; j + 64 <= c2; j += 64)
+            {
+                __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+                __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+                for (k = 0; k < c1; k++)
+                {
+                    __m512 f = _mm512_set1_ps(a[k]);
+                    const float *b = &m2[k * c2 + j];
+                    s0 = _mm512_fmadd_ps(f, _mm512_loadu_ps(b), s0);
+                    s1 = _mm512_fmadd_ps(f, _mm512_loadu_ps(b + 16), s1);
+                    s2 = _mm512_fmadd_ps(f, _mm512_loadu_ps(b + 32), s2);
+                    s3 = _mm512_fmadd_ps(f, _mm512_loadu_ps(b + 48), s3);
+                }
+                _mm512_storeu_ps(o + j, s0);
+                _mm512_storeu_ps(o + j + 16, s1);
+                _mm512_storeu_ps(o + j + 32, s2);
+                _mm512_storeu_ps(o + j + 48, s3);
+            }
+            for (; j < c2; j += 16)
+            {
+                __mmask16 m = r2__tail_mask((c2 - j < 16) ? (int)(c2 - j) : 16);
+                __m512 s0 = _mm512_setzero_ps();
+                for (k = 0; k < c1; k++)
+                    s0 = _mm512_fmadd_ps(_mm512_set1_ps(a[k]), _mm512_maskz_loadu_ps(m, &m2[k * c2 + j]), s0);
+                _mm512_mask_storeu_ps(o + j, m, s0);
+            }
+        }
     }
 
-    static void quat_sub(const quat *q1, const quat *q2, quat *out)
+    // 8x32: 16 accumulators, the other half of the 32 zmm registers is spare
+    R2_TARGET_AVX512 static void r2__gemm_8x32_avx512(int kc, const float *a, const float *b, float *c, int ldc,
+                                                      int acc)
     {
-        vec4_sub(q1, q2, out);
+        __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+        __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+        __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+        __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+        __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+        __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+        __m512 c60 = _mm512_setzero_ps(), c61 = _mm512_setzero_ps();
+        __m512 c70 = _mm512_setzero_ps(), c71 = _mm512_setzero_ps();
+        int k;
+        for (k = 0; k < kc; k++, a += 8, b += 32)
+        {
+            __m512 b0 = _mm512_loadu_ps(b);
+            __m512 b1 = _mm512_loadu_ps(b + 16);
+            __m512 ai = _mm512_set1_ps(a[0]);
+            c00 = _mm512_fmadd_ps(ai, b0, c00);
+            c01 = _mm512_fmadd_ps(ai, b1, c01);
+            ai = _mm512_set1_ps(a[1]);
+            c10 = _mm512_fmadd_ps(ai, b0, c10);
+            c11 = _mm512_fmadd_ps(ai, b1, c11);
+            ai = _mm512_set1_ps(a[2]);
+            c20 = _mm512_fmadd_ps(ai, b0, c20);
+            c21 = _mm512_fmadd_ps(ai, b1, c21);
+            ai = _mm512_set1_ps(a[3]);
+            c30 = _mm512_fmadd_ps(ai, b0, c30);
+            c31 = _mm512_fmadd_ps(ai, b1, c31);
+            ai = _mm512_set1_ps(a[4]);
+            c40 = _mm512_fmadd_ps(ai, b0, c40);
+            c41 = _mm512_fmadd_ps(ai, b1, c41);
+            ai = _mm512_set1_ps(a[5]);
+            c50 = _mm512_fmadd_ps(ai, b0, c50);
+            c51 = _mm512_fmadd_ps(ai, b1, c51);
+            ai = _mm512_set1_ps(a[6]);
+            c60 = _mm512_fmadd_ps(ai, b0, c60);
+            c61 = _mm512_fmadd_ps(ai, b1, c61);
+            ai = _mm512_set1_ps(a[7]);
+            c70 = _mm512_fmadd_ps(ai, b0, c70);
+            c71 = _mm512_fmadd_ps(ai, b1, c71);
+        }
+        if (acc)
+        {
+            c00 = _mm512_add_ps(c00, _mm512_loadu_ps(&c[0 * ldc]));
+            c01 = _mm512_add_ps(c01, _mm512_loadu_ps(&c[0 * ldc + 16]));
+            c10 = _mm512_add_ps(c10, _mm512_loadu_ps(&c[1 * ldc]));
+            c11 = _mm512_add_ps(c11, _mm512_loadu_ps(&c[1 * ldc + 16]));
+            c20 = _mm512_add_ps(c20, _mm512_loadu_ps(&c[2 * ldc]));
+            c21 = _mm512_add_ps(c21, _mm512_loadu_ps(&c[2 * ldc + 16]));
+            c30 = _mm512_add_ps(c30, _mm512_loadu_ps(&c[3 * ldc]));
+            c31 = _mm512_add_ps(c31, _mm512_loadu_ps(&c[3 * ldc + 16]));
+            c40 = _mm512_add_ps(c40, _mm512_loadu_ps(&c[4 * ldc]));
+            c41 = _mm512_add_ps(c41, _mm512_loadu_ps(&c[4 * ldc + 16]));
+            c50 = _mm512_add_ps(c50, _mm512_loadu_ps(&c[5 * ldc]));
+            c51 = _mm512_add_ps(c51, _mm512_loadu_ps(&c[5 * ldc + 16]));
+            c60 = _mm512_add_ps(c60, _mm512_loadu_ps(&c[6 * ldc]));
+            c61 = _mm512_add_ps(c61, _mm512_loadu_ps(&c[6 * ldc + 16]));
+            c70 = _mm512_add_ps(c70, _mm512_loadu_ps(&c[7 * ldc]));
+            c71 = _mm512_add_ps(c71, _mm512_loadu_ps(&c[7 * ldc + 16]));
+        }
+        _mm512_storeu_ps(&c[0 * ldc], c00);
+        _mm512_storeu_ps(&c[0 * ldc + 16], c01);
+        _mm512_storeu_ps(&c[1 * ldc], c10);
+        _mm512_storeu_ps(&c[1 * ldc + 16], c11);
+        _mm512_storeu_ps(&c[2 * ldc], c20);
+        _mm512_storeu_ps(&c[2 * ldc + 16], c21);
+        _mm512_storeu_ps(&c[3 * ldc], c30);
+        _mm512_storeu_ps(&c[3 * ldc + 16], c31);
+        _mm512_storeu_ps(&c[4 * ldc], c40);
+        _mm512_storeu_ps(&c[4 * ldc + 16], c41);
+        _mm512_storeu_ps(&c[5 * ldc], c50);
+        _mm512_storeu_ps(&c[5 * ldc + 16], c51);
+        _mm512_storeu_ps(&c[6 * ldc], c60);
+        _mm512_storeu_ps(&c[6 * ldc + 16], c61);
+        _mm512_storeu_ps(&c[7 * ldc], c70);
+        _mm512_storeu_ps(&c[7 * ldc + 16], c71);
     }
 
-    static float quat_dot(const quat *q1, const quat *q2)
+    // 16 bit masked loads need AVX-512BW, so the f16 tails are scalar (and
+    // byte maths needs it too, so int8 stays on the AVX2 kernel)
+
+    R2_TARGET_AVX512 static void r2__from_f16_avx512(const f16 *v, int n, float *out)
     {
-        return vec4_dot(q1, q2);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(&out[i], _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&v[i])));
+        for (; i < n; i++)
+            out[i] = f16_to_float(v[i]);
     }
 
-    static float quat_length(const quat *q)
+    R2_TARGET_AVX512 static void r2__to_f16_avx512(const float *v, int n, f16 *out)
     {
-        return vec4_length(q);
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm256_storeu_si256((__m256i *)&out[i],
+                                _mm512_cvtps_ph(_mm512_loadu_ps(&v[i]), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        for (; i < n; i++)
+            out[i] = float_to_f16(v[i]);
     }
-    static float quat_magnitude(const quat *q)
+
+    R2_TARGET_AVX512 static float r2__dot_f16_avx512(const f16 *v1, const f16 *v2, int n)
     {
-        return quat_length(q);
+        __m512 acc = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m512 a = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&v1[i]));
+            __m512 b = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&v2[i]));
+            acc = _mm512_fmadd_ps(a, b, acc);
+        }
+        float sum = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++)
+            sum += f16_to_float(v1[i]) * f16_to_float(v2[i]);
+        return sum;
     }
 
-    static void quat_rot2q(const vec3 *axis, float theta, quat *out)
+    R2_TARGET_AVX512 static float r2__dist_sqrd_f16_avx512(const f16 *v1, const f16 *v2, int n)
     {
-        vec4_mul(axis, sinf(theta * .5), out);
-        float d = cosf(theta * .5);
-        out->w = d;
+        __m512 acc = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m512 d = _mm512_sub_ps(_mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&v1[i])),
+                                     _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&v2[i])));
+            acc = _mm512_fmadd_ps(d, d, acc);
+        }
+        float sum = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++)
+        {
+            float d = f16_to_float(v1[i]) - f16_to_float(v2[i]);
+            sum += d * d;
+        }
+        return sum;
     }
 
-    // Given a set of euler angles (in radians) create a quaternion
-    static void quat_from_euler(const vec3 *r, quat *q)
+    static const r2_kernels r2__kernels_avx512 = {
+        R2_SIMD_AVX512,       r2__add_avx512,     r2__sub_avx512,           r2__mul_vec_avx512,
+        r2__mul_avx512,       r2__dot_avx512,     r2__dist_sqrd_avx512,     r2__sum_avx512,
+        r2__minmax_avx512,    r2__axpby_avx512,   r2__fma_avx512,           r2__scale_add_avx512,
+        r2__mat_mul_avx512,   8,                  32,                       r2__gemm_8x32_avx512,
+        r2__from_f16_avx512,  r2__to_f16_avx512,  r2__dot_f16_avx512,       r2__dist_sqrd_f16_avx512,
+        r2__dot_i8_avx2,      r2__exp_avx2,       r2__log_avx2,             r2__tanh_avx2,
+        r2__sin_avx2,         r2__cos_avx2,       r2__sincos_avx2,          r2__pow_avx2,
+    };
+#endif
+
+    static const r2_kernels *__g_kernels = NULL;
+
+    // Best level this CPU (and build) can run
+    static r2_simd_level r2__simd_cpu(void)
+    {
+#if defined(R2_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return R2_SIMD_AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+            return R2_SIMD_AVX2;
+        return R2_SIMD_SSE;
+#elif defined(R2_SSE)
+        return R2_SIMD_SSE;
+#else
+        return R2_SIMD_SCALAR;
+#endif
+    }
+
+    static r2_simd_level r2_simd_set(r2_simd_level level)
+    {
+        r2_simd_level cpu = r2__simd_cpu();
+        if (level > cpu)
+            level = cpu;
+
+        switch (level)
+        {
+#ifdef R2_DISPATCH
+        case R2_SIMD_AVX512:
+            __g_kernels = &r2__kernels_avx512;
+            break;
+        case R2_SIMD_AVX2:
+            __g_kernels = &r2__kernels_avx2;
+            break;
+#endif
+#ifdef R2_SSE
+        case R2_SIMD_SSE:
+            __g_kernels = &r2__kernels_sse;
+            break;
+#endif
+        default:
+            __g_kernels = &r2__kernels_scalar;
+            break;
+        }
+        return __g_kernels->level;
+    }
+
+    static const r2_kernels *r2__kernels_init(void)
+    {
+        r2_simd_level level = R2_SIMD_AVX512;
+        const char *env = getenv("R2_SIMD");
+        if (env != NULL)
+        {
+            if (strcmp(env, "scalar") == 0)
+                level = R2_SIMD_SCALAR;
+            else if (strcmp(env, "sse") == 0)
+                level = R2_SIMD_SSE;
+            else if (strcmp(env, "avx2") == 0)
+                level = R2_SIMD_AVX2;
+            else if (strcmp(env, "avx512") == 0)
+                level = R2_SIMD_AVX512;
+        }
+        r2_simd_set(level);
+        return __g_kernels;
+    }
+
+    // The kernel table to use for a vector (or matrix row) of length n
+    static const r2_kernels *r2__kernels(int n)
+    {
+        if (n < R2_SIMD_MIN_N)
+            return &r2__kernels_scalar;
+        return (__g_kernels != NULL) ? __g_kernels : r2__kernels_init();
+    }
+
+    static r2_simd_level r2_simd_get(void)
+    {
+        return r2__kernels(R2_SIMD_MIN_N)->level;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Vecn — generic float* operations
+
+    static void vecn_zero(float *v, int n)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            v[i] = 0.f;
+    }
+
+    static bool vecn_equals(const float *v1, const float *v2, int n)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            if (!r2_equals(v1[i], v2[i]))
+                return false;
+        return true;
+    }
+
+    static void vecn_add(const float *v1, const float *v2, int n, float *out)
+    {
+        r2__kernels(n)->add(v1, v2, n, out);
+    }
+
+    static void vecn_sub(const float *v1, const float *v2, int n, float *out)
+    {
+        r2__kernels(n)->sub(v1, v2, n, out);
+    }
+
+    static void vecn_mul(const float *v, float fac, int n, float *out)
+    {
+#ifdef HAVE_BLAS
+        // sscal only works in place; a copy first would be a second pass over memory
+        if (v == out)
+        {
+            cblas_sscal(n, fac, out, 1);
+            return;
+        }
+#endif
+        r2__kernels(n)->mul(v, fac, n, out);
+    }
+
+    static void vecn_mul_vec(const float *v1, const float *v2, int n, float *out)
+    {
+        r2__kernels(n)->mul_vec(v1, v2, n, out);
+    }
+
+    static void vecn_div(const float *v, float fac, int n, float *out)
+    {
+        float d = (fac == 0.f) ? 1.f : 1.f / fac;
+        vecn_mul(v, d, n, out);
+    }
+
+    static void vecn_div_vec(const float *v1, const float *v2, int n, float *out)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = v1[i] / ((v2[i] == 0.f) ? 1.f : v2[i]);
+    }
+
+    static void vecn_pow(const float *v, float exp, int n, float *out)
+    {
+        int i;
+        // the common exponents are exact
+        if (exp == 2.f)
+        {
+            r2__kernels(n)->mul_vec(v, v, n, out);
+            return;
+        }
+        if (exp == 1.f || exp == 0.f)
+        {
+            for (i = 0; i < n; i++)
+                out[i] = (exp == 0.f) ? 1.f : v[i];
+            return;
+        }
+        r2__kernels(n)->pow(v, exp, n, out);
+    }
+
+    static void vecn_abs(const float *v, int n, float *out)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = fabsf(v[i]);
+    }
+
+    static void vecn_sqrt(const float *v, int n, float *out)
+    {
+        int i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+            R2_VF_STORE(&out[i], R2_VF_SQRT(R2_VF_LOAD(&v[i])));
+#endif
+        for (; i < n; i++)
+            out[i] = sqrtf(v[i]);
+    }
+
+    static void vecn_exp(const float *v, int n, float *out)
+    {
+        r2__kernels(n)->exp(v, n, out);
+    }
+
+    static void vecn_log(const float *v, int n, float *out)
+    {
+        r2__kernels(n)->log(v, n, out);
+    }
+
+    static void vecn_tanh(const float *v, int n, float *out)
+    {
+        r2__kernels(n)->tanh(v, n, out);
+    }
+
+    static void vecn_sin(const float *v, int n, float *out)
+    {
+        r2__kernels(n)->sin(v, n, out);
+    }
+
+    static void vecn_cos(const float *v, int n, float *out)
+    {
+        r2__kernels(n)->cos(v, n, out);
+    }
+
+    static void vecn_sincos(const float *v, int n, float *out_sin, float *out_cos)
+    {
+        r2__kernels(n)->sincos(v, n, out_sin, out_cos);
+    }
+
+    static float vecn_dot(const float *v1, const float *v2, int n)
+    {
+#ifdef HAVE_BLAS
+        return cblas_sdot(n, v1, 1, v2, 1);
+#else
+        return r2__kernels(n)->dot(v1, v2, n);
+#endif
+    }
+
+    static float vecn_length_sqrd(const float *v, int n)
+    {
+        return vecn_dot(v, v, n);
+    }
+
+    static float vecn_length(const float *v, int n)
+    {
+#ifdef HAVE_BLAS
+        return cblas_snrm2(n, v, 1);
+#else
+        return sqrtf(vecn_length_sqrd(v, n));
+#endif
+    }
+
+    static float vecn_dist_sqrd(const float *v1, const float *v2, int n)
+    {
+        return r2__kernels(n)->dist_sqrd(v1, v2, n);
+    }
+
+    static float vecn_dist(const float *v1, const float *v2, int n)
+    {
+        return sqrtf(vecn_dist_sqrd(v1, v2, n));
+    }
+
+    static void vecn_normalize(const float *v, int n, float *out)
+    {
+        float len = vecn_length(v, n);
+        if (len < EPSILON)
+            vecn_zero(out, n);
+        else
+            vecn_div(v, len, n, out);
+    }
+
+    static float vecn_sum(const float *v, int n)
+    {
+        return r2__kernels(n)->sum(v, n);
+    }
+
+    static void vecn_minmax(const float *v, int n, float *min, float *max)
+    {
+        r2__kernels(n)->minmax(v, n, min, max);
+    }
+
+    // min and max alone are memory bound, so they share the minmax kernel
+    static float vecn_min(const float *v, int n)
+    {
+        float lo, hi;
+        vecn_minmax(v, n, &lo, &hi);
+        return lo;
+    }
+
+    static float vecn_max(const float *v, int n)
+    {
+        float lo, hi;
+        vecn_minmax(v, n, &lo, &hi);
+        return hi;
+    }
+
+    static int vecn_argmax(const float *v, int n)
+    {
+        // find the max, then the first lane that holds it. Nothing compares
+        // above the max (and NaNs compare false), so >= is equality here.
+        float hi = vecn_max(v, n);
+        int i = 0;
+#ifdef R2_VF_N
+        r2_vf m = R2_VF_SET1(hi);
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            int bits = R2_VF_MOVEMASK(R2_VF_GE(R2_VF_LOAD(&v[i]), m));
+            if (bits != 0)
+            {
+                int j = 0;
+                while (!(bits & (1 << j)))
+                    j++;
+                return i + j;
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if (v[i] >= hi)
+                return i;
+        }
+        return -1;
+    }
+
+    static void vecn_axpy(float a, const float *x, const float *y, int n, float *out)
+    {
+#ifdef HAVE_BLAS
+        if (y == out)
+        {
+            cblas_saxpy(n, a, x, 1, out, 1);
+            return;
+        }
+#endif
+        r2__kernels(n)->axpby(a, x, 1.f, y, n, out);
+    }
+
+    static void vecn_axpby(float a, const float *x, float b, const float *y, int n, float *out)
+    {
+#ifdef HAVE_BLAS
+        // in place only, as axpy: into another out it would need a copy first, a second pass over memory
+        if (y == out)
+        {
+  #ifdef __APPLE__
+            catlas_saxpby(n, a, x, 1, b, out, 1);
+  #else
+            cblas_saxpby(n, a, x, 1, b, out, 1);
+  #endif
+            return;
+        }
+#endif
+        r2__kernels(n)->axpby(a, x, b, y, n, out);
+    }
+
+    static void vecn_fma(const float *v1, const float *v2, const float *v3, int n, float *out)
+    {
+        // BLAS has no element wise multiply, so this is always the r2 kernel
+        r2__kernels(n)->fma(v1, v2, v3, n, out);
+    }
+
+    static void vecn_lerp(const float *v1, const float *v2, float t, int n, float *out)
+    {
+        r2__kernels(n)->axpby(1.f - t, v1, t, v2, n, out);
+    }
+
+    static void vecn_scale_add(const float *v, float fac, float add, int n, float *out)
+    {
+        r2__kernels(n)->scale_add(v, fac, add, n, out);
+    }
+
+    static void vecn_to_f16(const float *v, int n, f16 *out)
+    {
+        r2__kernels(n)->to_f16(v, n, out);
+    }
+
+    static void vecn_from_f16(const f16 *v, int n, float *out)
+    {
+        r2__kernels(n)->from_f16(v, n, out);
+    }
+
+    static float vecn_dot_f16(const f16 *v1, const f16 *v2, int n)
+    {
+        return r2__kernels(n)->dot_f16(v1, v2, n);
+    }
+
+    static float vecn_dist_sqrd_f16(const f16 *v1, const f16 *v2, int n)
+    {
+        return r2__kernels(n)->dist_sqrd_f16(v1, v2, n);
+    }
+
+    // bf16 is the top half of a float, so widening is a 16 bit shift and
+    // plain SSE2 is enough for every level
+
+#ifdef R2_SSE
+    // the four bf16 at v[0..3] as floats
+    static inline __m128 r2__bf16_load4(const bf16 *v)
+    {
+        return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i *)v)));
+    }
+
+    // round four floats to nearest even bf16, sign extended in 32 bit lanes
+    static inline __m128i r2__bf16_round4(__m128 f)
+    {
+        __m128i x = _mm_castps_si128(f);
+        __m128i odd = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(1));
+        __m128i r = _mm_add_epi32(x, _mm_add_epi32(odd, _mm_set1_epi32(0x7fff)));
+        __m128i nan = _mm_cmpgt_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7fffffff)), _mm_set1_epi32(0x7f800000));
+        r = _mm_or_si128(_mm_and_si128(nan, _mm_or_si128(x, _mm_set1_epi32(0x400000))), _mm_andnot_si128(nan, r));
+        return _mm_srai_epi32(r, 16);
+    }
+#endif
+
+    static void vecn_to_bf16(const float *v, int n, bf16 *out)
+    {
+        int i = 0;
+#ifdef R2_SSE
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i lo = r2__bf16_round4(_mm_loadu_ps(&v[i]));
+            __m128i hi = r2__bf16_round4(_mm_loadu_ps(&v[i + 4]));
+            _mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(lo, hi));
+        }
+#endif
+        for (; i < n; i++)
+            out[i] = float_to_bf16(v[i]);
+    }
+
+    static void vecn_from_bf16(const bf16 *v, int n, float *out)
+    {
+        int i = 0;
+#ifdef R2_SSE
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(&out[i], r2__bf16_load4(&v[i]));
+#endif
+        for (; i < n; i++)
+            out[i] = bf16_to_float(v[i]);
+    }
+
+    static float vecn_dot_bf16(const bf16 *v1, const bf16 *v2, int n)
+    {
+        float sum = 0.f;
+        int i = 0;
+#ifdef R2_SSE
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+            acc = R2_MADD_PS(r2__bf16_load4(&v1[i]), r2__bf16_load4(&v2[i]), acc);
+        sum = r2__hsum_sse(acc);
+#endif
+        for (; i < n; i++)
+            sum += bf16_to_float(v1[i]) * bf16_to_float(v2[i]);
+        return sum;
+    }
+
+    static float vecn_dist_sqrd_bf16(const bf16 *v1, const bf16 *v2, int n)
+    {
+        float sum = 0.f;
+        int i = 0;
+#ifdef R2_SSE
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 d = _mm_sub_ps(r2__bf16_load4(&v1[i]), r2__bf16_load4(&v2[i]));
+            acc = R2_MADD_PS(d, d, acc);
+        }
+        sum = r2__hsum_sse(acc);
+#endif
+        for (; i < n; i++)
+        {
+            float d = bf16_to_float(v1[i]) - bf16_to_float(v2[i]);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Vec2
+
+    static void vec2_zero(vec2 *out)
+    {
+        vecn_zero(out->a_vec2, 2);
+    }
+    static bool vec2_equals(const vec2 *v1, const vec2 *v2)
+    {
+        return vecn_equals(v1->a_vec2, v2->a_vec2, 2);
+    }
+
+    static void vec2_set(float x, float y, vec2 *v)
+    {
+        v->x = x;
+        v->y = y;
+    }
+
+    static void vec2_add(const vec2 *v1, const vec2 *v2, vec2 *out)
+    {
+        vecn_add(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+    }
+    static void vec2_sub(const vec2 *v1, const vec2 *v2, vec2 *out)
+    {
+        vecn_sub(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+    }
+    static void vec2_div(const vec2 *v, float fac, vec2 *out)
+    {
+        vecn_div(v->a_vec2, fac, 2, out->a_vec2);
+    }
+    static void vec2_div_vec2(const vec2 *v1, const vec2 *v2, vec2 *out)
+    {
+        vecn_div_vec(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+    }
+    static void vec2_mul(const vec2 *v, float fac, vec2 *out)
+    {
+        vecn_mul(v->a_vec2, fac, 2, out->a_vec2);
+    }
+    static void vec2_mul_vec2(const vec2 *v1, const vec2 *v2, vec2 *out)
+    {
+        vecn_mul_vec(v1->a_vec2, v2->a_vec2, 2, out->a_vec2);
+    }
+    static void vec2_pow(const vec2 *v, float exp, vec2 *out)
+    {
+        vecn_pow(v->a_vec2, exp, 2, out->a_vec2);
+    }
+    static float vec2_dot(const vec2 *v1, const vec2 *v2)
+    {
+        return vecn_dot(v1->a_vec2, v2->a_vec2, 2);
+    }
+    static float vec2_length_sqrd(const vec2 *v)
+    {
+        return vecn_length_sqrd(v->a_vec2, 2);
+    }
+    static float vec2_length(const vec2 *v)
+    {
+        return vecn_length(v->a_vec2, 2);
+    }
+    static float vec2_dist_sqrd(const vec2 *v1, const vec2 *v2)
+    {
+        return vecn_dist_sqrd(v1->a_vec2, v2->a_vec2, 2);
+    }
+    static float vec2_dist(const vec2 *v1, const vec2 *v2)
+    {
+        return vecn_dist(v1->a_vec2, v2->a_vec2, 2);
+    }
+    static void vec2_normalize(const vec2 *v, vec2 *out)
+    {
+        vecn_normalize(v->a_vec2, 2, out->a_vec2);
+    }
+
+    static float vec2_edge_cross(const vec2 *a, const vec2 *b, const vec2 *c)
+    {
+        return (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    }
+
+    static void vec2_to_array(const vec2 *v, float *out)
+    {
+        out[0] = v->x;
+        out[1] = v->y;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Vec3
+
+    static void vec3_zero(vec3 *out)
+    {
+        vecn_zero(out->a_vec, 3);
+    }
+    static bool vec3_equals(const vec3 *v1, const vec3 *v2)
+    {
+        return vecn_equals(v1->a_vec, v2->a_vec, 3);
+    }
+
+    static void vec3_set(float x, float y, float z, vec3 *v)
+    {
+        v->x = x;
+        v->y = y;
+        v->z = z;
+    }
+
+    static void vec3_add(const vec3 *v1, const vec3 *v2, vec3 *out)
+    {
+        vecn_add(v1->a_vec, v2->a_vec, 3, out->a_vec);
+    }
+    static void vec3_sub(const vec3 *v1, const vec3 *v2, vec3 *out)
+    {
+        vecn_sub(v1->a_vec, v2->a_vec, 3, out->a_vec);
+    }
+    static void vec3_div(const vec3 *v, float fac, vec3 *out)
+    {
+        vecn_div(v->a_vec, fac, 3, out->a_vec);
+    }
+    static void vec3_div_vec3(const vec3 *v1, const vec3 *v2, vec3 *out)
+    {
+        vecn_div_vec(v1->a_vec, v2->a_vec, 3, out->a_vec);
+    }
+    static void vec3_mul(const vec3 *v, float fac, vec3 *out)
+    {
+        vecn_mul(v->a_vec, fac, 3, out->a_vec);
+    }
+    static void vec3_mul_vec3(const vec3 *v1, const vec3 *v2, vec3 *out)
+    {
+        vecn_mul_vec(v1->a_vec, v2->a_vec, 3, out->a_vec);
+    }
+    static void vec3_pow(const vec3 *v, float exp, vec3 *out)
+    {
+        vecn_pow(v->a_vec, exp, 3, out->a_vec);
+    }
+    static float vec3_dot(const vec3 *v1, const vec3 *v2)
+    {
+        return vecn_dot(v1->a_vec, v2->a_vec, 3);
+    }
+    static float vec3_length_sqrd(const vec3 *v)
+    {
+        return vecn_length_sqrd(v->a_vec, 3);
+    }
+    static float vec3_length(const vec3 *v)
+    {
+        return vecn_length(v->a_vec, 3);
+    }
+    static float vec3_dist_sqrd(const vec3 *v1, const vec3 *v2)
+    {
+        return vecn_dist_sqrd(v1->a_vec, v2->a_vec, 3);
+    }
+    static float vec3_dist(const vec3 *v1, const vec3 *v2)
+    {
+        return vecn_dist(v1->a_vec, v2->a_vec, 3);
+    }
+    static void vec3_normalize(const vec3 *v, vec3 *out)
+    {
+        vecn_normalize(v->a_vec, 3, out->a_vec);
+    }
+
+    static void vec3_cross(const vec3 *v1, const vec3 *v2, vec3 *out)
+    {
+        out->x = (v1->y * v2->z) - (v1->z * v2->y);
+        out->y = (v1->z * v2->x) - (v1->x * v2->z);
+        out->z = (v1->x * v2->y) - (v1->y * v2->x);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Vec4
+
+    static void vec4_zero(vec4 *out)
+    {
+        vecn_zero(out->a_vec, 4);
+    }
+    static bool vec4_equals(const vec4 *v1, const vec4 *v2)
+    {
+        return vecn_equals(v1->a_vec, v2->a_vec, 4);
+    }
+
+    static void vec4_set(const float ary[4], vec4 *v)
+    {
+        v->x = ary[0];
+        v->y = ary[1];
+        v->z = ary[2];
+        v->w = ary[3];
+    }
+
+    static void vec4_add(const vec4 *v1, const vec4 *v2, vec4 *out)
+    {
+        vecn_add(v1->a_vec, v2->a_vec, 4, out->a_vec);
+    }
+    static void vec4_sub(const vec4 *v1, const vec4 *v2, vec4 *out)
+    {
+        vecn_sub(v1->a_vec, v2->a_vec, 4, out->a_vec);
+    }
+    static void vec4_div(const vec4 *v, float fac, vec4 *out)
+    {
+        vecn_div(v->a_vec, fac, 4, out->a_vec);
+    }
+    static void vec4_mul(const vec4 *v, float fac, vec4 *out)
+    {
+        vecn_mul(v->a_vec, fac, 4, out->a_vec);
+    }
+    static void vec4_mul_vec4(const vec4 *v1, const vec4 *v2, vec4 *out)
+    {
+        vecn_mul_vec(v1->a_vec, v2->a_vec, 4, out->a_vec);
+    }
+    static void vec4_pow(const vec4 *v, float exp, vec4 *out)
+    {
+        vecn_pow(v->a_vec, exp, 4, out->a_vec);
+    }
+    static void vec4_abs(const vec4 *v, vec4 *out)
+    {
+        vecn_abs(v->a_vec, 4, out->a_vec);
+    }
+    static void vec4_sqrt(const vec4 *v, vec4 *out)
+    {
+        vecn_sqrt(v->a_vec, 4, out->a_vec);
+    }
+    static float vec4_dot(const vec4 *v1, const vec4 *v2)
+    {
+        return vecn_dot(v1->a_vec, v2->a_vec, 4);
+    }
+    static float vec4_length_sqrd(const vec4 *v)
+    {
+        return vecn_length_sqrd(v->a_vec, 4);
+    }
+    static float vec4_length(const vec4 *v)
+    {
+        return vecn_length(v->a_vec, 4);
+    }
+    static float vec4_dist_sqrd(const vec4 *v1, const vec4 *v2)
+    {
+        return vecn_dist_sqrd(v1->a_vec, v2->a_vec, 4);
+    }
+    static float vec4_dist(const vec4 *v1, const vec4 *v2)
+    {
+        return vecn_dist(v1->a_vec, v2->a_vec, 4);
+    }
+    static void vec4_normalize(const vec4 *v, vec4 *out)
+    {
+        vecn_normalize(v->a_vec, 4, out->a_vec);
+    }
+
+    static char *vec4_tos(const quat *q)
+    {
+        char *out = (char *)calloc(sizeof(char), 60);
+        snprintf(out, 50, "(%f, %f, %f, %f)\n", q->x, q->y, q->z, q->w);
+        return out;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // SoA streams
+
+    static void vec3_soa_add(const vec3_soa *a, const vec3_soa *b, vec3_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            R2_VF_STORE(&out->x[i], R2_VF_ADD(R2_VF_LOAD(&a->x[i]), R2_VF_LOAD(&b->x[i])));
+            R2_VF_STORE(&out->y[i], R2_VF_ADD(R2_VF_LOAD(&a->y[i]), R2_VF_LOAD(&b->y[i])));
+            R2_VF_STORE(&out->z[i], R2_VF_ADD(R2_VF_LOAD(&a->z[i]), R2_VF_LOAD(&b->z[i])));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out->x[i] = a->x[i] + b->x[i];
+            out->y[i] = a->y[i] + b->y[i];
+            out->z[i] = a->z[i] + b->z[i];
+        }
+    }
+
+    static void vec3_soa_sub(const vec3_soa *a, const vec3_soa *b, vec3_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            R2_VF_STORE(&out->x[i], R2_VF_SUB(R2_VF_LOAD(&a->x[i]), R2_VF_LOAD(&b->x[i])));
+            R2_VF_STORE(&out->y[i], R2_VF_SUB(R2_VF_LOAD(&a->y[i]), R2_VF_LOAD(&b->y[i])));
+            R2_VF_STORE(&out->z[i], R2_VF_SUB(R2_VF_LOAD(&a->z[i]), R2_VF_LOAD(&b->z[i])));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out->x[i] = a->x[i] - b->x[i];
+            out->y[i] = a->y[i] - b->y[i];
+            out->z[i] = a->z[i] - b->z[i];
+        }
+    }
+
+    static void vec3_soa_mul(const vec3_soa *a, float fac, vec3_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        r2_vf f = R2_VF_SET1(fac);
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            R2_VF_STORE(&out->x[i], R2_VF_MUL(R2_VF_LOAD(&a->x[i]), f));
+            R2_VF_STORE(&out->y[i], R2_VF_MUL(R2_VF_LOAD(&a->y[i]), f));
+            R2_VF_STORE(&out->z[i], R2_VF_MUL(R2_VF_LOAD(&a->z[i]), f));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out->x[i] = a->x[i] * fac;
+            out->y[i] = a->y[i] * fac;
+            out->z[i] = a->z[i] * fac;
+        }
+    }
+
+    static void vec3_soa_dot(const vec3_soa *a, const vec3_soa *b, float *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            r2_vf d = R2_VF_MUL(R2_VF_LOAD(&a->x[i]), R2_VF_LOAD(&b->x[i]));
+            d = R2_VF_MADD(R2_VF_LOAD(&a->y[i]), R2_VF_LOAD(&b->y[i]), d);
+            d = R2_VF_MADD(R2_VF_LOAD(&a->z[i]), R2_VF_LOAD(&b->z[i]), d);
+            R2_VF_STORE(&out[i], d);
+        }
+#endif
+        for (; i < n; i++)
+            out[i] = a->x[i] * b->x[i] + a->y[i] * b->y[i] + a->z[i] * b->z[i];
+    }
+
+    static void vec3_soa_cross(const vec3_soa *a, const vec3_soa *b, vec3_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            r2_vf ax = R2_VF_LOAD(&a->x[i]);
+            r2_vf ay = R2_VF_LOAD(&a->y[i]);
+            r2_vf az = R2_VF_LOAD(&a->z[i]);
+            r2_vf bx = R2_VF_LOAD(&b->x[i]);
+            r2_vf by = R2_VF_LOAD(&b->y[i]);
+            r2_vf bz = R2_VF_LOAD(&b->z[i]);
+            R2_VF_STORE(&out->x[i], R2_VF_SUB(R2_VF_MUL(ay, bz), R2_VF_MUL(az, by)));
+            R2_VF_STORE(&out->y[i], R2_VF_SUB(R2_VF_MUL(az, bx), R2_VF_MUL(ax, bz)));
+            R2_VF_STORE(&out->z[i], R2_VF_SUB(R2_VF_MUL(ax, by), R2_VF_MUL(ay, bx)));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            // same as vec3_cross, through locals as out may be a or b
+            vec3 v1 = {.x = a->x[i], .y = a->y[i], .z = a->z[i]};
+            vec3 v2 = {.x = b->x[i], .y = b->y[i], .z = b->z[i]};
+            vec3 r;
+            vec3_cross(&v1, &v2, &r);
+            out->x[i] = r.x;
+            out->y[i] = r.y;
+            out->z[i] = r.z;
+        }
+    }
+
+    static void vec3_soa_length(const vec3_soa *a, float *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            r2_vf x = R2_VF_LOAD(&a->x[i]);
+            r2_vf y = R2_VF_LOAD(&a->y[i]);
+            r2_vf z = R2_VF_LOAD(&a->z[i]);
+            r2_vf d = R2_VF_MADD(z, z, R2_VF_MADD(y, y, R2_VF_MUL(x, x)));
+            R2_VF_STORE(&out[i], R2_VF_SQRT(d));
+        }
+#endif
+        for (; i < n; i++)
+            out[i] = sqrtf(a->x[i] * a->x[i] + a->y[i] * a->y[i] + a->z[i] * a->z[i]);
+    }
+
+    static void vec3_soa_normalize(const vec3_soa *a, vec3_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        // like vecn_normalize, anything shorter than EPSILON becomes zero,
+        // done with a mask so there is no branch per element
+        r2_vf eps = R2_VF_SET1(EPSILON);
+        r2_vf one = R2_VF_SET1(1.f);
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            r2_vf x = R2_VF_LOAD(&a->x[i]);
+            r2_vf y = R2_VF_LOAD(&a->y[i]);
+            r2_vf z = R2_VF_LOAD(&a->z[i]);
+            r2_vf len = R2_VF_SQRT(R2_VF_MADD(z, z, R2_VF_MADD(y, y, R2_VF_MUL(x, x))));
+            r2_vf inv = R2_VF_AND(R2_VF_DIV(one, R2_VF_MAX(len, eps)), R2_VF_GE(len, eps));
+            R2_VF_STORE(&out->x[i], R2_VF_MUL(x, inv));
+            R2_VF_STORE(&out->y[i], R2_VF_MUL(y, inv));
+            R2_VF_STORE(&out->z[i], R2_VF_MUL(z, inv));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float x = a->x[i];
+            float y = a->y[i];
+            float z = a->z[i];
+            float len = sqrtf(x * x + y * y + z * z);
+            float inv = (len < EPSILON) ? 0.f : 1.f / len;
+            out->x[i] = x * inv;
+            out->y[i] = y * inv;
+            out->z[i] = z * inv;
+        }
+    }
+
+    static void vec3_to_soa(const vec3 *in, size_t n, vec3_soa *out)
+    {
+        size_t i = 0;
+#ifdef R2_SSE
+        // 4 vec3 (16 floats, w lanes ignored) -> 4 each of x, y, z
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(in[i].a_vec);
+            __m128 r1 = _mm_loadu_ps(in[i + 1].a_vec);
+            __m128 r2 = _mm_loadu_ps(in[i + 2].a_vec);
+            __m128 r3 = _mm_loadu_ps(in[i + 3].a_vec);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&out->x[i], r0);
+            _mm_storeu_ps(&out->y[i], r1);
+            _mm_storeu_ps(&out->z[i], r2);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out->x[i] = in[i].x;
+            out->y[i] = in[i].y;
+            out->z[i] = in[i].z;
+        }
+        out->n = n;
+    }
+
+    static void vec3_from_soa(const vec3_soa *in, vec3 *out)
+    {
+        size_t n = in->n;
+        size_t i = 0;
+#ifdef R2_SSE
+        __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(&in->x[i]);
+            __m128 r1 = _mm_loadu_ps(&in->y[i]);
+            __m128 r2 = _mm_loadu_ps(&in->z[i]);
+            __m128 r3 = zero;
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out[i].a_vec, r0);
+            _mm_storeu_ps(out[i + 1].a_vec, r1);
+            _mm_storeu_ps(out[i + 2].a_vec, r2);
+            _mm_storeu_ps(out[i + 3].a_vec, r3);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i].x = in->x[i];
+            out[i].y = in->y[i];
+            out[i].z = in->z[i];
+            out[i].w = 0.f;
+        }
+    }
+
+    static void vec4_to_soa(const vec4 *in, size_t n, vec4_soa *out)
+    {
+        size_t i = 0;
+#ifdef R2_SSE
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(in[i].a_vec);
+            __m128 r1 = _mm_loadu_ps(in[i + 1].a_vec);
+            __m128 r2 = _mm_loadu_ps(in[i + 2].a_vec);
+            __m128 r3 = _mm_loadu_ps(in[i + 3].a_vec);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&out->x[i], r0);
+            _mm_storeu_ps(&out->y[i], r1);
+            _mm_storeu_ps(&out->z[i], r2);
+            _mm_storeu_ps(&out->w[i], r3);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out->x[i] = in[i].x;
+            out->y[i] = in[i].y;
+            out->z[i] = in[i].z;
+            out->w[i] = in[i].w;
+        }
+        out->n = n;
+    }
+
+    static void vec4_from_soa(const vec4_soa *in, vec4 *out)
+    {
+        size_t n = in->n;
+        size_t i = 0;
+#ifdef R2_SSE
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(&in->x[i]);
+            __m128 r1 = _mm_loadu_ps(&in->y[i]);
+            __m128 r2 = _mm_loadu_ps(&in->z[i]);
+            __m128 r3 = _mm_loadu_ps(&in->w[i]);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out[i].a_vec, r0);
+            _mm_storeu_ps(out[i + 1].a_vec, r1);
+            _mm_storeu_ps(out[i + 2].a_vec, r2);
+            _mm_storeu_ps(out[i + 3].a_vec, r3);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i].x = in->x[i];
+            out[i].y = in->y[i];
+            out[i].z = in->z[i];
+            out[i].w = in->w[i];
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Quat
+    // http://www.tobynorris.com/work/prog/csharp/quatview/help/orientations_and_quaternions.htm
+
+    static void quat_zero(quat *q)
+    {
+        q->x = 0.;
+        q->y = 0.;
+        q->z = 0.;
+        q->w = 0.;
+    }
+
+    static void quat_identity(quat *q)
+    {
+        q->x = 0.;
+        q->y = 0.;
+        q->z = 0.;
+        q->w = 1.;
+    }
+
+    static void quat_add(const quat *q1, const quat *q2, quat *out)
+    {
+        vec4_add(q1, q2, out);
+    }
+
+    static void quat_sub(const quat *q1, const quat *q2, quat *out)
+    {
+        vec4_sub(q1, q2, out);
+    }
+
+    static float quat_dot(const quat *q1, const quat *q2)
+    {
+        return vec4_dot(q1, q2);
+    }
+
+    static float quat_length(const quat *q)
+    {
+        return vec4_length(q);
+    }
+    static float quat_magnitude(const quat *q)
+    {
+        return quat_length(q);
+    }
+
+    static void quat_rot2q(const vec3 *axis, float theta, quat *out)
+    {
+        vec4_mul(axis, sinf(theta * .5), out);
+        float d = cosf(theta * .5);
+        out->w = d;
+    }
+
+    // Given a set of euler angles (in radians) create a quaternion
+    static void quat_from_euler(const vec3 *r, quat *q)
     {
         float roll = r->x;
         float pitch = r->y;
         float yaw = r->z;
 
-        float cy = cosf(yaw * .5);
-        float sy = sinf(yaw * .5);
+        float cy = cosf(yaw * .5);
+        float sy = sinf(yaw * .5);
+
+        float cp = cosf(pitch * .5);
+        float sp = sinf(pitch * .5);
+
+        float cr = cosf(roll * .5);
+        float sr = sinf(roll * .5);
+
+        // Warning: in most maths apps and documentation about quats the w
+        // part (real) is in the front. We have some names here that make it
+        // a bit more difficult to see what is going on.
+        q->w = cr * cp * cy + sr * sp * sy; // r
+        q->x = sr * cp * cy - cr * sp * sy; // i
+        q->y = cr * sp * cy + sr * cp * sy; // j
+        q->z = cr * cp * sy - sr * sp * cy; // k
+    }
+
+    static void quat_mul_quat(const quat *q1, const quat *q2, quat *out)
+    {
+        // i² = j² = k² = ijk = -1
+
+        // q1 = a+bi+cj+dk
+        float a = q1->w;
+        float b = q1->x;
+        float c = q1->y;
+        float d = q1->z;
+        // q2 = e+fi+gj+hk
+        float e = q2->w;
+        float f = q2->x;
+        float g = q2->y;
+        float h = q2->z;
+
+        //   |  i  j  k
+        //--------------
+        // i | -1  k -j
+        // j | -k -1  i
+        // k |  j -i -1
+        out->w = a * e - b * f - c * g - d * h;
+        out->x = a * f + b * e + c * h - d * g;
+        out->y = a * g - b * h + c * e + d * f;
+        out->z = a * h + b * g - c * f + d * e;
+    }
+
+    static void quat_conj(const quat *q, quat *out)
+    {
+        out->w = q->w;
+        out->x = -q->x;
+        out->y = -q->y;
+        out->z = -q->z;
+    }
+
+    static char *quat_tos(const quat *q)
+    {
+        char *out = (char *)calloc(sizeof(char), 100);
+        snprintf(out, 100, "[%f + %fi + %fj + %fk]\n", q->w, q->x, q->y, q->z);
+        return out;
+    }
+
+    static void quat_normalize(const quat *q, quat *out)
+    {
+        vec4_normalize(q, out);
+    }
+
+    static void quat_mul_vec3(const quat *q, const vec3 *v, vec3 *out)
+    {
+        // t = 2(q x v), v' = v + w t + q x t
+        float tx = 2.f * (q->y * v->z - q->z * v->y);
+        float ty = 2.f * (q->z * v->x - q->x * v->z);
+        float tz = 2.f * (q->x * v->y - q->y * v->x);
+        float x = v->x + q->w * tx + (q->y * tz - q->z * ty);
+        float y = v->y + q->w * ty + (q->z * tx - q->x * tz);
+        float z = v->z + q->w * tz + (q->x * ty - q->y * tx);
+        out->x = x;
+        out->y = y;
+        out->z = z;
+        out->w = v->w;
+    }
+
+#ifdef R2_SSE
+    // cross(a, b) = (a * b.yzx - a.yzx * b).yzx. The w lanes cancel to
+    // exactly 0, so the rotated vector keeps its w. qs is q.yzx
+    static inline __m128 r2__quat_rotate_sse(__m128 q, __m128 qs, __m128 w, __m128 v)
+    {
+        __m128 t = _mm_sub_ps(_mm_mul_ps(q, _mm_shuffle_ps(v, v, 0xC9)), _mm_mul_ps(qs, v));
+        t = _mm_shuffle_ps(t, t, 0xC9);
+        t = _mm_add_ps(t, t);
+        __m128 c = _mm_sub_ps(_mm_mul_ps(q, _mm_shuffle_ps(t, t, 0xC9)), _mm_mul_ps(qs, t));
+        c = _mm_shuffle_ps(c, c, 0xC9);
+        return _mm_add_ps(R2_MADD_PS(w, t, v), c);
+    }
+#endif
+
+#if defined(R2_AVX) && defined(R2_FMA)
+    // r2__quat_rotate_sse on two vectors at once, permute_ps works per 128-bit lane
+    static inline __m256 r2__quat_rotate_avx(__m256 q, __m256 qs, __m256 w, __m256 v)
+    {
+        __m256 t = _mm256_sub_ps(_mm256_mul_ps(q, _mm256_permute_ps(v, 0xC9)), _mm256_mul_ps(qs, v));
+        t = _mm256_permute_ps(t, 0xC9);
+        t = _mm256_add_ps(t, t);
+        __m256 c = _mm256_sub_ps(_mm256_mul_ps(q, _mm256_permute_ps(t, 0xC9)), _mm256_mul_ps(qs, t));
+        c = _mm256_permute_ps(c, 0xC9);
+        return _mm256_add_ps(_mm256_fmadd_ps(w, t, v), c);
+    }
+#endif
+
+    static void quat_rotate_batch(const quat *q, const vec3 *in, vec3 *out, size_t n)
+    {
+        size_t i = 0;
+#if defined(R2_AVX) && defined(R2_FMA)
+        __m128 q4 = _mm_loadu_ps(q->a_vec);
+        __m256 q8 = _mm256_insertf128_ps(_mm256_castps128_ps256(q4), q4, 1);
+        __m256 qs = _mm256_permute_ps(q8, 0xC9);
+        __m256 w = _mm256_permute_ps(q8, 0xFF);
+        __m128 qs4 = _mm_shuffle_ps(q4, q4, 0xC9);
+        __m128 w4 = _mm_shuffle_ps(q4, q4, 0xFF);
+        bool stream = n * sizeof(vec3) >= R2_STREAM_MIN && (const vec3 *)out != in;
+        const vec3 *src;
+        vec3 *dst;
+        size_t pairs;
+        size_t k;
+        // alignment handled as in mat4_transform_batch
+        if (n > 0 && ((uintptr_t)in & 31) == 16 && ((uintptr_t)out & 31) == 16)
+        {
+            _mm_storeu_ps(out[0].a_vec, r2__quat_rotate_sse(q4, qs4, w4, _mm_loadu_ps(in[0].a_vec)));
+            i = 1;
+        }
+        src = in + i;
+        dst = out + i;
+        pairs = (n - i) / 2;
+        if ((((uintptr_t)src | (uintptr_t)dst) & 31) != 0)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                _mm256_storeu_ps(dst[k * 2].a_vec, r2__quat_rotate_avx(q8, qs, w, _mm256_loadu_ps(src[k * 2].a_vec)));
+        }
+        else if (!stream)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                _mm256_store_ps(dst[k * 2].a_vec, r2__quat_rotate_avx(q8, qs, w, _mm256_load_ps(src[k * 2].a_vec)));
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                _mm256_stream_ps(dst[k * 2].a_vec, r2__quat_rotate_avx(q8, qs, w, _mm256_load_ps(src[k * 2].a_vec)));
+            _mm_sfence();
+        }
+        i += pairs * 2;
+        if (i < n)
+            _mm_storeu_ps(out[i].a_vec, r2__quat_rotate_sse(q4, qs4, w4, _mm_loadu_ps(in[i].a_vec)));
+#elif defined(R2_SSE)
+        __m128 q4 = _mm_loadu_ps(q->a_vec);
+        __m128 qs = _mm_shuffle_ps(q4, q4, 0xC9);
+        __m128 w = _mm_shuffle_ps(q4, q4, 0xFF);
+        bool stream = n * sizeof(vec3) >= R2_STREAM_MIN && (const vec3 *)out != in;
+        if ((((uintptr_t)in | (uintptr_t)out) & 15) != 0)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_storeu_ps(out[i].a_vec, r2__quat_rotate_sse(q4, qs, w, _mm_loadu_ps(in[i].a_vec)));
+        }
+        else if (!stream)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_store_ps(out[i].a_vec, r2__quat_rotate_sse(q4, qs, w, _mm_load_ps(in[i].a_vec)));
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_stream_ps(out[i].a_vec, r2__quat_rotate_sse(q4, qs, w, _mm_load_ps(in[i].a_vec)));
+            _mm_sfence();
+        }
+#else
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < n; i++)
+            quat_mul_vec3(q, &in[i], &out[i]);
+#endif
+    }
+
+    static void quat_rotate_each(const quat *q, const vec3 *in, vec3 *out, size_t n)
+    {
+        size_t i = 0;
+#if defined(R2_AVX) && defined(R2_FMA)
+        size_t pairs = n / 2;
+        size_t k;
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (k = 0; k < pairs; k++)
+        {
+            __m256 q8 = _mm256_loadu_ps(q[k * 2].a_vec);
+            __m256 r = r2__quat_rotate_avx(q8, _mm256_permute_ps(q8, 0xC9), _mm256_permute_ps(q8, 0xFF),
+                                           _mm256_loadu_ps(in[k * 2].a_vec));
+            _mm256_storeu_ps(out[k * 2].a_vec, r);
+        }
+        i = pairs * 2;
+        if (i < n)
+            quat_mul_vec3(&q[i], &in[i], &out[i]);
+#elif defined(R2_SSE)
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            __m128 q4 = _mm_loadu_ps(q[i].a_vec);
+            __m128 r = r2__quat_rotate_sse(q4, _mm_shuffle_ps(q4, q4, 0xC9), _mm_shuffle_ps(q4, q4, 0xFF),
+                                           _mm_loadu_ps(in[i].a_vec));
+            _mm_storeu_ps(out[i].a_vec, r);
+        }
+#else
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < n; i++)
+            quat_mul_vec3(&q[i], &in[i], &out[i]);
+#endif
+    }
+
+    // Polynomials for the slerp weights. acos(x) = sqrt(1 - x) P(x) on [0, 1]
+    // (Abramowitz & Stegun 4.4.46, |error| < 2e-8) and the sin Taylor series
+    // to x^11, good to 6e-8 on [0, pi/2]. That is all the range slerp needs
+    // once the shortest path has made q1 . q2 >= 0
+    static const float r2__acos_c[8] = {1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+                                        0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f};
+    static const float r2__sin_c[6] = {1.f,           -1.6666667e-1f, 8.3333333e-3f,
+                                       -1.9841270e-4f, 2.7557319e-6f, -2.5052108e-8f};
+
+    // Above this q1 . q2 the slerp weights lose precision, use (1 - t, t)
+#define R2__SLERP_LINEAR 0.9995f
+
+    static inline float r2__acos_poly(float x)
+    {
+        float p = r2__acos_c[7];
+        int k;
+        for (k = 6; k >= 0; k--)
+            p = p * x + r2__acos_c[k];
+        return sqrtf(1.f - x) * p;
+    }
+
+    static inline float r2__sin_poly(float x)
+    {
+        float x2 = x * x;
+        float p = r2__sin_c[5];
+        int k;
+        for (k = 4; k >= 0; k--)
+            p = p * x2 + r2__sin_c[k];
+        return x * p;
+    }
+
+#ifdef R2_VF_N
+    static inline r2_vf r2__acos_poly_vf(r2_vf x)
+    {
+        r2_vf p = R2_VF_SET1(r2__acos_c[7]);
+        int k;
+        for (k = 6; k >= 0; k--)
+            p = R2_VF_MADD(p, x, R2_VF_SET1(r2__acos_c[k]));
+        return R2_VF_MUL(R2_VF_SQRT(R2_VF_SUB(R2_VF_SET1(1.f), x)), p);
+    }
+
+    static inline r2_vf r2__sin_poly_vf(r2_vf x)
+    {
+        r2_vf x2 = R2_VF_MUL(x, x);
+        r2_vf p = R2_VF_SET1(r2__sin_c[5]);
+        int k;
+        for (k = 4; k >= 0; k--)
+            p = R2_VF_MADD(p, x2, R2_VF_SET1(r2__sin_c[k]));
+        return R2_VF_MUL(x, p);
+    }
+#endif
+
+    static void r2__quat_blend(const float *a, const float *b, float t, bool slerp, float *out)
+    {
+        float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        float sign = (d < 0.f) ? -1.f : 1.f;
+        float wa = 1.f - t;
+        float wb = t * sign;
+        d = fminf(fabsf(d), 1.f);
+        if (slerp && d < R2__SLERP_LINEAR)
+        {
+            float theta = r2__acos_poly(d);
+            float inv_s = 1.f / sqrtf(1.f - d * d);
+            wa = r2__sin_poly(wa * theta) * inv_s;
+            wb = r2__sin_poly(t * theta) * inv_s * sign;
+        }
+        float x = wa * a[0] + wb * b[0];
+        float y = wa * a[1] + wb * b[1];
+        float z = wa * a[2] + wb * b[2];
+        float w = wa * a[3] + wb * b[3];
+        float len = sqrtf(x * x + y * y + z * z + w * w);
+        float inv = (len < EPSILON) ? 0.f : 1.f / len;
+        out[0] = x * inv;
+        out[1] = y * inv;
+        out[2] = z * inv;
+        out[3] = w * inv;
+    }
+
+    static void quat_slerp(const quat *q1, const quat *q2, float t, quat *out)
+    {
+        r2__quat_blend(q1->a_vec, q2->a_vec, t, true, out->a_vec);
+    }
+
+    static void quat_nlerp(const quat *q1, const quat *q2, float t, quat *out)
+    {
+        r2__quat_blend(q1->a_vec, q2->a_vec, t, false, out->a_vec);
+    }
+
+    static void r2__quat_blend_soa(const vec4_soa *a, const vec4_soa *b, float t, bool slerp, vec4_soa *out)
+    {
+        size_t n = a->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        r2_vf one = R2_VF_SET1(1.f);
+        r2_vf sign_bit = R2_VF_SET1(-0.f);
+        r2_vf eps = R2_VF_SET1(EPSILON);
+        r2_vf linear = R2_VF_SET1(R2__SLERP_LINEAR);
+        r2_vf vt = R2_VF_SET1(t);
+        r2_vf vt1 = R2_VF_SET1(1.f - t);
+        for (; i + R2_VF_N <= n; i += R2_VF_N)
+        {
+            r2_vf ax = R2_VF_LOAD(&a->x[i]);
+            r2_vf ay = R2_VF_LOAD(&a->y[i]);
+            r2_vf az = R2_VF_LOAD(&a->z[i]);
+            r2_vf aw = R2_VF_LOAD(&a->w[i]);
+            r2_vf bx = R2_VF_LOAD(&b->x[i]);
+            r2_vf by = R2_VF_LOAD(&b->y[i]);
+            r2_vf bz = R2_VF_LOAD(&b->z[i]);
+            r2_vf bw = R2_VF_LOAD(&b->w[i]);
+            r2_vf d = R2_VF_MADD(aw, bw, R2_VF_MADD(az, bz, R2_VF_MADD(ay, by, R2_VF_MUL(ax, bx))));
+
+            // shortest path: move the sign of d onto b's weight, d becomes |d|
+            r2_vf sign = R2_VF_AND(d, sign_bit);
+            d = R2_VF_MIN(R2_VF_XOR(d, sign), one);
+            r2_vf wa = vt1;
+            r2_vf wb = vt;
+            if (slerp)
+            {
+                r2_vf theta = r2__acos_poly_vf(d);
+                r2_vf s = R2_VF_SQRT(R2_VF_MAX(R2_VF_SUB(one, R2_VF_MUL(d, d)), eps));
+                r2_vf sa = R2_VF_DIV(r2__sin_poly_vf(R2_VF_MUL(vt1, theta)), s);
+                r2_vf sb = R2_VF_DIV(r2__sin_poly_vf(R2_VF_MUL(vt, theta)), s);
+                // nearly parallel lanes keep the nlerp weights
+                r2_vf lin = R2_VF_GE(d, linear);
+                wa = R2_VF_SELECT(lin, vt1, sa);
+                wb = R2_VF_SELECT(lin, vt, sb);
+            }
+            wb = R2_VF_XOR(wb, sign);
+
+            r2_vf x = R2_VF_MADD(wb, bx, R2_VF_MUL(wa, ax));
+            r2_vf y = R2_VF_MADD(wb, by, R2_VF_MUL(wa, ay));
+            r2_vf z = R2_VF_MADD(wb, bz, R2_VF_MUL(wa, az));
+            r2_vf w = R2_VF_MADD(wb, bw, R2_VF_MUL(wa, aw));
+            r2_vf len = R2_VF_SQRT(R2_VF_MADD(w, w, R2_VF_MADD(z, z, R2_VF_MADD(y, y, R2_VF_MUL(x, x)))));
+            r2_vf inv = R2_VF_AND(R2_VF_DIV(one, R2_VF_MAX(len, eps)), R2_VF_GE(len, eps));
+            R2_VF_STORE(&out->x[i], R2_VF_MUL(x, inv));
+            R2_VF_STORE(&out->y[i], R2_VF_MUL(y, inv));
+            R2_VF_STORE(&out->z[i], R2_VF_MUL(z, inv));
+            R2_VF_STORE(&out->w[i], R2_VF_MUL(w, inv));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float qa[4] = {a->x[i], a->y[i], a->z[i], a->w[i]};
+            float qb[4] = {b->x[i], b->y[i], b->z[i], b->w[i]};
+            float r[4];
+            r2__quat_blend(qa, qb, t, slerp, r);
+            out->x[i] = r[0];
+            out->y[i] = r[1];
+            out->z[i] = r[2];
+            out->w[i] = r[3];
+        }
+    }
+
+    static void quat_slerp_soa(const vec4_soa *a, const vec4_soa *b, float t, vec4_soa *out)
+    {
+        r2__quat_blend_soa(a, b, t, true, out);
+    }
+
+    static void quat_nlerp_soa(const vec4_soa *a, const vec4_soa *b, float t, vec4_soa *out)
+    {
+        r2__quat_blend_soa(a, b, t, false, out);
+    }
+
+#undef R2__SLERP_LINEAR
+
+    static void quat_mat4(const quat *q, mat4 *out)
+    {
+        float a = q->w;
+        float b = q->x;
+        float c = q->y;
+        float d = q->z;
+
+        // a -b -c -d
+        // b  a -d  c
+        // c  d  a -b
+        // d -c  b  a
+        out->m00 = a;
+        out->m01 = b;
+        out->m02 = c;
+        out->m03 = d;
+
+        out->m10 = -b;
+        out->m11 = a;
+        out->m12 = d;
+        out->m13 = -c;
+
+        out->m20 = -c;
+        out->m21 = -d;
+        out->m22 = a;
+        out->m23 = b;
+
+        out->m30 = -d;
+        out->m31 = c;
+        out->m32 = -b;
+        out->m33 = a;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Mat4
+
+    static void mat4_identity(mat4 *m)
+    {
+        // clang-format off
+        m->m00 = 1.; m->m10 = 0.; m->m20 = 0.; m->m30 = 0.;
+        m->m01 = 0.; m->m11 = 1.; m->m21 = 0.; m->m31 = 0.;
+        m->m02 = 0.; m->m12 = 0.; m->m22 = 1.; m->m32 = 0.;
+        m->m03 = 0.; m->m13 = 0.; m->m23 = 0.; m->m33 = 1.;
+        // clang-format on
+    }
+
+    static void mat4_set(const float *arry, mat4 *m)
+    {
+        m->m00 = arry[0];
+        m->m01 = arry[4];
+        m->m02 = arry[8];
+        m->m03 = arry[12];
+
+        m->m10 = arry[1];
+        m->m11 = arry[5];
+        m->m12 = arry[9];
+        m->m13 = arry[13];
+
+        m->m20 = arry[2];
+        m->m21 = arry[6];
+        m->m22 = arry[10];
+        m->m23 = arry[14];
+
+        m->m30 = arry[3];
+        m->m31 = arry[7];
+        m->m32 = arry[11];
+        m->m33 = arry[15];
+    }
+
+    static void mat4_transform(const vec4 *p, const mat4 *mat, vec4 *out)
+    {
+        out->x = (mat->m00 * p->x) + (mat->m01 * p->y) + (mat->m02 * p->z) + (mat->m03 * p->w);
+        out->y = (mat->m10 * p->x) + (mat->m11 * p->y) + (mat->m12 * p->z) + (mat->m13 * p->w);
+        out->z = (mat->m20 * p->x) + (mat->m21 * p->y) + (mat->m22 * p->z) + (mat->m23 * p->w);
+        out->w = (mat->m30 * p->x) + (mat->m31 * p->y) + (mat->m32 * p->z) + (mat->m33 * p->w);
+    }
+
+    static void mat4_transform_batch(const mat4 *mat, const vec4 *in, vec4 *out, size_t n)
+    {
+        // out = x * col0 + y * col1 + z * col2 + w * col3 where col j is
+        // (m0j, m1j, m2j, m3j), which is a_mat4[4j..4j+3]
+        size_t i = 0;
+#if defined(R2_SSE)
+        // When in and out are both aligned the loads and stores are too, and
+        // a big out that is not in is written around the cache
+        r2m4 m4 = r2m4_load(mat);
+        bool stream = n * sizeof(vec4) >= R2_STREAM_MIN && (const vec4 *)out != in;
+#endif
+#if defined(R2_AVX) && defined(R2_FMA)
+        __m256 c0 = _mm256_insertf128_ps(_mm256_castps128_ps256(m4.c[0]), m4.c[0], 1);
+        __m256 c1 = _mm256_insertf128_ps(_mm256_castps128_ps256(m4.c[1]), m4.c[1], 1);
+        __m256 c2 = _mm256_insertf128_ps(_mm256_castps128_ps256(m4.c[2]), m4.c[2], 1);
+        __m256 c3 = _mm256_insertf128_ps(_mm256_castps128_ps256(m4.c[3]), m4.c[3], 1);
+        const vec4 *src;
+        vec4 *dst;
+        size_t pairs;
+        size_t k;
+        // Two points per register. If both arrays are 16 mod 32 every other
+        // pair would straddle a cache line, one point on its own lines them up
+        if (n > 0 && ((uintptr_t)in & 31) == 16 && ((uintptr_t)out & 31) == 16)
+        {
+            _mm_storeu_ps(out[0].a_vec, r2m4_transform(m4, _mm_loadu_ps(in[0].a_vec)));
+            i = 1;
+        }
+        src = in + i;
+        dst = out + i;
+        pairs = (n - i) / 2;
+  #define R2__TRANSFORM_PAIR(load, store)                                                                     \
+      do                                                                                                      \
+      {                                                                                                       \
+          __m256 p = load(src[k * 2].a_vec);                                                                  \
+          __m256 r = _mm256_mul_ps(_mm256_permute_ps(p, 0x00), c0);                                           \
+          r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0x55), c1, r);                                             \
+          r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0xAA), c2, r);                                             \
+          r = _mm256_fmadd_ps(_mm256_permute_ps(p, 0xFF), c3, r);                                             \
+          store(dst[k * 2].a_vec, r);                                                                         \
+      } while (0)
+        if ((((uintptr_t)src | (uintptr_t)dst) & 31) != 0)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                R2__TRANSFORM_PAIR(_mm256_loadu_ps, _mm256_storeu_ps);
+        }
+        else if (!stream)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                R2__TRANSFORM_PAIR(_mm256_load_ps, _mm256_store_ps);
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < pairs; k++)
+                R2__TRANSFORM_PAIR(_mm256_load_ps, _mm256_stream_ps);
+            _mm_sfence();
+        }
+  #undef R2__TRANSFORM_PAIR
+        i += pairs * 2;
+        if (i < n)
+            _mm_storeu_ps(out[i].a_vec, r2m4_transform(m4, _mm_loadu_ps(in[i].a_vec)));
+#elif defined(R2_SSE)
+        if ((((uintptr_t)in | (uintptr_t)out) & 15) != 0)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_storeu_ps(out[i].a_vec, r2m4_transform(m4, _mm_loadu_ps(in[i].a_vec)));
+        }
+        else if (!stream)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_store_ps(out[i].a_vec, r2m4_transform(m4, _mm_load_ps(in[i].a_vec)));
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (i = 0; i < n; i++)
+                _mm_stream_ps(out[i].a_vec, r2m4_transform(m4, _mm_load_ps(in[i].a_vec)));
+            _mm_sfence();
+        }
+#else
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            // copy first, out may be in
+            vec4 p = in[i];
+            mat4_transform(&p, mat, &out[i]);
+        }
+#endif
+    }
+
+    static void mat4_transform_soa(const mat4 *mat, const vec4_soa *in, vec4_soa *out)
+    {
+        size_t n = in->n;
+        size_t i = 0;
+#ifdef R2_VF_N
+        // one register per matrix element, R2_VF_N points at a time. As in
+        // mat4_transform_batch, aligned streams get aligned loads and stores
+        // and a big out that is not in is written around the cache
+        r2_vf m[16];
+        size_t blocks = n / R2_VF_N;
+        size_t k;
+        uintptr_t addr = (uintptr_t)in->x | (uintptr_t)in->y | (uintptr_t)in->z | (uintptr_t)in->w |
+                         (uintptr_t)out->x | (uintptr_t)out->y | (uintptr_t)out->z | (uintptr_t)out->w;
+        bool stream = n * 4 * sizeof(float) >= R2_STREAM_MIN && out->x != in->x;
+        for (k = 0; k < 16; k++)
+            m[k] = R2_VF_SET1(mat->a_mat4[k]);
+  #define R2__TRANSFORM_BLOCK(load, store)                                                                    \
+      do                                                                                                      \
+      {                                                                                                       \
+          size_t j = k * R2_VF_N;                                                                             \
+          r2_vf x = load(&in->x[j]);                                                                          \
+          r2_vf y = load(&in->y[j]);                                                                          \
+          r2_vf z = load(&in->z[j]);                                                                          \
+          r2_vf w = load(&in->w[j]);                                                                          \
+          r2_vf ox = R2_VF_MUL(m[0], x);                                                                      \
+          r2_vf oy = R2_VF_MUL(m[1], x);                                                                      \
+          r2_vf oz = R2_VF_MUL(m[2], x);                                                                      \
+          r2_vf ow = R2_VF_MUL(m[3], x);                                                                      \
+          ox = R2_VF_MADD(m[4], y, ox);                                                                       \
+          oy = R2_VF_MADD(m[5], y, oy);                                                                       \
+          oz = R2_VF_MADD(m[6], y, oz);                                                                       \
+          ow = R2_VF_MADD(m[7], y, ow);                                                                       \
+          ox = R2_VF_MADD(m[8], z, ox);                                                                       \
+          oy = R2_VF_MADD(m[9], z, oy);                                                                       \
+          oz = R2_VF_MADD(m[10], z, oz);                                                                      \
+          ow = R2_VF_MADD(m[11], z, ow);                                                                      \
+          ox = R2_VF_MADD(m[12], w, ox);                                                                      \
+          oy = R2_VF_MADD(m[13], w, oy);                                                                      \
+          oz = R2_VF_MADD(m[14], w, oz);                                                                      \
+          ow = R2_VF_MADD(m[15], w, ow);                                                                      \
+          store(&out->x[j], ox);                                                                              \
+          store(&out->y[j], oy);                                                                              \
+          store(&out->z[j], oz);                                                                              \
+          store(&out->w[j], ow);                                                                              \
+      } while (0)
+        if ((addr & (sizeof(r2_vf) - 1)) != 0)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < blocks; k++)
+                R2__TRANSFORM_BLOCK(R2_VF_LOAD, R2_VF_STORE);
+        }
+        else if (!stream)
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < blocks; k++)
+                R2__TRANSFORM_BLOCK(R2_VF_LOADA, R2_VF_STOREA);
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+            for (k = 0; k < blocks; k++)
+                R2__TRANSFORM_BLOCK(R2_VF_LOADA, R2_VF_STREAM);
+            _mm_sfence();
+        }
+  #undef R2__TRANSFORM_BLOCK
+        i = blocks * R2_VF_N;
+#endif
+        // scalar tail (or everything, without SIMD)
+        for (; i < n; i++)
+        {
+            vec4 p = {.x = in->x[i], .y = in->y[i], .z = in->z[i], .w = in->w[i]};
+            vec4 r;
+            mat4_transform(&p, mat, &r);
+            out->x[i] = r.x;
+            out->y[i] = r.y;
+            out->z[i] = r.z;
+            out->w[i] = r.w;
+        }
+    }
+
+    static void mat4_mul(const mat4 *m1, const mat4 *m2, mat4 *out)
+    {
+        // Same maths as mat_mul(m1, m2, 4, 4, 4, 4, out): the flat arrays are
+        // treated as row-major, so out row i = sum(m1[i][k] * m2 row k)
+        const float *a = m1->a_mat4;
+        const float *b = m2->a_mat4;
+#if defined(R2_AVX) && defined(R2_FMA)
+        // Two result rows per register. permute_ps splats one element of
+        // each 128-bit lane, so a01 gives [a0k a0k a0k a0k | a1k a1k a1k a1k]
+        __m128 t0 = _mm_loadu_ps(&b[0]);
+        __m128 t1 = _mm_loadu_ps(&b[4]);
+        __m128 t2 = _mm_loadu_ps(&b[8]);
+        __m128 t3 = _mm_loadu_ps(&b[12]);
+        __m256 b0 = _mm256_insertf128_ps(_mm256_castps128_ps256(t0), t0, 1);
+        __m256 b1 = _mm256_insertf128_ps(_mm256_castps128_ps256(t1), t1, 1);
+        __m256 b2 = _mm256_insertf128_ps(_mm256_castps128_ps256(t2), t2, 1);
+        __m256 b3 = _mm256_insertf128_ps(_mm256_castps128_ps256(t3), t3, 1);
+        __m256 a01 = _mm256_loadu_ps(&a[0]);
+        __m256 a23 = _mm256_loadu_ps(&a[8]);
+
+        __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0x55), b1, r01);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xAA), b2, r01);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xFF), b3, r01);
+
+        __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0x55), b1, r23);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xAA), b2, r23);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xFF), b3, r23);
+
+        _mm256_storeu_ps(&out->a_mat4[0], r01);
+        _mm256_storeu_ps(&out->a_mat4[8], r23);
+#elif defined(R2_SSE)
+        __m128 b0 = _mm_loadu_ps(&b[0]);
+        __m128 b1 = _mm_loadu_ps(&b[4]);
+        __m128 b2 = _mm_loadu_ps(&b[8]);
+        __m128 b3 = _mm_loadu_ps(&b[12]);
+        int i;
+        for (i = 0; i < 16; i += 4)
+        {
+            __m128 ai = _mm_loadu_ps(&a[i]);
+            __m128 r = _mm_mul_ps(_mm_shuffle_ps(ai, ai, 0x00), b0);
+            r = R2_MADD_PS(_mm_shuffle_ps(ai, ai, 0x55), b1, r);
+            r = R2_MADD_PS(_mm_shuffle_ps(ai, ai, 0xAA), b2, r);
+            r = R2_MADD_PS(_mm_shuffle_ps(ai, ai, 0xFF), b3, r);
+            _mm_storeu_ps(&out->a_mat4[i], r);
+        }
+#else
+        float tmp[16];
+        int i, j;
+        for (i = 0; i < 16; i += 4)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                tmp[i + j] = a[i] * b[j] + a[i + 1] * b[4 + j] + a[i + 2] * b[8 + j] + a[i + 3] * b[12 + j];
+            }
+        }
+        for (i = 0; i < 16; i++)
+            out->a_mat4[i] = tmp[i];
+#endif
+    }
+
+    static void mat4_perspective(float fov, float aspect, float near, float far, mat4 *out)
+    {
+        /***
+         *   ⌈ n/r       0         0           0     ⌉
+         *   | 0        n/t        0           0     |
+         *   | 0         0    -(f+n)/f-n    -2fn/f-n |
+         *   ⌊ 0         0        -1           0     ⌋
+         */
+        float range = tan(fov / 2) * near;
+        float Sx = (2 * near) / (range * aspect + range * aspect);
+        float Sy = near / range;
+        float Sz = -(far + near) / (far - near);
+        float Pz = -(2 * far * near) / (far - near);
+
+        // clang-format off
+        out->m00 = Sx; out->m10 = 0;  out->m20 = 0;  out->m30 = 0;
+        out->m01 = 0;  out->m11 = Sy; out->m21 = 0;  out->m31 = 0;
+        out->m02 = 0;  out->m12 = 0;  out->m22 = Sz; out->m32 = Pz;
+        out->m03 = 0;  out->m13 = 0;  out->m23 = -1; out->m33 = 0;
+        // clang-format on
+    }
+
+    static void mat4_lookat(const vec4 *pos, const vec4 *target, const vec4 *up, mat4 *out)
+    {
+        /**
+         *  [fur]             ∙  [pos]
+         *
+         *  ⌈ rx  ux  fx  0 ⌉    ⌈ 1  0  0  -px ⌉
+         *  | ry  uy  fy  0 | ∙  | 0  1  0  -py |
+         *  | rz  uz  fz  0 |    | 0  0  1  -pz |
+         *  ⌊ 0   0   0   1 ⌋    ⌊ 0  0  0   1  ⌋
+         */
+        vec4 right = {.x = 0, .y = 0, .z = 0, .w = 0};
+        vec3_cross(target, up, &right);
+        mat4_identity(out);
+
+        const vec4 *u = up;
+        const vec4 *f = target;
+        const vec4 *r = &right;
+        // clang-format off
+        out->m00 =  r->x; out->m10 =  r->y; out->m20 = r->z; out->m30 = -pos->x;
+        out->m01 =  u->x; out->m11 =  u->y; out->m21 = u->z; out->m31 = -pos->y;
+        out->m02 = -f->x; out->m12 = -f->y; out->m22 = f->z; out->m32 = -pos->z;
+        out->m03 = 0;    out->m13 = 0;    out->m23 = 0;    out->m33 = 1;
+        // clang-format on
+    }
+
+    static char *mat4_tos(const mat4 *m)
+    {
+        char *out = (char *)calloc(sizeof(char), 300);
+        // clang-format off
+        snprintf(out, 300, "[\n %f, %f, %f, %f \n %f, %f, %f, %f \n %f, %f, %f, %f \n %f, %f, %f, %f \n]\n", 
+            m->m00, m->m10, m->m20, m->m30,
+            m->m01, m->m11, m->m21, m->m31,
+            m->m02, m->m12, m->m22, m->m32,
+            m->m03, m->m13, m->m23, m->m33
+        );
+        // clang-format on
+        return out;
+    }
+
+    static void mat4_transpose(const mat4 *m1, mat4 *m2)
+    {
+        const float a = m1->m00;
+        const float b = m1->m10;
+        const float c = m1->m20;
+        const float d = m1->m30;
+
+        const float e = m1->m01;
+        const float f = m1->m11;
+        const float g = m1->m21;
+        const float h = m1->m31;
+
+        const float i = m1->m02;
+        const float j = m1->m12;
+        const float k = m1->m22;
+        const float l = m1->m32;
+
+        const float m = m1->m03;
+        const float n = m1->m13;
+        const float o = m1->m23;
+        const float p = m1->m33;
+
+        // clang-format off
+        m2->m00 = a; m2->m10 = e; m2->m20 = i; m2->m30 = m;
+        m2->m01 = b; m2->m11 = f; m2->m21 = j; m2->m31 = n;
+        m2->m02 = c; m2->m12 = g; m2->m22 = k; m2->m32 = o;
+        m2->m03 = d; m2->m13 = h; m2->m23 = l; m2->m33 = p;
+        // clang-format on
+    }
+
+#ifdef R2_SSE
+    // 2x2 helpers for mat4_inverse. Each __m128 holds a row-major 2x2
+    // matrix (a b c d); A# is the adjugate (d -b -c a)
+#define R2_SWZ(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(w, z, y, x))
+#define R2_SHUF(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE(w, z, y, x))
+
+    // A * B
+    static inline __m128 r2__mat2_mul(__m128 a, __m128 b)
+    {
+        return _mm_add_ps(_mm_mul_ps(a, R2_SWZ(b, 0, 3, 0, 3)),
+                          _mm_mul_ps(R2_SWZ(a, 1, 0, 3, 2), R2_SWZ(b, 2, 1, 2, 1)));
+    }
+
+    // A# * B
+    static inline __m128 r2__mat2_adj_mul(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(R2_SWZ(a, 3, 3, 0, 0), b),
+                          _mm_mul_ps(R2_SWZ(a, 1, 1, 2, 2), R2_SWZ(b, 2, 3, 0, 1)));
+    }
+
+    // A * B#
+    static inline __m128 r2__mat2_mul_adj(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(a, R2_SWZ(b, 3, 0, 3, 0)),
+                          _mm_mul_ps(R2_SWZ(a, 1, 0, 3, 2), R2_SWZ(b, 2, 1, 2, 1)));
+    }
+#endif
+
+    static bool r2__mat4_inverse(const float *m, float *out)
+    {
+        // Inverting the transpose gives the transposed inverse, so this works
+        // on the flat array and does not care which way round the layout is
+#ifdef R2_SSE
+        // Block-wise Cramer's rule: M = | A B |, with each block a 2x2
+        //                               | C D |
+        __m128 r0 = _mm_loadu_ps(&m[0]);
+        __m128 r1 = _mm_loadu_ps(&m[4]);
+        __m128 r2 = _mm_loadu_ps(&m[8]);
+        __m128 r3 = _mm_loadu_ps(&m[12]);
+        __m128 a = _mm_movelh_ps(r0, r1);
+        __m128 b = _mm_movehl_ps(r1, r0);
+        __m128 c = _mm_movelh_ps(r2, r3);
+        __m128 d = _mm_movehl_ps(r3, r2);
+
+        // (|A| |B| |C| |D|)
+        __m128 dets = _mm_sub_ps(_mm_mul_ps(R2_SHUF(r0, r2, 0, 2, 0, 2), R2_SHUF(r1, r3, 1, 3, 1, 3)),
+                                 _mm_mul_ps(R2_SHUF(r0, r2, 1, 3, 1, 3), R2_SHUF(r1, r3, 0, 2, 0, 2)));
+        __m128 det_a = R2_SWZ(dets, 0, 0, 0, 0);
+        __m128 det_b = R2_SWZ(dets, 1, 1, 1, 1);
+        __m128 det_c = R2_SWZ(dets, 2, 2, 2, 2);
+        __m128 det_d = R2_SWZ(dets, 3, 3, 3, 3);
+
+        __m128 d_c = r2__mat2_adj_mul(d, c);
+        __m128 a_b = r2__mat2_adj_mul(a, b);
+        // inverse = 1/|M| * | X Y |, these are the adjugates of X Y Z W
+        //                   | Z W |
+        __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), r2__mat2_mul(b, d_c));
+        __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), r2__mat2_mul(c, a_b));
+        __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), r2__mat2_mul_adj(d, a_b));
+        __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), r2__mat2_mul_adj(a, d_c));
+
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        __m128 tr = _mm_mul_ps(a_b, R2_SWZ(d_c, 0, 2, 1, 3));
+        tr = _mm_add_ps(tr, R2_SWZ(tr, 1, 0, 3, 2));
+        tr = _mm_add_ps(tr, R2_SWZ(tr, 2, 3, 0, 1));
+        __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+        if (_mm_cvtss_f32(det) == 0.f)
+            return false;
+
+        __m128 rdet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+        x = _mm_mul_ps(x, rdet);
+        y = _mm_mul_ps(y, rdet);
+        z = _mm_mul_ps(z, rdet);
+        w = _mm_mul_ps(w, rdet);
+
+        // undo the adjugate and put the blocks back into rows in one shuffle
+        _mm_storeu_ps(&out[0], R2_SHUF(x, y, 3, 1, 3, 1));
+        _mm_storeu_ps(&out[4], R2_SHUF(x, y, 2, 0, 2, 0));
+        _mm_storeu_ps(&out[8], R2_SHUF(z, w, 3, 1, 3, 1));
+        _mm_storeu_ps(&out[12], R2_SHUF(z, w, 2, 0, 2, 0));
+        return true;
+#else
+        // cofactor expansion, sharing the 2x2 minors of the bottom and top rows
+        float s0 = m[0] * m[5] - m[4] * m[1];
+        float s1 = m[0] * m[6] - m[4] * m[2];
+        float s2 = m[0] * m[7] - m[4] * m[3];
+        float s3 = m[1] * m[6] - m[5] * m[2];
+        float s4 = m[1] * m[7] - m[5] * m[3];
+        float s5 = m[2] * m[7] - m[6] * m[3];
+        float c5 = m[10] * m[15] - m[14] * m[11];
+        float c4 = m[9] * m[15] - m[13] * m[11];
+        float c3 = m[9] * m[14] - m[13] * m[10];
+        float c2 = m[8] * m[15] - m[12] * m[11];
+        float c1 = m[8] * m[14] - m[12] * m[10];
+        float c0 = m[8] * m[13] - m[12] * m[9];
+        float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        if (det == 0.f)
+            return false;
+
+        float r = 1.f / det;
+        float tmp[16];
+        int i;
+        tmp[0] = (m[5] * c5 - m[6] * c4 + m[7] * c3) * r;
+        tmp[1] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * r;
+        tmp[2] = (m[13] * s5 - m[14] * s4 + m[15] * s3) * r;
+        tmp[3] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * r;
+        tmp[4] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * r;
+        tmp[5] = (m[0] * c5 - m[2] * c2 + m[3] * c1) * r;
+        tmp[6] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * r;
+        tmp[7] = (m[8] * s5 - m[10] * s2 + m[11] * s1) * r;
+        tmp[8] = (m[4] * c4 - m[5] * c2 + m[7] * c0) * r;
+        tmp[9] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * r;
+        tmp[10] = (m[12] * s4 - m[13] * s2 + m[15] * s0) * r;
+        tmp[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * r;
+        tmp[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * r;
+        tmp[13] = (m[0] * c3 - m[1] * c1 + m[2] * c0) * r;
+        tmp[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * r;
+        tmp[15] = (m[8] * s3 - m[9] * s1 + m[10] * s0) * r;
+        for (i = 0; i < 16; i++)
+            out[i] = tmp[i];
+        return true;
+#endif
+    }
+
+    static bool mat4_inverse(const mat4 *m, mat4 *out)
+    {
+        return r2__mat4_inverse(m->a_mat4, out->a_mat4);
+    }
+
+    static bool mat4_inverse_affine(const mat4 *m, mat4 *out)
+    {
+        // | A t |^-1 = | A^-1  -A^-1 t |
+        // | 0 1 |      | 0      1      |
+        // The rows of A^-1 are the cross products of the columns of A over |A|
+#ifdef R2_SSE
+        __m128 c0 = _mm_loadu_ps(&m->a_mat4[0]);
+        __m128 c1 = _mm_loadu_ps(&m->a_mat4[4]);
+        __m128 c2 = _mm_loadu_ps(&m->a_mat4[8]);
+        __m128 t = _mm_loadu_ps(&m->a_mat4[12]);
+
+        // cross(a, b) = (a * b.yzx - a.yzx * b).yzx
+        __m128 c0_yzx = R2_SWZ(c0, 1, 2, 0, 3);
+        __m128 c1_yzx = R2_SWZ(c1, 1, 2, 0, 3);
+        __m128 c2_yzx = R2_SWZ(c2, 1, 2, 0, 3);
+        __m128 x0 = _mm_sub_ps(_mm_mul_ps(c1, c2_yzx), _mm_mul_ps(c1_yzx, c2));
+        __m128 x1 = _mm_sub_ps(_mm_mul_ps(c2, c0_yzx), _mm_mul_ps(c2_yzx, c0));
+        __m128 x2 = _mm_sub_ps(_mm_mul_ps(c0, c1_yzx), _mm_mul_ps(c0_yzx, c1));
+        x0 = R2_SWZ(x0, 1, 2, 0, 3);
+        x1 = R2_SWZ(x1, 1, 2, 0, 3);
+        x2 = R2_SWZ(x2, 1, 2, 0, 3);
+
+        // |A| = c0 . (c1 x c2)
+        __m128 det = _mm_mul_ps(c0, x0);
+        det = _mm_add_ps(_mm_add_ps(det, R2_SWZ(det, 1, 1, 1, 1)), R2_SWZ(det, 2, 2, 2, 2));
+        if (_mm_cvtss_f32(det) == 0.f)
+            return false;
+        __m128 rdet = _mm_div_ps(_mm_set1_ps(1.f), R2_SWZ(det, 0, 0, 0, 0));
+        x0 = _mm_mul_ps(x0, rdet);
+        x1 = _mm_mul_ps(x1, rdet);
+        x2 = _mm_mul_ps(x2, rdet);
+
+        // x0 x1 x2 are rows of A^-1, turn them into columns (w ends up 0)
+        __m128 zero = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x0, x1, x2, zero);
+
+        __m128 tr = _mm_mul_ps(R2_SWZ(t, 0, 0, 0, 0), x0);
+        tr = R2_MADD_PS(R2_SWZ(t, 1, 1, 1, 1), x1, tr);
+        tr = R2_MADD_PS(R2_SWZ(t, 2, 2, 2, 2), x2, tr);
+        tr = _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), tr);
+
+        _mm_storeu_ps(&out->a_mat4[0], x0);
+        _mm_storeu_ps(&out->a_mat4[4], x1);
+        _mm_storeu_ps(&out->a_mat4[8], x2);
+        _mm_storeu_ps(&out->a_mat4[12], tr);
+        return true;
+#else
+        float a = m->m00, b = m->m01, c = m->m02;
+        float d = m->m10, e = m->m11, f = m->m12;
+        float g = m->m20, h = m->m21, k = m->m22;
+        float tx = m->m03, ty = m->m13, tz = m->m23;
+
+        float i00 = e * k - f * h;
+        float i01 = c * h - b * k;
+        float i02 = b * f - c * e;
+        float det = a * i00 + d * i01 + g * i02;
+        if (det == 0.f)
+            return false;
+
+        float r = 1.f / det;
+        float i10 = (f * g - d * k) * r;
+        float i11 = (a * k - c * g) * r;
+        float i12 = (c * d - a * f) * r;
+        float i20 = (d * h - e * g) * r;
+        float i21 = (b * g - a * h) * r;
+        float i22 = (a * e - b * d) * r;
+        i00 *= r;
+        i01 *= r;
+        i02 *= r;
+
+        // clang-format off
+        out->m00 = i00; out->m01 = i01; out->m02 = i02; out->m03 = -(i00 * tx + i01 * ty + i02 * tz);
+        out->m10 = i10; out->m11 = i11; out->m12 = i12; out->m13 = -(i10 * tx + i11 * ty + i12 * tz);
+        out->m20 = i20; out->m21 = i21; out->m22 = i22; out->m23 = -(i20 * tx + i21 * ty + i22 * tz);
+        out->m30 = 0;   out->m31 = 0;   out->m32 = 0;   out->m33 = 1;
+        // clang-format on
+        return true;
+#endif
+    }
+
+    static size_t mat4_inverse_batch(const mat4 *in, mat4 *out, size_t n)
+    {
+        size_t i, bad = 0;
+        // an inverse is ~100 flops, so fewer of them are worth threading
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : bad) if (n >= R2_OMP_MIN_BATCH / 16)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            if (!r2__mat4_inverse(in[i].a_mat4, out[i].a_mat4))
+            {
+                if (in != out)
+                    out[i] = in[i];
+                bad++;
+            }
+        }
+        return bad;
+    }
+
+#ifdef R2_SSE
+#undef R2_SWZ
+#undef R2_SHUF
+#endif
+
+#ifdef R2_SSE
+    // xyz length of a direction, w is ignored
+    static inline __m128 r2__normalize3_sse(__m128 v)
+    {
+        __m128 sq = _mm_mul_ps(v, v);
+        __m128 len = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(sq, sq, 0x00), _mm_shuffle_ps(sq, sq, 0x55)),
+                                _mm_shuffle_ps(sq, sq, 0xAA));
+        len = _mm_sqrt_ps(len);
+        __m128 eps = _mm_set1_ps(EPSILON);
+        __m128 inv = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.f), _mm_max_ps(len, eps)), _mm_cmpge_ps(len, eps));
+        return _mm_mul_ps(v, inv);
+    }
+#endif
+
+    static void mat4_skin(const mat4 *palette, const uint16_t *bones, const float *weights, const vec4 *pos,
+                          const vec4 *nrm, vec4 *out_pos, vec4 *out_nrm, size_t n)
+    {
+        bool normals = nrm && out_nrm;
+        size_t i;
+#ifdef _OPENMP
+        // ~100 flops a vertex, so worth threading sooner than a transform
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH / 4)
+#endif
+        for (i = 0; i < n; i++)
+        {
+            const uint16_t *b = &bones[i * 4];
+            const float *w = &weights[i * 4];
+#if defined(R2_AVX) && defined(R2_FMA)
+            // blend two matrix columns per register
+            __m256 c01 = _mm256_setzero_ps();
+            __m256 c23 = _mm256_setzero_ps();
+            int k;
+            for (k = 0; k < 4; k++)
+            {
+                __m256 wk = _mm256_set1_ps(w[k]);
+                c01 = _mm256_fmadd_ps(wk, _mm256_loadu_ps(&palette[b[k]].a_mat4[0]), c01);
+                c23 = _mm256_fmadd_ps(wk, _mm256_loadu_ps(&palette[b[k]].a_mat4[8]), c23);
+            }
+            // x*c0 + y*c1 in one half, z*c2 + w*c3 in the other
+            __m128 p = _mm_loadu_ps(pos[i].a_vec);
+            __m256 pxy = _mm256_set_m128(_mm_shuffle_ps(p, p, 0x55), _mm_shuffle_ps(p, p, 0x00));
+            __m256 pzw = _mm256_set_m128(_mm_shuffle_ps(p, p, 0xFF), _mm_shuffle_ps(p, p, 0xAA));
+            __m256 r = _mm256_fmadd_ps(pzw, c23, _mm256_mul_ps(pxy, c01));
+            _mm_storeu_ps(out_pos[i].a_vec, _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1)));
+            if (normals)
+            {
+                __m128 q = _mm_loadu_ps(nrm[i].a_vec);
+                __m256 nxy = _mm256_set_m128(_mm_shuffle_ps(q, q, 0x55), _mm_shuffle_ps(q, q, 0x00));
+                __m256 nz = _mm256_castps128_ps256(_mm_shuffle_ps(q, q, 0xAA));
+                nz = _mm256_insertf128_ps(nz, _mm_setzero_ps(), 1);
+                __m256 s = _mm256_fmadd_ps(nz, c23, _mm256_mul_ps(nxy, c01));
+                __m128 v = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+                v = _mm_and_ps(v, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+                _mm_storeu_ps(out_nrm[i].a_vec, r2__normalize3_sse(v));
+            }
+#elif defined(R2_SSE)
+            __m128 c0 = _mm_setzero_ps();
+            __m128 c1 = _mm_setzero_ps();
+            __m128 c2 = _mm_setzero_ps();
+            __m128 c3 = _mm_setzero_ps();
+            int k;
+            for (k = 0; k < 4; k++)
+            {
+                const float *m = palette[b[k]].a_mat4;
+                __m128 wk = _mm_set1_ps(w[k]);
+                c0 = R2_MADD_PS(wk, _mm_loadu_ps(&m[0]), c0);
+                c1 = R2_MADD_PS(wk, _mm_loadu_ps(&m[4]), c1);
+                c2 = R2_MADD_PS(wk, _mm_loadu_ps(&m[8]), c2);
+                c3 = R2_MADD_PS(wk, _mm_loadu_ps(&m[12]), c3);
+            }
+            __m128 p = _mm_loadu_ps(pos[i].a_vec);
+            __m128 r = _mm_mul_ps(_mm_shuffle_ps(p, p, 0x00), c0);
+            r = R2_MADD_PS(_mm_shuffle_ps(p, p, 0x55), c1, r);
+            r = R2_MADD_PS(_mm_shuffle_ps(p, p, 0xAA), c2, r);
+            r = R2_MADD_PS(_mm_shuffle_ps(p, p, 0xFF), c3, r);
+            _mm_storeu_ps(out_pos[i].a_vec, r);
+            if (normals)
+            {
+                __m128 q = _mm_loadu_ps(nrm[i].a_vec);
+                __m128 v = _mm_mul_ps(_mm_shuffle_ps(q, q, 0x00), c0);
+                v = R2_MADD_PS(_mm_shuffle_ps(q, q, 0x55), c1, v);
+                v = R2_MADD_PS(_mm_shuffle_ps(q, q, 0xAA), c2, v);
+                v = _mm_and_ps(v, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+                _mm_storeu_ps(out_nrm[i].a_vec, r2__normalize3_sse(v));
+            }
+#else
+            mat4 m;
+            int j, k;
+            for (j = 0; j < 16; j++)
+                m.a_mat4[j] = 0.f;
+            for (k = 0; k < 4; k++)
+                for (j = 0; j < 16; j++)
+                    m.a_mat4[j] += w[k] * palette[b[k]].a_mat4[j];
+            vec4 p = pos[i];
+            mat4_transform(&p, &m, &out_pos[i]);
+            if (normals)
+            {
+                vec4 q = nrm[i];
+                q.w = 0.f;
+                mat4_transform(&q, &m, &out_nrm[i]);
+                out_nrm[i].w = 0.f;
+                vec3_normalize(&out_nrm[i], &out_nrm[i]);
+            }
+#endif
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Mat3
+
+    static void mat3_identity(mat3 *m)
+    {
+        // clang-format off
+        m->m00 = 1.; m->m10 = 0.; m->m20 = 0.;
+        m->m01 = 0.; m->m11 = 1.; m->m21 = 0.;
+        m->m02 = 0.; m->m12 = 0.; m->m22 = 1.;
+        // clang-format on
+    }
+
+    // Multiply two 3x3 matrix output to out
+    static void mat3_mul(const mat3 *m1, const mat3 *m2, mat3 *out)
+    {
+        mat_mul(m1->a_mat3, m2->a_mat3, 3, 3, 3, 3, out->a_mat3);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Value types (r2v4, r2m4)
+
+    // Everything here is static inline and short enough that an r2v4
+    // chain compiles to the bare SSE ops, with no loads or stores in between
+
+    static inline r2v4 r2v4_set(float x, float y, float z, float w)
+    {
+#ifdef R2_SSE
+        return _mm_setr_ps(x, y, z, w);
+#else
+        r2v4 r;
+        r.x = x;
+        r.y = y;
+        r.z = z;
+        r.w = w;
+        return r;
+#endif
+    }
+
+    static inline r2v4 r2v4_splat(float f)
+    {
+#ifdef R2_SSE
+        return _mm_set1_ps(f);
+#else
+        return r2v4_set(f, f, f, f);
+#endif
+    }
+
+    static inline r2v4 r2v4_zero(void)
+    {
+#ifdef R2_SSE
+        return _mm_setzero_ps();
+#else
+        return r2v4_set(0.f, 0.f, 0.f, 0.f);
+#endif
+    }
+
+    static inline r2v4 r2v4_load(const vec4 *v)
+    {
+#ifdef R2_SSE
+        return _mm_loadu_ps(v->a_vec);
+#else
+        return *v;
+#endif
+    }
+
+    static inline void r2v4_store(r2v4 v, vec4 *out)
+    {
+#ifdef R2_SSE
+        _mm_storeu_ps(out->a_vec, v);
+#else
+        *out = v;
+#endif
+    }
+
+    static inline r2v4 r2v4_from_vec4(vec4 v)
+    {
+        return r2v4_load(&v);
+    }
+
+    static inline vec4 r2v4_to_vec4(r2v4 v)
+    {
+        vec4 r;
+        r2v4_store(v, &r);
+        return r;
+    }
+
+#ifdef R2_SSE
+  #define R2__LANE(v, i) _mm_cvtss_f32(_mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i)))
+#else
+  #define R2__LANE(v, i) ((v).a_vec[i])
+#endif
+    static inline float r2v4_x(r2v4 v)
+    {
+        return R2__LANE(v, 0);
+    }
+    static inline float r2v4_y(r2v4 v)
+    {
+        return R2__LANE(v, 1);
+    }
+    static inline float r2v4_z(r2v4 v)
+    {
+        return R2__LANE(v, 2);
+    }
+    static inline float r2v4_w(r2v4 v)
+    {
+        return R2__LANE(v, 3);
+    }
+#undef R2__LANE
+
+    static inline bool r2v4_equals(r2v4 v1, r2v4 v2)
+    {
+        vec4 a = r2v4_to_vec4(v1);
+        vec4 b = r2v4_to_vec4(v2);
+        return vec4_equals(&a, &b);
+    }
+
+    // Two operand ops: the SSE intrinsic, or the same op on each element
+#ifdef R2_SSE
+  #define R2__OP2(name, sse, expr)                                                                              \
+      static inline r2v4 name(r2v4 v1, r2v4 v2)                                                                 \
+      {                                                                                                         \
+          return sse(v1, v2);                                                                                   \
+      }
+#else
+  #define R2__OP2(name, sse, expr)                                                                              \
+      static inline r2v4 name(r2v4 v1, r2v4 v2)                                                                 \
+      {                                                                                                         \
+          r2v4 r;                                                                                               \
+          int i;                                                                                                \
+          for (i = 0; i < 4; i++)                                                                               \
+          {                                                                                                     \
+              float a = v1.a_vec[i], b = v2.a_vec[i];                                                           \
+              r.a_vec[i] = (expr);                                                                              \
+          }                                                                                                     \
+          return r;                                                                                             \
+      }
+#endif
+    R2__OP2(r2v4_add, _mm_add_ps, a + b)
+    R2__OP2(r2v4_sub, _mm_sub_ps, a - b)
+    R2__OP2(r2v4_mul_vec, _mm_mul_ps, a * b)
+    R2__OP2(r2v4_div_vec, _mm_div_ps, a / b)
+    R2__OP2(r2v4_min, _mm_min_ps, a < b ? a : b)
+    R2__OP2(r2v4_max, _mm_max_ps, a > b ? a : b)
+#undef R2__OP2
+
+    static inline r2v4 r2v4_mul(r2v4 v, float fac)
+    {
+        return r2v4_mul_vec(v, r2v4_splat(fac));
+    }
+
+    static inline r2v4 r2v4_div(r2v4 v, float fac)
+    {
+        return r2v4_div_vec(v, r2v4_splat(fac));
+    }
+
+    static inline r2v4 r2v4_madd(r2v4 v1, r2v4 v2, r2v4 v3)
+    {
+#ifdef R2_SSE
+        return R2_MADD_PS(v1, v2, v3);
+#else
+        return r2v4_set(fmaf(v1.x, v2.x, v3.x), fmaf(v1.y, v2.y, v3.y), fmaf(v1.z, v2.z, v3.z),
+                        fmaf(v1.w, v2.w, v3.w));
+#endif
+    }
+
+    static inline r2v4 r2v4_neg(r2v4 v)
+    {
+#ifdef R2_SSE
+        return _mm_xor_ps(v, _mm_set1_ps(-0.f));
+#else
+        return r2v4_set(-v.x, -v.y, -v.z, -v.w);
+#endif
+    }
+
+    static inline r2v4 r2v4_abs(r2v4 v)
+    {
+#ifdef R2_SSE
+        return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+#else
+        return r2v4_set(fabsf(v.x), fabsf(v.y), fabsf(v.z), fabsf(v.w));
+#endif
+    }
+
+    static inline r2v4 r2v4_sqrt(r2v4 v)
+    {
+#ifdef R2_SSE
+        return _mm_sqrt_ps(v);
+#else
+        return r2v4_set(sqrtf(v.x), sqrtf(v.y), sqrtf(v.z), sqrtf(v.w));
+#endif
+    }
+
+    static inline r2v4 r2v4_lerp(r2v4 v1, r2v4 v2, float t)
+    {
+        return r2v4_madd(r2v4_sub(v2, v1), r2v4_splat(t), v1);
+    }
+
+    static inline float r2v4_dot(r2v4 v1, r2v4 v2)
+    {
+#ifdef R2_SSE
+        // (x + y) + (z + w), the pairing of vecn_dot's four partial sums,
+        // so the two agree bit for bit
+        __m128 m = _mm_mul_ps(v1, v2);
+        __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehl_ps(s, s)));
+#else
+        float xy = v1.x * v2.x + v1.y * v2.y;
+        float zw = v1.z * v2.z + v1.w * v2.w;
+        return xy + zw;
+#endif
+    }
+
+    static inline float r2v4_dot3(r2v4 v1, r2v4 v2)
+    {
+#ifdef R2_SSE
+        // (x + y) + z, in vecn_dot's order for three
+        __m128 m = _mm_mul_ps(v1, v2);
+        __m128 s = _mm_add_ss(m, _mm_shuffle_ps(m, m, 0x55));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehl_ps(m, m)));
+#else
+        float xy = v1.x * v2.x + v1.y * v2.y;
+        return xy + v1.z * v2.z;
+#endif
+    }
+
+    static inline r2v4 r2v4_cross3(r2v4 v1, r2v4 v2)
+    {
+#ifdef R2_SSE
+        // cross(a, b) = (a * b.yzx - a.yzx * b).yzx, the w lanes cancel
+        __m128 a_yzx = _mm_shuffle_ps(v1, v1, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_yzx = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 c = _mm_sub_ps(_mm_mul_ps(v1, b_yzx), _mm_mul_ps(a_yzx, v2));
+        c = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+        return _mm_and_ps(c, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+#else
+        return r2v4_set(v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x, 0.f);
+#endif
+    }
+
+    static inline float r2v4_length(r2v4 v)
+    {
+        return sqrtf(r2v4_dot(v, v));
+    }
+
+    static inline r2v4 r2v4_normalize(r2v4 v)
+    {
+        float len = r2v4_length(v);
+        if (len < EPSILON)
+            return r2v4_zero();
+        return r2v4_div(v, len);
+    }
+
+    static inline r2m4 r2m4_load(const mat4 *m)
+    {
+        r2m4 r;
+#ifdef R2_SSE
+        r.c[0] = _mm_loadu_ps(&m->a_mat4[0]);
+        r.c[1] = _mm_loadu_ps(&m->a_mat4[4]);
+        r.c[2] = _mm_loadu_ps(&m->a_mat4[8]);
+        r.c[3] = _mm_loadu_ps(&m->a_mat4[12]);
+#else
+        memcpy(r.c, m->a_mat4, sizeof(r.c));
+#endif
+        return r;
+    }
+
+    static inline void r2m4_store(r2m4 m, mat4 *out)
+    {
+#ifdef R2_SSE
+        _mm_storeu_ps(&out->a_mat4[0], m.c[0]);
+        _mm_storeu_ps(&out->a_mat4[4], m.c[1]);
+        _mm_storeu_ps(&out->a_mat4[8], m.c[2]);
+        _mm_storeu_ps(&out->a_mat4[12], m.c[3]);
+#else
+        memcpy(out->a_mat4, m.c, sizeof(m.c));
+#endif
+    }
+
+    static inline r2m4 r2m4_from_mat4(const mat4 *m)
+    {
+        return r2m4_load(m);
+    }
+
+    static inline mat4 r2m4_to_mat4(r2m4 m)
+    {
+        mat4 r;
+        r2m4_store(m, &r);
+        return r;
+    }
+
+    static inline r2m4 r2m4_identity(void)
+    {
+        r2m4 r;
+        r.c[0] = r2v4_set(1.f, 0.f, 0.f, 0.f);
+        r.c[1] = r2v4_set(0.f, 1.f, 0.f, 0.f);
+        r.c[2] = r2v4_set(0.f, 0.f, 1.f, 0.f);
+        r.c[3] = r2v4_set(0.f, 0.f, 0.f, 1.f);
+        return r;
+    }
+
+    static inline r2m4 r2m4_transpose(r2m4 m)
+    {
+#ifdef R2_SSE
+        _MM_TRANSPOSE4_PS(m.c[0], m.c[1], m.c[2], m.c[3]);
+        return m;
+#else
+        r2m4 r;
+        int i, j;
+        for (i = 0; i < 4; i++)
+            for (j = 0; j < 4; j++)
+                r.c[i].a_vec[j] = m.c[j].a_vec[i];
+        return r;
+#endif
+    }
+
+    static inline r2v4 r2m4_transform(r2m4 m, r2v4 p)
+    {
+        // x * c0 + y * c1 + z * c2 + w * c3
+#ifdef R2_SSE
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(p, p, 0x00), m.c[0]);
+        r = R2_MADD_PS(_mm_shuffle_ps(p, p, 0x55), m.c[1], r);
+        r = R2_MADD_PS(_mm_shuffle_ps(p, p, 0xAA), m.c[2], r);
+        return R2_MADD_PS(_mm_shuffle_ps(p, p, 0xFF), m.c[3], r);
+#else
+        r2v4 r = r2v4_mul(m.c[0], p.x);
+        r = r2v4_add(r, r2v4_mul(m.c[1], p.y));
+        r = r2v4_add(r, r2v4_mul(m.c[2], p.z));
+        return r2v4_add(r, r2v4_mul(m.c[3], p.w));
+#endif
+    }
+
+    static inline r2m4 r2m4_mul(r2m4 m1, r2m4 m2)
+    {
+        // mat4_mul builds its output 4 floats at a time as m2 transforming
+        // the matching 4 floats of m1, which here is column by column
+        r2m4 r;
+        r.c[0] = r2m4_transform(m2, m1.c[0]);
+        r.c[1] = r2m4_transform(m2, m1.c[1]);
+        r.c[2] = r2m4_transform(m2, m1.c[2]);
+        r.c[3] = r2m4_transform(m2, m1.c[3]);
+        return r;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Frustum
+
+    static void frustum_from_mat4(const mat4 *proj, const mat4 *view, frustum *out)
+    {
+        // Gribb & Hartmann: with the rows of the clip matrix r0..r3 (the
+        // flat array is row-major, the same as mat4_mul) the planes are
+        // r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2
+        mat4 clip;
+        if (view)
+            mat4_mul(proj, view, &clip);
+        else
+            clip = *proj;
+
+        const float *r3 = &clip.a_mat4[12];
+        int p, k;
+        for (p = 0; p < 6; p++)
+        {
+            const float *r = &clip.a_mat4[(p / 2) * 4];
+            float sign = (p % 2) ? -1.f : 1.f;
+            for (k = 0; k < 4; k++)
+                out->planes[p].a_vec[k] = r3[k] + sign * r[k];
+            float len = sqrtf(vec3_length_sqrd(&out->planes[p]));
+            if (len > EPSILON)
+                vec4_div(&out->planes[p], len, &out->planes[p]);
+        }
+    }
+
+    // Visibility bits of objects [base, base + count), count <= 32. Spheres
+    // pass radii, boxes pass extents. An object is kept when its signed
+    // distance to every plane, pushed out by its radius (or by the box's
+    // projected extent |n| . e), is >= 0, so only the nearest plane matters
+    static uint32_t r2__cull_word(const frustum *f, const vec3_soa *c, const float *radii, const vec3_soa *ext,
+                                  size_t base, size_t count)
+    {
+        uint32_t bits = 0;
+        size_t k = 0;
+        int p;
+#ifdef R2_VF_N
+        r2_vf zero = R2_VF_SET1(0.f);
+        for (; k + R2_VF_N <= count; k += R2_VF_N)
+        {
+            size_t i = base + k;
+            r2_vf x = R2_VF_LOAD(&c->x[i]);
+            r2_vf y = R2_VF_LOAD(&c->y[i]);
+            r2_vf z = R2_VF_LOAD(&c->z[i]);
+            r2_vf r = radii ? R2_VF_LOAD(&radii[i]) : zero;
+            r2_vf dmin = R2_VF_SET1(INFINITY);
+            for (p = 0; p < 6; p++)
+            {
+                const vec4 *pl = &f->planes[p];
+                r2_vf d = R2_VF_ADD(R2_VF_SET1(pl->w), r);
+                d = R2_VF_MADD(R2_VF_SET1(pl->x), x, d);
+                d = R2_VF_MADD(R2_VF_SET1(pl->y), y, d);
+                d = R2_VF_MADD(R2_VF_SET1(pl->z), z, d);
+                if (ext)
+                {
+                    d = R2_VF_MADD(R2_VF_SET1(fabsf(pl->x)), R2_VF_LOAD(&ext->x[i]), d);
+                    d = R2_VF_MADD(R2_VF_SET1(fabsf(pl->y)), R2_VF_LOAD(&ext->y[i]), d);
+                    d = R2_VF_MADD(R2_VF_SET1(fabsf(pl->z)), R2_VF_LOAD(&ext->z[i]), d);
+                }
+                dmin = R2_VF_MIN(dmin, d);
+            }
+            bits |= (uint32_t)R2_VF_MOVEMASK(R2_VF_GE(dmin, zero)) << k;
+        }
+#endif
+        for (; k < count; k++)
+        {
+            size_t i = base + k;
+            float dmin = INFINITY;
+            for (p = 0; p < 6; p++)
+            {
+                const vec4 *pl = &f->planes[p];
+                float d = pl->x * c->x[i] + pl->y * c->y[i] + pl->z * c->z[i] + pl->w;
+                if (radii)
+                    d += radii[i];
+                if (ext)
+                    d += fabsf(pl->x) * ext->x[i] + fabsf(pl->y) * ext->y[i] + fabsf(pl->z) * ext->z[i];
+                dmin = fminf(dmin, d);
+            }
+            bits |= (uint32_t)(dmin >= 0.f) << k;
+        }
+        return bits;
+    }
+
+    static size_t r2__cull_list(const frustum *f, const vec3_soa *c, const float *radii, const vec3_soa *ext,
+                                uint32_t *visible)
+    {
+        size_t n = c->n;
+        size_t base, count = 0;
+        for (base = 0; base < n; base += 32)
+        {
+            size_t len = (n - base < 32) ? n - base : 32;
+            uint32_t bits = r2__cull_word(f, c, radii, ext, base, len);
+            size_t k;
+            // branchless compaction: always write, only advance on a hit
+            for (k = 0; k < len; k++)
+            {
+                visible[count] = (uint32_t)(base + k);
+                count += (bits >> k) & 1;
+            }
+        }
+        return count;
+    }
+
+    static void r2__cull_mask(const frustum *f, const vec3_soa *c, const float *radii, const vec3_soa *ext,
+                              uint32_t *mask)
+    {
+        size_t n = c->n;
+        size_t words = (n + 31) / 32;
+        size_t w;
+#ifdef _OPENMP
+#pragma omp parallel for if (n >= R2_OMP_MIN_BATCH)
+#endif
+        for (w = 0; w < words; w++)
+        {
+            size_t base = w * 32;
+            mask[w] = r2__cull_word(f, c, radii, ext, base, (n - base < 32) ? n - base : 32);
+        }
+    }
+
+    static size_t frustum_cull_spheres(const frustum *f, const vec3_soa *centers, const float *radii, uint32_t *visible)
+    {
+        return r2__cull_list(f, centers, radii, NULL, visible);
+    }
+
+    static void frustum_cull_spheres_mask(const frustum *f, const vec3_soa *centers, const float *radii, uint32_t *mask)
+    {
+        r2__cull_mask(f, centers, radii, NULL, mask);
+    }
+
+    static size_t frustum_cull_aabbs(const frustum *f, const vec3_soa *centers, const vec3_soa *extents,
+                                     uint32_t *visible)
+    {
+        return r2__cull_list(f, centers, NULL, extents, visible);
+    }
+
+    static void frustum_cull_aabbs_mask(const frustum *f, const vec3_soa *centers, const vec3_soa *extents,
+                                        uint32_t *mask)
+    {
+        r2__cull_mask(f, centers, NULL, extents, mask);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Packed GEMM (the non-BLAS mat_mul for anything but small matrices)
+    //
+    // Goto / BLIS style: m2 is cut into kc x nc blocks and m1 into mc x kc
+    // blocks, each packed into a contiguous buffer of micro-panels (nr wide
+    // for m2, mr tall for m1) so the micro-kernel reads both with unit
+    // stride. The micro-kernel keeps an mr x nr tile of out in registers for
+    // the whole kc loop. Partial panels are zero padded and partial tiles
+    // go through a scratch tile.
+
+    // Element types the packing can read, anything but float is widened
+    // as it is packed so the micro-kernels only ever see floats
+    enum r2__elem
+    {
+        R2__F32,
+        R2__F16,
+        R2__BF16
+    };
+
+    // n elements of matrix m (of type t) from element i on, as floats
+    static void r2__gemm_load(const r2_kernels *k, const void *m, int t, size_t i, int n, float *dst)
+    {
+        if (t == R2__F16)
+            k->from_f16(&((const f16 *)m)[i], n, dst);
+        else if (t == R2__BF16)
+            vecn_from_bf16(&((const bf16 *)m)[i], n, dst);
+        else
+            memcpy(dst, &((const float *)m)[i], sizeof(float) * (size_t)n);
+    }
+
+    // Pack rows [0, kc) and columns [0, nc) of b (row stride ldb, starting
+    // at element off) into nr wide panels, each kc * nr floats
+    static void r2__gemm_pack_b(const r2_kernels *kr, const void *b, int t, size_t off, unsigned int ldb, int kc,
+                                int nc, int nr, float *dst)
+    {
+        int j, k, jj;
+        for (j = 0; j < nc; j += nr)
+        {
+            int w = (nc - j < nr) ? nc - j : nr;
+            for (k = 0; k < kc; k++)
+            {
+                r2__gemm_load(kr, b, t, off + (size_t)k * ldb + j, w, dst);
+                for (jj = w; jj < nr; jj++)
+                    dst[jj] = 0.f;
+                dst += nr;
+            }
+        }
+    }
+
+    // Pack rows [0, mc) and columns [0, kc) of a (row stride lda) into
+    // mr tall panels, each kc * mr floats stored k-major
+    static void r2__gemm_pack_a(const float *a, unsigned int lda, int mc, int kc, int mr, float *dst)
+    {
+        int i, k, ii;
+        for (i = 0; i < mc; i += mr)
+        {
+            int h = (mc - i < mr) ? mc - i : mr;
+            for (k = 0; k < kc; k++)
+            {
+                for (ii = 0; ii < h; ii++)
+                    dst[ii] = a[(size_t)(i + ii) * lda + k];
+                for (; ii < mr; ii++)
+                    dst[ii] = 0.f;
+                dst += mr;
+            }
+        }
+    }
+
+    // One packed mc x kc block of m1 against one packed kc x nc block of m2
+    static void r2__gemm_block(const r2_kernels *k, const float *ap, const float *bp, int mc, int nc, int kc,
+                               float *c, unsigned int ldc, int acc)
+    {
+        float tile[8 * 32]; // largest mr * nr
+        int mr = k->mr;
+        int nr = k->nr;
+        int i, j, ii, jj;
+        for (j = 0; j < nc; j += nr)
+        {
+            int w = (nc - j < nr) ? nc - j : nr;
+            for (i = 0; i < mc; i += mr)
+            {
+                int h = (mc - i < mr) ? mc - i : mr;
+                const float *a = &ap[(size_t)i * kc];
+                const float *b = &bp[(size_t)j * kc];
+                float *ct = &c[(size_t)i * ldc + j];
+                if (h == mr && w == nr)
+                {
+                    k->gemm_tile(kc, a, b, ct, (int)ldc, acc);
+                    continue;
+                }
+                k->gemm_tile(kc, a, b, tile, nr, 0);
+                for (ii = 0; ii < h; ii++)
+                {
+                    for (jj = 0; jj < w; jj++)
+                        ct[ii * ldc + jj] = acc ? ct[ii * ldc + jj] + tile[ii * nr + jj] : tile[ii * nr + jj];
+                }
+            }
+        }
+    }
+
+    // m1 and m2 are of element type et. Returns false (having done nothing)
+    // when there is no memory for the packed blocks.
+    static bool r2__gemm(const r2_kernels *k, const void *m1, const void *m2, int et, unsigned int r1,
+                         unsigned int c1, unsigned int c2, float *out)
+    {
+        int mr = k->mr;
+        int nr = k->nr;
+        int mc_max = (R2_GEMM_MC / mr) * mr;
+        int nc_max = (R2_GEMM_NC / nr) * nr;
+        int kc_max = R2_GEMM_KC;
+        int threads = 1;
+#ifdef _OPENMP
+        if ((double)r1 * c1 * c2 >= R2_OMP_MIN_FLOPS)
+            threads = omp_get_max_threads();
+#endif
+        // every thread packs its own blocks of m1, the m2 block is shared.
+        // Halves are widened into a per thread row buffer before packing m1.
+        size_t a_size = (size_t)mc_max * kc_max;
+        int widen = (et != R2__F32);
+        float *ap = (float *)malloc(sizeof(float) * a_size * threads * (widen ? 2 : 1));
+        float *bp = (float *)malloc(sizeof(float) * (size_t)nc_max * kc_max);
+        if (ap == NULL || bp == NULL)
+        {
+            free(ap);
+            free(bp);
+            return false;
+        }
+        // The work for each m2 block is (row block x column tile). Columns
+        // are only cut finer than nc when there are threads to feed, so a
+        // tall m1 or a wide m2 both spread out.
+        int nt = (threads > 1) ? ((256 + nr - 1) / nr) * nr : nc_max;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+        {
+            float *apt = ap;
+            unsigned int jc, pc;
+#ifdef _OPENMP
+            apt = &ap[a_size * omp_get_thread_num() * (widen ? 2 : 1)];
+#endif
+            float *awt = &apt[a_size];
+            for (jc = 0; jc < c2; jc += nc_max)
+            {
+                int nc = (c2 - jc < (unsigned int)nc_max) ? (int)(c2 - jc) : nc_max;
+                for (pc = 0; pc < c1; pc += kc_max)
+                {
+                    int kc = (c1 - pc < (unsigned int)kc_max) ? (int)(c1 - pc) : kc_max;
+                    int panels = (nc + nr - 1) / nr;
+                    int p;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+                    for (p = 0; p < panels; p++)
+                    {
+                        int j = p * nr;
+                        int w = (nc - j < nr) ? nc - j : nr;
+                        r2__gemm_pack_b(k, m2, et, (size_t)pc * c2 + jc + j, c2, kc, w, nr, &bp[(size_t)j * kc]);
+                    }
+
+                    int row_blocks = (int)((r1 + mc_max - 1) / mc_max);
+                    int col_blocks = (nc + nt - 1) / nt;
+                    int t;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                    for (t = 0; t < row_blocks * col_blocks; t++)
+                    {
+                        unsigned int ic = (unsigned int)(t / col_blocks) * mc_max;
+                        int j = (t % col_blocks) * nt;
+                        int mc = (r1 - ic < (unsigned int)mc_max) ? (int)(r1 - ic) : mc_max;
+                        int w = (nc - j < nt) ? nc - j : nt;
+                        if (widen)
+                        {
+                            int ii;
+                            for (ii = 0; ii < mc; ii++)
+                                r2__gemm_load(k, m1, et, (size_t)(ic + ii) * c1 + pc, kc, &awt[(size_t)ii * kc]);
+                            r2__gemm_pack_a(awt, (unsigned int)kc, mc, kc, mr, apt);
+                        }
+                        else
+                            r2__gemm_pack_a(&((const float *)m1)[(size_t)ic * c1 + pc], c1, mc, kc, mr, apt);
+                        r2__gemm_block(k, apt, &bp[(size_t)j * kc], mc, w, kc, &out[(size_t)ic * c2 + jc + j], c2,
+                                       pc != 0);
+                    }
+                }
+            }
+        }
+        free(ap);
+        free(bp);
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Generic Matrix Multiply
+
+    // The packed GEMM runs its micro-kernel over nr wide panels and only pads
+    // the ragged last one, so once a product is big enough to pack the SIMD
+    // table pays off however few columns the output has (1000x1000 by
+    // 1000x8, say). Smaller products use the row kernel, picked by row length.
+    static const r2_kernels *r2__mat_mul_kernels(unsigned int r1, unsigned int c1, unsigned int c2)
+    {
+        if ((double)r1 * c1 * c2 >= R2_GEMM_MIN_FLOPS)
+            return r2__kernels(R2_SIMD_MIN_N);
+        return r2__kernels((int)c2);
+    }
+
+    static void mat_mul(const float *m1, const float *m2, unsigned int r1, unsigned int c1, unsigned int r2,
+                        unsigned int c2, float *out)
+    {
+#ifdef HAVE_BLAS
+      cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+		  r1, c2, c1,
+		  1.0f, m1, c1,
+		        m2, c2,
+		  0.0f, out, c2);
+#else
+        if (c1 != r2)
+        {
+            perror("column size of m1 must match row size of m2");
+            return;
+        }
+
+        const r2_kernels *k = r2__mat_mul_kernels(r1, c1, c2);
+        // (the unblocked kernel is also the fallback when packing runs out of memory)
+        if ((double)r1 * c1 * c2 < R2_GEMM_MIN_FLOPS || !r2__gemm(k, m1, m2, R2__F32, r1, c1, c2, out))
+            k->mat_mul(m1, m2, r1, c1, c2, out);
+#endif
+    }
+
+    static void r2__mat_mul_half(const void *m1, const void *m2, int t, unsigned int r1, unsigned int c1,
+                                 unsigned int r2, unsigned int c2, float *out)
+    {
+        if (c1 != r2)
+        {
+            perror("column size of m1 must match row size of m2");
+            return;
+        }
+
+        const r2_kernels *k = r2__mat_mul_kernels(r1, c1, c2);
+        if ((double)r1 * c1 * c2 >= R2_GEMM_MIN_FLOPS && r2__gemm(k, m1, m2, t, r1, c1, c2, out))
+            return;
+
+        // small (or no room to pack): widen both and use the float mat_mul
+        float *a = (float *)malloc(sizeof(float) * ((size_t)r1 * c1 + 1));
+        float *b = (float *)malloc(sizeof(float) * ((size_t)c1 * c2 + 1));
+        if (a == NULL || b == NULL)
+        {
+            perror("out of memory widening halves for mat_mul");
+            free(a);
+            free(b);
+            return;
+        }
+        if (t == R2__F16)
+        {
+            vecn_from_f16((const f16 *)m1, (int)(r1 * c1), a);
+            vecn_from_f16((const f16 *)m2, (int)(c1 * c2), b);
+        }
+        else
+        {
+            vecn_from_bf16((const bf16 *)m1, (int)(r1 * c1), a);
+            vecn_from_bf16((const bf16 *)m2, (int)(c1 * c2), b);
+        }
+        mat_mul(a, b, r1, c1, r2, c2, out);
+        free(a);
+        free(b);
+    }
+
+    static void mat_mul_f16(const f16 *m1, const f16 *m2, unsigned int r1, unsigned int c1, unsigned int r2,
+                            unsigned int c2, float *out)
+    {
+        r2__mat_mul_half(m1, m2, R2__F16, r1, c1, r2, c2, out);
+    }
+
+    static void mat_mul_bf16(const bf16 *m1, const bf16 *m2, unsigned int r1, unsigned int c1, unsigned int r2,
+                             unsigned int c2, float *out)
+    {
+        r2__mat_mul_half(m1, m2, R2__BF16, r1, c1, r2, c2, out);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Generic Matrix Transpose
+
+    // Transpose an h x w block at src (row stride ss) into dst (row stride ds)
+    static void r2__transpose_scalar(const float *src, size_t ss, float *dst, size_t ds, unsigned int h,
+                                     unsigned int w)
+    {
+        unsigned int i, j;
+        for (i = 0; i < h; i++)
+        {
+            for (j = 0; j < w; j++)
+            {
+                dst[j * ds + i] = src[i * ss + j];
+            }
+        }
+    }
+
+#if defined(R2_AVX)
+    // Full blocks are transposed in registers, all rows are loaded before
+    // any are stored so src may be dst
+    #define R2_TRANSPOSE_BLOCK 8
+    static void r2__transpose_block(const float *src, size_t ss, float *dst, size_t ds)
+    {
+        __m256 r0 = _mm256_loadu_ps(&src[0 * ss]);
+        __m256 r1 = _mm256_loadu_ps(&src[1 * ss]);
+        __m256 r2 = _mm256_loadu_ps(&src[2 * ss]);
+        __m256 r3 = _mm256_loadu_ps(&src[3 * ss]);
+        __m256 r4 = _mm256_loadu_ps(&src[4 * ss]);
+        __m256 r5 = _mm256_loadu_ps(&src[5 * ss]);
+        __m256 r6 = _mm256_loadu_ps(&src[6 * ss]);
+        __m256 r7 = _mm256_loadu_ps(&src[7 * ss]);
+
+        // interleave pairs of rows, then pairs of pairs, then swap the
+        // 128-bit halves to finish the 8x8
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+        __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps(&dst[0 * ds], _mm256_permute2f128_ps(u0, u4, 0x20));
+        _mm256_storeu_ps(&dst[1 * ds], _mm256_permute2f128_ps(u1, u5, 0x20));
+        _mm256_storeu_ps(&dst[2 * ds], _mm256_permute2f128_ps(u2, u6, 0x20));
+        _mm256_storeu_ps(&dst[3 * ds], _mm256_permute2f128_ps(u3, u7, 0x20));
+        _mm256_storeu_ps(&dst[4 * ds], _mm256_permute2f128_ps(u0, u4, 0x31));
+        _mm256_storeu_ps(&dst[5 * ds], _mm256_permute2f128_ps(u1, u5, 0x31));
+        _mm256_storeu_ps(&dst[6 * ds], _mm256_permute2f128_ps(u2, u6, 0x31));
+        _mm256_storeu_ps(&dst[7 * ds], _mm256_permute2f128_ps(u3, u7, 0x31));
+    }
+#elif defined(R2_SSE)
+    #define R2_TRANSPOSE_BLOCK 4
+    static void r2__transpose_block(const float *src, size_t ss, float *dst, size_t ds)
+    {
+        __m128 r0 = _mm_loadu_ps(&src[0 * ss]);
+        __m128 r1 = _mm_loadu_ps(&src[1 * ss]);
+        __m128 r2 = _mm_loadu_ps(&src[2 * ss]);
+        __m128 r3 = _mm_loadu_ps(&src[3 * ss]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&dst[0 * ds], r0);
+        _mm_storeu_ps(&dst[1 * ds], r1);
+        _mm_storeu_ps(&dst[2 * ds], r2);
+        _mm_storeu_ps(&dst[3 * ds], r3);
+    }
+#else
+    #define R2_TRANSPOSE_BLOCK 1
+    static void r2__transpose_block(const float *src, size_t ss, float *dst, size_t ds)
+    {
+        dst[0] = src[0];
+    }
+#endif
+
+    // In place transpose of an n x n matrix. Blocks above the diagonal are
+    // swapped with their mirror below it, each transposed on the way.
+    static void r2__transpose_square(float *m, unsigned int n)
+    {
+        const unsigned int b = R2_TRANSPOSE_BLOCK;
+        float tmp[R2_TRANSPOSE_BLOCK * R2_TRANSPOSE_BLOCK];
+        unsigned int i0, j0, i, j, ii, jj;
+        for (i0 = 0; i0 < n; i0 += R2_TRANSPOSE_TILE)
+        {
+            unsigned int i1 = (n - i0 < R2_TRANSPOSE_TILE) ? n : i0 + R2_TRANSPOSE_TILE;
+            for (j0 = i0; j0 < n; j0 += R2_TRANSPOSE_TILE)
+            {
+                unsigned int j1 = (n - j0 < R2_TRANSPOSE_TILE) ? n : j0 + R2_TRANSPOSE_TILE;
+                for (i = i0; i < i1; i += b)
+                {
+                    for (j = (j0 > i) ? j0 : i; j < j1; j += b)
+                    {
+                        float *upper = &m[(size_t)i * n + j];
+                        float *lower = &m[(size_t)j * n + i];
+                        unsigned int h = (i1 - i < b) ? i1 - i : b;
+                        unsigned int w = (j1 - j < b) ? j1 - j : b;
+                        if (h == b && w == b)
+                        {
+                            if (i == j)
+                            {
+                                r2__transpose_block(upper, n, upper, n);
+                                continue;
+                            }
+                            r2__transpose_block(upper, n, tmp, b);
+                            r2__transpose_block(lower, n, upper, n);
+                            for (ii = 0; ii < b; ii++)
+                                memcpy(&lower[(size_t)ii * n], &tmp[ii * b], sizeof(float) * b);
+                            continue;
+                        }
+                        // partial block on the edge
+                        for (ii = 0; ii < h; ii++)
+                        {
+                            for (jj = (i == j) ? ii + 1 : 0; jj < w; jj++)
+                            {
+                                float t = upper[(size_t)ii * n + jj];
+                                upper[(size_t)ii * n + jj] = lower[(size_t)jj * n + ii];
+                                lower[(size_t)jj * n + ii] = t;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    static void mat_transpose(const float *m, unsigned int r, unsigned int c, float *out)
+    {
+        if (m == out && r == c)
+        {
+            r2__transpose_square(out, r);
+            return;
+        }
+
+        const unsigned int b = R2_TRANSPOSE_BLOCK;
+        unsigned int i0, j0, i, j;
+        for (i0 = 0; i0 < r; i0 += R2_TRANSPOSE_TILE)
+        {
+            unsigned int i1 = (r - i0 < R2_TRANSPOSE_TILE) ? r : i0 + R2_TRANSPOSE_TILE;
+            for (j0 = 0; j0 < c; j0 += R2_TRANSPOSE_TILE)
+            {
+                unsigned int j1 = (c - j0 < R2_TRANSPOSE_TILE) ? c : j0 + R2_TRANSPOSE_TILE;
+                for (i = i0; i < i1; i += b)
+                {
+                    unsigned int h = (i1 - i < b) ? i1 - i : b;
+                    for (j = j0; j < j1; j += b)
+                    {
+                        unsigned int w = (j1 - j < b) ? j1 - j : b;
+                        const float *src = &m[(size_t)i * c + j];
+                        float *dst = &out[(size_t)j * r + i];
+                        if (h == b && w == b)
+                            r2__transpose_block(src, c, dst, r);
+                        else
+                            r2__transpose_scalar(src, c, dst, r, h, w);
+                    }
+                }
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // LU factorization
+
+    static void r2__swap_rows(float *a, float *b, unsigned int n)
+    {
+        unsigned int i;
+        for (i = 0; i < n; i++)
+        {
+            float t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+    }
+
+#ifndef HAVE_BLAS
+    // Unblocked LU of the panel of columns [k0, k1) over rows [k0, n). Swaps take whole rows, so the L columns
+    // to the left and the rows still to be solved on the right are permuted along with it
+    static bool r2__lu_panel(float *m, unsigned int n, unsigned int k0, unsigned int k1, int *piv)
+    {
+        bool ok = true;
+        unsigned int i, j, c;
+        for (j = k0; j < k1; j++)
+        {
+            unsigned int p = j;
+            float best = fabsf(m[(size_t)j * n + j]);
+            for (i = j + 1; i < n; i++)
+            {
+                float v = fabsf(m[(size_t)i * n + j]);
+                if (v > best)
+                {
+                    best = v;
+                    p = i;
+                }
+            }
+            piv[j] = (int)p;
+            if (p != j)
+                r2__swap_rows(&m[(size_t)j * n], &m[(size_t)p * n], n);
+            if (best == 0.f)
+            {
+                // nothing to eliminate, the column is zero from the diagonal down
+                ok = false;
+                continue;
+            }
+
+            const float *pr = &m[(size_t)j * n];
+            float inv = 1.f / pr[j];
+            for (i = j + 1; i < n; i++)
+            {
+                float *row = &m[(size_t)i * n];
+                float l = row[j] * inv;
+                row[j] = l;
+                for (c = j + 1; c < k1; c++)
+                    row[c] -= l * pr[c];
+            }
+        }
+        return ok;
+    }
+#endif
+
+    static bool mat_lu(float *m, unsigned int n, int *piv)
+    {
+#ifdef HAVE_BLAS
+        // LAPACK is column-major: hand it the transpose so it factors m itself, then turn the factors back
+        int nn = (int)n, info = 0, i;
+        if (n == 0)
+            return true; // lda must be at least 1, and the empty matrix is already factored
+        mat_transpose(m, n, n, m);
+        sgetrf_(&nn, &nn, m, &nn, piv, &info);
+        mat_transpose(m, n, n, m);
+        for (i = 0; i < nn; i++)
+            piv[i]--;
+        return info == 0;
+#else
+        // tiles of the trailing update, one mat_mul each
+        const unsigned int tile = 256;
+        unsigned int nb = R2_LU_BLOCK;
+        float *lp = NULL, *up = NULL, *t = NULL;
+        bool ok = true;
+        unsigned int k0;
+
+        if (n > nb)
+        {
+            lp = (float *)malloc(sizeof(float) * n * nb);
+            up = (float *)malloc(sizeof(float) * nb * tile);
+            t = (float *)malloc(sizeof(float) * tile * tile);
+            if (!lp || !up || !t)
+                nb = n; // no room for the blocked update, factor it as one panel
+        }
+
+        for (k0 = 0; k0 < n; k0 += nb)
+        {
+            unsigned int kb = (n - k0 < nb) ? n - k0 : nb;
+            unsigned int k1 = k0 + kb;
+            unsigned int rest = n - k1;
+            unsigned int i, j, r0, c0;
+
+            if (!r2__lu_panel(m, n, k0, k1, piv))
+                ok = false;
+            if (rest == 0)
+                break;
+
+            // U12 = L11^-1 A12, as row updates across the panel's rows
+            for (i = k0 + 1; i < k1; i++)
+            {
+                float *ri = &m[(size_t)i * n + k1];
+                for (j = k0; j < i; j++)
+                    vecn_axpy(-m[(size_t)i * n + j], &m[(size_t)j * n + k1], ri, (int)rest, ri);
+            }
+
+            // A22 -= L21 U12, L21 packed once and U12 a strip of columns at a time
+            for (i = 0; i < rest; i++)
+                memcpy(&lp[(size_t)i * kb], &m[(size_t)(k1 + i) * n + k0], sizeof(float) * kb);
+            for (c0 = 0; c0 < rest; c0 += tile)
+            {
+                unsigned int w = (rest - c0 < tile) ? rest - c0 : tile;
+                for (j = 0; j < kb; j++)
+                    memcpy(&up[(size_t)j * w], &m[(size_t)(k0 + j) * n + k1 + c0], sizeof(float) * w);
+                for (r0 = 0; r0 < rest; r0 += tile)
+                {
+                    unsigned int h = (rest - r0 < tile) ? rest - r0 : tile;
+                    mat_mul(&lp[(size_t)r0 * kb], up, h, kb, kb, w, t);
+                    for (i = 0; i < h; i++)
+                    {
+                        float *row = &m[(size_t)(k1 + r0 + i) * n + k1 + c0];
+                        vecn_sub(row, &t[(size_t)i * w], (int)w, row);
+                    }
+                }
+            }
+        }
+
+        free(lp);
+        free(up);
+        free(t);
+        return ok;
+#endif
+    }
+
+    static void mat_lu_solve(const float *lu, const int *piv, unsigned int n, float *b, unsigned int nrhs)
+    {
+        unsigned int i;
+        for (i = 0; i < n; i++)
+            if ((unsigned int)piv[i] != i)
+                r2__swap_rows(&b[(size_t)i * nrhs], &b[(size_t)piv[i] * nrhs], nrhs);
+#ifdef HAVE_BLAS
+        cblas_strsm(CblasRowMajor, CblasLeft, CblasLower, CblasNoTrans, CblasUnit, (int)n, (int)nrhs, 1.f, lu, (int)n,
+                    b, (int)nrhs);
+        cblas_strsm(CblasRowMajor, CblasLeft, CblasUpper, CblasNoTrans, CblasNonUnit, (int)n, (int)nrhs, 1.f, lu,
+                    (int)n, b, (int)nrhs);
+#else
+        if (nrhs == 1)
+        {
+            // L y = P b, then U x = y, a dot product a row
+            for (i = 1; i < n; i++)
+                b[i] -= vecn_dot(&lu[(size_t)i * n], b, (int)i);
+            for (i = n; i-- > 0;)
+            {
+                const float *row = &lu[(size_t)i * n];
+                b[i] = (b[i] - vecn_dot(&row[i + 1], &b[i + 1], (int)(n - i - 1))) / row[i];
+            }
+        }
+        else
+        {
+            unsigned int j;
+            for (i = 1; i < n; i++)
+            {
+                float *bi = &b[(size_t)i * nrhs];
+                for (j = 0; j < i; j++)
+                    vecn_axpy(-lu[(size_t)i * n + j], &b[(size_t)j * nrhs], bi, (int)nrhs, bi);
+            }
+            for (i = n; i-- > 0;)
+            {
+                float *bi = &b[(size_t)i * nrhs];
+                for (j = i + 1; j < n; j++)
+                    vecn_axpy(-lu[(size_t)i * n + j], &b[(size_t)j * nrhs], bi, (int)nrhs, bi);
+                vecn_div(bi, lu[(size_t)i * n + i], (int)nrhs, bi);
+            }
+        }
+#endif
+    }
+
+    // Copy of m factored by mat_lu into lu and piv (malloc'd, the caller frees them). False if m is singular or
+    // there was no memory
+    static bool r2__lu_copy(const float *m, unsigned int n, float **lu, int **piv)
+    {
+        *lu = (float *)malloc(sizeof(float) * ((size_t)n * n + 1));
+        *piv = (int *)malloc(sizeof(int) * (n + 1));
+        if (!*lu || !*piv)
+        {
+            perror("out of memory for LU factors");
+            return false;
+        }
+        memcpy(*lu, m, sizeof(float) * n * n);
+        return mat_lu(*lu, n, *piv);
+    }
+
+    static bool mat_solve(const float *a, const float *b, unsigned int n, unsigned int nrhs, float *x)
+    {
+        float *lu;
+        int *piv;
+        bool ok = r2__lu_copy(a, n, &lu, &piv);
+        if (ok)
+        {
+            memmove(x, b, sizeof(float) * n * nrhs);
+            mat_lu_solve(lu, piv, n, x, nrhs);
+        }
+        free(lu);
+        free(piv);
+        return ok;
+    }
+
+    static bool mat_inverse(const float *m, unsigned int n, float *out)
+    {
+        float *lu;
+        int *piv;
+        bool ok = r2__lu_copy(m, n, &lu, &piv);
+        if (ok)
+        {
+            unsigned int i;
+            memset(out, 0, sizeof(float) * n * n);
+            for (i = 0; i < n; i++)
+                out[(size_t)i * n + i] = 1.f;
+            mat_lu_solve(lu, piv, n, out, n);
+        }
+        free(lu);
+        free(piv);
+        return ok;
+    }
+
+    static float mat_det(const float *m, unsigned int n)
+    {
+        float *lu;
+        int *piv;
+        double det = 0.;
+        if (r2__lu_copy(m, n, &lu, &piv))
+        {
+            unsigned int i;
+            det = 1.;
+            for (i = 0; i < n; i++)
+            {
+                det *= lu[(size_t)i * n + i];
+                if ((unsigned int)piv[i] != i)
+                    det = -det;
+            }
+        }
+        free(lu);
+        free(piv);
+        return (float)det;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Int8 quantization
+
+    static float vecn_quantize_i8(const float *v, int n, int8_t *out)
+    {
+        float amax = 0.f;
+        int i;
+        for (i = 0; i < n; i++)
+            amax = fmaxf(amax, fabsf(v[i]));
+        float scale = amax / 127.f;
+        float inv = (amax > 0.f) ? 127.f / amax : 0.f;
+        for (i = 0; i < n; i++)
+        {
+            long q = lrintf(v[i] * inv);
+            out[i] = (int8_t)(q > 127 ? 127 : (q < -127 ? -127 : q));
+        }
+        return scale;
+    }
+
+    static void vecn_dequantize_i8(const int8_t *v, float scale, int n, float *out)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = (float)v[i] * scale;
+    }
+
+    static void vecn_quantize_u8(const float *v, int n, uint8_t *out, float *scale, uint8_t *zero)
+    {
+        // keep 0 in range so it quantizes exactly (zero padding stays zero)
+        float lo = 0.f, hi = 0.f;
+        int i;
+        for (i = 0; i < n; i++)
+        {
+            lo = fminf(lo, v[i]);
+            hi = fmaxf(hi, v[i]);
+        }
+        float s = (hi - lo) / 255.f;
+        float inv = (s > 0.f) ? 1.f / s : 0.f;
+        long z = lrintf(-lo * inv);
+        z = z > 255 ? 255 : (z < 0 ? 0 : z);
+        for (i = 0; i < n; i++)
+        {
+            long q = lrintf(v[i] * inv) + z;
+            out[i] = (uint8_t)(q > 255 ? 255 : (q < 0 ? 0 : q));
+        }
+        *scale = s;
+        *zero = (uint8_t)z;
+    }
+
+    static void vecn_dequantize_u8(const uint8_t *v, float scale, uint8_t zero, int n, float *out)
+    {
+        int i;
+        for (i = 0; i < n; i++)
+            out[i] = (float)((int)v[i] - (int)zero) * scale;
+    }
+
+    static int32_t vecn_dot_i8(const int8_t *v1, const int8_t *v2, int n)
+    {
+        return r2__kernels(n)->dot_i8(v1, v2, n);
+    }
+
+    static void mat_quantize_i8(const float *m, unsigned int r, unsigned int c, int8_t *out, float *scales)
+    {
+        int i;
+#ifdef _OPENMP
+#pragma omp parallel for if ((double)r * c >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < (int)r; i++)
+            scales[i] = vecn_quantize_i8(&m[(size_t)i * c], (int)c, &out[(size_t)i * c]);
+    }
+
+    static void mat_quantize_u8(const float *m, unsigned int r, unsigned int c, uint8_t *out, float *scales,
+                                uint8_t *zeros)
+    {
+        int i;
+#ifdef _OPENMP
+#pragma omp parallel for if ((double)r * c >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < (int)r; i++)
+            vecn_quantize_u8(&m[(size_t)i * c], (int)c, &out[(size_t)i * c], &scales[i], &zeros[i]);
+    }
+
+    static void mat_mul_i8(const int8_t *m1, const float *s1, const int8_t *m2t, const float *s2t, unsigned int r1,
+                           unsigned int c1, unsigned int c2, float *out)
+    {
+        const r2_kernels *k = r2__kernels((int)c1);
+        // rows of m2t per block, so a block stays in cache while every row
+        // of an m1 block runs over it
+        unsigned int nb = (c1 > 0 && R2_I8_BLOCK / c1 > 0) ? R2_I8_BLOCK / c1 : 1;
+        int blocks = (int)((r1 + 15) / 16);
+        int b;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if ((double)r1 * c1 * c2 >= R2_OMP_MIN_FLOPS)
+#endif
+        for (b = 0; b < blocks; b++)
+        {
+            unsigned int i0 = (unsigned int)b * 16;
+            unsigned int i1 = (r1 - i0 < 16) ? r1 : i0 + 16;
+            unsigned int j0, i, j;
+            for (j0 = 0; j0 < c2; j0 += nb)
+            {
+                unsigned int j1 = (c2 - j0 < nb) ? c2 : j0 + nb;
+                for (i = i0; i < i1; i++)
+                {
+                    const int8_t *a = &m1[(size_t)i * c1];
+                    float *o = &out[(size_t)i * c2];
+                    for (j = j0; j < j1; j++)
+                        o[j] = (float)k->dot_i8(a, &m2t[(size_t)j * c1], (int)c1) * s1[i] * s2t[j];
+                }
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // k-NN
+    //
+    // Each query keeps a k sized max-heap of keys (squared distance, or the
+    // negated dot product) so the worst of the current best k is at the
+    // root and most rows are rejected with one compare.
+
+    static inline void r2__heap_push(float *key, uint32_t *id, int *count, int k, float s, uint32_t i)
+    {
+        int c, p;
+        if (*count < k)
+        {
+            // sift up
+            c = (*count)++;
+            while (c > 0 && key[(p = (c - 1) / 2)] < s)
+            {
+                key[c] = key[p];
+                id[c] = id[p];
+                c = p;
+            }
+            key[c] = s;
+            id[c] = i;
+            return;
+        }
+        if (!(s < key[0]))
+            return;
+        // replace the root and sift down
+        p = 0;
+        while ((c = 2 * p + 1) < k)
+        {
+            if (c + 1 < k && key[c + 1] > key[c])
+                c++;
+            if (key[c] <= s)
+                break;
+            key[p] = key[c];
+            id[p] = id[c];
+            p = c;
+        }
+        key[p] = s;
+        id[p] = i;
+    }
+
+    // heap sort in place, leaves the keys ascending (best first)
+    static void r2__heap_sort(float *key, uint32_t *id, int count)
+    {
+        int end;
+        for (end = count - 1; end > 0; end--)
+        {
+            float s = key[end];
+            uint32_t i = id[end];
+            int p = 0, c;
+            key[end] = key[0];
+            id[end] = id[0];
+            while ((c = 2 * p + 1) < end)
+            {
+                if (c + 1 < end && key[c + 1] > key[c])
+                    c++;
+                if (key[c] <= s)
+                    break;
+                key[p] = key[c];
+                id[p] = id[c];
+                p = c;
+            }
+            key[p] = s;
+            id[p] = i;
+        }
+    }
+
+    // sort, turn keys back into scores and pad short results
+    static void r2__knn_finish(float *key, uint32_t *id, int count, int k, knn_metric metric, float qnorm)
+    {
+        int j;
+        r2__heap_sort(key, id, count);
+        for (j = 0; j < count; j++)
+            key[j] = (metric == KNN_DOT) ? -key[j] : fmaxf(key[j] + qnorm, 0.f);
+        for (; j < k; j++)
+        {
+            key[j] = (metric == KNN_DOT) ? -INFINITY : INFINITY;
+            id[j] = UINT32_MAX;
+        }
+    }
+
+    // one query against every row with the dispatched dot / dist kernels
+    static void r2__knn_rows(const float *data, int n, int d, const float *query, int k, knn_metric metric,
+                             uint32_t *idx, float *dist)
+    {
+        int i, count = 0;
+        for (i = 0; i < n; i++)
+        {
+            const float *row = &data[(size_t)i * d];
+            float s = (metric == KNN_DOT) ? -vecn_dot(row, query, d) : vecn_dist_sqrd(row, query, d);
+            r2__heap_push(dist, idx, &count, k, s, (uint32_t)i);
+        }
+        r2__knn_finish(dist, idx, count, k, metric, 0.f);
+    }
+
+    static void vecn_knn(const float *data, int n, int d, const float *query, int k, knn_metric metric, uint32_t *idx,
+                         float *dist)
+    {
+        // (the heap compares against key[0] once it is full, so it needs a slot)
+        if (k <= 0)
+            return;
+        r2__knn_rows(data, n, d, query, k, metric, idx, dist);
+    }
+
+    static void vecn_knn_batch(const float *data, int n, int d, const float *queries, int q, int k, knn_metric metric,
+                               uint32_t *idx, float *dist)
+    {
+        int i;
+        float *norms = NULL, *scores = NULL, *rows_t = NULL;
+        int *counts = NULL;
+
+        if (k <= 0)
+            return;
+        if (q >= R2_KNN_GEMM_MIN)
+        {
+            norms = (float *)malloc(sizeof(float) * (size_t)(n > 0 ? n : 1));
+            scores = (float *)malloc(sizeof(float) * R2_KNN_QUERY_BLOCK * R2_KNN_BLOCK);
+            counts = (int *)calloc((size_t)q, sizeof(int));
+#ifndef HAVE_BLAS
+            rows_t = (float *)malloc(sizeof(float) * (size_t)d * R2_KNN_BLOCK);
+#endif
+        }
+        if (!norms || !scores || !counts
+#ifndef HAVE_BLAS
+            || !rows_t
+#endif
+        )
+        {
+            // few queries (or no memory for the blocks): one at a time
+            free(norms);
+            free(scores);
+            free(counts);
+            free(rows_t);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if ((double)q * n * d >= R2_OMP_MIN_FLOPS)
+#endif
+            for (i = 0; i < q; i++)
+                r2__knn_rows(data, n, d, &queries[(size_t)i * d], k, metric, &idx[(size_t)i * k],
+                             &dist[(size_t)i * k]);
+            return;
+        }
+
+        // |x - q|^2 = |x|^2 - 2 x.q + |q|^2, the |q|^2 is added at the end
+        for (i = 0; i < n; i++)
+            norms[i] = (metric == KNN_L2) ? vecn_length_sqrd(&data[(size_t)i * d], d) : 0.f;
+
+        int r0, q0;
+        for (r0 = 0; r0 < n; r0 += R2_KNN_BLOCK)
+        {
+            int nb = (n - r0 < R2_KNN_BLOCK) ? n - r0 : R2_KNN_BLOCK;
+            const float *block = &data[(size_t)r0 * d];
+#ifndef HAVE_BLAS
+            // mat_mul wants the rows as columns
+            mat_transpose(block, (unsigned int)nb, (unsigned int)d, rows_t);
+#endif
+            for (q0 = 0; q0 < q; q0 += R2_KNN_QUERY_BLOCK)
+            {
+                int qb = (q - q0 < R2_KNN_QUERY_BLOCK) ? q - q0 : R2_KNN_QUERY_BLOCK;
+                const float *qs = &queries[(size_t)q0 * d];
+#ifdef HAVE_BLAS
+                cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, qb, nb, d, 1.f, qs, d, block, d, 0.f, scores, nb);
+#else
+                mat_mul(qs, rows_t, (unsigned int)qb, (unsigned int)d, (unsigned int)d, (unsigned int)nb, scores);
+#endif
+                int j;
+#ifdef _OPENMP
+#pragma omp parallel for if ((double)qb * nb >= R2_OMP_MIN_BATCH)
+#endif
+                for (j = 0; j < qb; j++)
+                {
+                    const float *sj = &scores[(size_t)j * nb];
+                    size_t o = (size_t)(q0 + j) * k;
+                    int r;
+                    for (r = 0; r < nb; r++)
+                    {
+                        float s = (metric == KNN_DOT) ? -sj[r] : norms[r0 + r] - 2.f * sj[r];
+                        r2__heap_push(&dist[o], &idx[o], &counts[q0 + j], k, s, (uint32_t)(r0 + r));
+                    }
+                }
+            }
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel for if ((double)q * k >= R2_OMP_MIN_BATCH)
+#endif
+        for (i = 0; i < q; i++)
+        {
+            float qn = (metric == KNN_L2) ? vecn_length_sqrd(&queries[(size_t)i * d], d) : 0.f;
+            r2__knn_finish(&dist[(size_t)i * k], &idx[(size_t)i * k], counts[i], k, metric, qn);
+        }
+        free(norms);
+        free(scores);
+        free(counts);
+        free(rows_t);
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // BVH
+
+    // deepest a bvh gets, which bounds the traversal stacks
+#define R2__BVH_MAX_DEPTH 60
+
+    typedef struct s_r2__bvh_ctx
+    {
+        bvh *b;
+        float *cent; // 3 floats per primitive
+        uint32_t used;
+    } r2__bvh_ctx;
+
+    typedef struct s_r2__bvh_bin
+    {
+        uint32_t count;
+        float min[3];
+        float max[3];
+    } r2__bvh_bin;
+
+    // half the surface area, all SAH needs
+    static inline float r2__bvh_area(const float *mn, const float *mx)
+    {
+        float dx = mx[0] - mn[0], dy = mx[1] - mn[1], dz = mx[2] - mn[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    static inline void r2__bvh_grow(float *mn, float *mx, const float *pmn, const float *pmx)
+    {
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            mn[k] = fminf(mn[k], pmn[k]);
+            mx[k] = fmaxf(mx[k], pmx[k]);
+        }
+    }
+
+    static inline int r2__bvh_bin_of(float c, float cmin, float scale)
+    {
+        int k = (int)((c - cmin) * scale);
+        return (k < R2_BVH_BINS - 1) ? k : R2_BVH_BINS - 1;
+    }
+
+    static void r2__bvh_split(r2__bvh_ctx *ctx, uint32_t node, uint32_t first, uint32_t count, int depth)
+    {
+        bvh *b = ctx->b;
+        bvh_node *nd = &b->nodes[node];
+        uint32_t *idx = &b->indices[first];
+        float cmin[3] = {INFINITY, INFINITY, INFINITY};
+        float cmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+        uint32_t i;
+        int k, axis;
+
+        nd->min[0] = nd->min[1] = nd->min[2] = INFINITY;
+        nd->max[0] = nd->max[1] = nd->max[2] = -INFINITY;
+        for (i = 0; i < count; i++)
+        {
+            const float *c = &ctx->cent[idx[i] * 3];
+            r2__bvh_grow(nd->min, nd->max, b->prim_min[idx[i]].a_vec, b->prim_max[idx[i]].a_vec);
+            r2__bvh_grow(cmin, cmax, c, c);
+        }
+        nd->first = first;
+        nd->count = count;
+        if (count <= 1 || depth >= R2__BVH_MAX_DEPTH)
+            return;
+
+        // binned SAH: cost of a split = area(left) * n(left) + area(right) * n(right)
+        float best_cost = INFINITY;
+        int best_axis = -1, best_bin = 0;
+        for (axis = 0; axis < 3; axis++)
+        {
+            float extent = cmax[axis] - cmin[axis];
+            if (extent <= 0.f)
+                continue;
+            float scale = (float)R2_BVH_BINS / extent;
+            r2__bvh_bin bins[R2_BVH_BINS];
+            for (k = 0; k < R2_BVH_BINS; k++)
+            {
+                bins[k].count = 0;
+                bins[k].min[0] = bins[k].min[1] = bins[k].min[2] = INFINITY;
+                bins[k].max[0] = bins[k].max[1] = bins[k].max[2] = -INFINITY;
+            }
+            for (i = 0; i < count; i++)
+            {
+                r2__bvh_bin *bin = &bins[r2__bvh_bin_of(ctx->cent[idx[i] * 3 + axis], cmin[axis], scale)];
+                bin->count++;
+                r2__bvh_grow(bin->min, bin->max, b->prim_min[idx[i]].a_vec, b->prim_max[idx[i]].a_vec);
+            }
+
+            // sweep from the right, then from the left; split k puts bins < k left
+            float right_cost[R2_BVH_BINS];
+            float mn[3] = {INFINITY, INFINITY, INFINITY};
+            float mx[3] = {-INFINITY, -INFINITY, -INFINITY};
+            uint32_t n = 0;
+            for (k = R2_BVH_BINS - 1; k > 0; k--)
+            {
+                n += bins[k].count;
+                r2__bvh_grow(mn, mx, bins[k].min, bins[k].max);
+                right_cost[k] = n ? r2__bvh_area(mn, mx) * (float)n : INFINITY;
+            }
+            mn[0] = mn[1] = mn[2] = INFINITY;
+            mx[0] = mx[1] = mx[2] = -INFINITY;
+            n = 0;
+            for (k = 1; k < R2_BVH_BINS; k++)
+            {
+                n += bins[k - 1].count;
+                r2__bvh_grow(mn, mx, bins[k - 1].min, bins[k - 1].max);
+                float cost = n ? r2__bvh_area(mn, mx) * (float)n + right_cost[k] : INFINITY;
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = k;
+                }
+            }
+        }
+        // every centroid in one spot, nothing to split on
+        if (best_axis < 0)
+            return;
+        // with traversal and intersection costs of 1, a leaf costs count * area
+        float area = r2__bvh_area(nd->min, nd->max);
+        if (count <= R2_BVH_LEAF_MAX && best_cost + area >= (float)count * area)
+            return;
+
+        float scale = (float)R2_BVH_BINS / (cmax[best_axis] - cmin[best_axis]);
+        uint32_t left = 0, right = count;
+        while (left < right)
+        {
+            if (r2__bvh_bin_of(ctx->cent[idx[left] * 3 + best_axis], cmin[best_axis], scale) < best_bin)
+            {
+                left++;
+            }
+            else
+            {
+                uint32_t t = idx[left];
+                idx[left] = idx[--right];
+                idx[right] = t;
+            }
+        }
+
+        // children are allocated as a pair, so siblings sit next to each other
+        uint32_t child;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+        {
+            child = ctx->used;
+            ctx->used += 2;
+        }
+        nd->first = child;
+        nd->count = 0;
+
+        if (count >= R2_BVH_TASK_MIN)
+        {
+#ifdef _OPENMP
+#pragma omp task
+#endif
+            r2__bvh_split(ctx, child, first, left, depth + 1);
+#ifdef _OPENMP
+#pragma omp task
+#endif
+            r2__bvh_split(ctx, child + 1, first + left, count - left, depth + 1);
+        }
+        else
+        {
+            r2__bvh_split(ctx, child, first, left, depth + 1);
+            r2__bvh_split(ctx, child + 1, first + left, count - left, depth + 1);
+        }
+    }
+
+    // prim_min / prim_max are filled in, build the rest of out over them
+    static bool r2__bvh_build(bvh *out)
+    {
+        size_t n = out->count;
+        size_t i;
+        r2__bvh_ctx ctx;
+        if (n == 0)
+            return true;
+
+        // root, padding, then n - 1 sibling pairs at most
+        ctx.b = out;
+        ctx.used = 2;
+        ctx.cent = (float *)malloc(sizeof(float) * 3 * n);
+        out->indices = (uint32_t *)malloc(sizeof(uint32_t) * n);
+        out->nodes = (bvh_node *)r2_aligned_alloc(64, sizeof(bvh_node) * 2 * n);
+        if (!ctx.cent || !out->indices || !out->nodes)
+        {
+            free(ctx.cent);
+            bvh_free(out);
+            return false;
+        }
+        memset(&out->nodes[1], 0, sizeof(bvh_node));
+        for (i = 0; i < n; i++)
+        {
+            int k;
+            for (k = 0; k < 3; k++)
+                ctx.cent[i * 3 + k] = .5f * (out->prim_min[i].a_vec[k] + out->prim_max[i].a_vec[k]);
+            out->indices[i] = (uint32_t)i;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel if (n >= R2_BVH_TASK_MIN)
+#pragma omp single
+#endif
+        r2__bvh_split(&ctx, 0, 0, (uint32_t)n, 0);
+
+        out->node_count = ctx.used;
+        free(ctx.cent);
+        return true;
+    }
+
+    static bool bvh_build(const vec3 *mins, const vec3 *maxs, size_t n, bvh *out)
+    {
+        memset(out, 0, sizeof(bvh));
+        out->count = n;
+        if (n == 0)
+            return true;
+        out->prim_min = (vec3 *)malloc(sizeof(vec3) * n);
+        out->prim_max = (vec3 *)malloc(sizeof(vec3) * n);
+        if (!out->prim_min || !out->prim_max)
+        {
+            bvh_free(out);
+            return false;
+        }
+        memcpy(out->prim_min, mins, sizeof(vec3) * n);
+        memcpy(out->prim_max, maxs, sizeof(vec3) * n);
+        return r2__bvh_build(out);
+    }
+
+    static bool bvh_build_triangles(const vec3 *verts, const uint32_t *tris, size_t n, bvh *out)
+    {
+        size_t i;
+        memset(out, 0, sizeof(bvh));
+        out->count = n;
+        out->verts = verts;
+        out->tris = tris;
+        if (n == 0)
+            return true;
+        out->prim_min = (vec3 *)malloc(sizeof(vec3) * n);
+        out->prim_max = (vec3 *)malloc(sizeof(vec3) * n);
+        if (!out->prim_min || !out->prim_max)
+        {
+            bvh_free(out);
+            return false;
+        }
+        for (i = 0; i < n; i++)
+        {
+            const vec3 *a = &verts[tris[i * 3]];
+            const vec3 *b = &verts[tris[i * 3 + 1]];
+            const vec3 *c = &verts[tris[i * 3 + 2]];
+            int k;
+            for (k = 0; k < 3; k++)
+            {
+                out->prim_min[i].a_vec[k] = fminf(a->a_vec[k], fminf(b->a_vec[k], c->a_vec[k]));
+                out->prim_max[i].a_vec[k] = fmaxf(a->a_vec[k], fmaxf(b->a_vec[k], c->a_vec[k]));
+            }
+            out->prim_min[i].w = out->prim_max[i].w = 0.f;
+        }
+        return r2__bvh_build(out);
+    }
+
+    static void bvh_free(bvh *b)
+    {
+        r2_aligned_free(b->nodes);
+        free(b->indices);
+        free(b->prim_min);
+        free(b->prim_max);
+        memset(b, 0, sizeof(bvh));
+    }
+
+    // Entry t of the ray into a box, clipped to [0, tmax]; INFINITY on a miss
+    static inline float r2__bvh_slab(const float *mn, const float *mx, const float *o, const float *inv, float tmax)
+    {
+        float t0 = 0.f, t1 = tmax;
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            float a = (mn[k] - o[k]) * inv[k];
+            float c = (mx[k] - o[k]) * inv[k];
+            t0 = fmaxf(t0, fminf(a, c));
+            t1 = fminf(t1, fmaxf(a, c));
+        }
+        return (t0 <= t1) ? t0 : INFINITY;
+    }
+
+    // Moller-Trumbore, t of the hit in [0, tmax] or INFINITY
+    static float r2__ray_triangle(const float *o, const float *d, const vec3 *a, const vec3 *b, const vec3 *c,
+                                  float tmax)
+    {
+        float e1[3] = {b->x - a->x, b->y - a->y, b->z - a->z};
+        float e2[3] = {c->x - a->x, c->y - a->y, c->z - a->z};
+        float p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (fabsf(det) < 1e-12f)
+            return INFINITY;
+        float inv = 1.f / det;
+        float s[3] = {o[0] - a->x, o[1] - a->y, o[2] - a->z};
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+        if (u < 0.f || u > 1.f)
+            return INFINITY;
+        float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+        float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+        if (v < 0.f || u + v > 1.f)
+            return INFINITY;
+        float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+        return (t >= 0.f && t <= tmax) ? t : INFINITY;
+    }
+
+    static bool bvh_raycast(const bvh *b, const vec3 *origin, const vec3 *dir, float tmax, bvh_hit *hit)
+    {
+        const float *o = origin->a_vec;
+        const float *d = dir->a_vec;
+        float inv[3] = {1.f / d[0], 1.f / d[1], 1.f / d[2]};
+        uint32_t stack[R2__BVH_MAX_DEPTH + 4];
+        float tnear[R2__BVH_MAX_DEPTH + 4];
+        int sp = 0;
+        float best = tmax;
+        uint32_t best_prim = UINT32_MAX;
+
+        if (!b->node_count)
+            return false;
+        tnear[sp] = r2__bvh_slab(b->nodes[0].min, b->nodes[0].max, o, inv, best);
+        stack[sp++] = 0;
+        while (sp)
+        {
+            sp--;
+            // something closer was found since this was pushed
+            if (tnear[sp] > best)
+                continue;
+            const bvh_node *nd = &b->nodes[stack[sp]];
+            if (nd->count)
+            {
+                uint32_t i;
+                for (i = nd->first; i < nd->first + nd->count; i++)
+                {
+                    uint32_t id = b->indices[i];
+                    float t;
+                    if (b->tris)
+                        t = r2__ray_triangle(o, d, &b->verts[b->tris[id * 3]], &b->verts[b->tris[id * 3 + 1]],
+                                             &b->verts[b->tris[id * 3 + 2]], best);
+                    else
+                        t = r2__bvh_slab(b->prim_min[id].a_vec, b->prim_max[id].a_vec, o, inv, best);
+                    if (t < best || (t == best && best_prim == UINT32_MAX))
+                    {
+                        best = t;
+                        best_prim = id;
+                    }
+                }
+                continue;
+            }
+            // push the far child first so the near one is visited next
+            uint32_t c0 = nd->first, c1 = nd->first + 1;
+            float t0 = r2__bvh_slab(b->nodes[c0].min, b->nodes[c0].max, o, inv, best);
+            float t1 = r2__bvh_slab(b->nodes[c1].min, b->nodes[c1].max, o, inv, best);
+            if (t0 > t1)
+            {
+                uint32_t c = c0;
+                float t = t0;
+                c0 = c1, t0 = t1;
+                c1 = c, t1 = t;
+            }
+            if (t1 != INFINITY)
+            {
+                tnear[sp] = t1;
+                stack[sp++] = c1;
+            }
+            if (t0 != INFINITY)
+            {
+                tnear[sp] = t0;
+                stack[sp++] = c0;
+            }
+        }
+        if (best_prim == UINT32_MAX)
+            return false;
+        hit->prim = best_prim;
+        hit->t = best;
+        hit->point.x = o[0] + d[0] * best;
+        hit->point.y = o[1] + d[1] * best;
+        hit->point.z = o[2] + d[2] * best;
+        hit->point.w = 0.f;
+        return true;
+    }
+
+    static inline bool r2__bvh_overlaps(const float *amin, const float *amax, const float *bmin, const float *bmax)
+    {
+        return amin[0] <= bmax[0] && amax[0] >= bmin[0] && amin[1] <= bmax[1] && amax[1] >= bmin[1] &&
+               amin[2] <= bmax[2] && amax[2] >= bmin[2];
+    }
+
+    static size_t bvh_overlap(const bvh *b, const vec3 *min, const vec3 *max, uint32_t *out, size_t max_out)
+    {
+        uint32_t stack[R2__BVH_MAX_DEPTH + 4];
+        int sp = 0;
+        size_t found = 0;
+        if (!b->node_count)
+            return 0;
+        stack[sp++] = 0;
+        while (sp)
+        {
+            const bvh_node *nd = &b->nodes[stack[--sp]];
+            if (!r2__bvh_overlaps(nd->min, nd->max, min->a_vec, max->a_vec))
+                continue;
+            if (nd->count)
+            {
+                uint32_t i;
+                for (i = nd->first; i < nd->first + nd->count; i++)
+                {
+                    uint32_t id = b->indices[i];
+                    if (r2__bvh_overlaps(b->prim_min[id].a_vec, b->prim_max[id].a_vec, min->a_vec, max->a_vec))
+                    {
+                        if (found < max_out)
+                            out[found] = id;
+                        found++;
+                    }
+                }
+                continue;
+            }
+            stack[sp++] = nd->first + 1;
+            stack[sp++] = nd->first;
+        }
+        return found;
+    }
+
+    // squared distance from p to a box, 0 inside; the clamped point goes to q
+    static inline float r2__bvh_box_dist_sqrd(const float *mn, const float *mx, const float *p, float *q)
+    {
+        float d = 0.f;
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            float c = fminf(fmaxf(p[k], mn[k]), mx[k]);
+            d += (c - p[k]) * (c - p[k]);
+            if (q)
+                q[k] = c;
+        }
+        return d;
+    }
+
+    // Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+    static void r2__closest_on_triangle(const float *p, const vec3 *va, const vec3 *vb, const vec3 *vc, float *q)
+    {
+        const float *a = va->a_vec, *b = vb->a_vec, *c = vc->a_vec;
+        float ab[3], ac[3], ap[3], bp[3], cp[3];
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            ab[k] = b[k] - a[k];
+            ac[k] = c[k] - a[k];
+            ap[k] = p[k] - a[k];
+            bp[k] = p[k] - b[k];
+            cp[k] = p[k] - c[k];
+        }
+        float d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+        float d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+        float d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+        float d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+        float d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+        float d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+        float vc_ = d1 * d4 - d3 * d2;
+        float vb_ = d5 * d2 - d1 * d6;
+        float va_ = d3 * d6 - d5 * d4;
+        float v, w;
 
-        float cp = cosf(pitch * .5);
-        float sp = sinf(pitch * .5);
+        if (d1 <= 0.f && d2 <= 0.f)
+        {
+            v = 0.f, w = 0.f; // vertex a
+        }
+        else if (d3 >= 0.f && d4 <= d3)
+        {
+            v = 1.f, w = 0.f; // vertex b
+        }
+        else if (d6 >= 0.f && d5 <= d6)
+        {
+            v = 0.f, w = 1.f; // vertex c
+        }
+        else if (vc_ <= 0.f && d1 >= 0.f && d3 <= 0.f)
+        {
+            v = d1 / (d1 - d3), w = 0.f; // edge ab
+        }
+        else if (vb_ <= 0.f && d2 >= 0.f && d6 <= 0.f)
+        {
+            v = 0.f, w = d2 / (d2 - d6); // edge ac
+        }
+        else if (va_ <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+        {
+            w = (d4 - d3) / ((d4 - d3) + (d5 - d6)); // edge bc
+            v = 1.f - w;
+        }
+        else
+        {
+            float denom = 1.f / (va_ + vb_ + vc_);
+            v = vb_ * denom;
+            w = vc_ * denom;
+        }
+        for (k = 0; k < 3; k++)
+            q[k] = a[k] + ab[k] * v + ac[k] * w;
+    }
 
-        float cr = cosf(roll * .5);
-        float sr = sinf(roll * .5);
+    static bool bvh_nearest(const bvh *b, const vec3 *p, bvh_hit *hit)
+    {
+        uint32_t stack[R2__BVH_MAX_DEPTH + 4];
+        float lower[R2__BVH_MAX_DEPTH + 4];
+        int sp = 0;
+        float best = INFINITY;
+        float best_q[3] = {0.f, 0.f, 0.f};
+        uint32_t best_prim = UINT32_MAX;
 
-        // Warning: in most maths apps and documentation about quats the w
-        // part (real) is in the front. We have some names here that make it
-        // a bit more difficult to see what is going on.
-        q->w = cr * cp * cy + sr * sp * sy; // r
-        q->x = sr * cp * cy - cr * sp * sy; // i
-        q->y = cr * sp * cy + sr * cp * sy; // j
-        q->z = cr * cp * sy - sr * sp * cy; // k
+        if (!b->node_count)
+            return false;
+        lower[sp] = r2__bvh_box_dist_sqrd(b->nodes[0].min, b->nodes[0].max, p->a_vec, NULL);
+        stack[sp++] = 0;
+        while (sp)
+        {
+            sp--;
+            if (lower[sp] >= best)
+                continue;
+            const bvh_node *nd = &b->nodes[stack[sp]];
+            if (nd->count)
+            {
+                uint32_t i;
+                for (i = nd->first; i < nd->first + nd->count; i++)
+                {
+                    uint32_t id = b->indices[i];
+                    float q[3];
+                    float dist;
+                    if (b->tris)
+                    {
+                        r2__closest_on_triangle(p->a_vec, &b->verts[b->tris[id * 3]], &b->verts[b->tris[id * 3 + 1]],
+                                                &b->verts[b->tris[id * 3 + 2]], q);
+                        dist = (q[0] - p->x) * (q[0] - p->x) + (q[1] - p->y) * (q[1] - p->y) +
+                               (q[2] - p->z) * (q[2] - p->z);
+                    }
+                    else
+                    {
+                        dist = r2__bvh_box_dist_sqrd(b->prim_min[id].a_vec, b->prim_max[id].a_vec, p->a_vec, q);
+                    }
+                    if (dist < best)
+                    {
+                        best = dist;
+                        best_prim = id;
+                        best_q[0] = q[0], best_q[1] = q[1], best_q[2] = q[2];
+                    }
+                }
+                continue;
+            }
+            uint32_t c0 = nd->first, c1 = nd->first + 1;
+            float d0 = r2__bvh_box_dist_sqrd(b->nodes[c0].min, b->nodes[c0].max, p->a_vec, NULL);
+            float d1 = r2__bvh_box_dist_sqrd(b->nodes[c1].min, b->nodes[c1].max, p->a_vec, NULL);
+            if (d0 > d1)
+            {
+                uint32_t c = c0;
+                float d = d0;
+                c0 = c1, d0 = d1;
+                c1 = c, d1 = d;
+            }
+            if (d1 < best)
+            {
+                lower[sp] = d1;
+                stack[sp++] = c1;
+            }
+            if (d0 < best)
+            {
+                lower[sp] = d0;
+                stack[sp++] = c0;
+            }
+        }
+        hit->prim = best_prim;
+        hit->t = sqrtf(best);
+        hit->point.x = best_q[0];
+        hit->point.y = best_q[1];
+        hit->point.z = best_q[2];
+        hit->point.w = 0.f;
+        return true;
     }
 
-    static void quat_mul_quat(const quat *q1, const quat *q2, quat *out)
+#undef R2__BVH_MAX_DEPTH
+
+    ///////////////////////////////////////////////////////////////
+    // Spatial hash
+
+    static bool spatial_hash_init(spatial_hash *h, float cell_size, size_t table_size)
     {
-        // i² = j² = k² = ijk = -1
+        uint32_t size = 1;
+        memset(h, 0, sizeof(spatial_hash));
+        while (size < table_size && size < (1u << 31))
+            size <<= 1;
+        h->cell_size = cell_size;
+        h->table_size = size;
+        h->start = (uint32_t *)calloc((size_t)size + 1, sizeof(uint32_t));
+        return h->start != NULL;
+    }
 
-        // q1 = a+bi+cj+dk
-        float a = q1->w;
-        float b = q1->x;
-        float c = q1->y;
-        float d = q1->z;
-        // q2 = e+fi+gj+hk
-        float e = q2->w;
-        float f = q2->x;
-        float g = q2->y;
-        float h = q2->z;
+    static void spatial_hash_free(spatial_hash *h)
+    {
+        free(h->start);
+        free(h->indices);
+        free(h->keys);
+        memset(h, 0, sizeof(spatial_hash));
+    }
 
-        //   |  i  j  k
-        //--------------
-        // i | -1  k -j
-        // j | -k -1  i
-        // k |  j -i -1
-        out->w = a * e - b * f - c * g - d * h;
-        out->x = a * f + b * e + c * h - d * g;
-        out->y = a * g - b * h + c * e + d * f;
-        out->z = a * h + b * g - c * f + d * e;
+    // Cells are clamped to +-2^30 so huge (or infinite) coordinates convert safely and a query range can always be
+    // walked with int32_t. NaN goes to cell 0
+    static inline int32_t r2__hash_cell(float v, float inv_cell)
+    {
+        float c = floorf(v * inv_cell);
+        if (c != c)
+            return 0;
+        return (int32_t)fminf(fmaxf(c, -1073741824.f), 1073741824.f);
+    }
+
+    static int r2__cmp_u32(const void *a, const void *b)
+    {
+        uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+        return (x > y) - (x < y);
+    }
+
+    // Writes the span of bucket b if it has points (and there is room), returns how many spans that was
+    static inline size_t r2__hash_emit(const spatial_hash *h, uint32_t b, spatial_hash_span *spans, size_t found,
+                                       size_t max_spans)
+    {
+        uint32_t first = h->start[b];
+        uint32_t count = h->start[b + 1] - first;
+        if (!count)
+            return 0;
+        if (found < max_spans)
+        {
+            spans[found].first = first;
+            spans[found].count = count;
+        }
+        return 1;
+    }
+
+    // Teschner et al. 2003, large primes xor'ed together
+    static inline uint32_t r2__hash_bucket(int32_t x, int32_t y, int32_t z, uint32_t mask)
+    {
+        return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u)) & mask;
+    }
+
+    static bool spatial_hash_build(spatial_hash *h, const vec3 *points, size_t n)
+    {
+        uint32_t size = h->table_size;
+        uint32_t mask = size - 1;
+        float inv_cell = 1.f / h->cell_size;
+        int threads = 1;
+        uint32_t *hist;
+
+        if (n > h->capacity)
+        {
+            uint32_t *indices = (uint32_t *)realloc(h->indices, sizeof(uint32_t) * n);
+            if (indices)
+                h->indices = indices;
+            uint32_t *keys = (uint32_t *)realloc(h->keys, sizeof(uint32_t) * n);
+            if (keys)
+                h->keys = keys;
+            if (!indices || !keys)
+                return false;
+            h->capacity = n;
+        }
+        h->count = n;
+
+#ifdef _OPENMP
+        if (n >= R2_OMP_MIN_BATCH)
+            threads = omp_get_max_threads();
+#endif
+        // one histogram per thread, so the scatter stays stable and lock free
+        hist = (uint32_t *)calloc((size_t)threads * size, sizeof(uint32_t));
+        if (!hist)
+            return false;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+        {
+            int tid = 0, nth = 1;
+#ifdef _OPENMP
+            tid = omp_get_thread_num();
+            nth = omp_get_num_threads();
+#endif
+            size_t lo = n * (size_t)tid / (size_t)nth;
+            size_t hi = n * (size_t)(tid + 1) / (size_t)nth;
+            uint32_t *mine = &hist[(size_t)tid * size];
+            size_t k;
+
+            for (k = lo; k < hi; k++)
+            {
+                const vec3 *p = &points[k];
+                uint32_t b = r2__hash_bucket(r2__hash_cell(p->x, inv_cell), r2__hash_cell(p->y, inv_cell),
+                                             r2__hash_cell(p->z, inv_cell), mask);
+                h->keys[k] = b;
+                mine[b]++;
+            }
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+            {
+                // exclusive prefix over buckets, then threads within a bucket
+                uint32_t run = 0;
+                uint32_t b;
+                int t;
+                for (b = 0; b < size; b++)
+                {
+                    h->start[b] = run;
+                    for (t = 0; t < nth; t++)
+                    {
+                        uint32_t c = hist[(size_t)t * size + b];
+                        hist[(size_t)t * size + b] = run;
+                        run += c;
+                    }
+                }
+                h->start[size] = run;
+            }
+            for (k = lo; k < hi; k++)
+                h->indices[mine[h->keys[k]]++] = (uint32_t)k;
+        }
+        free(hist);
+        return true;
+    }
+
+    static size_t spatial_hash_query(const spatial_hash *h, const vec3 *p, float radius, spatial_hash_span *spans,
+                                     size_t max_spans)
+    {
+        float inv_cell = 1.f / h->cell_size;
+        uint32_t mask = h->table_size - 1;
+        int32_t x0 = r2__hash_cell(p->x - radius, inv_cell), x1 = r2__hash_cell(p->x + radius, inv_cell);
+        int32_t y0 = r2__hash_cell(p->y - radius, inv_cell), y1 = r2__hash_cell(p->y + radius, inv_cell);
+        int32_t z0 = r2__hash_cell(p->z - radius, inv_cell), z1 = r2__hash_cell(p->z + radius, inv_cell);
+        int32_t x, y, z;
+        uint32_t local[27];
+        uint32_t *buckets = local;
+        size_t nb = 0, i, found = 0;
+
+        if (!h->count || x1 < x0 || y1 < y0 || z1 < z0)
+            return 0;
+        double cells = ((double)x1 - x0 + 1.) * ((double)y1 - y0 + 1.) * ((double)z1 - z0 + 1.);
+        if (cells > 27.)
+        {
+            buckets = (cells < (double)h->table_size) ? (uint32_t *)malloc(sizeof(uint32_t) * (size_t)cells) : NULL;
+            if (!buckets)
+            {
+                // the box touches about every bucket anyway (or there was no memory to sort them)
+                uint32_t b;
+                for (b = 0; b < h->table_size; b++)
+                    found += r2__hash_emit(h, b, spans, found, max_spans);
+                return found;
+            }
+        }
+
+        for (z = z0; z <= z1; z++)
+        {
+            for (y = y0; y <= y1; y++)
+            {
+                for (x = x0; x <= x1; x++)
+                {
+                    uint32_t b = r2__hash_bucket(x, y, z, mask);
+                    if (buckets == local)
+                    {
+                        // two cells can land in one bucket, only report it once
+                        bool seen = false;
+                        for (i = 0; i < nb; i++)
+                            seen |= local[i] == b;
+                        if (seen)
+                            continue;
+                    }
+                    buckets[nb++] = b;
+                }
+            }
+        }
+        if (buckets == local)
+        {
+            for (i = 0; i < nb; i++)
+                found += r2__hash_emit(h, local[i], spans, found, max_spans);
+            return found;
+        }
+
+        // bigger boxes sort their buckets and skip the repeats
+        qsort(buckets, nb, sizeof(uint32_t), r2__cmp_u32);
+        for (i = 0; i < nb; i++)
+        {
+            if (i == 0 || buckets[i] != buckets[i - 1])
+                found += r2__hash_emit(h, buckets[i], spans, found, max_spans);
+        }
+        free(buckets);
+        return found;
+    }
+
+    static size_t spatial_hash_radius(const spatial_hash *h, const vec3 *points, const vec3 *p, float radius,
+                                      uint32_t *out, size_t max_out)
+    {
+        // 27 cells covers a radius up to the cell size, more goes on the heap
+        spatial_hash_span local[27];
+        spatial_hash_span *spans = local;
+        spatial_hash_span all;
+        size_t n = spatial_hash_query(h, p, radius, local, 27);
+        size_t s, found = 0;
+        float r2 = radius * radius;
+
+        if (n > 27)
+        {
+            spans = (spatial_hash_span *)malloc(sizeof(spatial_hash_span) * n);
+            if (spans)
+            {
+                n = spatial_hash_query(h, p, radius, spans, n);
+            }
+            else
+            {
+                // no memory: every point is a candidate
+                all.first = 0;
+                all.count = (uint32_t)h->count;
+                spans = &all;
+                n = 1;
+            }
+        }
+        for (s = 0; s < n; s++)
+        {
+            const uint32_t *ids = &h->indices[spans[s].first];
+            uint32_t k;
+            for (k = 0; k < spans[s].count; k++)
+            {
+                const vec3 *q = &points[ids[k]];
+                float dx = q->x - p->x, dy = q->y - p->y, dz = q->z - p->z;
+                if (dx * dx + dy * dy + dz * dz <= r2)
+                {
+                    if (found < max_out)
+                        out[found] = ids[k];
+                    found++;
+                }
+            }
+        }
+        if (spans != local && spans != &all)
+            free(spans);
+        return found;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // Tensor files
+
+    static const char r2__tensor_magic[8] = {'R', '2', 'T', 'E', 'N', 'S', 'O', 'R'};
+#define R2__TENSOR_ENDIAN 0x01020304u
+#define R2__TENSOR_VERSION 1u
+
+    static size_t r2__dtype_size(uint32_t dtype)
+    {
+        switch (dtype)
+        {
+        case R2_DTYPE_F32:
+            return 4;
+        case R2_DTYPE_F16:
+        case R2_DTYPE_BF16:
+            return 2;
+        case R2_DTYPE_I8:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    // Elements in shape, false if ndim is out of range, a dimension is 0 or
+    // the payload would not fit in a size_t
+    static bool r2__tensor_count(uint32_t ndim, const uint64_t *shape, size_t elem, uint64_t *count)
+    {
+        uint64_t c = 1;
+        uint32_t i;
+        if (ndim < 1 || ndim > R2_TENSOR_MAX_DIMS || elem == 0)
+            return false;
+        for (i = 0; i < ndim; i++)
+        {
+            if (shape[i] == 0 || c > (uint64_t)SIZE_MAX / elem / shape[i])
+                return false;
+            c *= shape[i];
+        }
+        *count = c;
+        return true;
+    }
+
+    // payloads (and I8 scales) must lie between the header and end, the
+    // start of the table
+    static bool r2__tensor_view(const unsigned char *base, uint64_t end, const r2_tensor_entry *e, r2_tensor *t)
+    {
+        size_t elem = r2__dtype_size(e->dtype);
+        uint64_t count;
+        uint64_t rows;
+        int i;
+
+        if (memchr(e->name, 0, sizeof(e->name)) == NULL || !r2__tensor_count(e->ndim, e->shape, elem, &count))
+            return false;
+        rows = count / e->shape[e->ndim - 1];
+        if (e->bytes != count * elem || e->offset % R2_TENSOR_ALIGN != 0 || e->offset < sizeof(r2_tensor_header) ||
+            e->offset > end || e->bytes > end - e->offset)
+            return false;
+        if (e->dtype == R2_DTYPE_I8)
+        {
+            if (e->scales % sizeof(float) != 0 || e->scales < sizeof(r2_tensor_header) || e->scales > end ||
+                rows > (end - e->scales) / sizeof(float))
+                return false;
+            t->scales = (const float *)(base + e->scales);
+        }
+        else
+            t->scales = NULL;
+
+        t->dtype = (r2_dtype)e->dtype;
+        t->ndim = (int)e->ndim;
+        t->count = (size_t)count;
+        t->rows = (size_t)rows;
+        t->data = base + e->offset;
+        for (i = t->ndim - 1; i >= 0; i--)
+        {
+            t->shape[i] = (size_t)e->shape[i];
+            t->stride[i] = i == t->ndim - 1 ? 1 : t->stride[i + 1] * t->shape[i + 1];
+        }
+        for (i = t->ndim; i < R2_TENSOR_MAX_DIMS; i++)
+        {
+            t->shape[i] = 1;
+            t->stride[i] = 1;
+        }
+        return true;
+    }
+
+    static bool r2_tensor_open(const char *path, r2_tensor_file *out)
+    {
+        const unsigned char *base;
+        r2_tensor_header hdr;
+        uint32_t i;
+
+        memset(out, 0, sizeof(r2_tensor_file));
+#ifdef R2_MMAP
+        {
+            struct stat st;
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+            {
+                perror(path);
+                return false;
+            }
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(r2_tensor_header) ||
+                (uint64_t)st.st_size > SIZE_MAX)
+            {
+                close(fd);
+                fprintf(stderr, "%s: not an r2 tensor file\n", path);
+                return false;
+            }
+            out->size = (size_t)st.st_size;
+            out->base = mmap(NULL, out->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (out->base == MAP_FAILED)
+            {
+                perror(path);
+                memset(out, 0, sizeof(r2_tensor_file));
+                return false;
+            }
+            out->mapped = true;
+        }
+#else
+        {
+            FILE *fp = fopen(path, "rb");
+            int64_t len;
+            if (fp == NULL)
+            {
+                perror(path);
+                return false;
+            }
+            // long is 32 bits on Windows, so ftell stops at 2 GB there
+  #ifdef _WIN32
+            if (_fseeki64(fp, 0, SEEK_END) != 0 || (len = _ftelli64(fp)) < (int64_t)sizeof(r2_tensor_header) ||
+                (uint64_t)len > SIZE_MAX || _fseeki64(fp, 0, SEEK_SET) != 0)
+  #else
+            if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < (int64_t)sizeof(r2_tensor_header) ||
+                (uint64_t)len > SIZE_MAX || fseek(fp, 0, SEEK_SET) != 0)
+  #endif
+            {
+                fclose(fp);
+                fprintf(stderr, "%s: not an r2 tensor file\n", path);
+                return false;
+            }
+            out->size = (size_t)len;
+            out->base = r2_aligned_alloc(R2_TENSOR_ALIGN, out->size);
+            if (out->base == NULL || fread(out->base, 1, out->size, fp) != out->size)
+            {
+                perror(path);
+                fclose(fp);
+                r2_tensor_close(out);
+                return false;
+            }
+            fclose(fp);
+        }
+#endif
+        base = (const unsigned char *)out->base;
+        memcpy(&hdr, base, sizeof(hdr));
+        if (memcmp(hdr.magic, r2__tensor_magic, sizeof(hdr.magic)) != 0 || hdr.endian != R2__TENSOR_ENDIAN ||
+            hdr.version != R2__TENSOR_VERSION || hdr.table > out->size ||
+            hdr.count > (out->size - hdr.table) / sizeof(r2_tensor_entry))
+        {
+            fprintf(stderr, "%s: not an r2 tensor file (or from another version or byte order)\n", path);
+            r2_tensor_close(out);
+            return false;
+        }
+
+        out->tensors = (r2_tensor *)calloc(hdr.count ? hdr.count : 1, sizeof(r2_tensor));
+        if (out->tensors == NULL)
+        {
+            perror("out of memory opening tensor file");
+            r2_tensor_close(out);
+            return false;
+        }
+        out->count = hdr.count;
+        for (i = 0; i < hdr.count; i++)
+        {
+            const unsigned char *at = base + hdr.table + (size_t)i * sizeof(r2_tensor_entry);
+            r2_tensor_entry e;
+            memcpy(&e, at, sizeof(e));
+            if (!r2__tensor_view(base, hdr.table, &e, &out->tensors[i]))
+            {
+                fprintf(stderr, "%s: tensor %u is corrupt\n", path, (unsigned)i);
+                r2_tensor_close(out);
+                return false;
+            }
+            // the name is the first field of the entry, point into the file
+            out->tensors[i].name = (const char *)at;
+        }
+        return true;
+    }
+
+    static void r2_tensor_close(r2_tensor_file *f)
+    {
+        if (f->base != NULL)
+        {
+#ifdef R2_MMAP
+            if (f->mapped)
+                munmap(f->base, f->size);
+            else
+#endif
+                r2_aligned_free(f->base);
+        }
+        free(f->tensors);
+        memset(f, 0, sizeof(r2_tensor_file));
+    }
+
+    static const r2_tensor *r2_tensor_find(const r2_tensor_file *f, const char *name)
+    {
+        uint32_t i;
+        for (i = 0; i < f->count; i++)
+            if (strcmp(f->tensors[i].name, name) == 0)
+                return &f->tensors[i];
+        return NULL;
+    }
+
+    static const float *r2_tensor_f32(const r2_tensor *t)
+    {
+        return t->dtype == R2_DTYPE_F32 ? (const float *)t->data : NULL;
+    }
+
+    static void r2__tensor_put(r2_tensor_writer *w, const void *p, size_t bytes)
+    {
+        if (bytes > 0 && fwrite(p, 1, bytes, w->fp) != bytes)
+            w->failed = true;
+        w->offset += bytes;
+    }
+
+    // zero pad the file to a multiple of align (at most R2_TENSOR_ALIGN)
+    static void r2__tensor_pad(r2_tensor_writer *w, uint64_t align)
+    {
+        static const unsigned char zeros[R2_TENSOR_ALIGN] = {0};
+        r2__tensor_put(w, zeros, (size_t)((align - w->offset % align) % align));
+    }
+
+    static bool r2_tensor_write_begin(r2_tensor_writer *w, const char *path)
+    {
+        r2_tensor_header hdr;
+        memset(w, 0, sizeof(r2_tensor_writer));
+        w->fp = fopen(path, "wb");
+        if (w->fp == NULL)
+        {
+            perror(path);
+            return false;
+        }
+        // a placeholder, r2_tensor_write_end fills it in
+        memset(&hdr, 0, sizeof(hdr));
+        r2__tensor_put(w, &hdr, sizeof(hdr));
+        return !w->failed;
+    }
+
+    // Add a table entry for a payload about to be written at the next
+    // aligned offset, NULL if the arguments are bad
+    static r2_tensor_entry *r2__tensor_entry(r2_tensor_writer *w, const char *name, r2_dtype dtype, int ndim,
+                                             const size_t *shape)
+    {
+        r2_tensor_entry *e;
+        uint64_t count;
+        int i;
+
+        if (w->fp == NULL || w->failed || strlen(name) >= R2_TENSOR_NAME_MAX || ndim < 1 || ndim > R2_TENSOR_MAX_DIMS)
+            return NULL;
+        if (w->count == w->capacity)
+        {
+            uint32_t cap = w->capacity ? w->capacity * 2 : 16;
+            r2_tensor_entry *entries = (r2_tensor_entry *)realloc(w->entries, sizeof(r2_tensor_entry) * cap);
+            if (entries == NULL)
+                return NULL;
+            w->entries = entries;
+            w->capacity = cap;
+        }
+        e = &w->entries[w->count];
+        memset(e, 0, sizeof(r2_tensor_entry));
+        strcpy(e->name, name);
+        e->dtype = (uint32_t)dtype;
+        e->ndim = (uint32_t)ndim;
+        for (i = 0; i < R2_TENSOR_MAX_DIMS; i++)
+            e->shape[i] = i < ndim ? (uint64_t)shape[i] : 1;
+        if (!r2__tensor_count(e->ndim, e->shape, r2__dtype_size(e->dtype), &count))
+            return NULL;
+        w->count++;
+
+        r2__tensor_pad(w, R2_TENSOR_ALIGN);
+        e->offset = w->offset;
+        e->bytes = count * r2__dtype_size(e->dtype);
+        return e;
+    }
+
+    static bool r2_tensor_write_raw(r2_tensor_writer *w, const char *name, r2_dtype dtype, int ndim,
+                                    const size_t *shape, const void *data, const float *scales)
+    {
+        r2_tensor_entry *e;
+        if (dtype == R2_DTYPE_I8 && scales == NULL)
+            return false;
+        e = r2__tensor_entry(w, name, dtype, ndim, shape);
+        if (e == NULL)
+            return false;
+        r2__tensor_put(w, data, (size_t)e->bytes);
+        if (dtype == R2_DTYPE_I8)
+        {
+            r2__tensor_pad(w, sizeof(float));
+            e->scales = w->offset;
+            r2__tensor_put(w, scales, (size_t)(e->bytes / e->shape[ndim - 1]) * sizeof(float));
+        }
+        return !w->failed;
+    }
+
+    static bool r2_tensor_write(r2_tensor_writer *w, const char *name, r2_dtype dtype, int ndim, const size_t *shape,
+                                const float *data)
+    {
+        // converted a block of rows at a time, about this many floats
+        const size_t block = 256 * 1024;
+        r2_tensor_entry *e;
+        size_t cols, rows, step, r;
+        size_t elem = r2__dtype_size((uint32_t)dtype);
+        void *buf;
+        float *scales = NULL;
+
+        if (dtype == R2_DTYPE_F32)
+            return r2_tensor_write_raw(w, name, dtype, ndim, shape, data, NULL);
+        if (elem == 0 || ndim < 1 || ndim > R2_TENSOR_MAX_DIMS || shape[ndim - 1] > (size_t)INT32_MAX)
+            return false;
+        e = r2__tensor_entry(w, name, dtype, ndim, shape);
+        if (e == NULL)
+            return false;
+        cols = shape[ndim - 1];
+        rows = (size_t)(e->bytes / elem / cols);
+        step = cols >= block ? 1 : block / cols;
+        if (step > rows)
+            step = rows;
+
+        buf = malloc(step * cols * elem);
+        if (dtype == R2_DTYPE_I8)
+            scales = (float *)malloc(sizeof(float) * rows);
+        if (buf == NULL || (dtype == R2_DTYPE_I8 && scales == NULL))
+        {
+            perror("out of memory writing tensor");
+            w->failed = true;
+        }
+        for (r = 0; r < rows && !w->failed; r += step)
+        {
+            size_t nr = rows - r < step ? rows - r : step;
+            const float *src = data + r * cols;
+            if (dtype == R2_DTYPE_F16)
+                vecn_to_f16(src, (int)(nr * cols), (f16 *)buf);
+            else if (dtype == R2_DTYPE_BF16)
+                vecn_to_bf16(src, (int)(nr * cols), (bf16 *)buf);
+            else
+                mat_quantize_i8(src, (unsigned int)nr, (unsigned int)cols, (int8_t *)buf, scales + r);
+            r2__tensor_put(w, buf, nr * cols * elem);
+        }
+        if (dtype == R2_DTYPE_I8 && !w->failed)
+        {
+            r2__tensor_pad(w, sizeof(float));
+            e->scales = w->offset;
+            r2__tensor_put(w, scales, sizeof(float) * rows);
+        }
+        free(buf);
+        free(scales);
+        return !w->failed;
     }
 
-    static void quat_conj(const quat *q, quat *out)
+    static bool r2_tensor_write_end(r2_tensor_writer *w)
     {
-        out->w = q->w;
-        out->x = -q->x;
-        out->y = -q->y;
-        out->z = -q->z;
+        r2_tensor_header hdr;
+        bool ok;
+        if (w->fp == NULL)
+            return false;
+
+        r2__tensor_pad(w, 8);
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, r2__tensor_magic, sizeof(hdr.magic));
+        hdr.endian = R2__TENSOR_ENDIAN;
+        hdr.version = R2__TENSOR_VERSION;
+        hdr.count = w->count;
+        hdr.table = w->offset;
+        r2__tensor_put(w, w->entries, sizeof(r2_tensor_entry) * w->count);
+        if (fseek(w->fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, w->fp) != 1)
+            w->failed = true;
+        if (fclose(w->fp) != 0)
+            w->failed = true;
+        if (w->failed)
+            perror("writing tensor file");
+
+        ok = !w->failed;
+        free(w->entries);
+        memset(w, 0, sizeof(r2_tensor_writer));
+        return ok;
     }
+#undef R2__TENSOR_ENDIAN
+#undef R2__TENSOR_VERSION
 
-    static char *quat_tos(const quat *q)
+#endif /* implementation */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* R2_MATHS_H */
+
+#ifdef R2__VMATH_PASS
+/*
+ * The exp, log, pow, tanh, sin and cos kernels, written once against r2_vf.
+ * The implementation includes this file again here for each kernel table
+ * that has them (see "SIMD transcendentals"), with R2__VM(name) naming the
+ * functions for that table and R2__VM_TARGET their target attribute.
+ */
+  #define R2__C(f) R2_VF_SET1(f)
+
+    // 2^n for n in [-126, 127]
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__pow2i_vf)(r2_vi n)
     {
-        char *out = calloc(sizeof(char), 100);
-        snprintf(out, 100, "[%f + %fi + %fj + %fk]\n", q->w, q->x, q->y, q->z);
-        return out;
+        return R2_VI_AS_VF(R2_VI_SLLI(R2_VI_ADD(n, R2_VI_SET1(127)), 23));
     }
 
-    static void quat_normalize(const quat *q, quat *out)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__exp_vf)(r2_vf x, int fast)
     {
-        vec4_normalize(q, out);
+        // the clamp keeps NaN (it is the second operand) and sends every
+        // overflow to infinity and every underflow to 0
+        x = R2_VF_MAX(R2__C(-104.f), R2_VF_MIN(R2__C(88.73f), x));
+        r2_vi n = R2_VF_TO_VI(R2_VF_MUL(x, R2__C(1.44269504088896341f)));
+        r2_vf fn = R2_VI_TO_VF(n);
+        // x - n ln2, with ln2 split so n * hi is exact
+        r2_vf r = R2_VF_MADD(fn, R2__C(-0.693359375f), x);
+        r = R2_VF_MADD(fn, R2__C(2.12194440e-4f), r);
+        r2_vf p;
+        if (fast)
+        {
+            p = R2_VF_MADD(r, R2__C(4.16666667e-2f), R2__C(1.66666667e-1f));
+            p = R2_VF_MADD(p, r, R2__C(0.5f));
+        }
+        else
+        {
+            p = R2_VF_MADD(r, R2__C(1.9875691500e-4f), R2__C(1.3981999507e-3f));
+            p = R2_VF_MADD(p, r, R2__C(8.3334519073e-3f));
+            p = R2_VF_MADD(p, r, R2__C(4.1665795894e-2f));
+            p = R2_VF_MADD(p, r, R2__C(1.6666665459e-1f));
+            p = R2_VF_MADD(p, r, R2__C(5.0000001201e-1f));
+        }
+        r2_vf y = R2_VF_MADD(p, R2_VF_MUL(r, r), R2_VF_ADD(r, R2__C(1.f)));
+        // n is in [-150, 128], scale in two halves so neither leaves the
+        // normal range and subnormal results round only once
+        r2_vi n1 = R2_VI_SRAI(n, 1);
+        return R2_VF_MUL(R2_VF_MUL(y, R2__VM(r2__pow2i_vf)(n1)), R2__VM(r2__pow2i_vf)(R2_VI_SUB(n, n1)));
     }
 
-    static void quat_mul_vec3(const quat *q, const vec3 *v, vec3 *out)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__log_vf)(r2_vf x, int fast)
     {
-        vec3 work = {.x = 0., .y = 0., .z = 0.};
-        quat inv = {.x = 0., .y = 0., .z = 0., .w = 0.};
+        r2_vf one = R2__C(1.f);
+        // subnormals are scaled up by 2^23 first
+        r2_vf tiny = R2_VF_LT(x, R2__C(1.17549435e-38f));
+        r2_vf xs = R2_VF_SELECT(tiny, R2_VF_MUL(x, R2__C(8388608.f)), x);
+        r2_vi bits = R2_VF_AS_VI(xs);
+        r2_vi e = R2_VI_SUB(R2_VI_AND(R2_VI_SRLI(bits, 23), R2_VI_SET1(0xff)), R2_VI_SET1(126));
+        r2_vf fe = R2_VF_SUB(R2_VI_TO_VF(e), R2_VF_AND(tiny, R2__C(23.f)));
+        // mantissa in [0.5, 1), then m - 1 in [sqrt(0.5) - 1, sqrt(2) - 1)
+        r2_vf m = R2_VF_OR(R2_VF_AND(xs, R2_VI_AS_VF(R2_VI_SET1(0x007fffff))), R2__C(0.5f));
+        r2_vf lt = R2_VF_LT(m, R2__C(0.707106781186547524f));
+        fe = R2_VF_SUB(fe, R2_VF_AND(lt, one));
+        m = R2_VF_ADD(R2_VF_SUB(m, one), R2_VF_AND(lt, m));
 
-        quat_conj(q, &inv);
-        quat_mul_quat(q, v, &work);
-        quat_mul_quat(&work, &inv, out);
+        r2_vf r;
+        if (fast)
+        {
+            // log(1 + m) = 2 atanh(m / (2 + m)), |s| < 0.18
+            r2_vf sm = R2_VF_DIV(m, R2_VF_ADD(m, R2__C(2.f)));
+            r2_vf s2 = R2_VF_MUL(sm, sm);
+            r2_vf p = R2_VF_MADD(s2, R2__C(0.4f), R2__C(0.666666667f));
+            r = R2_VF_MADD(R2_VF_MUL(p, s2), sm, R2_VF_ADD(sm, sm));
+            r = R2_VF_MADD(fe, R2__C(0.693147180559945f), r);
+        }
+        else
+        {
+            r2_vf z = R2_VF_MUL(m, m);
+            r2_vf p = R2_VF_MADD(m, R2__C(7.0376836292e-2f), R2__C(-1.1514610310e-1f));
+            p = R2_VF_MADD(p, m, R2__C(1.1676998740e-1f));
+            p = R2_VF_MADD(p, m, R2__C(-1.2420140846e-1f));
+            p = R2_VF_MADD(p, m, R2__C(1.4249322787e-1f));
+            p = R2_VF_MADD(p, m, R2__C(-1.6668057665e-1f));
+            p = R2_VF_MADD(p, m, R2__C(2.0000714765e-1f));
+            p = R2_VF_MADD(p, m, R2__C(-2.4999993993e-1f));
+            p = R2_VF_MADD(p, m, R2__C(3.3333331174e-1f));
+            r2_vf y = R2_VF_MUL(R2_VF_MUL(p, m), z);
+            y = R2_VF_MADD(fe, R2__C(-2.12194440e-4f), y);
+            y = R2_VF_MADD(z, R2__C(-0.5f), y);
+            r = R2_VF_MADD(fe, R2__C(0.693359375f), R2_VF_ADD(m, y));
+        }
+        // log(+-0) = -inf, log(inf) = inf, log(< 0 or NaN) = NaN
+        r = R2_VF_SELECT(R2_VF_EQ(x, R2__C(0.f)), R2__C(-INFINITY), r);
+        r = R2_VF_SELECT(R2_VF_EQ(x, R2__C(INFINITY)), x, r);
+        return R2_VF_SELECT(R2_VF_GE(x, R2__C(0.f)), r, R2__C(NAN));
     }
 
-    static void quat_mat4(const quat *q, mat4 *out)
+  #ifdef R2_FMA
+    // Double-float values for the precise pow: an unevaluated sum h + l
+    // carries about 44 bits, enough that |e * log x| up to ~100 still has
+    // its fraction right to a float ULP. Exact products need FMA (without
+    // it powf is cheaper than splitting every product).
+    typedef struct
     {
-        float a = q->w;
-        float b = q->x;
-        float c = q->y;
-        float d = q->z;
-
-        // a -b -c -d
-        // b  a -d  c
-        // c  d  a -b
-        // d -c  b  a
-        out->m00 = a;
-        out->m01 = b;
-        out->m02 = c;
-        out->m03 = d;
+        r2_vf h, l;
+    } R2__VM(r2__vf2);
 
-        out->m10 = -b;
-        out->m11 = a;
-        out->m12 = d;
-        out->m13 = -c;
+    // a * b exactly, as h + l
+    R2__VM_TARGET static inline R2__VM(r2__vf2) R2__VM(r2__two_prod_vf)(r2_vf a, r2_vf b)
+    {
+        R2__VM(r2__vf2) r;
+        r.h = R2_VF_MUL(a, b);
+        r.l = R2_VF_MADD(a, b, R2_VF_XOR(r.h, R2__C(-0.f)));
+        return r;
+    }
 
-        out->m20 = -c;
-        out->m21 = -d;
-        out->m22 = a;
-        out->m23 = b;
+    // x + y for |x.h| >= |y.h| (or x.h == 0)
+    R2__VM_TARGET static inline R2__VM(r2__vf2) R2__VM(r2__add_vf2)(R2__VM(r2__vf2) x, R2__VM(r2__vf2) y)
+    {
+        R2__VM(r2__vf2) r;
+        r.h = R2_VF_ADD(x.h, y.h);
+        r.l = R2_VF_ADD(R2_VF_ADD(R2_VF_ADD(R2_VF_SUB(x.h, r.h), y.h), x.l), y.l);
+        return r;
+    }
 
-        out->m30 = -d;
-        out->m31 = c;
-        out->m32 = -b;
-        out->m33 = a;
+    R2__VM_TARGET static inline R2__VM(r2__vf2) R2__VM(r2__mul_vf2)(R2__VM(r2__vf2) x, R2__VM(r2__vf2) y)
+    {
+        R2__VM(r2__vf2) r = R2__VM(r2__two_prod_vf)(x.h, y.h);
+        r.l = R2_VF_MADD(x.h, y.l, R2_VF_MADD(x.l, y.h, r.l));
+        return r;
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Mat4
+    R2__VM_TARGET static inline R2__VM(r2__vf2) R2__VM(r2__mul_vf2_vf)(R2__VM(r2__vf2) x, r2_vf y)
+    {
+        R2__VM(r2__vf2) r = R2__VM(r2__two_prod_vf)(x.h, y);
+        r.l = R2_VF_MADD(x.l, y, r.l);
+        return r;
+    }
 
-    static void mat4_identity(mat4 *m)
+    // log x for finite x > 0 as h + l: the same reduction as R2__VM(r2__log_vf),
+    // then log(1 + m) = 2 atanh(s) with s = m / (2 + m) kept in two parts
+    R2__VM_TARGET static inline R2__VM(r2__vf2) R2__VM(r2__log_vf2)(r2_vf x)
     {
-        // clang-format off
-        m->m00 = 1.; m->m10 = 0.; m->m20 = 0.; m->m30 = 0.;
-        m->m01 = 0.; m->m11 = 1.; m->m21 = 0.; m->m31 = 0.;
-        m->m02 = 0.; m->m12 = 0.; m->m22 = 1.; m->m32 = 0.;
-        m->m03 = 0.; m->m13 = 0.; m->m23 = 0.; m->m33 = 1.;
-        // clang-format on
+        r2_vf one = R2__C(1.f);
+        r2_vf tiny = R2_VF_LT(x, R2__C(1.17549435e-38f));
+        r2_vf xs = R2_VF_SELECT(tiny, R2_VF_MUL(x, R2__C(8388608.f)), x);
+        r2_vi bits = R2_VF_AS_VI(xs);
+        r2_vi e = R2_VI_SUB(R2_VI_AND(R2_VI_SRLI(bits, 23), R2_VI_SET1(0xff)), R2_VI_SET1(126));
+        r2_vf fe = R2_VF_SUB(R2_VI_TO_VF(e), R2_VF_AND(tiny, R2__C(23.f)));
+        r2_vf m = R2_VF_OR(R2_VF_AND(xs, R2_VI_AS_VF(R2_VI_SET1(0x007fffff))), R2__C(0.5f));
+        r2_vf lt = R2_VF_LT(m, R2__C(0.707106781186547524f));
+        fe = R2_VF_SUB(fe, R2_VF_AND(lt, one));
+        m = R2_VF_ADD(R2_VF_SUB(m, one), R2_VF_AND(lt, m)); // exact
+
+        // s = m / (2 + m): 2 + m split exactly, then one correction step
+        R2__VM(r2__vf2) d, s;
+        d.h = R2_VF_ADD(R2__C(2.f), m);
+        d.l = R2_VF_ADD(R2_VF_SUB(R2__C(2.f), d.h), m);
+        s.h = R2_VF_DIV(m, d.h);
+        R2__VM(r2__vf2) p = R2__VM(r2__two_prod_vf)(s.h, d.h);
+        r2_vf rem = R2_VF_SUB(R2_VF_SUB(R2_VF_SUB(m, p.h), p.l), R2_VF_MUL(s.h, d.l));
+        s.l = R2_VF_DIV(rem, d.h);
+
+        // 2 atanh(s) = 2s + s^3 (2/3 + s^2 t(s^2)), |s| < 0.172
+        R2__VM(r2__vf2) s2 = R2__VM(r2__mul_vf2)(s, s);
+        r2_vf t = R2_VF_MADD(s2.h, R2__C(0.240320354700088500976562f), R2__C(0.285112679004669189453125f));
+        t = R2_VF_MADD(t, s2.h, R2__C(0.400007992982864379882812f));
+        R2__VM(r2__vf2) c = {R2__C(0.66666662693023681640625f), R2__C(3.69183861259614332084311e-9f)};
+        R2__VM(r2__vf2) ln2 = {R2__C(0.69314718246459960938f), R2__C(-1.904654323148236017e-9f)};
+        R2__VM(r2__vf2) s3 = R2__VM(r2__mul_vf2)(s2, s);
+        R2__VM(r2__vf2) two_s = {R2_VF_ADD(s.h, s.h), R2_VF_ADD(s.l, s.l)};
+        R2__VM(r2__vf2) r = R2__VM(r2__add_vf2)(R2__VM(r2__mul_vf2_vf)(ln2, fe), two_s);
+        return R2__VM(r2__add_vf2)(r, R2__VM(r2__mul_vf2)(s3, R2__VM(r2__add_vf2)(c, R2__VM(r2__mul_vf2_vf)(s2, t))));
     }
 
-    static void mat4_set(const float *arry, mat4 *m)
+    // exp(x.h + x.l), like R2__VM(r2__exp_vf) but with the reduction done in two parts
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__exp_vf2)(R2__VM(r2__vf2) x)
     {
-        m->m00 = arry[0];
-        m->m01 = arry[4];
-        m->m02 = arry[8];
-        m->m03 = arry[12];
+        // out of range (or NaN) drops the low part, as it may be NaN from inf - inf
+        r2_vf xh = R2_VF_MAX(R2__C(-104.f), R2_VF_MIN(R2__C(88.8f), x.h));
+        r2_vf xl = R2_VF_AND(R2_VF_EQ(xh, x.h), x.l);
+        r2_vi n = R2_VF_TO_VI(R2_VF_MUL(R2_VF_ADD(xh, xl), R2__C(1.44269504088896341f)));
+        r2_vf fn = R2_VI_TO_VF(n);
 
-        m->m10 = arry[1];
-        m->m11 = arry[5];
-        m->m12 = arry[9];
-        m->m13 = arry[13];
+        // r = x - n ln2, n * 0.693145751953125f is exact and cancels exactly
+        R2__VM(r2__vf2) r;
+        r.h = R2_VF_MADD(fn, R2__C(-0.693145751953125f), xh);
+        r.l = R2_VF_MADD(fn, R2__C(-1.428606765330187045e-6f), xl);
+        r2_vf h = R2_VF_ADD(r.h, r.l);
+        r.l = R2_VF_ADD(R2_VF_SUB(r.h, h), r.l);
+        r.h = h;
 
-        m->m20 = arry[2];
-        m->m21 = arry[6];
-        m->m22 = arry[10];
-        m->m23 = arry[14];
+        r2_vf p = R2_VF_MADD(r.h, R2__C(0.00136324646882712841033936f), R2__C(0.00836596917361021041870117f));
+        p = R2_VF_MADD(p, r.h, R2__C(0.0416710823774337768554688f));
+        p = R2_VF_MADD(p, r.h, R2__C(0.166665524244308471679688f));
+        p = R2_VF_MADD(p, r.h, R2__C(0.499999850988388061523438f));
+        R2__VM(r2__vf2) one = {R2__C(1.f), R2__C(0.f)};
+        R2__VM(r2__vf2) rr = R2__VM(r2__mul_vf2)(r, r);
+        R2__VM(r2__vf2) y = R2__VM(r2__add_vf2)(one, R2__VM(r2__add_vf2)(r, R2__VM(r2__mul_vf2_vf)(rr, p)));
 
-        m->m30 = arry[3];
-        m->m31 = arry[7];
-        m->m32 = arry[11];
-        m->m33 = arry[15];
+        r2_vi n1 = R2_VI_SRAI(n, 1);
+        r2_vf e = R2_VF_ADD(y.h, y.l);
+        return R2_VF_MUL(R2_VF_MUL(e, R2__VM(r2__pow2i_vf)(n1)), R2__VM(r2__pow2i_vf)(R2_VI_SUB(n, n1)));
     }
 
-    static void mat4_transform(const vec4 *p, const mat4 *mat, vec4 *out)
+    // |x|^e for the precise tier, log and exp carried in double-float
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__pow_vf2)(r2_vf ax, r2_vf e)
     {
-        out->x = (mat->m00 * p->x) + (mat->m01 * p->y) + (mat->m02 * p->z) + (mat->m03 * p->w);
-        out->y = (mat->m10 * p->x) + (mat->m11 * p->y) + (mat->m12 * p->z) + (mat->m13 * p->w);
-        out->z = (mat->m20 * p->x) + (mat->m21 * p->y) + (mat->m22 * p->z) + (mat->m23 * p->w);
-        out->w = (mat->m30 * p->x) + (mat->m31 * p->y) + (mat->m32 * p->z) + (mat->m33 * p->w);
+        R2__VM(r2__vf2) l = R2__VM(r2__log_vf2)(ax);
+        // log 0 = -inf and log inf = inf (the reduction gets these wrong), NaN stays NaN
+        r2_vf zero = R2_VF_EQ(ax, R2__C(0.f));
+        r2_vf inf = R2_VF_EQ(ax, R2__C(INFINITY));
+        l.h = R2_VF_SELECT(zero, R2__C(-INFINITY), R2_VF_SELECT(inf, ax, l.h));
+        l.l = R2_VF_SELECT(R2_VF_OR(zero, inf), R2__C(0.f), l.l);
+        l.h = R2_VF_SELECT(R2_VF_EQ(ax, ax), l.h, ax);
+        return R2__VM(r2__exp_vf2)(R2__VM(r2__mul_vf2_vf)(l, e));
     }
+  #endif
 
-    static void mat4_mul(const mat4 *m1, const mat4 *m2, mat4 *out)
+    R2__VM_TARGET static inline void R2__VM(r2__sincos_vf)(r2_vf x, int fast, r2_vf *s, r2_vf *c)
     {
-        mat_mul(m1->a_mat4, m2->a_mat4, 4, 4, 4, 4, out->a_mat4);
+        r2_vf sign = R2__C(-0.f);
+        r2_vf ax = R2_VF_AND(x, R2_VI_AS_VF(R2_VI_SET1(0x7fffffff)));
+        // j = the even multiple of pi/4 nearest |x|, r = |x| - j pi/4 in
+        // [-pi/4, pi/4] with pi/4 split in three
+        r2_vi j = R2_VF_TRUNC_VI(R2_VF_MUL(ax, R2__C(1.27323954473516f)));
+        j = R2_VI_AND(R2_VI_ADD(j, R2_VI_SET1(1)), R2_VI_SET1(~1));
+        r2_vf y = R2_VI_TO_VF(j);
+        r2_vf r = R2_VF_MADD(y, R2__C(-0.78515625f), ax);
+        r = R2_VF_MADD(y, R2__C(-2.4187564849853515625e-4f), r);
+        r = R2_VF_MADD(y, R2__C(-3.77489497744594108e-8f), r);
+        r2_vf z = R2_VF_MUL(r, r);
+
+        r2_vf ps, pc;
+        if (fast)
+        {
+            ps = R2_VF_MADD(z, R2__C(8.33333333e-3f), R2__C(-1.66666667e-1f));
+            pc = R2_VF_MADD(z, R2__C(-1.38888889e-3f), R2__C(4.16666667e-2f));
+        }
+        else
+        {
+            ps = R2_VF_MADD(z, R2__C(-1.9515295891e-4f), R2__C(8.3321608736e-3f));
+            ps = R2_VF_MADD(ps, z, R2__C(-1.6666654611e-1f));
+            pc = R2_VF_MADD(z, R2__C(2.443315711809948e-5f), R2__C(-1.388731625493765e-3f));
+            pc = R2_VF_MADD(pc, z, R2__C(4.166664568298827e-2f));
+        }
+        ps = R2_VF_MADD(R2_VF_MUL(ps, z), r, r);
+        pc = R2_VF_MADD(R2_VF_MUL(pc, z), z, R2_VF_MADD(z, R2__C(-0.5f), R2__C(1.f)));
+
+        // j / 2 mod 4 is the quadrant: odd ones swap sin and cos, sin is
+        // negated in the lower half plane and cos in the left one
+        r2_vf swap = R2_VI_AS_VF(R2_VI_EQ(R2_VI_AND(j, R2_VI_SET1(2)), R2_VI_SET1(2)));
+        r2_vf sin_sign = R2_VF_XOR(R2_VF_AND(x, sign), R2_VI_AS_VF(R2_VI_SLLI(R2_VI_AND(j, R2_VI_SET1(4)), 29)));
+        r2_vi jc = R2_VI_ADD(j, R2_VI_SET1(2));
+        r2_vf cos_sign = R2_VI_AS_VF(R2_VI_SLLI(R2_VI_AND(jc, R2_VI_SET1(4)), 29));
+        *s = R2_VF_XOR(R2_VF_SELECT(swap, pc, ps), sin_sign);
+        *c = R2_VF_XOR(R2_VF_SELECT(swap, ps, pc), cos_sign);
     }
 
-    static void mat4_perspective(float fov, float aspect, float near, float far, mat4 *out)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__tanh_vf)(r2_vf x, int fast)
     {
-        /***
-         *   ⌈ n/r       0         0           0     ⌉
-         *   | 0        n/t        0           0     |
-         *   | 0         0    -(f+n)/f-n    -2fn/f-n |
-         *   ⌊ 0         0        -1           0     ⌋
-         */
-        float range = tan(fov / 2) * near;
-        float Sx = (2 * near) / (range * aspect + range * aspect);
-        float Sy = near / range;
-        float Sz = -(far + near) / (far - near);
-        float Pz = -(2 * far * near) / (far - near);
+        // odd polynomial near 0 (both tiers, 1 - 2 / (e^2x + 1) cancels
+        // there), otherwise through exp
+        r2_vf ax = R2_VF_AND(x, R2_VI_AS_VF(R2_VI_SET1(0x7fffffff)));
+        r2_vf z = R2_VF_MUL(x, x);
+        r2_vf p = R2_VF_MADD(z, R2__C(-5.70498872745e-3f), R2__C(2.06390887954e-2f));
+        p = R2_VF_MADD(p, z, R2__C(-5.37397155531e-2f));
+        p = R2_VF_MADD(p, z, R2__C(1.33314422036e-1f));
+        p = R2_VF_MADD(p, z, R2__C(-3.33332819422e-1f));
+        r2_vf small = R2_VF_MADD(R2_VF_MUL(p, z), x, x);
 
-        // clang-format off
-        out->m00 = Sx; out->m10 = 0;  out->m20 = 0;  out->m30 = 0;
-        out->m01 = 0;  out->m11 = Sy; out->m21 = 0;  out->m31 = 0;
-        out->m02 = 0;  out->m12 = 0;  out->m22 = Sz; out->m32 = Pz;
-        out->m03 = 0;  out->m13 = 0;  out->m23 = -1; out->m33 = 0;
-        // clang-format on
+        r2_vf e = R2__VM(r2__exp_vf)(R2_VF_ADD(ax, ax), fast);
+        r2_vf big = R2_VF_SUB(R2__C(1.f), R2_VF_DIV(R2__C(2.f), R2_VF_ADD(e, R2__C(1.f))));
+        big = R2_VF_OR(big, R2_VF_AND(x, R2__C(-0.f)));
+        return R2_VF_SELECT(R2_VF_LT(ax, R2__C(0.625f)), small, big);
     }
 
-    static void mat4_lookat(const vec4 *pos, const vec4 *target, const vec4 *up, mat4 *out)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__exp_map)(r2_vf x, int fast)
     {
-        /**
-         *  [fur]             ∙  [pos]
-         *
-         *  ⌈ rx  ux  fx  0 ⌉    ⌈ 1  0  0  -px ⌉
-         *  | ry  uy  fy  0 | ∙  | 0  1  0  -py |
-         *  | rz  uz  fz  0 |    | 0  0  1  -pz |
-         *  ⌊ 0   0   0   1 ⌋    ⌊ 0  0  0   1  ⌋
-         */
-        vec4 right = {.x = 0, .y = 0, .z = 0, .w = 0};
-        vec3_cross(target, up, &right);
-        mat4_identity(out);
+        return R2__VM(r2__exp_vf)(x, fast);
+    }
 
-        const vec4 *u = up;
-        const vec4 *f = target;
-        const vec4 *r = &right;
-        // clang-format off
-        out->m00 =  r->x; out->m10 =  r->y; out->m20 = r->z; out->m30 = -pos->x;
-        out->m01 =  u->x; out->m11 =  u->y; out->m21 = u->z; out->m31 = -pos->y;
-        out->m02 = -f->x; out->m12 = -f->y; out->m22 = f->z; out->m32 = -pos->z;
-        out->m03 = 0;    out->m13 = 0;    out->m23 = 0;    out->m33 = 1;
-        // clang-format on
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__log_map)(r2_vf x, int fast)
+    {
+        return R2__VM(r2__log_vf)(x, fast);
     }
 
-    static char *mat4_tos(const mat4 *m)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__tanh_map)(r2_vf x, int fast)
     {
-        char *out = calloc(sizeof(char), 300);
-        // clang-format off
-        snprintf(out, 300, "[\n %f, %f, %f, %f \n %f, %f, %f, %f \n %f, %f, %f, %f \n %f, %f, %f, %f \n]\n", 
-            m->m00, m->m10, m->m20, m->m30,
-            m->m01, m->m11, m->m21, m->m31,
-            m->m02, m->m12, m->m22, m->m32,
-            m->m03, m->m13, m->m23, m->m33
-        );
-        // clang-format on
-        return out;
+        return R2__VM(r2__tanh_vf)(x, fast);
     }
 
-    static void mat4_transpose(const mat4 *m1, mat4 *m2)
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__sin_map)(r2_vf x, int fast)
     {
-        const float a = m1->m00;
-        const float b = m1->m10;
-        const float c = m1->m20;
-        const float d = m1->m30;
+        r2_vf s, c;
+        R2__VM(r2__sincos_vf)(x, fast, &s, &c);
+        return s;
+    }
 
-        const float e = m1->m01;
-        const float f = m1->m11;
-        const float g = m1->m21;
-        const float h = m1->m31;
+    R2__VM_TARGET static inline r2_vf R2__VM(r2__cos_map)(r2_vf x, int fast)
+    {
+        r2_vf s, c;
+        R2__VM(r2__sincos_vf)(x, fast, &s, &c);
+        return c;
+    }
 
-        const float i = m1->m02;
-        const float j = m1->m12;
-        const float k = m1->m22;
-        const float l = m1->m32;
+  // out[i] = fn(v[i]) R2_VF_N at a time, the tail goes through a zero
+  // padded register so it gets the same accuracy as the rest
+  #define R2__VF_MAP(v, n, out, fn)                                                                                    \
+      do                                                                                                               \
+      {                                                                                                                \
+          int fast_ = (__g_accuracy == R2_ACCURACY_FAST);                                                              \
+          int i_ = 0;                                                                                                  \
+          for (; i_ + R2_VF_N <= (n); i_ += R2_VF_N)                                                                   \
+              R2_VF_STORE(&(out)[i_], fn(R2_VF_LOAD(&(v)[i_]), fast_));                                                \
+          if (i_ < (n))                                                                                                \
+          {                                                                                                            \
+              float t_[R2_VF_N] = {0};                                                                                 \
+              memcpy(t_, &(v)[i_], sizeof(float) * (size_t)((n) - i_));                                                \
+              R2_VF_STORE(t_, fn(R2_VF_LOAD(t_), fast_));                                                              \
+              memcpy(&(out)[i_], t_, sizeof(float) * (size_t)((n) - i_));                                              \
+          }                                                                                                            \
+      } while (0)
 
-        const float m = m1->m03;
-        const float n = m1->m13;
-        const float o = m1->m23;
-        const float p = m1->m33;
+    R2__VM_TARGET static void R2__VM(r2__exp)(const float *v, int n, float *out)
+    {
+        R2__VF_MAP(v, n, out, R2__VM(r2__exp_map));
+    }
 
-        // clang-format off
-        m2->m00 = a; m2->m10 = e; m2->m20 = i; m2->m30 = m;
-        m2->m01 = b; m2->m11 = f; m2->m21 = j; m2->m31 = n;
-        m2->m02 = c; m2->m12 = g; m2->m22 = k; m2->m32 = o;
-        m2->m03 = d; m2->m13 = h; m2->m23 = l; m2->m33 = p;
-        // clang-format on
+    R2__VM_TARGET static void R2__VM(r2__log)(const float *v, int n, float *out)
+    {
+        R2__VF_MAP(v, n, out, R2__VM(r2__log_map));
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Mat3
+    R2__VM_TARGET static void R2__VM(r2__tanh)(const float *v, int n, float *out)
+    {
+        R2__VF_MAP(v, n, out, R2__VM(r2__tanh_map));
+    }
 
-    static void mat3_identity(mat3 *m)
+    R2__VM_TARGET static void R2__VM(r2__sin)(const float *v, int n, float *out)
     {
-        // clang-format off
-        m->m00 = 1.; m->m10 = 0.; m->m20 = 0.;
-        m->m01 = 0.; m->m11 = 1.; m->m21 = 0.;
-        m->m02 = 0.; m->m12 = 0.; m->m22 = 1.;
-        // clang-format on
+        R2__VF_MAP(v, n, out, R2__VM(r2__sin_map));
     }
 
-    // Multiply two 3x3 matrix output to out
-    static void mat3_mul(const mat3 *m1, const mat3 *m2, mat3 *out)
+    R2__VM_TARGET static void R2__VM(r2__cos)(const float *v, int n, float *out)
     {
-        mat_mul(m1->a_mat3, m2->a_mat3, 3, 3, 3, 3, out->a_mat3);
+        R2__VF_MAP(v, n, out, R2__VM(r2__cos_map));
     }
 
-    ///////////////////////////////////////////////////////////////
-    // Generic Matrix Multiply
+    R2__VM_TARGET static void R2__VM(r2__sincos)(const float *v, int n, float *out_sin, float *out_cos)
+    {
+        int fast = (__g_accuracy == R2_ACCURACY_FAST);
+        float t[R2_VF_N];
+        int i;
+        for (i = 0; i < n; i += R2_VF_N)
+        {
+            int w = (n - i < R2_VF_N) ? n - i : R2_VF_N;
+            r2_vf sv, cv;
+            memset(t, 0, sizeof(t));
+            memcpy(t, &v[i], sizeof(float) * (size_t)w);
+            R2__VM(r2__sincos_vf)(R2_VF_LOAD(t), fast, &sv, &cv);
+            R2_VF_STORE(t, sv);
+            memcpy(&out_sin[i], t, sizeof(float) * (size_t)w);
+            R2_VF_STORE(t, cv);
+            memcpy(&out_cos[i], t, sizeof(float) * (size_t)w);
+        }
+    }
 
-    static void mat_mul(const float *m1, const float *m2, unsigned int r1, unsigned int c1, unsigned int r2,
-                        unsigned int c2, float *out)
+    R2__VM_TARGET static void R2__VM(r2__pow)(const float *v, float exp, int n, float *out)
     {
-#ifdef HAVE_BLAS
-      cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-		  r1, c2, c1,
-		  1.0f, m1, c1,
-		        m2, c2,
-		  0.0f, out, c2);
-#else
-        if (c1 != r2)
+        int fast = (__g_accuracy == R2_ACCURACY_FAST);
+        int i = 0;
+  #ifndef R2_FMA
+        if (!fast)
         {
-            perror("column size of m1 must match row size of m2");
+            for (; i < n; i++)
+                out[i] = powf(v[i], exp);
             return;
         }
-
-        unsigned int i, j, k;
-        for (i = 0; i < r1; i++)
+  #endif
+        // every float from 2^24 up is an even integer
+        int whole = (exp == floorf(exp));
+        int odd = whole && fabsf(exp) < 16777216.f && fmodf(exp, 2.f) != 0.f;
+        r2_vf e = R2_VF_SET1(exp);
+        r2_vf zero = R2_VF_SET1(0.f);
+        r2_vf one = R2_VF_SET1(1.f);
+        r2_vf sign = R2_VF_SET1(-0.f);
+        r2_vf ninf = R2_VF_SET1(-INFINITY);
+        float t[R2_VF_N];
+        for (; i < n; i += R2_VF_N)
         {
-            for (j = 0; j < c2; j++)
+            int w = (n - i < R2_VF_N) ? n - i : R2_VF_N;
+            r2_vf x;
+            if (w == R2_VF_N)
+                x = R2_VF_LOAD(&v[i]);
+            else
             {
-                float sum = 0.f;
-                for (k = 0; k < c1; k++)
-                {
-                    sum += m1[i * c1 + k] * m2[k * c2 + j];
-                }
-                out[i * c2 + j] = sum;
+                memset(t, 0, sizeof(t));
+                memcpy(t, &v[i], sizeof(float) * (size_t)w);
+                x = R2_VF_LOAD(t);
             }
-        }
-#endif
-    }
-
-    ///////////////////////////////////////////////////////////////
-    // Generic Matrix Transpose
-
-    static void mat_transpose(const float *m, unsigned int r, unsigned int c, float *out)
-    {
-        unsigned int i, j;
-        for (i = 0; i < r; i++)
-        {
-            for (j = 0; j < c; j++)
+            r2_vf ax = R2_VF_AND(x, R2_VI_AS_VF(R2_VI_SET1(0x7fffffff)));
+  #ifdef R2_FMA
+            r2_vf r = fast ? R2__VM(r2__exp_vf)(R2_VF_MUL(e, R2__VM(r2__log_vf)(ax, fast)), fast)
+                           : R2__VM(r2__pow_vf2)(ax, e);
+  #else
+            r2_vf r = R2__VM(r2__exp_vf)(R2_VF_MUL(e, R2__VM(r2__log_vf)(ax, fast)), fast);
+  #endif
+            if (odd)
+                r = R2_VF_OR(r, R2_VF_AND(x, sign));
+            else if (!whole) // (pow(-inf, y) is not NaN though, it is |x|^y)
+                r = R2_VF_SELECT(R2_VF_AND(R2_VF_LT(x, zero), R2_VF_LT(ninf, x)), R2_VF_SET1(NAN), r);
+            // pow(+-1, +-inf) and pow(1, NaN) are 1, where the log gives 0 * inf or 0 * NaN
+            if (isinf(exp))
+                r = R2_VF_SELECT(R2_VF_EQ(ax, one), one, r);
+            else if (isnan(exp))
+                r = R2_VF_SELECT(R2_VF_EQ(x, one), one, r);
+            if (w == R2_VF_N)
+                R2_VF_STORE(&out[i], r);
+            else
             {
-                out[j * r + i] = m[i * c + j];
+                R2_VF_STORE(t, r);
+                memcpy(&out[i], t, sizeof(float) * (size_t)w);
             }
         }
     }
 
-#endif /* implementation */
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif /* R2_MATHS_H */
+  #undef R2__VF_MAP
+  #undef R2__C
+#endif /* R2__VMATH_PASS */
 
 /*
    revision history:
@@ -0,0 +1,636 @@
+/* r2_maths.hpp - v0.0 - public domain C++ wrapper over r2_maths.h
+    no warranty implied; use at your own risk
+
+    Built in the style of: https://github.com/nothings/stb
+
+    Fixed size value types for C++ (14 or later):
+
+        r2::vec<N>      N floats
+        r2::mat<R, C>   R x C floats, row-major: element (i, j) is at
+                        data()[i * C + j], the layout mat_mul uses
+
+    As with r2_maths.h, do this:
+       #define R2_MATHS_IMPLEMENTATION
+    before you include this file in *one* C++ file (everything else can
+    include it without the define). The heavy lifting is done by the C
+    functions, so vectors and matrices go through the same SIMD kernels
+    (and run time dispatch, and BLAS) as the C API.
+
+EXPRESSIONS
+    +, -, * (per element), unary - and scaling by a float build an
+    expression instead of a vector. Nothing is computed until it is
+    assigned to a vec, which then takes one pass over the data with no
+    temporaries. Common shapes are handed to the fused C kernels:
+
+        a * b + c       vecn_fma
+        a * s + b * t   vecn_axpby
+        a * s + b       vecn_axpy
+        a + b, a - b, a * b, a * s, a / s
+                        vecn_add, vecn_sub, vecn_mul_vec, vecn_mul, vecn_div
+
+    and anything else is evaluated element by element in a single loop.
+    Expressions hold references to the vectors they use, so assign them
+    straight away; do not keep one in an auto variable.
+
+MATRICES
+    mat<4, 4> has the same 16 floats as mat4 and the same maths: m1 * m2 is
+    mat4_mul(m1, m2), p * m (a row vector) is mat4_transform(p, m), so
+    p * (m1 * m2) == (p * m1) * m2. Note that mat4's m<row><col> names
+    label the transpose of the (i, j) used here. Use from_c / to_c to move
+    between the two.
+
+    mat4_identity, mat4_perspective and mat4_lookat are constexpr, so
+    fixed projections can be built at compile time.
+
+LICENSE
+    See end of file for license information.
+
+*/
+
+#ifndef R2_MATHS_HPP
+#define R2_MATHS_HPP
+
+#include "r2_maths.h"
+
+namespace r2
+{
+    template <int N>
+    struct vec;
+
+    namespace detail
+    {
+        // sin / cos / tan usable in constant expressions: reduce to
+        // [-pi, pi] and sum the Taylor series in double
+        constexpr double reduce(double x)
+        {
+            const double two_pi = 6.283185307179586476925;
+            double k = static_cast<double>(static_cast<long long>(x / two_pi + (x < 0 ? -.5 : .5)));
+            return x - k * two_pi;
+        }
+        constexpr double sin(double x)
+        {
+            x = reduce(x);
+            double term = x, sum = x;
+            for (int i = 1; i < 14; i++)
+            {
+                term *= -x * x / ((2 * i) * (2 * i + 1));
+                sum += term;
+            }
+            return sum;
+        }
+        constexpr double cos(double x)
+        {
+            x = reduce(x);
+            double term = 1., sum = 1.;
+            for (int i = 1; i < 14; i++)
+            {
+                term *= -x * x / ((2 * i - 1) * (2 * i));
+                sum += term;
+            }
+            return sum;
+        }
+        constexpr double tan(double x)
+        {
+            return sin(x) / cos(x);
+        }
+
+        // Expression nodes are small and copied into their parents, leaf
+        // vectors are held by reference
+        template <class T>
+        struct hold
+        {
+            typedef T type;
+        };
+        template <int N>
+        struct hold<vec<N>>
+        {
+            typedef const vec<N> &type;
+        };
+
+        struct add_op
+        {
+            static constexpr float apply(float a, float b)
+            {
+                return a + b;
+            }
+        };
+        struct sub_op
+        {
+            static constexpr float apply(float a, float b)
+            {
+                return a - b;
+            }
+        };
+        struct mul_op
+        {
+            static constexpr float apply(float a, float b)
+            {
+                return a * b;
+            }
+        };
+        struct div_op
+        {
+            static constexpr float apply(float a, float b)
+            {
+                return a / b;
+            }
+        };
+    } // namespace detail
+
+    /** Base of everything that can be assigned to a vec (CRTP) */
+    template <class E>
+    struct expr
+    {
+        constexpr const E &self() const
+        {
+            return static_cast<const E &>(*this);
+        }
+    };
+
+    /** Per element l op r */
+    template <class Op, class L, class R>
+    struct vbin : expr<vbin<Op, L, R>>
+    {
+        static_assert(L::size == R::size, "r2: vector sizes differ");
+        static constexpr int size = L::size;
+        typename detail::hold<L>::type l;
+        typename detail::hold<R>::type r;
+
+        constexpr vbin(const L &l_, const R &r_) : l(l_), r(r_)
+        {
+        }
+        constexpr float operator[](int i) const
+        {
+            return Op::apply(l[i], r[i]);
+        }
+    };
+
+    /** Per element l op f, for a float f */
+    template <class Op, class L>
+    struct vscalar : expr<vscalar<Op, L>>
+    {
+        static constexpr int size = L::size;
+        typename detail::hold<L>::type l;
+        float f;
+
+        constexpr vscalar(const L &l_, float f_) : l(l_), f(f_)
+        {
+        }
+        constexpr float operator[](int i) const
+        {
+            return Op::apply(l[i], f);
+        }
+    };
+
+    template <class L>
+    struct vneg : expr<vneg<L>>
+    {
+        static constexpr int size = L::size;
+        typename detail::hold<L>::type l;
+
+        constexpr explicit vneg(const L &l_) : l(l_)
+        {
+        }
+        constexpr float operator[](int i) const
+        {
+            return -l[i];
+        }
+    };
+
+    namespace detail
+    {
+        // Assigning an expression to out. The general case is one loop over
+        // the whole tree; the overloads below catch the shapes the C API has
+        // a kernel for. Every node is per element, so out may be one of the
+        // vectors the expression reads.
+        template <class E>
+        inline void eval(float *out, const E &e)
+        {
+            for (int i = 0; i < E::size; i++)
+                out[i] = e[i];
+        }
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vec<N>, vec<N>> &e)
+        {
+            ::vecn_add(e.l.a, e.r.a, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vbin<sub_op, vec<N>, vec<N>> &e)
+        {
+            ::vecn_sub(e.l.a, e.r.a, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vbin<mul_op, vec<N>, vec<N>> &e)
+        {
+            ::vecn_mul_vec(e.l.a, e.r.a, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vscalar<mul_op, vec<N>> &e)
+        {
+            ::vecn_mul(e.l.a, e.f, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vscalar<div_op, vec<N>> &e)
+        {
+            ::vecn_div(e.l.a, e.f, N, out);
+        }
+        // a * b + c and c + a * b
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vbin<mul_op, vec<N>, vec<N>>, vec<N>> &e)
+        {
+            ::vecn_fma(e.l.l.a, e.l.r.a, e.r.a, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vec<N>, vbin<mul_op, vec<N>, vec<N>>> &e)
+        {
+            ::vecn_fma(e.r.l.a, e.r.r.a, e.l.a, N, out);
+        }
+        // a * s + b and b + a * s
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vscalar<mul_op, vec<N>>, vec<N>> &e)
+        {
+            ::vecn_axpy(e.l.f, e.l.l.a, e.r.a, N, out);
+        }
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vec<N>, vscalar<mul_op, vec<N>>> &e)
+        {
+            ::vecn_axpy(e.r.f, e.r.l.a, e.l.a, N, out);
+        }
+        // a * s + b * t
+        template <int N>
+        inline void eval(float *out, const vbin<add_op, vscalar<mul_op, vec<N>>, vscalar<mul_op, vec<N>>> &e)
+        {
+            ::vecn_axpby(e.l.f, e.l.l.a, e.r.f, e.r.l.a, N, out);
+        }
+    } // namespace detail
+
+    /** N floats by value. Assigning an expression evaluates it in one pass. */
+    template <int N>
+    struct vec : expr<vec<N>>
+    {
+        static_assert(N > 0, "r2: vec needs at least one element");
+        static constexpr int size = N;
+        float a[N];
+
+        constexpr vec() : a{}
+        {
+        }
+        /** vec<3>(x, y, z), exactly N values */
+        template <class... T>
+        constexpr vec(float x, T... rest) : a{x, static_cast<float>(rest)...}
+        {
+            static_assert(sizeof...(T) + 1 == N, "r2: vec needs exactly N values");
+        }
+        template <class E>
+        vec(const expr<E> &e)
+        {
+            static_assert(E::size == N, "r2: vector sizes differ");
+            detail::eval(a, e.self());
+        }
+        template <class E>
+        vec &operator=(const expr<E> &e)
+        {
+            static_assert(E::size == N, "r2: vector sizes differ");
+            detail::eval(a, e.self());
+            return *this;
+        }
+
+        static constexpr vec splat(float f)
+        {
+            vec v;
+            for (int i = 0; i < N; i++)
+                v.a[i] = f;
+            return v;
+        }
+
+        constexpr float operator[](int i) const
+        {
+            return a[i];
+        }
+        constexpr float &operator[](int i)
+        {
+            return a[i];
+        }
+        float *data()
+        {
+            return a;
+        }
+        const float *data() const
+        {
+            return a;
+        }
+
+        template <class E>
+        vec &operator+=(const expr<E> &e)
+        {
+            return *this = *this + e.self();
+        }
+        template <class E>
+        vec &operator-=(const expr<E> &e)
+        {
+            return *this = *this - e.self();
+        }
+        vec &operator*=(float f)
+        {
+            return *this = *this * f;
+        }
+        vec &operator/=(float f)
+        {
+            return *this = *this / f;
+        }
+    };
+
+    template <class L, class R>
+    constexpr vbin<detail::add_op, L, R> operator+(const expr<L> &l, const expr<R> &r)
+    {
+        return vbin<detail::add_op, L, R>(l.self(), r.self());
+    }
+    template <class L, class R>
+    constexpr vbin<detail::sub_op, L, R> operator-(const expr<L> &l, const expr<R> &r)
+    {
+        return vbin<detail::sub_op, L, R>(l.self(), r.self());
+    }
+    /** Per element product */
+    template <class L, class R>
+    constexpr vbin<detail::mul_op, L, R> operator*(const expr<L> &l, const expr<R> &r)
+    {
+        return vbin<detail::mul_op, L, R>(l.self(), r.self());
+    }
+    template <class L>
+    constexpr vscalar<detail::mul_op, L> operator*(const expr<L> &l, float f)
+    {
+        return vscalar<detail::mul_op, L>(l.self(), f);
+    }
+    template <class L>
+    constexpr vscalar<detail::mul_op, L> operator*(float f, const expr<L> &l)
+    {
+        return vscalar<detail::mul_op, L>(l.self(), f);
+    }
+    template <class L>
+    constexpr vscalar<detail::div_op, L> operator/(const expr<L> &l, float f)
+    {
+        return vscalar<detail::div_op, L>(l.self(), f);
+    }
+    template <class L>
+    constexpr vneg<L> operator-(const expr<L> &l)
+    {
+        return vneg<L>(l.self());
+    }
+
+    template <int N>
+    inline bool operator==(const vec<N> &v1, const vec<N> &v2)
+    {
+        return ::vecn_equals(v1.a, v2.a, N);
+    }
+    template <int N>
+    inline bool operator!=(const vec<N> &v1, const vec<N> &v2)
+    {
+        return !(v1 == v2);
+    }
+
+    template <int N>
+    inline float dot(const vec<N> &v1, const vec<N> &v2)
+    {
+        return ::vecn_dot(v1.a, v2.a, N);
+    }
+    template <class L, class R>
+    inline float dot(const expr<L> &v1, const expr<R> &v2)
+    {
+        return dot(vec<L::size>(v1), vec<R::size>(v2));
+    }
+    template <int N>
+    inline float length(const vec<N> &v)
+    {
+        return ::vecn_length(v.a, N);
+    }
+    template <int N>
+    inline float dist(const vec<N> &v1, const vec<N> &v2)
+    {
+        return ::vecn_dist(v1.a, v2.a, N);
+    }
+    template <int N>
+    inline float sum(const vec<N> &v)
+    {
+        return ::vecn_sum(v.a, N);
+    }
+    /** As vecn_normalize, a vector shorter than EPSILON gives zero */
+    template <int N>
+    inline vec<N> normalize(const vec<N> &v)
+    {
+        vec<N> out;
+        ::vecn_normalize(v.a, N, out.a);
+        return out;
+    }
+    constexpr vec<3> cross(const vec<3> &v1, const vec<3> &v2)
+    {
+        return vec<3>(v1[1] * v2[2] - v1[2] * v2[1], v1[2] * v2[0] - v1[0] * v2[2], v1[0] * v2[1] - v1[1] * v2[0]);
+    }
+
+    /** R x C floats, row-major */
+    template <int R, int C>
+    struct mat
+    {
+        static_assert(R > 0 && C > 0, "r2: mat needs at least one row and column");
+        static constexpr int rows = R;
+        static constexpr int cols = C;
+        float a[R * C];
+
+        constexpr mat() : a{}
+        {
+        }
+        /** R * C values, one row at a time */
+        template <class... T>
+        constexpr mat(float x, T... rest) : a{x, static_cast<float>(rest)...}
+        {
+            static_assert(sizeof...(T) + 1 == R * C, "r2: mat needs exactly R * C values");
+        }
+
+        static constexpr mat identity()
+        {
+            mat m;
+            for (int i = 0; i < R && i < C; i++)
+                m.a[i * C + i] = 1.f;
+            return m;
+        }
+
+        constexpr float operator()(int r, int c) const
+        {
+            return a[r * C + c];
+        }
+        constexpr float &operator()(int r, int c)
+        {
+            return a[r * C + c];
+        }
+        float *data()
+        {
+            return a;
+        }
+        const float *data() const
+        {
+            return a;
+        }
+    };
+
+    template <int R, int C>
+    inline bool operator==(const mat<R, C> &m1, const mat<R, C> &m2)
+    {
+        return ::vecn_equals(m1.a, m2.a, R * C);
+    }
+    template <int R, int C>
+    inline bool operator!=(const mat<R, C> &m1, const mat<R, C> &m2)
+    {
+        return !(m1 == m2);
+    }
+
+    /** mat_mul (BLAS, or the packed SIMD kernel) */
+    template <int R, int K, int C>
+    inline mat<R, C> operator*(const mat<R, K> &m1, const mat<K, C> &m2)
+    {
+        mat<R, C> out;
+        ::mat_mul(m1.a, m2.a, R, K, K, C, out.a);
+        return out;
+    }
+    /** Column vector v, m * v */
+    template <int R, int C>
+    inline vec<R> operator*(const mat<R, C> &m, const vec<C> &v)
+    {
+        vec<R> out;
+        ::mat_mul(m.a, v.a, R, C, C, 1, out.a);
+        return out;
+    }
+    /** Row vector v, v * m */
+    template <int R, int C>
+    inline vec<C> operator*(const vec<R> &v, const mat<R, C> &m)
+    {
+        vec<C> out;
+        ::mat_mul(v.a, m.a, 1, R, R, C, out.a);
+        return out;
+    }
+    template <int R, int C>
+    inline mat<C, R> transpose(const mat<R, C> &m)
+    {
+        mat<C, R> out;
+        ::mat_transpose(m.a, R, C, out.a);
+        return out;
+    }
+
+    inline vec<4> from_c(const ::vec4 &v)
+    {
+        vec<4> out;
+        memcpy(out.a, v.a_vec, sizeof(out.a));
+        return out;
+    }
+    inline ::vec4 to_c(const vec<4> &v)
+    {
+        ::vec4 out;
+        memcpy(out.a_vec, v.a, sizeof(v.a));
+        return out;
+    }
+    inline mat<4, 4> from_c(const ::mat4 &m)
+    {
+        mat<4, 4> out;
+        memcpy(out.a, m.a_mat4, sizeof(out.a));
+        return out;
+    }
+    inline ::mat4 to_c(const mat<4, 4> &m)
+    {
+        ::mat4 out;
+        memcpy(out.a_mat4, m.a, sizeof(m.a));
+        return out;
+    }
+
+    // 4x4 goes through the register kernels instead of mat_mul
+    inline mat<4, 4> operator*(const mat<4, 4> &m1, const mat<4, 4> &m2)
+    {
+        ::mat4 a = to_c(m1), b = to_c(m2), out;
+        ::mat4_mul(&a, &b, &out);
+        return from_c(out);
+    }
+    inline vec<4> operator*(const vec<4> &p, const mat<4, 4> &m)
+    {
+        ::vec4 v = to_c(p), out;
+        ::mat4 c = to_c(m);
+        ::mat4_transform(&v, &c, &out);
+        return from_c(out);
+    }
+
+    constexpr mat<4, 4> mat4_identity()
+    {
+        return mat<4, 4>::identity();
+    }
+    /** As the C mat4_perspective (fov in radians) */
+    constexpr mat<4, 4> mat4_perspective(float fov, float aspect, float z_near, float z_far)
+    {
+        float range = static_cast<float>(detail::tan(fov / 2.)) * z_near;
+        float sx = (2 * z_near) / (range * aspect + range * aspect);
+        float sy = z_near / range;
+        float sz = -(z_far + z_near) / (z_far - z_near);
+        float pz = -(2 * z_far * z_near) / (z_far - z_near);
+        // clang-format off
+        return mat<4, 4>(sx, 0,  0,  0,
+                         0,  sy, 0,  0,
+                         0,  0,  sz, pz,
+                         0,  0,  -1, 0);
+        // clang-format on
+    }
+    /** As the C mat4_lookat, target and up should be normalized */
+    constexpr mat<4, 4> mat4_lookat(const vec<3> &pos, const vec<3> &target, const vec<3> &up)
+    {
+        vec<3> r = cross(target, up);
+        // clang-format off
+        return mat<4, 4>( r[0],       r[1],      r[2],      -pos[0],
+                          up[0],      up[1],     up[2],     -pos[1],
+                         -target[0], -target[1], target[2], -pos[2],
+                          0,          0,         0,          1);
+        // clang-format on
+    }
+} // namespace r2
+
+#endif /* R2_MATHS_HPP */
+
+/*
+   revision history:
+    0.0   (2026-10-17) Initial bits
+*/
+
+/*
+------------------------------------------------------------------------------
+This software is available under 2 licenses -- choose whichever you prefer.
+------------------------------------------------------------------------------
+ALTERNATIVE A - MIT License
+Copyright (c) 2020 Rob Rohan
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+------------------------------------------------------------------------------
+ALTERNATIVE B - Public Domain (www.unlicense.org)
+This is free and unencumbered software released into the public domain.
+Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+software, either in source code form or as a compiled binary, for any purpose,
+commercial or non-commercial, and by any means.
+In jurisdictions that recognize copyright laws, the author or authors of this
+software dedicate any and all copyright interest in the software to the public
+domain. We make this dedication for the benefit of the public at large and to
+the detriment of our heirs and successors. We intend this dedication to be an
+overt act of relinquishment in perpetuity of all present and future rights to
+this software under copyright law.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------
+*/
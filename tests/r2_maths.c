@@ -2,6 +2,7 @@
 #include "../r2_maths.h"
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -216,6 +217,102 @@ static const char *test_vec4_dist(void)
     return 0;
 }
 
+static const char *test_vec3_soa(void)
+{
+    // 13 elements: a full SIMD block or two plus a scalar tail
+    float ax[13], ay[13], az[13], bx[13], by[13], bz[13];
+    float ox[13], oy[13], oz[13], d[13], l[13];
+    vec3_soa a = {.x = ax, .y = ay, .z = az, .n = 13};
+    vec3_soa b = {.x = bx, .y = by, .z = bz, .n = 13};
+    vec3_soa out = {.x = ox, .y = oy, .z = oz, .n = 13};
+    int i;
+
+    for (i = 0; i < 13; i++)
+    {
+        ax[i] = (float)i - 6.f;
+        ay[i] = (float)(i % 4);
+        az[i] = .5f * (float)i;
+        bx[i] = 2.f;
+        by[i] = (float)(-i);
+        bz[i] = 1.f - (float)(i % 3);
+    }
+    // one zero length element for normalize
+    ax[6] = ay[6] = az[6] = 0.f;
+
+    vec3_soa_dot(&a, &b, d);
+    vec3_soa_length(&a, l);
+    for (i = 0; i < 13; i++)
+    {
+        vec3 v1 = {.x = ax[i], .y = ay[i], .z = az[i]};
+        vec3 v2 = {.x = bx[i], .y = by[i], .z = bz[i]};
+        r2_assert("vec3 soa dot is wrong", r2_equals(d[i], vec3_dot(&v1, &v2)));
+        r2_assert("vec3 soa length is wrong", fabsf(l[i] - vec3_length(&v1)) < 0.00001f);
+    }
+
+    vec3_soa_cross(&a, &b, &out);
+    for (i = 0; i < 13; i++)
+    {
+        vec3 v1 = {.x = ax[i], .y = ay[i], .z = az[i]};
+        vec3 v2 = {.x = bx[i], .y = by[i], .z = bz[i]};
+        vec3 c = {0};
+        vec3_cross(&v1, &v2, &c);
+        r2_assert("vec3 soa cross is wrong", r2_equals(ox[i], c.x) && r2_equals(oy[i], c.y) && r2_equals(oz[i], c.z));
+    }
+
+    vec3_soa_add(&a, &b, &out);
+    r2_assert("vec3 soa add is wrong", r2_equals(ox[12], 8.f) && r2_equals(oy[12], -12.f) && r2_equals(oz[12], 7.f));
+    vec3_soa_sub(&a, &b, &out);
+    r2_assert("vec3 soa sub is wrong", r2_equals(ox[3], -5.f) && r2_equals(oy[3], 6.f) && r2_equals(oz[3], .5f));
+    vec3_soa_mul(&a, 2.f, &out);
+    r2_assert("vec3 soa mul is wrong", r2_equals(ox[9], 6.f) && r2_equals(oy[9], 2.f) && r2_equals(oz[9], 9.f));
+
+    // in place
+    vec3_soa_normalize(&a, &a);
+    for (i = 0; i < 13; i++)
+    {
+        vec3 v = {.x = ax[i], .y = ay[i], .z = az[i]};
+        float len = vec3_length(&v);
+        if (i == 6)
+            r2_assert("vec3 soa normalize zero is wrong", len == 0.f);
+        else
+            r2_assert("vec3 soa normalize is wrong", fabsf(len - 1.f) < 0.00001f);
+    }
+    return 0;
+}
+
+static const char *test_vec_soa_convert(void)
+{
+    vec3 v3[6];
+    vec3 v3_back[6];
+    vec4 v4[6];
+    vec4 v4_back[6];
+    float x[6], y[6], z[6], w[6];
+    vec3_soa s3 = {.x = x, .y = y, .z = z, .n = 0};
+    vec4_soa s4 = {.x = x, .y = y, .z = z, .w = w, .n = 0};
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        float p[4] = {(float)i, (float)i * 10.f, (float)i * 100.f, -(float)i};
+        vec4_set(p, &v4[i]);
+        vec3_set(p[0], p[1], p[2], &v3[i]);
+    }
+
+    vec3_to_soa(v3, 6, &s3);
+    r2_assert("vec3 to soa n is wrong", s3.n == 6);
+    r2_assert("vec3 to soa is wrong", x[5] == 5.f && y[5] == 50.f && z[5] == 500.f && y[1] == 10.f);
+    vec3_from_soa(&s3, v3_back);
+    for (i = 0; i < 6; i++)
+        r2_assert("vec3 from soa is wrong", vec3_equals(&v3[i], &v3_back[i]));
+
+    vec4_to_soa(v4, 6, &s4);
+    r2_assert("vec4 to soa is wrong", s4.n == 6 && w[5] == -5.f && z[2] == 200.f);
+    vec4_from_soa(&s4, v4_back);
+    for (i = 0; i < 6; i++)
+        r2_assert("vec4 from soa is wrong", vec4_equals(&v4[i], &v4_back[i]));
+    return 0;
+}
+
 static const char *test_quat_rot2q(void)
 {
     quat out = {0};
@@ -380,6 +477,150 @@ static const char *test_quat_mul_vec3_y_180x(void)
     return 0;
 }
 
+static const char *test_quat_rotate_batch(void)
+{
+    // 7 vectors: the AVX pairs plus an odd one out
+    vec3 in[7], out[7], each[7], ref;
+    quat qs[7], conj, work;
+    vec3 e = {.x = .3f, .y = -1.1f, .z = 2.f};
+    quat q = {0};
+    int i;
+
+    quat_from_euler(&e, &q);
+    for (i = 0; i < 7; i++)
+    {
+        in[i].x = (float)i - 3.f;
+        in[i].y = (float)(i % 3) * .5f;
+        in[i].z = 1.f - (float)i * .25f;
+        in[i].w = 0.f;
+        vec3 ei = {.x = (float)i * .4f, .y = .2f, .z = -(float)i * .3f};
+        quat_from_euler(&ei, &qs[i]);
+    }
+
+    quat_rotate_batch(&q, in, out, 7);
+    quat_rotate_each(qs, in, each, 7);
+    for (i = 0; i < 7; i++)
+    {
+        // q v q* the long way
+        quat_conj(&q, &conj);
+        quat_mul_quat(&q, &in[i], &work);
+        quat_mul_quat(&work, &conj, &ref);
+        r2_assert("quat rotate batch is wrong", fabsf(out[i].x - ref.x) < 0.0001f &&
+                                                    fabsf(out[i].y - ref.y) < 0.0001f &&
+                                                    fabsf(out[i].z - ref.z) < 0.0001f && r2_equals(out[i].w, 0.));
+
+        quat_conj(&qs[i], &conj);
+        quat_mul_quat(&qs[i], &in[i], &work);
+        quat_mul_quat(&work, &conj, &ref);
+        r2_assert("quat rotate each is wrong", fabsf(each[i].x - ref.x) < 0.0001f &&
+                                                   fabsf(each[i].y - ref.y) < 0.0001f &&
+                                                   fabsf(each[i].z - ref.z) < 0.0001f);
+    }
+
+    // in place, w is carried through
+    for (i = 0; i < 7; i++)
+        in[i].w = 1.f;
+    quat_rotate_batch(&q, in, in, 7);
+    for (i = 0; i < 7; i++)
+        r2_assert("quat rotate batch in place is wrong",
+                  r2_equals(in[i].x, out[i].x) && r2_equals(in[i].z, out[i].z) && r2_equals(in[i].w, 1.));
+    return 0;
+}
+
+static const char *test_quat_slerp(void)
+{
+    vec3 z_axis = {.x = 0.f, .y = 0.f, .z = 1.f};
+    quat a = {0};
+    quat b = {0};
+    quat neg_b = {0};
+    quat out = {0};
+
+    // halfway from identity to 90 deg about z is 45 deg about z
+    quat_identity(&a);
+    quat_rot2q(&z_axis, M_PI / 2, &b);
+    quat_slerp(&a, &b, .5f, &out);
+    r2_assert("quat slerp is wrong", r2_equals(out.z, sinf(M_PI / 8)) && r2_equals(out.w, cosf(M_PI / 8)) &&
+                                         r2_equals(out.x, 0.) && r2_equals(out.y, 0.));
+
+    // -b is the same rotation, the shortest path gives the same answer
+    vec4_mul(&b, -1.f, &neg_b);
+    quat_slerp(&a, &neg_b, .5f, &out);
+    r2_assert("quat slerp shortest path is wrong",
+              r2_equals(out.z, sinf(M_PI / 8)) && r2_equals(out.w, cosf(M_PI / 8)));
+
+    // constant angular velocity: a quarter of the way is 22.5 deg
+    quat_slerp(&a, &b, .25f, &out);
+    r2_assert("quat slerp quarter is wrong", r2_equals(out.z, sinf(M_PI / 16)) && r2_equals(out.w, cosf(M_PI / 16)));
+
+    quat_slerp(&a, &b, 1.f, &out);
+    r2_assert("quat slerp end is wrong", r2_equals(out.z, b.z) && r2_equals(out.w, b.w));
+
+    // nlerp is symmetric too, so matches slerp halfway
+    quat_nlerp(&a, &b, .5f, &out);
+    r2_assert("quat nlerp is wrong", r2_equals(out.z, sinf(M_PI / 8)) && r2_equals(out.w, cosf(M_PI / 8)));
+
+    // nearly parallel falls back to nlerp and stays unit length
+    quat_rot2q(&z_axis, .001f, &b);
+    quat_slerp(&a, &b, .5f, &out);
+    r2_assert("quat slerp near parallel is wrong", r2_equals(quat_length(&out), 1.) && r2_equals(out.z, sinf(.00025f)));
+    return 0;
+}
+
+static const char *test_quat_slerp_soa(void)
+{
+    // 11 pairs: a full SIMD block or two plus a scalar tail
+    float ax[11], ay[11], az[11], aw[11];
+    float bx[11], by[11], bz[11], bw[11];
+    float ox[11], oy[11], oz[11], ow[11];
+    vec4_soa a = {.x = ax, .y = ay, .z = az, .w = aw, .n = 11};
+    vec4_soa b = {.x = bx, .y = by, .z = bz, .w = bw, .n = 11};
+    vec4_soa o = {.x = ox, .y = oy, .z = oz, .w = ow, .n = 11};
+    quat qa[11], qb[11], ref;
+    int i;
+
+    for (i = 0; i < 11; i++)
+    {
+        vec3 ea = {.x = (float)i * .3f, .y = .1f, .z = -(float)i * .2f};
+        vec3 eb = {.x = -(float)i * .25f, .y = (float)i * .4f, .z = .5f};
+        quat_from_euler(&ea, &qa[i]);
+        quat_from_euler(&eb, &qb[i]);
+        if (i % 3 == 0)
+            vec4_mul(&qb[i], -1.f, &qb[i]);
+        if (i == 5)
+            qb[i] = qa[i];
+    }
+    vec4_to_soa(qa, 11, &a);
+    vec4_to_soa(qb, 11, &b);
+
+    quat_slerp_soa(&a, &b, .3f, &o);
+    for (i = 0; i < 11; i++)
+    {
+        // reference slerp with libm
+        float d = quat_dot(&qa[i], &qb[i]);
+        float sign = (d < 0.f) ? -1.f : 1.f;
+        d = fminf(fabsf(d), 1.f);
+        float wa = .7f, wb = .3f;
+        if (d < .9995f)
+        {
+            float theta = acosf(d);
+            wa = sinf(.7f * theta) / sinf(theta);
+            wb = sinf(.3f * theta) / sinf(theta);
+        }
+        vecn_axpby(wa, qa[i].a_vec, wb * sign, qb[i].a_vec, 4, ref.a_vec);
+        r2_assert("quat slerp soa is wrong", fabsf(ox[i] - ref.x) < 0.0001f && fabsf(oy[i] - ref.y) < 0.0001f &&
+                                                 fabsf(oz[i] - ref.z) < 0.0001f && fabsf(ow[i] - ref.w) < 0.0001f);
+    }
+
+    quat_nlerp_soa(&a, &b, .3f, &o);
+    for (i = 0; i < 11; i++)
+    {
+        quat_nlerp(&qa[i], &qb[i], .3f, &ref);
+        r2_assert("quat nlerp soa is wrong", fabsf(ox[i] - ref.x) < 0.0001f && fabsf(oy[i] - ref.y) < 0.0001f &&
+                                                 fabsf(oz[i] - ref.z) < 0.0001f && fabsf(ow[i] - ref.w) < 0.0001f);
+    }
+    return 0;
+}
+
 static const char *test_quat_mat4(void)
 {
     quat q = {0};
@@ -428,6 +669,71 @@ static const char *test_mat4_transform(void)
     return 0;
 }
 
+static const char *test_mat4_transform_batch(void)
+{
+    mat4 kern = {0};
+    vec4 pts[7];
+    vec4 out[7];
+    vec4 expect[7];
+    int i;
+
+    float ary[16] = {1, 2, 3, 4, -1, 0, 1, 2, .5f, .25f, 2, 0, 0, 0, 0, 1};
+    mat4_set(ary, &kern);
+
+    // odd count so the SIMD tail is covered
+    for (i = 0; i < 7; i++)
+    {
+        float p[4] = {(float)i, (float)(i * 2) - 3.f, 1.f - (float)i, 1.f};
+        vec4_set(p, &pts[i]);
+        mat4_transform(&pts[i], &kern, &expect[i]);
+    }
+
+    mat4_transform_batch(&kern, pts, out, 7);
+    for (i = 0; i < 7; i++)
+        r2_assert("mat4 transform batch is wrong", vec4_equals(&out[i], &expect[i]));
+
+    // in place
+    mat4_transform_batch(&kern, pts, pts, 7);
+    for (i = 0; i < 7; i++)
+        r2_assert("mat4 transform batch in place is wrong", vec4_equals(&pts[i], &expect[i]));
+    return 0;
+}
+
+static const char *test_mat4_transform_soa(void)
+{
+    mat4 kern = {0};
+    float x[11], y[11], z[11], w[11];
+    float ox[11], oy[11], oz[11], ow[11];
+    int i;
+
+    float ary[16] = {1, 2, 3, 4, -1, 0, 1, 2, .5f, .25f, 2, 0, 0, 0, 0, 1};
+    mat4_set(ary, &kern);
+
+    for (i = 0; i < 11; i++)
+    {
+        x[i] = (float)i;
+        y[i] = (float)(i * 2) - 3.f;
+        z[i] = 1.f - (float)i;
+        w[i] = (i & 1) ? 1.f : 0.f;
+    }
+    vec4_soa in = {.x = x, .y = y, .z = z, .w = w, .n = 11};
+    vec4_soa out = {.x = ox, .y = oy, .z = oz, .w = ow, .n = 11};
+    mat4_transform_soa(&kern, &in, &out);
+
+    for (i = 0; i < 11; i++)
+    {
+        vec4 p = {.x = x[i], .y = y[i], .z = z[i], .w = w[i]};
+        vec4 expect = {0};
+        mat4_transform(&p, &kern, &expect);
+        // clang-format off
+        r2_assert("mat4 transform soa is wrong",
+            r2_equals(ox[i], expect.x) && r2_equals(oy[i], expect.y) &&
+            r2_equals(oz[i], expect.z) && r2_equals(ow[i], expect.w));
+        // clang-format on
+    }
+    return 0;
+}
+
 static const char *test_mat4_lookat(void)
 {
     mat4 view = {0};
@@ -531,28 +837,67 @@ static const char *test_mat4_mul_speed(void)
 
     srand((unsigned)time(&ti));
 
-    printf("Matrix Mul 4x4 10 run of 1000...\n");
-    double time_taken = 0;
+    // "generic" is the old path through mat_mul (cblas_sgemm under HAVE_BLAS),
+    // "mat4" is the dedicated kernel
+    printf("Matrix Mul 4x4 10 runs of 10000 (generic vs mat4)...\n");
     clock_t t;
+    // every out is read (a different element each time) so neither loop is optimised away
+    volatile float sink = 0.f;
 
     for (int z = 0; z < 10; z++)
     {
+        k1.m00 = rand();
+        k1.m10 = rand();
+        k1.m31 = rand();
+
+        t = clock();
         for (unsigned int x = 0; x < 10000; x++)
         {
-            k1.m00 = rand();
-            k1.m10 = rand();
-            k1.m31 = rand();
+            k1.m33 = (float)x;
+            mat_mul(k1.a_mat4, k2.a_mat4, 4, 4, 4, 4, out.a_mat4);
+            sink += out.a_mat4[x & 15];
+        }
+        double generic = ((double)clock() - t) / CLOCKS_PER_SEC;
 
-            t = clock();
+        t = clock();
+        for (unsigned int x = 0; x < 10000; x++)
+        {
+            k1.m33 = (float)x;
             mat4_mul(&k1, &k2, &out);
-            time_taken += ((double)clock() - t) / CLOCKS_PER_SEC;
+            sink += out.a_mat4[x & 15];
         }
+        double fast = ((double)clock() - t) / CLOCKS_PER_SEC;
         ////////////////////////
-        printf("Run %d; Time %f sec\n", z, time_taken);
-        // printf("%f\n", time_taken);
-        time_taken = 0;
+        printf("Run %d; generic %f sec; mat4 %f sec\n", z, generic, fast);
+    }
+
+    return 0;
+}
+
+static const char *test_mat4_mul_matches_mat_mul(void)
+{
+    mat4 a = {0};
+    mat4 b = {0};
+    mat4 expect = {0};
+    mat4 out = {0};
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        a.a_mat4[i] = (float)((i * 7) % 11) - 5.f;
+        b.a_mat4[i] = (float)((i * 5) % 13) * .5f - 3.f;
     }
+    mat_mul(a.a_mat4, b.a_mat4, 4, 4, 4, 4, expect.a_mat4);
+    mat4_mul(&a, &b, &out);
+    r2_assert("mat4 mul does not match mat_mul", vecn_equals(out.a_mat4, expect.a_mat4, 16));
 
+    // in place, either side
+    mat4 a2 = a;
+    mat4_mul(&a2, &b, &a2);
+    r2_assert("mat4 mul in place (m1) is wrong", vecn_equals(a2.a_mat4, expect.a_mat4, 16));
+    mat4 b2 = b;
+    mat4_mul(&a, &b2, &b2);
+    r2_assert("mat4 mul in place (m2) is wrong", vecn_equals(b2.a_mat4, expect.a_mat4, 16));
     return 0;
 }
 
@@ -753,6 +1098,369 @@ static const char *test_mat4_transpose_twice(void)
     return 0;
 }
 
+static const char *test_mat4_inverse(void)
+{
+    mat4 k = {0};
+    mat4 inv = {0};
+    mat4 id = {0};
+    int i;
+
+    static const float kmat[16] = {2, 0, 1, 3, 1, 4, 0, 2, 0, 1, 3, 1, 5, 2, 1, 6};
+    memcpy(k.a_mat4, kmat, sizeof(kmat));
+
+    // A * A^-1 = I
+    r2_assert("mat4 inverse should succeed", mat4_inverse(&k, &inv));
+    mat4_mul(&k, &inv, &id);
+    for (i = 0; i < 16; i++)
+        r2_assert("mat4 inverse is wrong", fabsf(id.a_mat4[i] - ((i % 5 == 0) ? 1.f : 0.f)) < 0.0001f);
+
+    // in place
+    mat4_inverse(&inv, &inv);
+    for (i = 0; i < 16; i++)
+        r2_assert("mat4 inverse in place is wrong", fabsf(inv.a_mat4[i] - kmat[i]) < 0.0001f);
+
+    // rows 1 and 2 the same -> singular, out is left alone
+    static const float smat[16] = {1, 2, 3, 4, 1, 2, 3, 4, 0, 1, 0, 1, 7, 1, 2, 0};
+    memcpy(k.a_mat4, smat, sizeof(smat));
+    mat4_identity(&inv);
+    r2_assert("mat4 inverse of a singular matrix should fail", !mat4_inverse(&k, &inv));
+    r2_assert("mat4 inverse should not touch out when singular", r2_equals(inv.m00, 1.) && r2_equals(inv.m10, 0.));
+    return 0;
+}
+
+static const char *test_mat4_inverse_affine(void)
+{
+    mat4 m = {0};
+    mat4 inv = {0};
+    mat4 full = {0};
+    int i;
+
+    // rotate 30 degrees about z, scale (2, 3, .5), translate (4, -1, 7)
+    float c = cosf(deg_to_rad(30.f));
+    float s = sinf(deg_to_rad(30.f));
+    mat4_identity(&m);
+    // clang-format off
+    m.m00 = c * 2; m.m01 = -s * 3; m.m02 = 0;    m.m03 = 4;
+    m.m10 = s * 2; m.m11 = c * 3;  m.m12 = 0;    m.m13 = -1;
+    m.m20 = 0;     m.m21 = 0;      m.m22 = .5f;  m.m23 = 7;
+    // clang-format on
+
+    r2_assert("mat4 inverse affine should succeed", mat4_inverse_affine(&m, &inv));
+    mat4_inverse(&m, &full);
+    for (i = 0; i < 16; i++)
+        r2_assert("mat4 inverse affine does not match mat4 inverse", fabsf(inv.a_mat4[i] - full.a_mat4[i]) < 0.0001f);
+
+    // p -> M -> M^-1 -> p
+    vec4 p = {.x = 1, .y = 2, .z = 3, .w = 1};
+    vec4 q, r;
+    mat4_transform(&p, &m, &q);
+    mat4_transform(&q, &inv, &r);
+    r2_assert("mat4 inverse affine round trip is wrong",
+              fabsf(r.x - 1.f) < 0.0001f && fabsf(r.y - 2.f) < 0.0001f && fabsf(r.z - 3.f) < 0.0001f &&
+                  r2_equals(r.w, 1.));
+
+    m.m22 = 0;
+    r2_assert("mat4 inverse affine of a flat matrix should fail", !mat4_inverse_affine(&m, &inv));
+    return 0;
+}
+
+static const char *test_mat4_inverse_batch(void)
+{
+    mat4 in[5];
+    mat4 out[5];
+    mat4 one = {0};
+    int i, j;
+
+    for (i = 0; i < 5; i++)
+    {
+        mat4_identity(&in[i]);
+        in[i].m00 = (float)(i + 1);
+        in[i].m01 = .5f * (float)i;
+        in[i].m13 = (float)i;
+        in[i].m21 = -1.f;
+    }
+    // third one is singular
+    in[2].m11 = 0.f;
+    in[2].m21 = 0.f;
+
+    r2_assert("mat4 inverse batch should report one singular", mat4_inverse_batch(in, out, 5) == 1);
+    for (i = 0; i < 5; i++)
+    {
+        if (i == 2)
+            continue;
+        mat4_inverse(&in[i], &one);
+        for (j = 0; j < 16; j++)
+            r2_assert("mat4 inverse batch is wrong", r2_equals(out[i].a_mat4[j], one.a_mat4[j]));
+    }
+    for (j = 0; j < 16; j++)
+        r2_assert("mat4 inverse batch should copy singular through", r2_equals(out[2].a_mat4[j], in[2].a_mat4[j]));
+    return 0;
+}
+
+static const char *test_mat4_skin(void)
+{
+    mat4 palette[3];
+    uint16_t bones[9 * 4];
+    float weights[9 * 4];
+    vec4 pos[9], nrm[9], out_pos[9], out_nrm[9];
+    int i, k;
+
+    // identity, a translate and a 90 deg turn about z with a translate
+    mat4_identity(&palette[0]);
+    mat4_identity(&palette[1]);
+    palette[1].m03 = 2.f;
+    palette[1].m13 = -1.f;
+    mat4_identity(&palette[2]);
+    palette[2].m00 = 0.f;
+    palette[2].m01 = -1.f;
+    palette[2].m10 = 1.f;
+    palette[2].m11 = 0.f;
+    palette[2].m23 = 3.f;
+
+    for (i = 0; i < 9; i++)
+    {
+        pos[i].x = (float)i;
+        pos[i].y = 1.f - (float)i * .5f;
+        pos[i].z = .25f * (float)i;
+        pos[i].w = 1.f;
+        nrm[i].x = (i % 2) ? 1.f : 0.f;
+        nrm[i].y = (i % 2) ? 0.f : 1.f;
+        nrm[i].z = .5f;
+        nrm[i].w = 0.f;
+        for (k = 0; k < 4; k++)
+            bones[i * 4 + k] = (uint16_t)((i + k) % 3);
+        weights[i * 4 + 0] = .5f;
+        weights[i * 4 + 1] = .3f;
+        weights[i * 4 + 2] = .2f;
+        weights[i * 4 + 3] = 0.f;
+    }
+
+    mat4_skin(palette, bones, weights, pos, nrm, out_pos, out_nrm, 9);
+    for (i = 0; i < 9; i++)
+    {
+        // skinning is linear, so it is the weighted sum of each bone's transform
+        vec4 ref_p = {0}, ref_n = {0}, t;
+        for (k = 0; k < 4; k++)
+        {
+            mat4_transform(&pos[i], &palette[bones[i * 4 + k]], &t);
+            vecn_axpy(weights[i * 4 + k], t.a_vec, ref_p.a_vec, 4, ref_p.a_vec);
+            mat4_transform(&nrm[i], &palette[bones[i * 4 + k]], &t);
+            vecn_axpy(weights[i * 4 + k], t.a_vec, ref_n.a_vec, 4, ref_n.a_vec);
+        }
+        vec3_normalize(&ref_n, &ref_n);
+        r2_assert("mat4 skin position is wrong", fabsf(out_pos[i].x - ref_p.x) < 0.0001f &&
+                                                     fabsf(out_pos[i].y - ref_p.y) < 0.0001f &&
+                                                     fabsf(out_pos[i].z - ref_p.z) < 0.0001f &&
+                                                     r2_equals(out_pos[i].w, 1.));
+        r2_assert("mat4 skin normal is wrong", fabsf(out_nrm[i].x - ref_n.x) < 0.0001f &&
+                                                   fabsf(out_nrm[i].y - ref_n.y) < 0.0001f &&
+                                                   fabsf(out_nrm[i].z - ref_n.z) < 0.0001f &&
+                                                   r2_equals(out_nrm[i].w, 0.));
+    }
+
+    // in place without normals
+    mat4_skin(palette, bones, weights, pos, NULL, pos, NULL, 9);
+    for (i = 0; i < 9; i++)
+        r2_assert("mat4 skin in place is wrong",
+                  r2_equals(pos[i].x, out_pos[i].x) && r2_equals(pos[i].y, out_pos[i].y));
+    return 0;
+}
+
+static const char *test_r2v4(void)
+{
+    vec4 a = {{1.f, -2.f, 3.f, .5f}};
+    vec4 b = {{-4.f, 5.f, .25f, 2.f}};
+    vec4 r, expect;
+    mat4 m1, m2, mr, mexpect;
+    r2v4 va = r2v4_load(&a);
+    r2v4 vb = r2v4_from_vec4(b);
+
+    float ary1[16] = {1, 2, 3, 4, -1, 0, 1, 2, .5f, .25f, 2, 0, 0, 0, 0, 1};
+    float ary2[16] = {2, 0, 1, -3, 0, 1, 0, 4, 1, -1, 3, 0, .5f, 0, 0, 1};
+    mat4_set(ary1, &m1);
+    mat4_set(ary2, &m2);
+
+    r2_assert("r2v4 load / store is wrong", r2v4_x(va) == 1.f && r2v4_y(va) == -2.f && r2v4_z(va) == 3.f &&
+                                                r2v4_w(va) == .5f);
+    r = r2v4_to_vec4(vb);
+    r2_assert("r2v4 to_vec4 is wrong", vec4_equals(&r, &b));
+
+    vec4_add(&a, &b, &expect);
+    r = r2v4_to_vec4(r2v4_add(va, vb));
+    r2_assert("r2v4 add is wrong", vec4_equals(&r, &expect));
+
+    vec4_sub(&a, &b, &expect);
+    r = r2v4_to_vec4(r2v4_sub(va, vb));
+    r2_assert("r2v4 sub is wrong", vec4_equals(&r, &expect));
+
+    vec4_mul(&a, 3.f, &expect);
+    r = r2v4_to_vec4(r2v4_mul(va, 3.f));
+    r2_assert("r2v4 mul is wrong", vec4_equals(&r, &expect));
+
+    vec4_mul_vec4(&a, &b, &expect);
+    r2_assert("r2v4 mul_vec is wrong", r2v4_equals(r2v4_mul_vec(va, vb), r2v4_load(&expect)));
+    vec4_add(&expect, &a, &expect);
+    r2_assert("r2v4 madd is wrong", r2v4_equals(r2v4_madd(va, vb, va), r2v4_load(&expect)));
+
+    vec4_abs(&a, &expect);
+    r2_assert("r2v4 abs is wrong", r2v4_equals(r2v4_abs(r2v4_neg(va)), r2v4_load(&expect)));
+    r2_assert("r2v4 lerp is wrong", r2v4_equals(r2v4_lerp(va, vb, 0.f), va) &&
+                                        r2v4_equals(r2v4_lerp(va, vb, 1.f), vb));
+    r2_assert("r2v4 min / max is wrong",
+              r2v4_equals(r2v4_min(va, vb), r2v4_set(-4.f, -2.f, .25f, .5f)) &&
+                  r2v4_equals(r2v4_max(va, vb), r2v4_set(1.f, 5.f, 3.f, 2.f)));
+    // a NaN in either operand gives the second, with or without SSE
+    r2v4 vn = r2v4_set(NAN, 1.f, NAN, 1.f), vo = r2v4_set(2.f, NAN, 2.f, NAN);
+    r2_assert("r2v4 min / max NaN order is wrong",
+              r2v4_x(r2v4_min(vn, vo)) == 2.f && isnan(r2v4_y(r2v4_min(vn, vo))) &&
+                  r2v4_x(r2v4_max(vn, vo)) == 2.f && isnan(r2v4_y(r2v4_max(vn, vo))));
+
+    r2_assert("r2v4 dot is wrong", r2_equals(r2v4_dot(va, vb), vec4_dot(&a, &b)));
+    r2_assert("r2v4 dot3 is wrong", r2_equals(r2v4_dot3(va, vb), -4.f - 10.f + .75f));
+
+    // the summation order shows: (x + y) + (z + w) is 0 here, (x + z) + (y + w) would be 2
+    {
+        vec4 big = {.x = 1e8f, .y = 1.f, .z = -1e8f, .w = 1.f};
+        vec4 ones = {.x = 1.f, .y = 1.f, .z = 1.f, .w = 1.f};
+        r2v4 vbig = r2v4_load(&big), vones = r2v4_load(&ones);
+        r2_assert("r2v4 dot sums in the wrong order", r2v4_dot(vbig, vones) == 0.f);
+        r2_assert("r2v4 dot3 sums in the wrong order", r2v4_dot3(vbig, vones) == 0.f);
+#ifndef HAVE_BLAS
+        // (cblas_sdot has its own order)
+        vec3 big3 = {.x = 1e8f, .y = 1.f, .z = -1e8f};
+        vec3 ones3 = {.x = 1.f, .y = 1.f, .z = 1.f};
+        r2_assert("r2v4 dot does not match vec4_dot", r2v4_dot(vbig, vones) == vec4_dot(&big, &ones));
+        r2_assert("r2v4 dot3 does not match vec3_dot", r2v4_dot3(vbig, vones) == vec3_dot(&big3, &ones3));
+#endif
+    }
+    r2_assert("r2v4 length is wrong", r2_equals(r2v4_length(va), vec4_length(&a)));
+
+    vec4_normalize(&a, &expect);
+    r2_assert("r2v4 normalize is wrong", r2v4_equals(r2v4_normalize(va), r2v4_load(&expect)));
+    r2_assert("r2v4 normalize of zero is wrong", r2v4_equals(r2v4_normalize(r2v4_zero()), r2v4_zero()));
+
+    vec3_cross(&a, &b, &expect);
+    expect.w = 0.f;
+    r2_assert("r2v4 cross3 is wrong", r2v4_equals(r2v4_cross3(va, vb), r2v4_load(&expect)));
+
+    // matrices
+    mat4_transform(&a, &m1, &expect);
+    r = r2v4_to_vec4(r2m4_transform(r2m4_load(&m1), va));
+    r2_assert("r2m4 transform is wrong", vec4_equals(&r, &expect));
+
+    mat4_mul(&m1, &m2, &mexpect);
+    mr = r2m4_to_mat4(r2m4_mul(r2m4_from_mat4(&m1), r2m4_load(&m2)));
+    r2_assert("r2m4 mul is wrong", vecn_equals(mr.a_mat4, mexpect.a_mat4, 16));
+
+    mat4_transpose(&m1, &mexpect);
+    r2m4_store(r2m4_transpose(r2m4_load(&m1)), &mr);
+    r2_assert("r2m4 transpose is wrong", vecn_equals(mr.a_mat4, mexpect.a_mat4, 16));
+
+    mat4_identity(&mexpect);
+    mr = r2m4_to_mat4(r2m4_identity());
+    r2_assert("r2m4 identity is wrong", vecn_equals(mr.a_mat4, mexpect.a_mat4, 16));
+    return 0;
+}
+
+static const char *test_aligned_batch(void)
+{
+    // Every alignment path of the batch kernels must agree with the
+    // unaligned one: 32 / 64 byte aligned, 16 mod 32 (the AVX peel), 4 byte
+    // aligned, in place and a streamed output bigger than R2_STREAM_MIN
+    size_t big = R2_STREAM_MIN / sizeof(vec4) + 3;
+    size_t offs[4] = {0, 1, 0, 0}; // in vec4s, the 3rd case is shifted by a float below
+    size_t sizes[4] = {13, 13, 13, 0};
+    mat4 kern = {0};
+    quat q = {0};
+    vec3 e = {.x = .3f, .y = -1.1f, .z = 2.f};
+    float ary[16] = {1, 2, 3, 4, -1, 0, 1, 2, .5f, .25f, 2, 0, 0, 0, 0, 1};
+    vec4 *in_buf, *out_buf, *in, *out;
+    size_t c, i, n;
+
+    mat4_set(ary, &kern);
+    quat_from_euler(&e, &q);
+    sizes[3] = big;
+
+    r2_assert("aligned alloc rejects bad alignment", r2_aligned_alloc(24, 64) == NULL);
+    in_buf = (vec4 *)r2_aligned_alloc(64, sizeof(vec4) * (big + 2));
+    out_buf = (vec4 *)r2_aligned_alloc(32, sizeof(vec4) * (big + 2));
+    r2_assert("aligned alloc failed", in_buf != NULL && out_buf != NULL);
+    r2_assert("aligned alloc is not aligned", ((uintptr_t)in_buf & 63) == 0 && ((uintptr_t)out_buf & 31) == 0);
+#ifdef R2_ALIGNED_TYPES
+    // make test_aligned
+    r2_assert("aligned types are not aligned", _Alignof(vec4) == 16 && _Alignof(quat) == 16 && _Alignof(mat4) == 64);
+#endif
+
+    for (c = 0; c < 4; c++)
+    {
+        n = sizes[c];
+        in = in_buf + offs[c];
+        out = out_buf + offs[c];
+        if (c == 2)
+        {
+            in = (vec4 *)((float *)in_buf + 1);
+            out = (vec4 *)((float *)out_buf + 1);
+        }
+        for (i = 0; i < n; i++)
+        {
+            in[i].x = (float)(i % 17) - 8.f;
+            in[i].y = (float)(i % 5) * .5f;
+            in[i].z = 1.f - (float)(i % 11) * .25f;
+            in[i].w = 1.f;
+        }
+
+        mat4_transform_batch(&kern, in, out, n);
+        for (i = 0; i < n; i++)
+        {
+            vec4 r;
+            mat4_transform(&in[i], &kern, &r);
+            r2_assert("aligned mat4 transform batch is wrong", vec4_equals(&out[i], &r));
+        }
+
+        quat_rotate_batch(&q, in, out, n);
+        for (i = 0; i < n; i += (n > 64 ? 997 : 1))
+        {
+            vec3 r;
+            in[i].w = 0.f;
+            quat_mul_vec3(&q, &in[i], &r);
+            r2_assert("aligned quat rotate batch is wrong", fabsf(out[i].x - r.x) < 0.0001f &&
+                                                               fabsf(out[i].y - r.y) < 0.0001f &&
+                                                               fabsf(out[i].z - r.z) < 0.0001f);
+        }
+
+        // in place
+        memcpy(out, in, sizeof(vec4) * n);
+        mat4_transform_batch(&kern, out, out, n);
+        for (i = 0; i < n; i += (n > 64 ? 997 : 1))
+        {
+            vec4 r;
+            mat4_transform(&in[i], &kern, &r);
+            r2_assert("aligned mat4 transform batch in place is wrong", vec4_equals(&out[i], &r));
+        }
+    }
+
+    // soa streams, all aligned
+    {
+        float *f = (float *)r2_aligned_alloc(64, sizeof(float) * 8 * 40);
+        vec4_soa sin = {f, f + 40, f + 80, f + 120, 37};
+        vec4_soa sout = {f + 160, f + 200, f + 240, f + 280, 37};
+        r2_assert("aligned alloc failed", f != NULL);
+        vec4_to_soa(in_buf, 37, &sin);
+        mat4_transform_soa(&kern, &sin, &sout);
+        mat4_transform_batch(&kern, in_buf, out_buf, 37);
+        for (i = 0; i < 37; i++)
+            r2_assert("aligned mat4 transform soa is wrong",
+                      r2_equals(sout.x[i], out_buf[i].x) && r2_equals(sout.y[i], out_buf[i].y) &&
+                          r2_equals(sout.z[i], out_buf[i].z) && r2_equals(sout.w[i], out_buf[i].w));
+        r2_aligned_free(f);
+    }
+
+    r2_aligned_free(in_buf);
+    r2_aligned_free(out_buf);
+    r2_aligned_free(NULL);
+    return 0;
+}
+
 static const char *test_mat3_mul_identity(void)
 {
     mat3 ident = {0};
@@ -807,6 +1515,414 @@ static const char *test_mat3_mul_not_commutative(void)
     return 0;
 }
 
+static const char *test_frustum_from_mat4(void)
+{
+    mat4 proj = {0};
+    mat4 view = {0};
+    frustum f;
+    int p;
+
+    // 90 deg fov looking down -z, so the side planes are x = +-z, y = +-z
+    mat4_perspective(M_PI / 2, 1.f, 1.f, 100.f, &proj);
+    mat4_identity(&view);
+    frustum_from_mat4(&proj, &view, &f);
+
+    for (p = 0; p < 6; p++)
+        r2_assert("frustum plane should be unit length", r2_equals(vec3_length(&f.planes[p]), 1.));
+    // left: (1, 0, -1) / sqrt 2, near: z = -1 facing -z, far: z = -100 facing +z
+    r2_assert("frustum left plane is wrong", r2_equals(f.planes[0].x, sqrtf(.5f)) &&
+                                                 r2_equals(f.planes[0].z, -sqrtf(.5f)) &&
+                                                 fabsf(f.planes[0].w) < 0.0001f);
+    r2_assert("frustum near plane is wrong", r2_equals(f.planes[4].z, -1.) && fabsf(f.planes[4].w + 1.f) < 0.0001f);
+    r2_assert("frustum far plane is wrong", r2_equals(f.planes[5].z, 1.) && fabsf(f.planes[5].w - 100.f) < 0.001f);
+    return 0;
+}
+
+static const char *test_frustum_cull(void)
+{
+    // 45 objects: a row along x at z = -10 plus a few behind, none exactly on a plane
+    float cx[45], cy[45], cz[45], r[45], ex[45], ey[45], ez[45];
+    vec3_soa centers = {.x = cx, .y = cy, .z = cz, .n = 45};
+    vec3_soa extents = {.x = ex, .y = ey, .z = ez, .n = 45};
+    uint32_t visible[45], mask[2];
+    mat4 proj = {0};
+    frustum f;
+    int i, p;
+
+    mat4_perspective(M_PI / 2, 1.f, 1.f, 100.f, &proj);
+    frustum_from_mat4(&proj, NULL, &f);
+    for (i = 0; i < 45; i++)
+    {
+        cx[i] = (float)(i - 22) + .25f;
+        cy[i] = (float)(i % 5) - 2.f;
+        cz[i] = (i % 11 == 0) ? 5.f : -10.f;
+        r[i] = (float)(i % 3);
+        ex[i] = (float)(i % 3);
+        ey[i] = .5f;
+        ez[i] = .5f;
+    }
+
+    size_t count = frustum_cull_spheres(&f, &centers, r, visible);
+    frustum_cull_spheres_mask(&f, &centers, r, mask);
+    size_t seen = 0;
+    for (i = 0; i < 45; i++)
+    {
+        float dmin = INFINITY;
+        for (p = 0; p < 6; p++)
+            dmin = fminf(dmin, f.planes[p].x * cx[i] + f.planes[p].y * cy[i] + f.planes[p].z * cz[i] +
+                                   f.planes[p].w + r[i]);
+        int in = dmin >= 0.f;
+        r2_assert("frustum cull spheres mask is wrong", (int)((mask[i / 32] >> (i % 32)) & 1) == in);
+        if (in)
+        {
+            r2_assert("frustum cull spheres list is wrong", seen < count && visible[seen] == (uint32_t)i);
+            seen++;
+        }
+    }
+    r2_assert("frustum cull spheres count is wrong", seen == count && count > 0 && count < 45);
+    // behind the camera and far to the side
+    r2_assert("frustum cull spheres kept a hidden sphere", !(mask[0] & 1) && !((mask[0] >> 11) & 1));
+
+    count = frustum_cull_aabbs(&f, &centers, &extents, visible);
+    frustum_cull_aabbs_mask(&f, &centers, &extents, mask);
+    seen = 0;
+    for (i = 0; i < 45; i++)
+    {
+        float dmin = INFINITY;
+        for (p = 0; p < 6; p++)
+        {
+            const vec4 *pl = &f.planes[p];
+            dmin = fminf(dmin, pl->x * cx[i] + pl->y * cy[i] + pl->z * cz[i] + pl->w + fabsf(pl->x) * ex[i] +
+                                   fabsf(pl->y) * ey[i] + fabsf(pl->z) * ez[i]);
+        }
+        int in = dmin >= 0.f;
+        r2_assert("frustum cull aabbs mask is wrong", (int)((mask[i / 32] >> (i % 32)) & 1) == in);
+        if (in)
+        {
+            r2_assert("frustum cull aabbs list is wrong", seen < count && visible[seen] == (uint32_t)i);
+            seen++;
+        }
+    }
+    r2_assert("frustum cull aabbs count is wrong", seen == count && count > 0 && count < 45);
+    r2_assert("frustum cull mask tail should be clear", (mask[1] >> 13) == 0);
+    return 0;
+}
+
+// small LCG so the bvh tests are repeatable
+static float bvh_test_rand(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (float)(*state >> 8) / (float)(1u << 24);
+}
+
+static const char *test_bvh_boxes(void)
+{
+    vec3 mins[300], maxs[300];
+    unsigned int seed = 7;
+    bvh b;
+    int i, j, q;
+
+    for (i = 0; i < 300; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            float c = bvh_test_rand(&seed) * 20.f - 10.f;
+            float e = bvh_test_rand(&seed) * .5f + .05f;
+            mins[i].a_vec[j] = c - e;
+            maxs[i].a_vec[j] = c + e;
+        }
+        mins[i].w = maxs[i].w = 0.f;
+    }
+    r2_assert("bvh build failed", bvh_build(mins, maxs, 300, &b));
+    r2_assert("bvh node count is wrong", b.node_count >= 2 && b.node_count <= 2 * 300);
+    r2_assert("bvh nodes are not cache line aligned", ((uintptr_t)b.nodes & 63) == 0);
+    for (i = 0; i < (int)b.node_count; i++)
+    {
+        if (i != 1 && b.nodes[i].count == 0)
+            r2_assert("bvh siblings straddle a cache line", (b.nodes[i].first & 1) == 0);
+    }
+
+    for (q = 0; q < 50; q++)
+    {
+        vec3 o = {.x = bvh_test_rand(&seed) * 24.f - 12.f, .y = bvh_test_rand(&seed) * 24.f - 12.f, .z = -12.f};
+        vec3 d = {.x = bvh_test_rand(&seed) - .5f, .y = bvh_test_rand(&seed) - .5f, .z = 1.f};
+        vec3 p = {.x = o.x, .y = o.y, .z = bvh_test_rand(&seed) * 24.f - 12.f};
+
+        // ray against every box
+        float best = INFINITY;
+        for (i = 0; i < 300; i++)
+        {
+            float t0 = 0.f, t1 = 100.f;
+            for (j = 0; j < 3; j++)
+            {
+                float a = (mins[i].a_vec[j] - o.a_vec[j]) / d.a_vec[j];
+                float c = (maxs[i].a_vec[j] - o.a_vec[j]) / d.a_vec[j];
+                t0 = fmaxf(t0, fminf(a, c));
+                t1 = fminf(t1, fmaxf(a, c));
+            }
+            if (t0 <= t1 && t0 < best)
+                best = t0;
+        }
+        bvh_hit hit;
+        bool got = bvh_raycast(&b, &o, &d, 100.f, &hit);
+        r2_assert("bvh raycast boxes is wrong", got == (best != INFINITY));
+        if (got)
+            r2_assert("bvh raycast boxes t is wrong", fabsf(hit.t - best) < 0.0001f);
+
+        // box query around p
+        vec3 qmin = {.x = p.x - 2.f, .y = p.y - 2.f, .z = p.z - 2.f};
+        vec3 qmax = {.x = p.x + 2.f, .y = p.y + 2.f, .z = p.z + 2.f};
+        uint32_t ids[300];
+        size_t found = bvh_overlap(&b, &qmin, &qmax, ids, 300);
+        size_t expect = 0;
+        for (i = 0; i < 300; i++)
+        {
+            int in = 1;
+            for (j = 0; j < 3; j++)
+                in &= mins[i].a_vec[j] <= qmax.a_vec[j] && maxs[i].a_vec[j] >= qmin.a_vec[j];
+            expect += in;
+        }
+        r2_assert("bvh overlap count is wrong", found == expect);
+        for (i = 0; i < (int)found; i++)
+            for (j = 0; j < 3; j++)
+                r2_assert("bvh overlap returned a box that does not overlap",
+                          mins[ids[i]].a_vec[j] <= qmax.a_vec[j] && maxs[ids[i]].a_vec[j] >= qmin.a_vec[j]);
+
+        // nearest box to p
+        float near_d = INFINITY;
+        for (i = 0; i < 300; i++)
+        {
+            float dd = 0.f;
+            for (j = 0; j < 3; j++)
+            {
+                float c = fminf(fmaxf(p.a_vec[j], mins[i].a_vec[j]), maxs[i].a_vec[j]);
+                dd += (c - p.a_vec[j]) * (c - p.a_vec[j]);
+            }
+            near_d = fminf(near_d, dd);
+        }
+        r2_assert("bvh nearest box failed", bvh_nearest(&b, &p, &hit));
+        r2_assert("bvh nearest box is wrong", fabsf(hit.t - sqrtf(near_d)) < 0.0001f);
+    }
+    bvh_free(&b);
+    r2_assert("bvh free should empty the bvh", b.nodes == NULL && b.node_count == 0);
+    return 0;
+}
+
+// plain Moller-Trumbore for checking bvh_raycast
+static float bvh_test_ray_triangle(const vec3 *o, const vec3 *d, const vec3 *a, const vec3 *b, const vec3 *c)
+{
+    vec3 e1, e2, p, s, q;
+    vec3_sub(b, a, &e1);
+    vec3_sub(c, a, &e2);
+    vec3_cross(d, &e2, &p);
+    float det = vec3_dot(&e1, &p);
+    if (fabsf(det) < 1e-12f)
+        return INFINITY;
+    vec3_sub(o, a, &s);
+    float u = vec3_dot(&s, &p) / det;
+    vec3_cross(&s, &e1, &q);
+    float v = vec3_dot(d, &q) / det;
+    float t = vec3_dot(&e2, &q) / det;
+    if (u < 0.f || v < 0.f || u + v > 1.f || t < 0.f)
+        return INFINITY;
+    return t;
+}
+
+// squared distance from p to the segment ab
+static float bvh_test_segment_dist_sqrd(const vec3 *p, const vec3 *a, const vec3 *b)
+{
+    vec3 ab, ap, q;
+    vec3_sub(b, a, &ab);
+    vec3_sub(p, a, &ap);
+    float t = fmaxf(0.f, fminf(1.f, vec3_dot(&ap, &ab) / vec3_dot(&ab, &ab)));
+    vec3_mul(&ab, t, &q);
+    vec3_sub(&ap, &q, &q);
+    return vec3_dot(&q, &q);
+}
+
+// squared distance from p to a triangle: to its plane when p projects
+// inside, else to the nearest edge
+static float bvh_test_triangle_dist_sqrd(const vec3 *p, const vec3 *a, const vec3 *b, const vec3 *c)
+{
+    vec3 e1, e2, n, ap, t;
+    vec3_sub(b, a, &e1);
+    vec3_sub(c, a, &e2);
+    vec3_cross(&e1, &e2, &n);
+    vec3_sub(p, a, &ap);
+    float nn = vec3_dot(&n, &n);
+    float h = vec3_dot(&ap, &n);
+    // barycentrics of the projection, from the sub triangle areas
+    vec3_cross(&e1, &ap, &t);
+    float v = vec3_dot(&t, &n) / nn;
+    vec3_cross(&ap, &e2, &t);
+    float u = vec3_dot(&t, &n) / nn;
+    if (u >= 0.f && v >= 0.f && u + v <= 1.f)
+        return h * h / nn;
+    return fminf(bvh_test_segment_dist_sqrd(p, a, b),
+                 fminf(bvh_test_segment_dist_sqrd(p, b, c), bvh_test_segment_dist_sqrd(p, c, a)));
+}
+
+static const char *test_bvh_triangles(void)
+{
+    // a bumpy 50x50 height field, 5000 triangles, enough for the task build
+    enum
+    {
+        G = 51,
+        TRIS = (G - 1) * (G - 1) * 2
+    };
+    static vec3 verts[G * G];
+    static uint32_t tris[TRIS * 3];
+    unsigned int seed = 3;
+    bvh b;
+    int i, j, q, t = 0;
+
+    for (i = 0; i < G; i++)
+    {
+        for (j = 0; j < G; j++)
+        {
+            vec3 *v = &verts[i * G + j];
+            v->x = (float)j;
+            v->y = sinf((float)j * .3f) * cosf((float)i * .2f) * 2.f;
+            v->z = (float)i;
+            v->w = 0.f;
+        }
+    }
+    for (i = 0; i < G - 1; i++)
+    {
+        for (j = 0; j < G - 1; j++)
+        {
+            uint32_t a = (uint32_t)(i * G + j);
+            uint32_t quad[6] = {a, a + G, a + 1, a + 1, a + G, a + G + 1};
+            memcpy(&tris[t], quad, sizeof(quad));
+            t += 6;
+        }
+    }
+    r2_assert("bvh build triangles failed", bvh_build_triangles(verts, tris, TRIS, &b));
+
+    for (q = 0; q < 40; q++)
+    {
+        vec3 o = {.x = bvh_test_rand(&seed) * 40.f + 5.f, .y = 10.f, .z = bvh_test_rand(&seed) * 40.f + 5.f};
+        vec3 d = {.x = bvh_test_rand(&seed) - .5f, .y = -1.f, .z = bvh_test_rand(&seed) - .5f};
+        bvh_hit hit, near_hit;
+
+        float best = INFINITY;
+        for (i = 0; i < TRIS; i++)
+            best = fminf(best, bvh_test_ray_triangle(&o, &d, &verts[tris[i * 3]], &verts[tris[i * 3 + 1]],
+                                                     &verts[tris[i * 3 + 2]]));
+        r2_assert("bvh raycast triangles should hit", bvh_raycast(&b, &o, &d, 1000.f, &hit));
+        r2_assert("bvh raycast triangles t is wrong", fabsf(hit.t - best) < 0.0001f);
+        r2_assert("bvh raycast hit point should be on the ray", fabsf(hit.point.y - (10.f - hit.t)) < 0.0001f);
+
+        // nothing within a short ray
+        r2_assert("bvh raycast should respect tmax", !bvh_raycast(&b, &o, &d, best * .5f, &hit));
+
+        // nearest point from above the field, against every triangle
+        vec3 p = {.x = o.x, .y = 3.f, .z = o.z};
+        r2_assert("bvh nearest triangles failed", bvh_nearest(&b, &p, &near_hit));
+        float nearest = INFINITY;
+        for (i = 0; i < TRIS; i++)
+            nearest = fminf(nearest, bvh_test_triangle_dist_sqrd(&p, &verts[tris[i * 3]], &verts[tris[i * 3 + 1]],
+                                                                 &verts[tris[i * 3 + 2]]));
+        r2_assert("bvh nearest triangles distance is wrong", fabsf(near_hit.t - sqrtf(nearest)) < 0.0001f);
+        r2_assert("bvh nearest point distance is wrong",
+                  fabsf(sqrtf(vec3_dist_sqrd(&near_hit.point, &p)) - near_hit.t) < 0.0001f);
+    }
+    bvh_free(&b);
+    return 0;
+}
+
+static const char *test_spatial_hash(void)
+{
+    // 20000 points is past R2_OMP_MIN_BATCH, so the threaded counting sort runs
+    enum
+    {
+        N = 20000
+    };
+    static vec3 points[N];
+    static uint32_t ids[N];
+    static uint8_t hit[N];
+    unsigned int seed = 11;
+    spatial_hash h;
+    int i, q;
+
+    r2_assert("spatial hash init failed", spatial_hash_init(&h, 1.f, 3000));
+    r2_assert("spatial hash table should be a power of two", h.table_size == 4096);
+
+    // small build first, then a bigger one reusing the hash
+    for (i = 0; i < N; i++)
+    {
+        points[i].x = bvh_test_rand(&seed) * 20.f - 10.f;
+        points[i].y = bvh_test_rand(&seed) * 20.f - 10.f;
+        points[i].z = bvh_test_rand(&seed) * 20.f - 10.f;
+        points[i].w = 0.f;
+    }
+    r2_assert("spatial hash build failed", spatial_hash_build(&h, points, 100));
+    r2_assert("spatial hash build failed", spatial_hash_build(&h, points, N));
+    r2_assert("spatial hash start is wrong", h.start[0] == 0 && h.start[h.table_size] == N);
+
+    // every point is in exactly one bucket
+    memset(hit, 0, sizeof(hit));
+    for (i = 0; i < N; i++)
+        hit[h.indices[i]]++;
+    for (i = 0; i < N; i++)
+        r2_assert("spatial hash lost a point", hit[i] == 1);
+
+    for (q = 0; q < 30; q++)
+    {
+        const vec3 *p = &points[q * 331];
+        float radius = (q % 3 == 0) ? 2.5f : .5f + (float)(q % 3) * .25f;
+        size_t found = spatial_hash_radius(&h, points, p, radius, ids, N);
+        size_t expect = 0;
+        memset(hit, 0, sizeof(hit));
+        for (i = 0; i < (int)found; i++)
+            hit[ids[i]] = 1;
+        for (i = 0; i < N; i++)
+        {
+            int in = vec3_dist_sqrd(&points[i], p) <= radius * radius;
+            expect += in;
+            r2_assert("spatial hash radius missed a neighbour", !in || hit[i]);
+        }
+        r2_assert("spatial hash radius count is wrong", found == expect);
+
+        // the point itself is always in one of the spans
+        spatial_hash_span spans[64];
+        size_t n = spatial_hash_query(&h, p, .5f, spans, 64);
+        r2_assert("spatial hash query should find the point itself", n > 0 && n <= 27);
+    }
+
+    // each bucket is reported once, also when the box is sorted (216 cells)
+    {
+        static spatial_hash_span spans[4096];
+        static uint8_t bucket_seen[N];
+        size_t n = spatial_hash_query(&h, &points[5], 2.5f, spans, 4096), s;
+        int unique = 1;
+        memset(bucket_seen, 0, sizeof(bucket_seen));
+        for (s = 0; s < n; s++)
+        {
+            unique &= !bucket_seen[spans[s].first];
+            bucket_seen[spans[s].first] = 1;
+        }
+        r2_assert("spatial hash query repeated a bucket", n > 27 && unique);
+    }
+
+    // a box bigger than the table gives every bucket, huge coordinates are clamped
+    {
+        vec3 far = {.x = 3e38f, .y = -INFINITY, .z = 1e20f};
+        size_t buckets = 0, b;
+        for (b = 0; b < h.table_size; b++)
+            buckets += h.start[b + 1] != h.start[b];
+        r2_assert("spatial hash query of a huge radius is wrong",
+            spatial_hash_query(&h, &points[0], 1e30f, NULL, 0) == buckets);
+        r2_assert("spatial hash radius of a huge radius is wrong",
+            spatial_hash_radius(&h, points, &points[0], 1e30f, ids, N) == N);
+        r2_assert("spatial hash radius far away is wrong", spatial_hash_radius(&h, points, &far, 1.f, ids, N) == 0);
+        r2_assert("spatial hash radius of infinity is wrong",
+            spatial_hash_radius(&h, points, &points[0], INFINITY, ids, N) == N);
+    }
+    spatial_hash_free(&h);
+    return 0;
+}
+
 static const char *test_mat_mul_non_square(void)
 {
     // 2x3 * 3x2 = 2x2
@@ -826,6 +1942,219 @@ static const char *test_mat_mul_non_square(void)
     return 0;
 }
 
+static const char *test_mat_transpose(void)
+{
+    // not a multiple of any block or tile size in either direction
+    const unsigned int r = 70, c = 37;
+    float *m = malloc(sizeof(float) * r * c);
+    float *out = malloc(sizeof(float) * r * c);
+    unsigned int i, j;
+    int ok = 1;
+
+    for (i = 0; i < r * c; i++)
+        m[i] = (float)i;
+    mat_transpose(m, r, c, out);
+    for (i = 0; i < r; i++)
+    {
+        for (j = 0; j < c; j++)
+            ok &= out[j * r + i] == m[i * c + j];
+    }
+
+    free(m);
+    free(out);
+    r2_assert("mat_transpose is wrong", ok);
+    return 0;
+}
+
+static const char *test_mat_transpose_in_place(void)
+{
+    unsigned int sizes[3] = {3, 8, 75};
+    unsigned int s, i, j;
+    int ok = 1;
+
+    for (s = 0; s < 3; s++)
+    {
+        unsigned int n = sizes[s];
+        float *m = malloc(sizeof(float) * n * n);
+        for (i = 0; i < n * n; i++)
+            m[i] = (float)i;
+        mat_transpose(m, n, n, m);
+        for (i = 0; i < n; i++)
+        {
+            for (j = 0; j < n; j++)
+                ok &= m[j * n + i] == (float)(i * n + j);
+        }
+        free(m);
+    }
+    r2_assert("mat_transpose in place is wrong", ok);
+    return 0;
+}
+
+static void lu_test_fill(float *m, unsigned int count, unsigned int seed)
+{
+    unsigned int i;
+    for (i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        m[i] = (float)(seed >> 8) / 8388608.f - 1.f;
+    }
+}
+
+static const char *test_mat_lu(void)
+{
+    // the first trailing update (n - R2_LU_BLOCK) is wider than mat_lu's 256 wide tiles, so it takes a full and
+    // a partial tile in each direction, and n is not a multiple of the panel width either
+    unsigned int n = 333, i, j;
+    float *a = malloc(sizeof(float) * n * n);
+    float *lu = malloc(sizeof(float) * n * n);
+    float *l = malloc(sizeof(float) * n * n);
+    float *u = malloc(sizeof(float) * n * n);
+    float *prod = malloc(sizeof(float) * n * n);
+    int *piv = malloc(sizeof(int) * n);
+    int ok = 1, swapped = 0;
+
+    lu_test_fill(a, n * n, 7);
+    memcpy(lu, a, sizeof(float) * n * n);
+    ok &= mat_lu(lu, n, piv);
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+        {
+            float v = lu[i * n + j];
+            l[i * n + j] = (j < i) ? v : (j == i) ? 1.f : 0.f;
+            u[i * n + j] = (j >= i) ? v : 0.f;
+            // partial pivoting keeps every multiplier at most 1
+            ok &= j >= i || fabsf(v) <= 1.f;
+        }
+    }
+    mat_mul(l, u, n, n, n, n, prod);
+
+    // P A, applying the swaps in order
+    for (i = 0; i < n; i++)
+    {
+        if ((unsigned int)piv[i] != i)
+        {
+            swapped = 1;
+            for (j = 0; j < n; j++)
+            {
+                float t = a[i * n + j];
+                a[i * n + j] = a[piv[i] * n + j];
+                a[piv[i] * n + j] = t;
+            }
+        }
+    }
+    for (i = 0; i < n * n; i++)
+        ok &= fabsf(prod[i] - a[i]) < 1e-4f;
+
+    free(a);
+    free(lu);
+    free(l);
+    free(u);
+    free(prod);
+    free(piv);
+    r2_assert("mat_lu does not reproduce P A", ok);
+    r2_assert("mat_lu never pivoted", swapped);
+    return 0;
+}
+
+static const char *test_mat_solve(void)
+{
+    // 2x + y - z = 8, -3x - y + 2z = -11, -2x + y + 2z = -3
+    float a3[9] = {2.f, 1.f, -1.f, -3.f, -1.f, 2.f, -2.f, 1.f, 2.f};
+    float b3[3] = {8.f, -11.f, -3.f};
+    float x3[3];
+    float sing[9] = {1.f, 2.f, 3.f, 2.f, 4.f, 6.f, 1.f, 0.f, 1.f};
+    float untouched[3] = {5.f, 5.f, 5.f};
+    unsigned int n = 150, nrhs = 3, i;
+    float *a = malloc(sizeof(float) * n * n);
+    float *x = malloc(sizeof(float) * n * nrhs);
+    float *b = malloc(sizeof(float) * n * nrhs);
+    float *ax = malloc(sizeof(float) * n * nrhs);
+    int ok = 1;
+
+    r2_assert("mat_solve 3x3 failed", mat_solve(a3, b3, 3, 1, x3));
+    r2_assert("mat_solve 3x3 is wrong",
+        fabsf(x3[0] - 2.f) < 1e-5f && fabsf(x3[1] - 3.f) < 1e-5f && fabsf(x3[2] + 1.f) < 1e-5f);
+
+    r2_assert("mat_solve took a singular matrix", !mat_solve(sing, b3, 3, 1, untouched));
+    r2_assert("mat_solve wrote x for a singular matrix",
+        untouched[0] == 5.f && untouched[1] == 5.f && untouched[2] == 5.f);
+    r2_assert("mat_solve of an empty system failed", mat_solve(a3, b3, 0, 1, untouched) && untouched[0] == 5.f);
+
+    // several right hand sides, then one, solved in place
+    lu_test_fill(a, n * n, 11);
+    lu_test_fill(b, n * nrhs, 13);
+    ok &= mat_solve(a, b, n, nrhs, x);
+    mat_mul(a, x, n, n, n, nrhs, ax);
+    for (i = 0; i < n * nrhs; i++)
+        ok &= fabsf(ax[i] - b[i]) < 1e-3f;
+
+    memcpy(x, b, sizeof(float) * n);
+    ok &= mat_solve(a, x, n, 1, x);
+    mat_mul(a, x, n, n, n, 1, ax);
+    for (i = 0; i < n; i++)
+        ok &= fabsf(ax[i] - b[i]) < 1e-3f;
+
+    free(a);
+    free(x);
+    free(b);
+    free(ax);
+    r2_assert("mat_solve residual is too large", ok);
+    return 0;
+}
+
+static const char *test_mat_inverse(void)
+{
+    float sing[4] = {1.f, 2.f, 2.f, 4.f};
+    float untouched[4] = {9.f, 9.f, 9.f, 9.f};
+    unsigned int n = 150, i, j;
+    float *a = malloc(sizeof(float) * n * n);
+    float *inv = malloc(sizeof(float) * n * n);
+    float *prod = malloc(sizeof(float) * n * n);
+    int ok = 1;
+
+    lu_test_fill(a, n * n, 17);
+    ok &= mat_inverse(a, n, inv);
+    mat_mul(a, inv, n, n, n, n, prod);
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+            ok &= fabsf(prod[i * n + j] - (i == j ? 1.f : 0.f)) < 1e-3f;
+    }
+
+    // in place, against mat4_inverse
+    mat4 m = {{2.f, 0.f, 1.f, 0.f, 1.f, 3.f, 0.f, 0.f, 0.f, 1.f, 4.f, 0.f, 1.f, 2.f, 3.f, 1.f}};
+    mat4 expect, got = m;
+    mat4_inverse(&m, &expect);
+    ok &= mat_inverse(got.a_mat4, 4, got.a_mat4);
+    for (i = 0; i < 16; i++)
+        ok &= fabsf(got.a_mat4[i] - expect.a_mat4[i]) < 1e-5f;
+
+    free(a);
+    free(inv);
+    free(prod);
+    r2_assert("mat_inverse is wrong", ok);
+    r2_assert("mat_inverse took a singular matrix", !mat_inverse(sing, 2, untouched));
+    r2_assert("mat_inverse wrote out for a singular matrix", untouched[0] == 9.f && untouched[3] == 9.f);
+    return 0;
+}
+
+static const char *test_mat_det(void)
+{
+    float a[9] = {2.f, 1.f, -1.f, -3.f, -1.f, 2.f, -2.f, 1.f, 2.f};
+    // a single row swap
+    float p[9] = {0.f, 1.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f};
+    float sing[9] = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f};
+    mat4 m = {{2.f, 0.f, 1.f, 0.f, 1.f, 3.f, 0.f, 0.f, 0.f, 1.f, 4.f, 0.f, 1.f, 2.f, 3.f, 1.f}};
+
+    r2_assert("mat_det is wrong", fabsf(mat_det(a, 3) + 1.f) < 1e-5f);
+    r2_assert("mat_det sign is wrong for a permutation", mat_det(p, 3) == -1.f);
+    r2_assert("mat_det of a singular matrix is not 0", fabsf(mat_det(sing, 3)) < 1e-5f);
+    r2_assert("mat_det of a mat4 is wrong", fabsf(mat_det(m.a_mat4, 4) - 25.f) < 1e-4f);
+    r2_assert("mat_det of an empty matrix is not 1", mat_det(a, 0) == 1.f);
+    return 0;
+}
+
 static const char *test_vecn_add(void)
 {
     float a[4] = {1.f, 2.f, 3.f, 4.f};
@@ -1046,6 +2375,751 @@ static const char *test_vecn_div_large(void)
     return 0;
 }
 
+static const char *test_vecn_fused(void)
+{
+    // 37 covers the vector body and the scalar/masked tail
+    float a[37], b[37], c[37], out[37];
+    int i, ok = 1;
+    for (i = 0; i < 37; i++)
+    {
+        a[i] = (float)(i % 7) - 3.f;
+        b[i] = (float)(i % 5) * .5f;
+        c[i] = (float)i;
+    }
+
+    vecn_axpby(2.f, a, -1.f, b, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], 2.f * a[i] - b[i]);
+    r2_assert("vecn_axpby is wrong", ok);
+
+    vecn_fma(a, b, c, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], a[i] * b[i] + c[i]);
+    r2_assert("vecn_fma is wrong", ok);
+
+    vecn_lerp(a, c, .25f, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], a[i] + (c[i] - a[i]) * .25f);
+    r2_assert("vecn_lerp is wrong", ok);
+
+    vecn_scale_add(a, 3.f, 1.f, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], a[i] * 3.f + 1.f);
+    r2_assert("vecn_scale_add is wrong", ok);
+
+    // in place on y, the BLAS saxpy path
+    for (i = 0; i < 37; i++) out[i] = c[i];
+    vecn_axpy(.5f, a, out, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], .5f * a[i] + c[i]);
+    r2_assert("vecn_axpy in place is wrong", ok);
+    // and saxpby
+    for (i = 0; i < 37; i++) out[i] = c[i];
+    vecn_axpby(2.f, a, -.5f, out, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], 2.f * a[i] - .5f * c[i]);
+    r2_assert("vecn_axpby in place is wrong", ok);
+    for (i = 0; i < 37; i++) out[i] = .5f * a[i] + c[i];
+
+    // in place mul and div, the BLAS sscal path
+    vecn_mul(out, 2.f, 37, out);
+    vecn_div(out, 4.f, 37, out);
+    for (i = 0; i < 37; i++) ok &= r2_equals(out[i], (.5f * a[i] + c[i]) * .5f);
+    r2_assert("vecn_mul in place is wrong", ok);
+    return 0;
+}
+
+static const char *test_vecn_f16(void)
+{
+    // exact values, rounding to even, range limits and subnormals
+    r2_assert("f16 one is wrong", float_to_f16(1.f) == 0x3c00 && f16_to_float(0x3c00) == 1.f);
+    r2_assert("f16 max is wrong", float_to_f16(65504.f) == 0x7bff && float_to_f16(-65520.f) == 0xfc00);
+    r2_assert("f16 should round to even",
+              float_to_f16(1.f + 1.f / 2048.f) == 0x3c00 && float_to_f16(1.f + 3.f / 2048.f) == 0x3c02);
+    r2_assert("f16 subnormal is wrong", float_to_f16(5.9604645e-8f) == 1 && f16_to_float(0x0200) == 3.0517578e-5f);
+    r2_assert("f16 nan is lost", isnan(f16_to_float(float_to_f16(NAN))));
+    r2_assert("bf16 is wrong", float_to_bf16(1.f) == 0x3f80 && bf16_to_float(0xc000) == -2.f);
+    r2_assert("bf16 should round to even",
+              float_to_bf16(1.00390625f) == 0x3f80 && float_to_bf16(1.01171875f) == 0x3f82);
+
+    // 37 covers the vector body and the scalar tail of every level
+    float a[37], b[37], wa[37], wb[37];
+    f16 ha[37], hb[37];
+    bf16 ba[37], bb[37];
+    int i, ok = 1;
+    for (i = 0; i < 37; i++)
+    {
+        a[i] = (float)(i % 7) * .3f - 1.f;
+        b[i] = (float)(i % 5) * .7f + .1f;
+    }
+    vecn_to_f16(a, 37, ha);
+    vecn_to_f16(b, 37, hb);
+    for (i = 0; i < 37; i++) ok &= ha[i] == float_to_f16(a[i]);
+    r2_assert("vecn_to_f16 is wrong", ok);
+    vecn_from_f16(ha, 37, wa);
+    vecn_from_f16(hb, 37, wb);
+    for (i = 0; i < 37; i++) ok &= wa[i] == f16_to_float(ha[i]) && fabsf(wa[i] - a[i]) < 1e-3f;
+    r2_assert("vecn_from_f16 is wrong", ok);
+    r2_assert("vecn_dot_f16 is wrong", fabsf(vecn_dot_f16(ha, hb, 37) - vecn_dot(wa, wb, 37)) < 1e-4f);
+    r2_assert("vecn_dist_sqrd_f16 is wrong",
+              fabsf(vecn_dist_sqrd_f16(ha, hb, 37) - vecn_dist_sqrd(wa, wb, 37)) < 1e-4f);
+
+    vecn_to_bf16(a, 37, ba);
+    vecn_to_bf16(b, 37, bb);
+    for (i = 0; i < 37; i++) ok &= ba[i] == float_to_bf16(a[i]);
+    r2_assert("vecn_to_bf16 is wrong", ok);
+    vecn_from_bf16(ba, 37, wa);
+    vecn_from_bf16(bb, 37, wb);
+    for (i = 0; i < 37; i++) ok &= wa[i] == bf16_to_float(ba[i]) && fabsf(wa[i] - a[i]) < 1e-2f;
+    r2_assert("vecn_from_bf16 is wrong", ok);
+    r2_assert("vecn_dot_bf16 is wrong", fabsf(vecn_dot_bf16(ba, bb, 37) - vecn_dot(wa, wb, 37)) < 1e-4f);
+    r2_assert("vecn_dist_sqrd_bf16 is wrong",
+              fabsf(vecn_dist_sqrd_bf16(ba, bb, 37) - vecn_dist_sqrd(wa, wb, 37)) < 1e-4f);
+    return 0;
+}
+
+static const char *test_mat_mul_f16(void)
+{
+    // big enough for the packed GEMM, with partial tiles on every edge
+    enum { R = 67, C = 83, K = 71 };
+    float *m1 = malloc(sizeof(float) * R * K), *m2 = malloc(sizeof(float) * K * C);
+    float *out = malloc(sizeof(float) * R * C), *ref = malloc(sizeof(float) * R * C);
+    f16 *h1 = malloc(sizeof(f16) * R * K), *h2 = malloc(sizeof(f16) * K * C);
+    bf16 *b1 = malloc(sizeof(bf16) * R * K), *b2 = malloc(sizeof(bf16) * K * C);
+    int i, ok = 1;
+    for (i = 0; i < R * K; i++) m1[i] = (float)(i % 13) * .25f - 1.5f;
+    for (i = 0; i < K * C; i++) m2[i] = (float)(i % 9) * .5f - 2.f;
+    // these values are exact in both f16 and bf16
+    vecn_to_f16(m1, R * K, h1);
+    vecn_to_f16(m2, K * C, h2);
+    vecn_to_bf16(m1, R * K, b1);
+    vecn_to_bf16(m2, K * C, b2);
+    mat_mul(m1, m2, R, K, K, C, ref);
+
+    mat_mul_f16(h1, h2, R, K, K, C, out);
+    for (i = 0; i < R * C; i++) ok &= fabsf(out[i] - ref[i]) < 1e-3f;
+    r2_assert("mat_mul_f16 is wrong", ok);
+    mat_mul_bf16(b1, b2, R, K, K, C, out);
+    for (i = 0; i < R * C; i++) ok &= fabsf(out[i] - ref[i]) < 1e-3f;
+    r2_assert("mat_mul_bf16 is wrong", ok);
+
+    // and the small (unpacked) path
+    mat_mul_f16(h1, h2, 3, 5, 5, 7, out);
+    mat_mul(m1, m2, 3, 5, 5, 7, ref);
+    for (i = 0; i < 3 * 7; i++) ok &= fabsf(out[i] - ref[i]) < 1e-3f;
+    r2_assert("small mat_mul_f16 is wrong", ok);
+
+    free(m1);
+    free(m2);
+    free(out);
+    free(ref);
+    free(h1);
+    free(h2);
+    free(b1);
+    free(b2);
+    return 0;
+}
+
+static const char *test_vecn_i8(void)
+{
+    // 77 covers the 32 and 16 wide bodies and the tails
+    float a[77], b[77], w[77];
+    int8_t qa[77], qb[77];
+    uint8_t ua[77];
+    int i, ok = 1;
+    for (i = 0; i < 77; i++)
+    {
+        a[i] = (float)(i % 11) * .4f - 2.f;
+        b[i] = (float)((i * 7) % 13) * .1f - .3f;
+    }
+
+    float sa = vecn_quantize_i8(a, 77, qa);
+    float sb = vecn_quantize_i8(b, 77, qb);
+    r2_assert("vecn_quantize_i8 scale is wrong", r2_equals(sa, 2.f / 127.f));
+    r2_assert("vecn_quantize_i8 should use the full range", qa[0] == -127 && qa[10] == 127);
+    vecn_dequantize_i8(qa, sa, 77, w);
+    for (i = 0; i < 77; i++) ok &= fabsf(w[i] - a[i]) <= sa * .5f + 1e-6f;
+    r2_assert("vecn_dequantize_i8 is wrong", ok);
+
+    int32_t dot = 0;
+    for (i = 0; i < 77; i++) dot += qa[i] * qb[i];
+    r2_assert("vecn_dot_i8 is wrong", vecn_dot_i8(qa, qb, 77) == dot);
+    r2_assert("vecn_dot_i8 dequantized is wrong", fabsf((float)dot * sa * sb - vecn_dot(a, b, 77)) < .05f);
+
+    // extremes of the allowed range
+    for (i = 0; i < 77; i++)
+    {
+        qa[i] = (int8_t)((i & 1) ? -127 : 127);
+        qb[i] = -127;
+    }
+    r2_assert("vecn_dot_i8 extremes are wrong", vecn_dot_i8(qa, qb, 77) == -127 * 127);
+
+    float su;
+    uint8_t zu;
+    vecn_quantize_u8(b, 77, ua, &su, &zu);
+    r2_assert("vecn_quantize_u8 scale is wrong", r2_equals(su, 1.2f / 255.f) && zu == 64);
+    vecn_dequantize_u8(ua, su, zu, 77, w);
+    for (i = 0; i < 77; i++) ok &= fabsf(w[i] - b[i]) <= su * .5f + 1e-6f;
+    r2_assert("vecn_dequantize_u8 is wrong", ok);
+    return 0;
+}
+
+static const char *test_mat_mul_i8(void)
+{
+    enum { R = 37, C = 45, K = 70 };
+    float m1[R * K], m2t[C * K], m2[K * C], ref[R * C], out[R * C], s1[R], s2[C];
+    int8_t q1[R * K], q2[C * K];
+    uint8_t u1[R * K], z1[R];
+    int i, j, k, ok = 1;
+    for (i = 0; i < R * K; i++) m1[i] = sinf((float)i * .37f);
+    for (i = 0; i < C * K; i++) m2t[i] = cosf((float)i * .21f) * 3.f;
+    mat_transpose(m2t, C, K, m2);
+    mat_mul(m1, m2, R, K, K, C, ref);
+
+    mat_quantize_i8(m1, R, K, q1, s1);
+    mat_quantize_i8(m2t, C, K, q2, s2);
+    r2_assert("mat_quantize_i8 row scale is wrong", r2_equals(s1[1], vecn_quantize_i8(&m1[K], K, q1 + K)));
+    mat_mul_i8(q1, s1, q2, s2, R, K, C, out);
+    for (i = 0; i < R; i++)
+    {
+        for (j = 0; j < C; j++)
+        {
+            int32_t dot = 0;
+            for (k = 0; k < K; k++) dot += q1[i * K + k] * q2[j * K + k];
+            ok &= fabsf(out[i * C + j] - (float)dot * s1[i] * s2[j]) < 1e-3f;
+            ok &= fabsf(out[i * C + j] - ref[i * C + j]) < .2f;
+        }
+    }
+    r2_assert("mat_mul_i8 is wrong", ok);
+
+    mat_quantize_u8(m1, R, K, u1, s1, z1);
+    for (i = 0; i < R; i++)
+    {
+        float row[K];
+        vecn_dequantize_u8(&u1[i * K], s1[i], z1[i], K, row);
+        for (k = 0; k < K; k++) ok &= fabsf(row[k] - m1[i * K + k]) <= s1[i] * .5f + 1e-6f;
+    }
+    r2_assert("mat_quantize_u8 is wrong", ok);
+    return 0;
+}
+
+static const char *test_vecn_reductions(void)
+{
+    // odd length so every level runs its unrolled body, single steps and tail
+    enum { N = 1003 };
+    float v[N];
+    double ref = 0.0;
+    int i;
+    for (i = 0; i < N; i++)
+    {
+        v[i] = sinf((float)i) * 10.f + .1f;
+        ref += v[i];
+    }
+    v[500] = 42.f;
+    v[900] = 42.f;
+    v[17] = -42.f;
+
+    ref += 42.0 - (sinf(500.f) * 10.f + .1f) + 42.0 - (sinf(900.f) * 10.f + .1f);
+    ref += -42.0 - (sinf(17.f) * 10.f + .1f);
+    r2_assert("vecn_sum is wrong", fabs(vecn_sum(v, N) - ref) < 1e-3);
+    r2_assert("vecn_max is wrong", vecn_max(v, N) == 42.f);
+    r2_assert("vecn_min is wrong", vecn_min(v, N) == -42.f);
+    r2_assert("vecn_argmax should find the first max", vecn_argmax(v, N) == 500);
+
+    float lo, hi;
+    v[3] = NAN;
+    v[N - 1] = NAN;
+    vecn_minmax(v, N, &lo, &hi);
+    r2_assert("vecn_minmax should skip NaN", lo == -42.f && hi == 42.f);
+    r2_assert("vecn_argmax should skip NaN", vecn_argmax(v, N) == 500);
+    r2_assert("vecn_argmax in the tail is wrong", vecn_argmax(&v[501], N - 501) == 399);
+
+    r2_assert("empty reductions are wrong",
+              vecn_sum(v, 0) == 0.f && vecn_min(v, 0) == INFINITY && vecn_max(v, 0) == -INFINITY &&
+                  vecn_argmax(v, 0) == -1);
+    return 0;
+}
+
+static const char *test_vecn_transcendentals(void)
+{
+    // odd length, so the padded tail is covered too
+    enum { N = 1001 };
+    float x[N], y[N], out[N], c[N];
+    int i, tier;
+    for (i = 0; i < N; i++)
+    {
+        x[i] = (float)i * .2f - 100.f;        // [-100, 100]
+        y[i] = expf((float)i * .17f - 85.f); // about [1e-37, 1e37]
+    }
+
+    for (tier = 0; tier < 2; tier++)
+    {
+        // relative error, absolute for sin / cos (they cross 0)
+        double tol = tier ? 2e-4 : 3e-7;
+        double err = 0.0, ref;
+        r2_accuracy_set(tier ? R2_ACCURACY_FAST : R2_ACCURACY_PRECISE);
+        r2_assert("r2_accuracy_get is wrong", r2_accuracy_get() == (tier ? R2_ACCURACY_FAST : R2_ACCURACY_PRECISE));
+
+        // past 88.7 is infinity and below -87.3 subnormal, checked below
+        vecn_mul(x, .87f, N, c);
+        vecn_exp(c, N, out);
+        for (i = 0; i < N; i++) err = fmax(err, fabs(out[i] - exp(c[i])) / exp(c[i]));
+        r2_assert("vecn_exp is wrong", err < tol);
+
+        vecn_log(y, N, out);
+        for (err = 0.0, i = 0; i < N; i++) err = fmax(err, fabs(out[i] - log(y[i])) / fmax(fabs(log(y[i])), 1e-3));
+        r2_assert("vecn_log is wrong", err < tol);
+
+        vecn_sincos(x, N, out, c);
+        for (err = 0.0, i = 0; i < N; i++) err = fmax(err, fmax(fabs(out[i] - sin(x[i])), fabs(c[i] - cos(x[i]))));
+        r2_assert("vecn_sincos is wrong", err < tol);
+        vecn_sin(x, N, c);
+        r2_assert("vecn_sin should match vecn_sincos", memcmp(c, out, sizeof(c)) == 0);
+
+        vecn_mul(x, .05f, N, c);
+        vecn_tanh(c, N, out);
+        for (err = 0.0, i = 0; i < N; i++) err = fmax(err, fabs(out[i] - tanh(c[i])) / fmax(fabs(tanh(c[i])), 1e-30));
+        r2_assert("vecn_tanh is wrong", err < tol);
+
+        // pow is exp(y log x); under FAST the error grows with |y log x|,
+        // the precise tier carries the log in two parts and stays in 1 ULP
+        double ptol = tier ? tol * 20.0 : 1.2e-7;
+        vecn_pow(x, 3.f, N, out);
+        for (err = 0.0, i = 0; i < N; i++)
+        {
+            ref = pow(x[i], 3.0);
+            err = fmax(err, fabs(out[i] - ref) / fmax(fabs(ref), 1e-30));
+        }
+        r2_assert("vecn_pow odd is wrong", err < ptol);
+        vecn_pow(y, -.75f, N, out);
+        for (err = 0.0, i = 0; i < N; i++) err = fmax(err, fabs(out[i] - pow(y[i], -.75)) / pow(y[i], -.75));
+        r2_assert("vecn_pow is wrong", err < ptol);
+        // x^40 over [2, 4), |y log x| up to 55
+        for (i = 0; i < N; i++) c[i] = 2.f + (float)i * (2.f / N);
+        vecn_pow(c, 40.f, N, out);
+        for (err = 0.0, i = 0; i < N; i++) err = fmax(err, fabs(out[i] - pow(c[i], 40.0)) / pow(c[i], 40.0));
+        r2_assert("vecn_pow of a large exponent is wrong", err < ptol * (tier ? 2.0 : 1.0));
+    }
+    r2_accuracy_set(R2_ACCURACY_PRECISE);
+
+    float sp[6] = {0.f, -1.f, INFINITY, -INFINITY, NAN, 1.f}, so[6];
+    vecn_log(sp, 6, so);
+    r2_assert("vecn_log specials are wrong",
+              so[0] == -INFINITY && isnan(so[1]) && so[2] == INFINITY && isnan(so[3]) && isnan(so[4]) && so[5] == 0.f);
+    vecn_exp(sp, 6, so);
+    r2_assert("vecn_exp specials are wrong", so[0] == 1.f && so[2] == INFINITY && so[3] == 0.f && isnan(so[4]));
+    vecn_tanh(sp, 6, so);
+    r2_assert("vecn_tanh specials are wrong", so[0] == 0.f && so[2] == 1.f && so[3] == -1.f && isnan(so[4]));
+    vecn_pow(sp, .5f, 6, so);
+    r2_assert("vecn_pow specials are wrong",
+              so[0] == 0.f && isnan(so[1]) && so[2] == INFINITY && so[3] == INFINITY && so[5] == 1.f);
+
+    // huge exponents are even, infinite ones go to 0, 1 or inf by |x|
+    float pw[6] = {-2.f, -.5f, -1.f, 3.f, 1.f, -3.f}, po[6];
+    vecn_pow(pw, 33554432.f, 6, po);
+    r2_assert("vecn_pow of 2^25 is wrong", po[0] == INFINITY && po[1] == 0.f && po[2] == 1.f && po[4] == 1.f);
+    vecn_pow(pw, INFINITY, 6, po);
+    r2_assert("vecn_pow of inf is wrong", po[0] == INFINITY && po[1] == 0.f && po[2] == 1.f && po[3] == INFINITY);
+    vecn_pow(pw, -INFINITY, 6, po);
+    r2_assert("vecn_pow of -inf is wrong", po[0] == 0.f && po[1] == INFINITY && po[2] == 1.f && po[3] == 0.f);
+    vecn_pow(pw, NAN, 6, po);
+    r2_assert("vecn_pow of NaN is wrong", isnan(po[0]) && isnan(po[2]) && po[4] == 1.f);
+    vecn_pow(pw, 3.f, 6, po);
+    r2_assert("vecn_pow of a cube is not exact", po[3] == 27.f && po[5] == -27.f && po[1] == -.125f);
+    return 0;
+}
+
+static const char *test_vecn_knn(void)
+{
+    // 1500 rows span two k-NN blocks, 9 queries take the mat_mul path
+    enum { N = 1500, D = 19, Q = 9, K = 7 };
+    static float data[N * D], queries[Q * D];
+    float dist[Q * K], one_dist[K], score[N];
+    uint32_t idx[Q * K], one_idx[K];
+    unsigned int seed = 7;
+    int i, j, m, ok = 1;
+    for (i = 0; i < N * D; i++) data[i] = bvh_test_rand(&seed) * 2.f - 1.f;
+    for (i = 0; i < Q * D; i++) queries[i] = bvh_test_rand(&seed) * 2.f - 1.f;
+
+    for (m = 0; m < 2; m++)
+    {
+        knn_metric metric = m ? KNN_DOT : KNN_L2;
+        vecn_knn_batch(data, N, D, queries, Q, K, metric, idx, dist);
+        for (j = 0; j < Q; j++)
+        {
+            const float *q = &queries[j * D];
+            // brute force: count rows strictly better than the kth answer
+            float kth = dist[j * K + K - 1];
+            int better = 0;
+            for (i = 0; i < N; i++)
+            {
+                score[i] = m ? vecn_dot(&data[i * D], q, D) : vecn_dist_sqrd(&data[i * D], q, D);
+                better += m ? (score[i] > kth + 1e-3f) : (score[i] < kth - 1e-3f);
+            }
+            ok &= better < K;
+            for (i = 0; i < K; i++)
+            {
+                uint32_t r = idx[j * K + i];
+                ok &= r < N && fabsf(score[r] - dist[j * K + i]) < 1e-3f;
+                if (i) ok &= m ? dist[j * K + i] <= dist[j * K + i - 1] : dist[j * K + i] >= dist[j * K + i - 1];
+            }
+
+            vecn_knn(data, N, D, q, K, metric, one_idx, one_dist);
+            for (i = 0; i < K; i++) ok &= r2_equals(one_dist[i], score[one_idx[i]]);
+            // the mat_mul path expands |x - q|^2 so it rounds a little differently
+            for (i = 0; i < K; i++) ok &= fabsf(one_dist[i] - dist[j * K + i]) < 1e-3f;
+        }
+        if (m)
+            r2_assert("vecn_knn dot is wrong", ok);
+        else
+            r2_assert("vecn_knn l2 is wrong", ok);
+    }
+
+    // fewer rows than k pads the tail
+    vecn_knn(data, 3, D, queries, 5, KNN_L2, one_idx, one_dist);
+    ok = one_idx[2] < 3 && one_idx[3] == UINT32_MAX && one_dist[4] == INFINITY;
+    r2_assert("vecn_knn should pad short results", ok);
+
+    // k of 0 writes nothing (not even idx[0])
+    vecn_knn(data, N, D, queries, 0, KNN_L2, NULL, NULL);
+    vecn_knn_batch(data, N, D, queries, Q, 0, KNN_DOT, NULL, NULL);
+    return 0;
+}
+
+// Write file with bytes patched in at offset at, and try to open it
+static bool tensor_test_open_patched(const char *path, const unsigned char *file, size_t size, size_t at,
+                                     const void *patch, size_t bytes)
+{
+    r2_tensor_file f;
+    unsigned char *copy = (unsigned char *)malloc(size);
+    FILE *fp = fopen(path, "wb");
+    bool opened = false;
+    if (copy != NULL && fp != NULL)
+    {
+        memcpy(copy, file, size);
+        memcpy(copy + at, patch, bytes);
+        fwrite(copy, 1, size, fp);
+        fclose(fp);
+        fp = NULL;
+        opened = r2_tensor_open(path, &f);
+        if (opened)
+            r2_tensor_close(&f);
+    }
+    if (fp != NULL)
+        fclose(fp);
+    free(copy);
+    return opened;
+}
+
+static const char *tensor_test_cases(const char *path)
+{
+    float m[7 * 33];
+    float got[7 * 33];
+    f16 h[7 * 33];
+    bf16 b[7 * 33];
+    int8_t q[7 * 33];
+    float scales[7];
+    size_t shape_m[2] = {7, 33};
+    size_t shape_v[1] = {37};
+    size_t shape_t[3] = {3, 1, 77};
+    r2_tensor_writer w;
+    r2_tensor_file f;
+    const r2_tensor *t;
+    FILE *fp;
+    int i;
+
+    for (i = 0; i < 7 * 33; i++)
+        m[i] = sinf((float)i * .37f) * (float)(i % 9 + 1);
+
+    r2_assert("tensor write begin failed", r2_tensor_write_begin(&w, path));
+    r2_assert("tensor write f32 failed", r2_tensor_write(&w, "weights", R2_DTYPE_F32, 2, shape_m, m));
+    r2_assert("tensor write f16 failed", r2_tensor_write(&w, "bias", R2_DTYPE_F16, 1, shape_v, m));
+    r2_assert("tensor write bf16 failed", r2_tensor_write(&w, "grid", R2_DTYPE_BF16, 3, shape_t, m));
+    r2_assert("tensor write i8 failed", r2_tensor_write(&w, "weights_i8", R2_DTYPE_I8, 2, shape_m, m));
+    r2_assert("tensor write accepted a bad ndim", !r2_tensor_write(&w, "bad", R2_DTYPE_F32, 0, shape_m, m));
+    r2_assert("tensor write end failed", r2_tensor_write_end(&w));
+
+    r2_assert("tensor open failed", r2_tensor_open(path, &f));
+    r2_assert("tensor count is wrong", f.count == 4);
+    r2_assert("tensor find of a missing name is wrong", r2_tensor_find(&f, "nope") == NULL);
+
+    t = r2_tensor_find(&f, "weights");
+    r2_assert("tensor f32 view is wrong", t != NULL && t->ndim == 2 && t->shape[0] == 7 && t->shape[1] == 33 &&
+                                              t->stride[0] == 33 && t->stride[1] == 1 && t->rows == 7 &&
+                                              ((uintptr_t)t->data % R2_TENSOR_ALIGN) == 0);
+    r2_assert("tensor f32 data is wrong", memcmp(r2_tensor_f32(t), m, sizeof(m)) == 0);
+
+    t = r2_tensor_find(&f, "bias");
+    vecn_to_f16(m, 37, h);
+    r2_assert("tensor f16 view is wrong", t != NULL && t->dtype == R2_DTYPE_F16 && t->count == 37 &&
+                                              r2_tensor_f32(t) == NULL && memcmp(t->data, h, 37 * sizeof(f16)) == 0);
+
+    t = r2_tensor_find(&f, "grid");
+    vecn_to_bf16(m, 3 * 77, b);
+    r2_assert("tensor bf16 view is wrong", t != NULL && t->ndim == 3 && t->stride[0] == 77 && t->stride[1] == 77 &&
+                                               t->rows == 3 && memcmp(t->data, b, 3 * 77 * sizeof(bf16)) == 0);
+
+    t = r2_tensor_find(&f, "weights_i8");
+    mat_quantize_i8(m, 7, 33, q, scales);
+    r2_assert("tensor i8 view is wrong", t != NULL && t->dtype == R2_DTYPE_I8 && t->scales != NULL &&
+                                             memcmp(t->data, q, sizeof(q)) == 0 &&
+                                             memcmp(t->scales, scales, sizeof(scales)) == 0);
+
+    // views feed the kernels directly
+    t = r2_tensor_find(&f, "weights");
+    mat_transpose(r2_tensor_f32(t), 7, 33, got);
+    r2_assert("tensor view transpose is wrong", got[33 * 7 - 1] == m[7 * 33 - 1] && got[1] == m[33]);
+    r2_tensor_close(&f);
+    r2_assert("tensor close did not reset", f.tensors == NULL && f.base == NULL);
+
+    // a cut short file is rejected
+    fp = fopen(path, "wb");
+    r2_assert("tensor test could not write", fp != NULL);
+    fwrite("R2TENSOR", 1, 8, fp);
+    fclose(fp);
+    r2_assert("tensor open accepted a bad file", !r2_tensor_open(path, &f));
+    return 0;
+}
+
+static const char *tensor_test_malformed(const char *path)
+{
+    float m[4 * 16] = {0};
+    size_t shape[2] = {4, 16};
+    unsigned char file[1024];
+    size_t size, entry, at;
+    r2_tensor_writer w;
+    r2_tensor_header hdr;
+    r2_tensor_entry e;
+    uint64_t u64;
+    uint32_t u32;
+    FILE *fp;
+
+    r2_assert("tensor write failed", r2_tensor_write_begin(&w, path) &&
+                                         r2_tensor_write(&w, "w", R2_DTYPE_F32, 2, shape, m) &&
+                                         r2_tensor_write(&w, "q", R2_DTYPE_I8, 2, shape, m) &&
+                                         r2_tensor_write_end(&w));
+    fp = fopen(path, "rb");
+    r2_assert("tensor test could not read", fp != NULL);
+    size = fread(file, 1, sizeof(file), fp);
+    fclose(fp);
+    memcpy(&hdr, file, sizeof(hdr));
+    r2_assert("tensor test file is not as expected", size < sizeof(file) && hdr.count == 2 &&
+                                                         hdr.table + 2 * sizeof(r2_tensor_entry) == size);
+    // the unpatched copy opens, so each case below fails for its own reason
+    r2_assert("tensor open rejected a good file", tensor_test_open_patched(path, file, size, 0, file, 0));
+
+    r2_assert("tensor open accepted a bad magic", !tensor_test_open_patched(path, file, size, 0, "R2TENSOX", 8));
+    u32 = 2;
+    r2_assert("tensor open accepted a bad version",
+              !tensor_test_open_patched(path, file, size, offsetof(r2_tensor_header, version), &u32, 4));
+    u32 = 3;
+    r2_assert("tensor open accepted a table past the end",
+              !tensor_test_open_patched(path, file, size, offsetof(r2_tensor_header, count), &u32, 4));
+
+    // the first entry, "w", is 4 x 16 floats at offset 64
+    entry = (size_t)hdr.table;
+    memcpy(&e, file + entry, sizeof(e));
+    r2_assert("tensor test entry is not as expected", e.offset == sizeof(r2_tensor_header) && e.bytes == sizeof(m));
+    at = entry + offsetof(r2_tensor_entry, offset);
+    u64 = (size + R2_TENSOR_ALIGN) / R2_TENSOR_ALIGN * R2_TENSOR_ALIGN;
+    r2_assert("tensor open accepted an offset past the end",
+              !tensor_test_open_patched(path, file, size, at, &u64, 8));
+    u64 = e.offset + 4;
+    r2_assert("tensor open accepted a misaligned offset", !tensor_test_open_patched(path, file, size, at, &u64, 8));
+    u64 = 0;
+    r2_assert("tensor open accepted a payload over the header",
+              !tensor_test_open_patched(path, file, size, at, &u64, 8));
+    u64 = hdr.table / R2_TENSOR_ALIGN * R2_TENSOR_ALIGN;
+    r2_assert("tensor open accepted a payload over the table",
+              !tensor_test_open_patched(path, file, size, at, &u64, 8));
+
+    // a size past the end, with the shape to match
+    e.shape[0] = 64;
+    e.bytes = 64 * 16 * sizeof(float);
+    r2_assert("tensor open accepted a size past the end",
+              !tensor_test_open_patched(path, file, size, entry, &e, sizeof(e)));
+    u64 = sizeof(m) + 4;
+    r2_assert("tensor open accepted a size that does not match the shape",
+              !tensor_test_open_patched(path, file, size, entry + offsetof(r2_tensor_entry, bytes), &u64, 8));
+
+    // and the I8 entry's scales
+    entry += sizeof(r2_tensor_entry);
+    memcpy(&e, file + entry, sizeof(e));
+    at = entry + offsetof(r2_tensor_entry, scales);
+    u64 = hdr.table;
+    r2_assert("tensor open accepted scales over the table", !tensor_test_open_patched(path, file, size, at, &u64, 8));
+    u64 = e.scales + 2;
+    r2_assert("tensor open accepted misaligned scales", !tensor_test_open_patched(path, file, size, at, &u64, 8));
+    return 0;
+}
+
+static const char *test_tensor_file(void)
+{
+    // in the temp directory, and removed whether or not the cases pass
+    const char *dir = getenv("TMPDIR");
+    char path[512];
+    const char *msg;
+
+#ifdef _WIN32
+    if (dir == NULL)
+        dir = getenv("TEMP");
+#endif
+    snprintf(path, sizeof(path), "%s/r2_tensor_test.r2t", dir != NULL ? dir : "/tmp");
+    msg = tensor_test_cases(path);
+    if (msg == NULL)
+        msg = tensor_test_malformed(path);
+    remove(path);
+    return msg;
+}
+
+static const char *test_simd_levels(void)
+{
+    // every level this CPU has must agree with the plain C maths
+    float a[37], b[37], out[37];
+    float m1[5 * 19], m2[19 * 37], mo[5 * 37];
+    int i, j, k;
+
+    for (i = 0; i < 37; i++)
+    {
+        a[i] = (float)(i % 7) - 3.f;
+        b[i] = (float)(i % 5) * .5f;
+    }
+    for (i = 0; i < 5 * 19; i++)
+        m1[i] = (float)(i % 9) - 4.f;
+    for (i = 0; i < 19 * 37; i++)
+        m2[i] = (float)(i % 11) * .25f;
+
+    float dot = 0.f, dist = 0.f;
+    for (i = 0; i < 37; i++)
+    {
+        dot += a[i] * b[i];
+        dist += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+
+    r2_simd_level best = r2_simd_get();
+    int level;
+    for (level = R2_SIMD_SCALAR; level <= (int)best; level++)
+    {
+        r2_assert("simd set level is wrong", r2_simd_set((r2_simd_level)level) == (r2_simd_level)level);
+
+        r2_assert("simd dot is wrong", r2_equals(vecn_dot(a, b, 37), dot));
+        r2_assert("simd dist sqrd is wrong", r2_equals(vecn_dist_sqrd(a, b, 37), dist));
+        float lo, hi;
+        vecn_minmax(b, 37, &lo, &hi);
+        r2_assert("simd sum is wrong", r2_equals(vecn_sum(a, 37), -5.f));
+        r2_assert("simd minmax is wrong", lo == 0.f && hi == 2.f && vecn_argmax(a, 37) == 6);
+
+        vecn_add(a, b, 37, out);
+        r2_assert("simd add is wrong", r2_equals(out[36], a[36] + b[36]) && r2_equals(out[17], a[17] + b[17]));
+        vecn_sub(a, b, 37, out);
+        r2_assert("simd sub is wrong", r2_equals(out[36], a[36] - b[36]) && r2_equals(out[17], a[17] - b[17]));
+        vecn_mul_vec(a, b, 37, out);
+        r2_assert("simd mul vec is wrong", r2_equals(out[36], a[36] * b[36]) && r2_equals(out[17], a[17] * b[17]));
+        vecn_mul(a, 3.f, 37, out);
+        r2_assert("simd mul is wrong", r2_equals(out[36], a[36] * 3.f) && r2_equals(out[17], a[17] * 3.f));
+        vecn_axpby(2.f, a, .5f, b, 37, out);
+        r2_assert("simd axpby is wrong",
+                  r2_equals(out[36], 2.f * a[36] + .5f * b[36]) && r2_equals(out[17], 2.f * a[17] + .5f * b[17]));
+        vecn_fma(a, b, a, 37, out);
+        r2_assert("simd fma is wrong",
+                  r2_equals(out[36], a[36] * b[36] + a[36]) && r2_equals(out[17], a[17] * b[17] + a[17]));
+        vecn_scale_add(a, 3.f, -1.f, 37, out);
+        r2_assert("simd scale add is wrong",
+                  r2_equals(out[36], a[36] * 3.f - 1.f) && r2_equals(out[17], a[17] * 3.f - 1.f));
+
+        f16 ha[37], hb[37];
+        vecn_to_f16(a, 37, ha);
+        vecn_to_f16(b, 37, hb);
+        r2_assert("simd f16 is wrong", ha[36] == float_to_f16(a[36]) && hb[17] == float_to_f16(b[17]));
+        r2_assert("simd dot f16 is wrong", r2_equals(vecn_dot_f16(ha, hb, 37), dot));
+        r2_assert("simd dist sqrd f16 is wrong", r2_equals(vecn_dist_sqrd_f16(ha, hb, 37), dist));
+        int8_t qa[37], qb[37];
+        int32_t qdot = 0;
+        vecn_quantize_i8(a, 37, qa);
+        vecn_quantize_i8(b, 37, qb);
+        for (i = 0; i < 37; i++)
+            qdot += qa[i] * qb[i];
+        r2_assert("simd dot i8 is wrong", vecn_dot_i8(qa, qb, 37) == qdot);
+
+        // the transcendentals at the precise tier, against libm
+        float tsin[37], tcos[37];
+        double terr = 0.0;
+        vecn_exp(a, 37, out);
+        for (i = 0; i < 37; i++) terr = fmax(terr, fabs(out[i] - exp(a[i])) / exp(a[i]));
+        vecn_log(b, 37, out);
+        for (i = 0; i < 37; i++) terr = fmax(terr, b[i] > 0.f ? fabs(out[i] - log(b[i])) : out[i] == -INFINITY ? 0 : 1);
+        vecn_tanh(a, 37, out);
+        for (i = 0; i < 37; i++) terr = fmax(terr, fabs(out[i] - tanh(a[i])));
+        vecn_sincos(a, 37, tsin, tcos);
+        for (i = 0; i < 37; i++) terr = fmax(terr, fmax(fabs(tsin[i] - sin(a[i])), fabs(tcos[i] - cos(a[i]))));
+        vecn_sin(a, 37, out);
+        r2_assert("simd sin should match sincos", memcmp(out, tsin, sizeof(tsin)) == 0);
+        vecn_cos(a, 37, out);
+        r2_assert("simd cos should match sincos", memcmp(out, tcos, sizeof(tcos)) == 0);
+        vecn_pow(b, 1.5f, 37, out);
+        for (i = 0; i < 37; i++) terr = fmax(terr, fabs(out[i] - pow(b[i], 1.5)) / fmax(pow(b[i], 1.5), 1.0));
+        r2_assert("simd transcendentals are wrong", terr < 3e-7);
+
+        mat_mul(m1, m2, 5, 19, 19, 37, mo);
+        for (i = 0; i < 5; i++)
+        {
+            for (j = 0; j < 37; j++)
+            {
+                float sum = 0.f;
+                for (k = 0; k < 19; k++)
+                    sum += m1[i * 19 + k] * m2[k * 37 + j];
+                r2_assert("simd mat mul is wrong", fabsf(mo[i * 37 + j] - sum) < 0.0001f);
+            }
+        }
+    }
+    r2_simd_set(best);
+    return 0;
+}
+
+static const char *test_mat_mul_blocked(void)
+{
+    // big enough for the packed (and OpenMP) path, with kc and every tile
+    // edge split, then a product with fewer output columns than a SIMD tile
+    const unsigned int shapes[2][3] = {{130, 300, 67}, {200, 300, 5}};
+    r2_simd_level best = r2_simd_get();
+    unsigned int s, i, j, k;
+    int level, ok = 1;
+
+    for (s = 0; s < 2; s++)
+    {
+        const unsigned int r = shapes[s][0], n = shapes[s][1], c = shapes[s][2];
+        float *m1 = malloc(sizeof(float) * r * n);
+        float *m2 = malloc(sizeof(float) * n * c);
+        float *out = malloc(sizeof(float) * r * c);
+        float *expect = malloc(sizeof(float) * r * c);
+
+        for (i = 0; i < r * n; i++)
+            m1[i] = (float)((i * 7) % 13) - 6.f;
+        for (i = 0; i < n * c; i++)
+            m2[i] = (float)((i * 5) % 11) * .125f;
+        for (i = 0; i < r; i++)
+        {
+            for (j = 0; j < c; j++)
+            {
+                float sum = 0.f;
+                for (k = 0; k < n; k++)
+                    sum += m1[i * n + k] * m2[k * c + j];
+                expect[i * c + j] = sum;
+            }
+        }
+
+        for (level = R2_SIMD_SCALAR; level <= (int)best; level++)
+        {
+            r2_simd_set((r2_simd_level)level);
+            mat_mul(m1, m2, r, n, n, c, out);
+            for (i = 0; i < r * c; i++)
+                ok &= fabsf(out[i] - expect[i]) < 0.001f;
+        }
+        r2_simd_set(best);
+
+        free(m1);
+        free(m2);
+        free(out);
+        free(expect);
+    }
+    r2_assert("mat_mul blocked is wrong", ok);
+    return 0;
+}
+
 static const char *r2_maths_test(void)
 {
     // v2
@@ -1072,6 +3146,10 @@ static const char *r2_maths_test(void)
     r2_run_test(test_vec4_dist_sqrd);
     r2_run_test(test_vec4_dist);
 
+    // soa
+    r2_run_test(test_vec3_soa);
+    r2_run_test(test_vec_soa_convert);
+
     // quat
     r2_run_test(test_quat_rot2q);
     r2_run_test(test_quat_from_euler);
@@ -1082,19 +3160,31 @@ static const char *r2_maths_test(void)
     r2_run_test(test_quat_mul_vec3_x_90z);
     r2_run_test(test_quat_mul_vec3_y_90x);
     r2_run_test(test_quat_mul_vec3_y_180x);
+    r2_run_test(test_quat_rotate_batch);
+    r2_run_test(test_quat_slerp);
+    r2_run_test(test_quat_slerp_soa);
     r2_run_test(test_quat_mat4);
 
     // mat4
     r2_run_test(test_mat4_size);
     r2_run_test(test_mat4_transform);
+    r2_run_test(test_mat4_transform_batch);
+    r2_run_test(test_mat4_transform_soa);
     r2_run_test(test_mat4_lookat);
     r2_run_test(test_mat4_identity);
     r2_run_test(test_mat4_mul);
     r2_run_test(test_mat4_mul2);
     r2_run_test(test_mat4_mul_identity);
     r2_run_test(test_mat4_mul_not_commutative);
+    r2_run_test(test_mat4_mul_matches_mat_mul);
     r2_run_test(test_mat4_transpose);
     r2_run_test(test_mat4_transpose_twice);
+    r2_run_test(test_mat4_inverse);
+    r2_run_test(test_mat4_inverse_affine);
+    r2_run_test(test_mat4_inverse_batch);
+    r2_run_test(test_mat4_skin);
+    r2_run_test(test_r2v4);
+    r2_run_test(test_aligned_batch);
     r2_run_test(test_mat4_mul_speed);
 
     // mat3
@@ -1103,9 +3193,29 @@ static const char *r2_maths_test(void)
     r2_run_test(test_mat3_mul_identity);
     r2_run_test(test_mat3_mul_not_commutative);
 
+    // frustum
+    r2_run_test(test_frustum_from_mat4);
+    r2_run_test(test_frustum_cull);
+
+    // bvh
+    r2_run_test(test_bvh_boxes);
+    r2_run_test(test_bvh_triangles);
+
+    // spatial hash
+    r2_run_test(test_spatial_hash);
+
     // generic mat
     r2_run_test(test_mat_mul);
     r2_run_test(test_mat_mul_non_square);
+    r2_run_test(test_mat_mul_blocked);
+    r2_run_test(test_mat_mul_f16);
+    r2_run_test(test_mat_mul_i8);
+    r2_run_test(test_mat_transpose);
+    r2_run_test(test_mat_transpose_in_place);
+    r2_run_test(test_mat_lu);
+    r2_run_test(test_mat_solve);
+    r2_run_test(test_mat_inverse);
+    r2_run_test(test_mat_det);
 
     // vecn
     r2_run_test(test_vecn_add);
@@ -1123,11 +3233,21 @@ static const char *r2_maths_test(void)
     r2_run_test(test_vecn_abs);
     r2_run_test(test_vecn_pow);
     r2_run_test(test_vecn_sqrt);
+    r2_run_test(test_vecn_transcendentals);
     r2_run_test(test_vecn_arbitrary_n);
     r2_run_test(test_vecn_dot_large);
     r2_run_test(test_vecn_length_large);
     r2_run_test(test_vecn_mul_large);
     r2_run_test(test_vecn_div_large);
+    r2_run_test(test_vecn_fused);
+    r2_run_test(test_vecn_reductions);
+    r2_run_test(test_vecn_f16);
+    r2_run_test(test_vecn_i8);
+    r2_run_test(test_vecn_knn);
+    r2_run_test(test_tensor_file);
+
+    // dispatch
+    r2_run_test(test_simd_levels);
 
     return 0;
 }